@@ -463,9 +463,11 @@ static int numWdl, numDtm, numDtz;
 
 static struct PieceEntry *pieceEntry;
 static struct PawnEntry *pawnEntry;
+static bool eagerMapping = false;
 static struct TbHashEntry tbHash[1 << TB_HASHBITS];
 
 static void init_indices(void);
+static bool init_table(struct BaseEntry *be, const char *str, int type);
 
 // Forward declarations. These functions without the tb_
 // prefix take a pos structure as input.
@@ -762,6 +764,15 @@ static void init_tb(char *str)
   add_to_hash(be, key);
   if (key != key2)
     add_to_hash(be, key2);
+
+  // Map the tables up front so that probes never have to take the lock.
+  // Tables that fail to map are retried on the first probe.
+  if (eagerMapping) {
+    if (init_table(be, str, WDL))
+      atomic_store_explicit(&be->ready[WDL], true, memory_order_relaxed);
+    if (be->hasDtz && init_table(be, str, DTZ))
+      atomic_store_explicit(&be->ready[DTZ], true, memory_order_relaxed);
+  }
 }
 
 #define PIECE(x) ((struct PieceEntry *)(x))
@@ -972,6 +983,11 @@ finished:
   return true;
 }
 
+void tb_set_eager_mapping(bool enabled)
+{
+  eagerMapping = enabled;
+}
+
 void tb_free(void)
 {
   tb_init("");
@@ -979,6 +995,69 @@ void tb_free(void)
   free(pawnEntry);
 }
 
+bool tb_prefetch_wdl(const char *name)
+{
+  int pcs[16];
+  for (int i = 0; i < 16; i++)
+    pcs[i] = 0;
+  int color = 0;
+  for (const char *s = name; *s; s++)
+    if (*s == 'v')
+      color = 8;
+    else {
+      int piece_type = char_to_piece_type(*s);
+      if (piece_type)
+        pcs[piece_type | color]++;
+    }
+
+  // KvK has no table
+  uint64_t key = calc_key_from_pcs(pcs, false);
+  if (key == 0ULL)
+    return false;
+
+  int hashIdx = key >> (64 - TB_HASHBITS);
+  while (tbHash[hashIdx].key && tbHash[hashIdx].key != key)
+    hashIdx = (hashIdx + 1) & ((1 << TB_HASHBITS) - 1);
+  if (!tbHash[hashIdx].ptr)
+    return false;
+
+  // Map the table the same way as probe_table() does
+  struct BaseEntry *be = tbHash[hashIdx].ptr;
+  if (!atomic_load_explicit(&be->ready[WDL], memory_order_acquire)) {
+    LOCK(tbMutex);
+    if (!atomic_load_explicit(&be->ready[WDL], memory_order_relaxed)) {
+      // The file name has the sides in the order of the stored key
+      char str[16];
+      const char *v = strchr(name, 'v');
+      if (v == NULL || strlen(name) >= sizeof(str)) {
+        UNLOCK(tbMutex);
+        return false;
+      }
+      if (be->key != key) {
+        strcpy(str, v + 1);
+        strcat(str, "v");
+        strncat(str, name, v - name);
+      } else {
+        strcpy(str, name);
+      }
+      if (!init_table(be, str, WDL)) {
+        tbHash[hashIdx].ptr = NULL; // mark as deleted
+        UNLOCK(tbMutex);
+        return false;
+      }
+      atomic_store_explicit(&be->ready[WDL], true, memory_order_release);
+    }
+    UNLOCK(tbMutex);
+  }
+
+#ifndef _WIN32
+  // Ask the kernel to start reading the table into the page cache
+  madvise(be->data[WDL], be->mapping[WDL], MADV_WILLNEED);
+#endif
+
+  return true;
+}
+
 static const int8_t OffDiag[] = {
   0,-1,-1,-1,-1,-1,-1,-1,
   1, 0,-1,-1,-1,-1,-1,-1,
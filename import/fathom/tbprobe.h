@@ -180,6 +180,32 @@ bool tb_init(const char *_path);
  */
 void tb_free(void);
 
+/*
+ * Select if tb_init() should map all WDL and DTZ tables immediately instead
+ * of mapping each table the first time it is probed. With all tables mapped
+ * the probe functions never take a lock. Only affects later calls to
+ * tb_init().
+ *
+ * PARAMETERS:
+ * - enabled:
+ *   true=map all tables in tb_init(), false=map tables when first probed.
+ */
+void tb_set_eager_mapping(bool enabled);
+
+/*
+ * Map the Win-Draw-Loss (WDL) table for a material configuration and ask
+ * the operating system to read it into memory ahead of the first probe.
+ *
+ * PARAMETERS:
+ * - name:
+ *   The material configuration in the same format as the table file
+ *   names, e.g. "KRPvKR". Either side may be given first.
+ *
+ * RETURN:
+ * - true if the table exists, false otherwise.
+ */
+bool tb_prefetch_wdl(const char *name);
+
 /*
  * Probe the Win-Draw-Loss (WDL) table.
  *
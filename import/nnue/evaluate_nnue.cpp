@@ -18,40 +18,29 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <set>
+#include <type_traits>
+
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "nnue.h"
 
 #include "evaluate_nnue.h"
 
-ExtPieceSquare kpp_board_index[PIECE_NB] = {
- // convention: W - us, B - them
- // viewed from other side, W and B are reversed
-    { PS_NONE,     PS_NONE     },
-    { PS_W_PAWN,   PS_B_PAWN   },
-    { PS_W_KNIGHT, PS_B_KNIGHT },
-    { PS_W_BISHOP, PS_B_BISHOP },
-    { PS_W_ROOK,   PS_B_ROOK   },
-    { PS_W_QUEEN,  PS_B_QUEEN  },
-    { PS_W_KING,   PS_B_KING   },
-    { PS_NONE,     PS_NONE     },
-    { PS_NONE,     PS_NONE     },
-    { PS_B_PAWN,   PS_W_PAWN   },
-    { PS_B_KNIGHT, PS_W_KNIGHT },
-    { PS_B_BISHOP, PS_W_BISHOP },
-    { PS_B_ROOK,   PS_W_ROOK   },
-    { PS_B_QUEEN,  PS_W_QUEEN  },
-    { PS_B_KING,   PS_W_KING   },
-    { PS_NONE,     PS_NONE     }
-};
-
-
 namespace Eval::NNUE {
 
-  // Input feature converter
+  // Input feature converter. Only one of them is used at a time,
+  // depending on the format of the evaluation file.
   AlignedPtr<FeatureTransformer> feature_transformer;
+  AlignedPtr<CompactFeatureTransformer> compact_feature_transformer;
 
   // Evaluation function
   AlignedPtr<Network> network;
@@ -59,16 +48,72 @@ namespace Eval::NNUE {
   // Evaluation function file name
   std::string fileName;
 
+  // Header of an evaluation file laid out for memory mapping. The file
+  // holds images of the parameter objects at page aligned offsets so
+  // that they can be used directly from the page cache.
+  struct MappedHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t hash_value;
+    std::uint64_t transformer_offset;
+    std::uint64_t transformer_size;
+    std::uint64_t network_offset;
+    std::uint64_t network_size;
+  };
+
+  constexpr char kMappedMagic[8] = {'M', 'A', 'R', 'V', 'N', 'N', 'U', 'E'};
+  constexpr std::uint32_t kMappedVersion = 1;
+  constexpr std::uint64_t kMappedAlignment = 4096;
+
+  static_assert(std::is_trivially_copyable<FeatureTransformer>::value &&
+                std::is_trivially_copyable<CompactFeatureTransformer>::value &&
+                std::is_trivially_copyable<Network>::value,
+                "Parameters must be trivially copyable to be mapped");
+
+  // Mapping of the current evaluation file, if any
+  void* mapping = nullptr;
+  std::size_t mappingSize = 0;
+
   namespace Detail {
 
   // Initialize the evaluation function parameters
   template <typename T>
   void Initialize(AlignedPtr<T>& pointer) {
 
-    pointer.reset(reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
+    pointer = AlignedPtr<T>(
+        reinterpret_cast<T*>(std_aligned_alloc(alignof(T), sizeof(T))));
     std::memset(pointer.get(), 0, sizeof(T));
   }
 
+  // Use evaluation function parameters from a mapped file
+  template <typename T>
+  void Map(AlignedPtr<T>& pointer, const char* base, std::uint64_t offset) {
+
+    pointer = AlignedPtr<T>(
+        reinterpret_cast<T*>(const_cast<char*>(base) + offset),
+        AlignedDeleter<T>{false});
+  }
+
+  // Stream buffer reading from memory
+  struct MemoryBuffer : public std::streambuf {
+    MemoryBuffer(const char* data, std::size_t size) {
+      char* p = const_cast<char*>(data);
+      setg(p, p, p + size);
+    }
+  };
+
+  // Write zeros up to the specified file offset
+  void Pad(std::ostream& stream, std::uint64_t offset) {
+
+    static const char zeros[kMappedAlignment] = {};
+    std::uint64_t pos = static_cast<std::uint64_t>(stream.tellp());
+    while (stream && pos < offset) {
+      const auto n = std::min(offset - pos, kMappedAlignment);
+      stream.write(zeros, n);
+      pos += n;
+    }
+  }
+
   // Read evaluation function parameters
   template <typename T>
   bool ReadParameters(std::istream& stream, const AlignedPtr<T>& pointer) {
@@ -81,10 +126,40 @@ namespace Eval::NNUE {
 
   }  // namespace Detail
 
+  // Call a function with the feature transformer in use
+  template <typename Function>
+  static auto WithFeatureTransformer(Function&& function) {
+
+    if (compact_feature_transformer) {
+      return function(*compact_feature_transformer);
+    }
+    return function(*feature_transformer);
+  }
+
+  // Release the evaluation function parameters
+  void Release() {
+
+    feature_transformer.reset();
+    compact_feature_transformer.reset();
+    network.reset();
+#ifndef WINDOWS
+    if (mapping != nullptr) {
+      munmap(mapping, mappingSize);
+      mapping = nullptr;
+      mappingSize = 0;
+    }
+#endif
+  }
+
   // Initialize the evaluation function parameters
-  void Initialize() {
+  void Initialize(bool compact) {
 
-    Detail::Initialize(feature_transformer);
+    Release();
+    if (compact) {
+      Detail::Initialize(compact_feature_transformer);
+    } else {
+      Detail::Initialize(feature_transformer);
+    }
     Detail::Initialize(network);
   }
 
@@ -108,16 +183,106 @@ namespace Eval::NNUE {
     std::uint32_t hash_value;
     std::string architecture;
     if (!ReadHeader(stream, &hash_value, &architecture)) return false;
-    if (hash_value != kHashValue) return false;
-    if (!Detail::ReadParameters(stream, feature_transformer)) return false;
+    if (hash_value == kHashValue) {
+      Initialize(false);
+      if (!Detail::ReadParameters(stream, feature_transformer)) return false;
+    } else if (hash_value == kCompactHashValue) {
+      Initialize(true);
+      if (!Detail::ReadParameters(stream, compact_feature_transformer)) return false;
+    } else {
+      return false;
+    }
     if (!Detail::ReadParameters(stream, network)) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
+  // Check that a mapped file header matches the current architecture
+  static bool ValidateMappedHeader(const MappedHeader& header,
+                                   std::uint64_t file_size) {
+
+    const std::uint64_t transformer_size =
+        header.hash_value == kCompactHashValue ?
+        sizeof(CompactFeatureTransformer) : sizeof(FeatureTransformer);
+    return header.version == kMappedVersion &&
+           (header.hash_value == kHashValue ||
+            header.hash_value == kCompactHashValue) &&
+           header.transformer_size == transformer_size &&
+           header.network_size == sizeof(Network) &&
+           header.transformer_offset % kMappedAlignment == 0 &&
+           header.network_offset % kMappedAlignment == 0 &&
+           header.transformer_offset >= sizeof(MappedHeader) &&
+           header.network_offset >=
+               header.transformer_offset + header.transformer_size &&
+           header.network_offset + header.network_size <= file_size;
+  }
+
+  // Use the parameters laid out for memory mapping at the specified address
+  static void UseMappedParameters(const char* base,
+                                  const MappedHeader& header) {
+
+    if (header.hash_value == kCompactHashValue) {
+      Detail::Map(compact_feature_transformer, base, header.transformer_offset);
+    } else {
+      Detail::Map(feature_transformer, base, header.transformer_offset);
+    }
+    Detail::Map(network, base, header.network_offset);
+  }
+
+  // Use the parameters of a file laid out for memory mapping. The file
+  // is mapped read-only and shared so that all processes using the same
+  // file share a single copy of the parameters.
+  static bool MapParameters(const std::string& evalFile,
+                            const MappedHeader& header) {
+
+#ifdef WINDOWS
+    // Without mmap the parameter images are read into allocated memory
+    std::ifstream stream(evalFile, std::ios::binary);
+    stream.seekg(0, std::ios::end);
+    if (!stream ||
+        !ValidateMappedHeader(header, static_cast<std::uint64_t>(stream.tellg()))) {
+      return false;
+    }
+    const bool compact = header.hash_value == kCompactHashValue;
+    Initialize(compact);
+    stream.seekg(header.transformer_offset);
+    stream.read(compact ?
+                reinterpret_cast<char*>(compact_feature_transformer.get()) :
+                reinterpret_cast<char*>(feature_transformer.get()),
+                header.transformer_size);
+    stream.seekg(header.network_offset);
+    stream.read(reinterpret_cast<char*>(network.get()), header.network_size);
+    return !stream.fail();
+#else
+    struct stat sb;
+    const int fd = open(evalFile.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    if (fstat(fd, &sb) != 0 ||
+        !ValidateMappedHeader(header, static_cast<std::uint64_t>(sb.st_size))) {
+      close(fd);
+      return false;
+    }
+    void* base = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return false;
+    }
+
+    Release();
+    mapping = base;
+    mappingSize = sb.st_size;
+    UseMappedParameters(static_cast<char*>(mapping), header);
+    return true;
+#endif
+  }
+
   // Proceed with the difference calculation if possible
   static void UpdateAccumulatorIfPossible(const Position& pos) {
 
-    feature_transformer->UpdateAccumulatorIfPossible(pos);
+    WithFeatureTransformer([&](const auto& transformer) {
+      transformer.UpdateAccumulatorIfPossible(pos);
+    });
   }
 
   // Calculate the evaluation value
@@ -130,7 +295,9 @@ namespace Eval::NNUE {
 
     alignas(kCacheLineSize) TransformedFeatureType
         transformed_features[FeatureTransformer::kBufferSize];
-    feature_transformer->Transform(pos, transformed_features, refresh);
+    WithFeatureTransformer([&](const auto& transformer) {
+      transformer.Transform(pos, transformed_features, refresh);
+    });
     alignas(kCacheLineSize) char buffer[Network::kBufferSize];
     const auto output = network->Propagate(transformed_features, buffer);
 
@@ -144,16 +311,119 @@ namespace Eval::NNUE {
   // Load the evaluation function file
   bool load_eval_file(const std::string& evalFile) {
 
-    Initialize();
     fileName = evalFile;
 
     std::ifstream stream(evalFile, std::ios::binary);
 
+    MappedHeader header;
+    stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (stream &&
+        std::memcmp(header.magic, kMappedMagic, sizeof(kMappedMagic)) == 0) {
+      if (MapParameters(evalFile, header)) {
+        return true;
+      }
+      Release();
+      return false;
+    }
+    stream.clear();
+    stream.seekg(0);
+
     const bool result = ReadParameters(stream);
 
     return result;
   }
 
+  // Load the evaluation function from memory, e.g. a network embedded
+  // in the executable. Networks laid out for memory mapping are used in
+  // place, so the memory must remain valid for as long as the network
+  // is used and be aligned to kMappedAlignment.
+  bool load_eval_data(const char* data, std::size_t size) {
+
+    fileName = NNUE_EMBEDDED_EVAL_FILE;
+
+    MappedHeader header;
+    if (size >= sizeof(header)) {
+      std::memcpy(&header, data, sizeof(header));
+      if (std::memcmp(header.magic, kMappedMagic, sizeof(kMappedMagic)) == 0) {
+        if (reinterpret_cast<std::uintptr_t>(data) % kMappedAlignment != 0 ||
+            !ValidateMappedHeader(header, size)) {
+          Release();
+          return false;
+        }
+        Release();
+        UseMappedParameters(data, header);
+        return true;
+      }
+    }
+
+    Detail::MemoryBuffer buffer(data, size);
+    std::istream stream(&buffer);
+
+    return ReadParameters(stream);
+  }
+
+  // Save the current evaluation function in a format suitable for
+  // memory mapping. The file can only be used by builds with the same
+  // parameter layout. If compact is set the transformer weights are
+  // quantized to int8 and the number of saturated weights is returned
+  // in saturated.
+  bool save_eval_file(const std::string& evalFile, bool compact,
+                      std::size_t* saturated) {
+
+    *saturated = 0;
+    if ((!feature_transformer && !compact_feature_transformer) || !network) {
+      return false;
+    }
+
+    AlignedPtr<CompactFeatureTransformer> quantized;
+    if (compact && !compact_feature_transformer) {
+      Detail::Initialize(quantized);
+      *saturated = quantized->Quantize(*feature_transformer);
+    }
+    const CompactFeatureTransformer* compact_transformer =
+        quantized ? quantized.get() : compact_feature_transformer.get();
+    const char* transformer = compact_transformer ?
+        reinterpret_cast<const char*>(compact_transformer) :
+        reinterpret_cast<const char*>(feature_transformer.get());
+
+    MappedHeader header = {};
+    std::memcpy(header.magic, kMappedMagic, sizeof(header.magic));
+    header.version = kMappedVersion;
+    header.hash_value = compact_transformer ? kCompactHashValue : kHashValue;
+    header.transformer_offset = kMappedAlignment;
+    header.transformer_size = compact_transformer ?
+        sizeof(CompactFeatureTransformer) : sizeof(FeatureTransformer);
+    header.network_offset =
+        (header.transformer_offset + header.transformer_size +
+         kMappedAlignment - 1) / kMappedAlignment * kMappedAlignment;
+    header.network_size = sizeof(Network);
+
+    std::ofstream stream(evalFile, std::ios::binary);
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    Detail::Pad(stream, header.transformer_offset);
+    stream.write(transformer, header.transformer_size);
+    Detail::Pad(stream, header.network_offset);
+    stream.write(reinterpret_cast<const char*>(network.get()),
+                 header.network_size);
+    stream.close();
+
+    return !stream.fail();
+  }
+
+  // Memory used by the evaluation function parameters. Parameters that
+  // are used in place from a mapping, or from the executable, are
+  // reported in mapped instead since they can be shared.
+  std::size_t memory_usage(std::size_t* mapped) {
+
+    std::size_t size = 0;
+    if (feature_transformer) size += sizeof(FeatureTransformer);
+    if (compact_feature_transformer) size += sizeof(CompactFeatureTransformer);
+    if (network) size += sizeof(Network);
+    const bool shared = network && !network.get_deleter().owned;
+    *mapped = shared ? size : 0;
+    return shared ? 0 : size;
+  }
+
   // Evaluation function. Perform differential calculation.
   Value evaluate(const Position& pos) {
     Value v = ComputeScore(pos, false);
@@ -162,6 +432,40 @@ namespace Eval::NNUE {
     return v;
   }
 
+  // Evaluate a batch of positions. The accumulators of all positions are
+  // computed first, then the network layers are applied to all positions
+  // one layer at a time.
+  void evaluate_batch(const Position* const* positions, int n, int* scores) {
+
+    constexpr int kBatchSize = 64;
+    constexpr std::size_t kFeatureStride = FeatureTransformer::kBufferSize;
+
+    alignas(kCacheLineSize) TransformedFeatureType
+        transformed_features[kBatchSize * kFeatureStride];
+    alignas(kCacheLineSize) char buffer[kBatchSize * Network::kBufferSize];
+
+    for (int first = 0; first < n; first += kBatchSize) {
+      const int count = std::min(n - first, kBatchSize);
+      WithFeatureTransformer([&](const auto& transformer) {
+        for (int b = 0; b < count; ++b) {
+          transformer.Transform(*positions[first + b],
+              &transformed_features[b * kFeatureStride], false);
+        }
+      });
+      const auto output = network->PropagateBatch(
+          transformed_features, kFeatureStride, count, buffer);
+      const std::size_t output_stride = Network::GetBatchStride(kFeatureStride);
+      for (int b = 0; b < count; ++b) {
+        auto& accumulator = positions[first + b]->state()->accumulator;
+        accumulator.score =
+            static_cast<Value>(output[b * output_stride] / FV_SCALE);
+        accumulator.computed_score = true;
+        scores[first + b] = Utility::clamp((int)accumulator.score,
+            VALUE_TB_LOSS_IN_MAX_PLY + 1, VALUE_TB_WIN_IN_MAX_PLY - 1);
+      }
+    }
+  }
+
   // Evaluation function. Perform full calculation.
   Value compute_eval(const Position& pos) {
     return ComputeScore(pos, true);
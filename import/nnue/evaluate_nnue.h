@@ -31,10 +31,17 @@ namespace Eval::NNUE {
   constexpr std::uint32_t kHashValue =
       FeatureTransformer::GetHashValue() ^ Network::GetHashValue();
 
-  // Deleter for automating release of memory area
+  // Hash value of evaluation function structure with int8 transformer weights
+  constexpr std::uint32_t kCompactHashValue =
+      CompactFeatureTransformer::GetHashValue() ^ Network::GetHashValue();
+
+  // Deleter for automating release of memory area. Parameters mapped
+  // from a file belong to the mapping and are not released.
   template <typename T>
   struct AlignedDeleter {
+    bool owned = true;
     void operator()(T* ptr) const {
+      if (!owned) return;
       ptr->~T();
       std_aligned_free(ptr);
     }
@@ -67,26 +67,44 @@ namespace Eval::NNUE::Features {
       if (dp.dirty_num == 0) return;
 
       for (Color perspective : { WHITE, BLACK }) {
-        reset[perspective] = false;
-        switch (trigger) {
-          case TriggerEvent::kFriendKingMoved:
-            reset[perspective] =
-                dp.pieceId[0] == PIECE_ID_KING + perspective;
-            break;
-          default:
-            assert(false);
-            break;
-        }
+        reset[perspective] = RequiresRefresh(dp, trigger, perspective);
         if (reset[perspective]) {
           Derived::CollectActiveIndices(
               pos, trigger, perspective, &added[perspective]);
         } else {
           Derived::CollectChangedIndices(
-              pos, trigger, perspective,
+              pos, dp, trigger, perspective,
               &removed[perspective], &added[perspective]);
         }
       }
     }
+
+    // Get a list of indices for the features changed by an earlier move,
+    // seen from one perspective. The move may not require a refresh for
+    // the perspective, nor may any move played after it.
+    template <typename PositionType, typename IndexListType>
+    static void AppendChangedIndices(
+        const PositionType& pos, const DirtyPiece& dp, TriggerEvent trigger,
+        Color perspective, IndexListType* removed, IndexListType* added) {
+
+      assert(!RequiresRefresh(dp, trigger, perspective));
+      Derived::CollectChangedIndices(
+          pos, dp, trigger, perspective, removed, added);
+    }
+
+    // Check if a move invalidates all features of a perspective
+    static bool RequiresRefresh(
+        const DirtyPiece& dp, TriggerEvent trigger, Color perspective) {
+
+      if (dp.dirty_num == 0) return false;
+      switch (trigger) {
+        case TriggerEvent::kFriendKingMoved:
+          return dp.pieceId[0] == PIECE_ID_KING + perspective;
+        default:
+          assert(false);
+          return false;
+      }
+    }
   };
 
   // Class template that represents the feature set
@@ -118,11 +136,12 @@ namespace Eval::NNUE::Features {
 
     // Get a list of indices for recently changed features
     static void CollectChangedIndices(
-        const Position& pos, const TriggerEvent trigger, const Color perspective,
-        IndexList* const removed, IndexList* const added) {
+        const Position& pos, const DirtyPiece& dp, const TriggerEvent trigger,
+        const Color perspective, IndexList* const removed,
+        IndexList* const added) {
 
       if (FeatureType::kRefreshTrigger == trigger) {
-        FeatureType::AppendChangedIndices(pos, perspective, removed, added);
+        FeatureType::AppendChangedIndices(pos, dp, perspective, removed, added);
       }
     }
 
@@ -65,13 +65,12 @@ namespace Eval::NNUE::Features {
   // Get a list of indices for recently changed features
   template <Side AssociatedKing>
   void HalfKP<AssociatedKing>::AppendChangedIndices(
-      const Position& pos, Color perspective,
+      const Position& pos, const DirtyPiece& dp, Color perspective,
       IndexList* removed, IndexList* added) {
 
     PieceSquare* pieces;
     Square sq_target_k;
     GetPieces(pos, perspective, &pieces, &sq_target_k);
-    const auto& dp = pos.state()->dirtyPiece;
     for (int i = 0; i < dp.dirty_num; ++i) {
       if (dp.pieceId[i] >= PIECE_ID_KING) continue;
       const auto old_p = static_cast<PieceSquare>(
@@ -50,8 +50,9 @@ namespace Eval::NNUE::Features {
                                     IndexList* active);
 
     // Get a list of indices for recently changed features
-    static void AppendChangedIndices(const Position& pos, Color perspective,
-                                     IndexList* removed, IndexList* added);
+    static void AppendChangedIndices(const Position& pos, const DirtyPiece& dp,
+                                     Color perspective, IndexList* removed,
+                                     IndexList* added);
 
     // Index of a feature for a given king position and another piece on some square
     static IndexType MakeIndex(Square sq_k, PieceSquare p);
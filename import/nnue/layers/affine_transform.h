@@ -76,10 +76,41 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Compute(input, output);
+      return output;
+    }
+
+    // Forward propagation of a batch of samples, one layer at a time for
+    // all samples so that the weights of the layer stay in cache. The
+    // transformed features of the samples are feature_stride bytes apart.
+    const OutputType* PropagateBatch(
+        const TransformedFeatureType* transformed_features,
+        std::size_t feature_stride, IndexType n, char* buffer) const {
+      const auto input = previous_layer_.PropagateBatch(
+          transformed_features, feature_stride, n, buffer + n * kSelfBufferSize);
+      const std::size_t input_stride =
+          PreviousLayer::GetBatchStride(feature_stride);
+      for (IndexType b = 0; b < n; ++b) {
+        Compute(input + b * input_stride,
+                reinterpret_cast<OutputType*>(buffer + b * kSelfBufferSize));
+      }
+      return reinterpret_cast<OutputType*>(buffer);
+    }
+
+    // Distance between the outputs of two samples in a batch
+    static constexpr std::size_t GetBatchStride(std::size_t /*feature_stride*/) {
+      return kSelfBufferSize / sizeof(OutputType);
+    }
+
+   private:
+    // Calculate the output for one sample
+    void Compute(const InputType* input, OutputType* output) const {
 
   #if defined(USE_AVX512)
       constexpr IndexType kNumChunks = kPaddedInputDimensions / (kSimdWidth * 2);
+    #if !defined(USE_VNNI)
       const __m512i kOnes = _mm512_set1_epi16(1);
+    #endif
       const auto input_vector = reinterpret_cast<const __m512i*>(input);
 
   #elif defined(USE_AVX2)
@@ -92,6 +123,10 @@ namespace Eval::NNUE::Layers {
       const __m128i kOnes = _mm_set1_epi16(1);
       const auto input_vector = reinterpret_cast<const __m128i*>(input);
 
+  #elif defined(USE_NEON_DOTPROD)
+      constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
+      const auto input_vector = reinterpret_cast<const int8x16_t*>(input);
+
   #elif defined(USE_NEON)
       constexpr IndexType kNumChunks = kPaddedInputDimensions / kSimdWidth;
       const auto input_vector = reinterpret_cast<const int8x8_t*>(input);
@@ -106,13 +141,20 @@ namespace Eval::NNUE::Layers {
         for (IndexType j = 0; j < kNumChunks; ++j) {
 
   #if defined(__MINGW32__) || defined(__MINGW64__)
-            __m512i product = _mm512_maddubs_epi16(_mm512_loadu_si512(&input_vector[j]), _mm512_load_si512(&row[j]));
+            const __m512i in = _mm512_loadu_si512(&input_vector[j]);
   #else
-            __m512i product = _mm512_maddubs_epi16(_mm512_load_si512(&input_vector[j]), _mm512_load_si512(&row[j]));
+            const __m512i in = _mm512_load_si512(&input_vector[j]);
   #endif
 
+  #if defined(USE_VNNI)
+            // vpdpbusd does the multiply, the pairwise add and the
+            // accumulation in one instruction without 16-bit saturation.
+            sum = _mm512_dpbusd_epi32(sum, in, _mm512_load_si512(&row[j]));
+  #else
+            __m512i product = _mm512_maddubs_epi16(in, _mm512_load_si512(&row[j]));
             product = _mm512_madd_epi16(product, kOnes);
             sum = _mm512_add_epi32(sum, product);
+  #endif
         }
         output[i] = _mm512_reduce_add_epi32(sum) + biases_[i];
 
@@ -126,12 +168,17 @@ namespace Eval::NNUE::Layers {
             int j = kNumChunks * 2;
 
   #if defined(__MINGW32__) || defined(__MINGW64__)  // See HACK comment below in AVX2.
-            __m256i sum256 = _mm256_maddubs_epi16(_mm256_loadu_si256(&iv_256[j]), _mm256_load_si256(&row_256[j]));
+            const __m256i in256 = _mm256_loadu_si256(&iv_256[j]);
   #else
-            __m256i sum256 = _mm256_maddubs_epi16(_mm256_load_si256(&iv_256[j]), _mm256_load_si256(&row_256[j]));
+            const __m256i in256 = _mm256_load_si256(&iv_256[j]);
   #endif
 
+  #if defined(USE_VNNI)
+            __m256i sum256 = _mm256_dpbusd_epi32(_mm256_setzero_si256(), in256, _mm256_load_si256(&row_256[j]));
+  #else
+            __m256i sum256 = _mm256_maddubs_epi16(in256, _mm256_load_si256(&row_256[j]));
             sum256 = _mm256_madd_epi16(sum256, _mm256_set1_epi16(1));
+  #endif
             sum256 = _mm256_hadd_epi32(sum256, sum256);
             sum256 = _mm256_hadd_epi32(sum256, sum256);
             const __m128i lo = _mm256_extracti128_si256(sum256, 0);
@@ -177,6 +224,17 @@ namespace Eval::NNUE::Layers {
         sum = _mm_hadd_epi32(sum, sum);
         output[i] = _mm_cvtsi128_si32(sum);
 
+  #elif defined(USE_NEON_DOTPROD)
+        // sdot multiplies groups of four bytes and adds them to 32-bit
+        // lanes in one instruction. The inputs are clipped to [0, 127] so
+        // they can be treated as signed.
+        int32x4_t sum = vdupq_n_s32(0);
+        const auto row = reinterpret_cast<const int8x16_t*>(&weights_[offset]);
+        for (IndexType j = 0; j < kNumChunks; ++j) {
+          sum = vdotq_s32(sum, input_vector[j], row[j]);
+        }
+        output[i] = vaddvq_s32(sum) + biases_[i];
+
   #elif defined(USE_NEON)
         int32x4_t sum = {biases_[i]};
         const auto row = reinterpret_cast<const int8x8_t*>(&weights_[offset]);
@@ -196,10 +254,8 @@ namespace Eval::NNUE::Layers {
   #endif
 
       }
-      return output;
     }
 
-   private:
     using BiasType = OutputType;
     using WeightType = std::int8_t;
 
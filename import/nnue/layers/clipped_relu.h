@@ -65,6 +65,33 @@ namespace Eval::NNUE::Layers {
       const auto input = previous_layer_.Propagate(
           transformed_features, buffer + kSelfBufferSize);
       const auto output = reinterpret_cast<OutputType*>(buffer);
+      Compute(input, output);
+      return output;
+    }
+
+    // Forward propagation of a batch of samples
+    const OutputType* PropagateBatch(
+        const TransformedFeatureType* transformed_features,
+        std::size_t feature_stride, IndexType n, char* buffer) const {
+      const auto input = previous_layer_.PropagateBatch(
+          transformed_features, feature_stride, n, buffer + n * kSelfBufferSize);
+      const std::size_t input_stride =
+          PreviousLayer::GetBatchStride(feature_stride);
+      for (IndexType b = 0; b < n; ++b) {
+        Compute(input + b * input_stride,
+                reinterpret_cast<OutputType*>(buffer + b * kSelfBufferSize));
+      }
+      return reinterpret_cast<OutputType*>(buffer);
+    }
+
+    // Distance between the outputs of two samples in a batch
+    static constexpr std::size_t GetBatchStride(std::size_t /*feature_stride*/) {
+      return kSelfBufferSize / sizeof(OutputType);
+    }
+
+   private:
+    // Calculate the output for one sample
+    void Compute(const InputType* input, OutputType* output) const {
 
   #if defined(USE_AVX2)
       constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
@@ -154,18 +181,23 @@ namespace Eval::NNUE::Layers {
       constexpr IndexType kStart = kNumChunks * kSimdWidth;
 
   #elif defined(USE_NEON)
-      constexpr IndexType kNumChunks = kInputDimensions / (kSimdWidth / 2);
-      const int8x8_t kZero = {0};
+      // Sixteen outputs per iteration, narrowing with saturation in the
+      // same way as the SSE version
+      constexpr IndexType kNumChunks = kInputDimensions / kSimdWidth;
+      const int8x16_t kZero = vdupq_n_s8(0);
       const auto in = reinterpret_cast<const int32x4_t*>(input);
-      const auto out = reinterpret_cast<int8x8_t*>(output);
+      const auto out = reinterpret_cast<int8x16_t*>(output);
       for (IndexType i = 0; i < kNumChunks; ++i) {
-        int16x8_t shifted;
-        const auto pack = reinterpret_cast<int16x4_t*>(&shifted);
-        pack[0] = vqshrn_n_s32(in[i * 2 + 0], kWeightScaleBits);
-        pack[1] = vqshrn_n_s32(in[i * 2 + 1], kWeightScaleBits);
-        out[i] = vmax_s8(vqmovn_s16(shifted), kZero);
+        const int16x8_t words0 = vcombine_s16(
+            vqshrn_n_s32(in[i * 4 + 0], kWeightScaleBits),
+            vqshrn_n_s32(in[i * 4 + 1], kWeightScaleBits));
+        const int16x8_t words1 = vcombine_s16(
+            vqshrn_n_s32(in[i * 4 + 2], kWeightScaleBits),
+            vqshrn_n_s32(in[i * 4 + 3], kWeightScaleBits));
+        out[i] = vmaxq_s8(
+            vcombine_s8(vqmovn_s16(words0), vqmovn_s16(words1)), kZero);
       }
-      constexpr IndexType kStart = kNumChunks * (kSimdWidth / 2);
+      constexpr IndexType kStart = kNumChunks * kSimdWidth;
   #else
       constexpr IndexType kStart = 0;
   #endif
@@ -174,10 +206,8 @@ namespace Eval::NNUE::Layers {
         output[i] = static_cast<OutputType>(
             std::max(0, std::min(127, input[i] >> kWeightScaleBits)));
       }
-      return output;
     }
 
-   private:
     PreviousLayer previous_layer_;
   };
 
@@ -60,6 +60,19 @@ class InputSlice {
     return transformed_features + Offset;
   }
 
+  // Forward propagation of a batch of samples
+  const OutputType* PropagateBatch(
+      const TransformedFeatureType* transformed_features,
+      std::size_t /*feature_stride*/, IndexType /*n*/,
+      char* /*buffer*/) const {
+    return transformed_features + Offset;
+  }
+
+  // Distance between the outputs of two samples in a batch
+  static constexpr std::size_t GetBatchStride(std::size_t feature_stride) {
+    return feature_stride;
+  }
+
  private:
 };
 
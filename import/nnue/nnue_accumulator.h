@@ -23,17 +23,51 @@
 
 #include "nnue_architecture.h"
 
-namespace Eval::NNUE {
+// Types embedded in the position are shared by all NNUE kernels. When
+// kernels are built for several instruction sets the Eval::NNUE namespace
+// is renamed for each of them, so the types are kept in a namespace that
+// is not renamed.
+namespace Eval::NNUECommon {
 
   // Class that holds the result of affine transformation of input features
   struct alignas(32) Accumulator {
     std::int16_t
-        accumulation[2][kRefreshTriggers.size()][kTransformedFeatureDimensions];
+        accumulation[2][NNUE::kRefreshTriggers.size()]
+                    [NNUE::kTransformedFeatureDimensions];
     Value score;
     bool computed_accumulation;
     bool computed_score;
   };
 
+  // Number of features that share the same king square
+  constexpr NNUE::IndexType kFeaturesPerKingSquare =
+      NNUE::RawFeatures::kDimensions / SQUARE_NB;
+
+  // Accumulator refresh cache entry. Holds the accumulation for one
+  // perspective and king square together with the features it was
+  // computed from.
+  struct alignas(64) AccumulatorCacheEntry {
+    std::int16_t accumulation[NNUE::kTransformedFeatureDimensions];
+    std::uint64_t active[(kFeaturesPerKingSquare + 63) / 64];
+    bool valid;
+  };
+
+  // Accumulator refresh cache ("Finny table"). A refresh after a king
+  // move only has to apply the difference between the current features
+  // and the features last seen with the king on the same square.
+  struct AccumulatorCache {
+    AccumulatorCacheEntry entries[COLOR_NB][SQUARE_NB];
+  };
+
+}  // namespace Eval::NNUECommon
+
+namespace Eval::NNUE {
+
+  using Accumulator = NNUECommon::Accumulator;
+  using NNUECommon::kFeaturesPerKingSquare;
+  using AccumulatorCacheEntry = NNUECommon::AccumulatorCacheEntry;
+  using AccumulatorCache = NNUECommon::AccumulatorCache;
+
 }  // namespace Eval::NNUE
 
 #endif // NNUE_ACCUMULATOR_H_INCLUDED
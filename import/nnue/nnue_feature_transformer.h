@@ -27,11 +27,15 @@
 #include "features/index_list.h"
 
 #include <cstring> // std::memset()
+#include <limits>
 
 namespace Eval::NNUE {
 
-  // Input feature converter
-  class FeatureTransformer {
+  // Input feature converter. The weights are either stored as int16 or,
+  // for a smaller memory footprint, quantized to int8. The accumulators
+  // are int16 in both cases.
+  template <typename WeightT>
+  class BasicFeatureTransformer {
 
    private:
     // Number of output dimensions for one side
@@ -51,7 +55,26 @@ namespace Eval::NNUE {
 
     // Hash value embedded in the evaluation file
     static constexpr std::uint32_t GetHashValue() {
-      return RawFeatures::kHashValue ^ kOutputDimensions;
+      return RawFeatures::kHashValue ^ kOutputDimensions ^
+             (sizeof(WeightT) == 1 ? kCompactHashValue : 0);
+    }
+
+    // Initialize the parameters from a transformer with wider weights.
+    // Weights outside the range of the weight type are saturated and the
+    // number of such weights is returned.
+    template <typename SourceWeightType>
+    std::size_t Quantize(
+        const BasicFeatureTransformer<SourceWeightType>& source) {
+      std::size_t saturated = 0;
+      std::memcpy(biases_, source.biases_, kHalfDimensions * sizeof(BiasType));
+      for (std::size_t i = 0; i < kHalfDimensions * kInputDimensions; ++i) {
+        const int w = source.weights_[i];
+        const int q = std::max<int>(std::numeric_limits<WeightType>::min(),
+                      std::min<int>(std::numeric_limits<WeightType>::max(), w));
+        saturated += q != w;
+        weights_[i] = static_cast<WeightType>(q);
+      }
+      return saturated;
     }
 
     // Read network parameters
@@ -69,12 +92,30 @@ namespace Eval::NNUE {
       if (now->accumulator.computed_accumulation) {
         return true;
       }
-      const auto prev = now->previous;
-      if (prev && prev->accumulator.computed_accumulation) {
-        UpdateAccumulator(pos);
-        return true;
+
+      // Accumulators are only calculated when a position is evaluated so
+      // walk back to the nearest position that has one. A perspective
+      // whose king moved on the way has to be refreshed.
+      const StateInfo* path[kMaxUpdateDistance];
+      bool reset[2] = { false, false };
+      int length = 0;
+      const StateInfo* st = now;
+      while (!st->accumulator.computed_accumulation) {
+        if (st->previous == nullptr || length == kMaxUpdateDistance) {
+          return false;
+        }
+        for (Color perspective : { WHITE, BLACK }) {
+          reset[perspective] |= RawFeatures::RequiresRefresh(
+              st->dirtyPiece, kRefreshTriggers[0], perspective);
+        }
+        if (reset[WHITE] && reset[BLACK]) {
+          return false;
+        }
+        path[length++] = st;
+        st = st->previous;
       }
-      return false;
+      UpdateAccumulator(pos, st, path, length, reset);
+      return true;
     }
 
     // Convert input features
@@ -184,157 +225,238 @@ namespace Eval::NNUE {
     }
 
    private:
-    // Calculate cumulative value without using difference calculation
-    void RefreshAccumulator(const Position& pos) const {
-      auto& accumulator = pos.state()->accumulator;
-      IndexType i = 0;
-      Features::IndexList active_indices[2];
-      RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
-                                       active_indices);
-      for (Color perspective : { WHITE, BLACK }) {
-        std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                   kHalfDimensions * sizeof(BiasType));
-        for (const auto index : active_indices[perspective]) {
-          const IndexType offset = kHalfDimensions * index;
+    // Hash value marking int8 transformer weights
+    static constexpr std::uint32_t kCompactHashValue = 0x00800000u;
+
+    // Minimum number of active features for using the refresh cache
+    static constexpr std::size_t kMinCachedFeatures = 8;
+
+    // Maximum number of moves to walk back looking for a calculated
+    // accumulator before falling back to a refresh
+    static constexpr int kMaxUpdateDistance = 8;
 
   #if defined(USE_AVX2)
-          auto accumulation = reinterpret_cast<__m256i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-  #if defined(__MINGW32__) || defined(__MINGW64__)
-            _mm256_storeu_si256(&accumulation[j], _mm256_add_epi16(_mm256_loadu_si256(&accumulation[j]), column[j]));
-  #else
-            accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-  #endif
-          }
+    // Load a chunk of weights of a feature as int16
+    __m256i LoadWeights(IndexType offset, IndexType j) const {
+      if constexpr (sizeof(WeightType) == 1) {
+        return _mm256_cvtepi8_epi16(_mm_load_si128(
+            &reinterpret_cast<const __m128i*>(&weights_[offset])[j]));
+      } else {
+        return reinterpret_cast<const __m256i*>(&weights_[offset])[j];
+      }
+    }
 
   #elif defined(USE_SSE2)
-          auto accumulation = reinterpret_cast<__m128i*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-          }
+    // Load a chunk of weights of a feature as int16
+    __m128i LoadWeights(IndexType offset, IndexType j) const {
+      if constexpr (sizeof(WeightType) == 1) {
+        const __m128i w = _mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(&weights_[offset + j * 8]));
+    #if defined(USE_SSE41)
+        return _mm_cvtepi8_epi16(w);
+    #else
+        return _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+    #endif
+      } else {
+        return reinterpret_cast<const __m128i*>(&weights_[offset])[j];
+      }
+    }
 
   #elif defined(USE_NEON)
-          auto accumulation = reinterpret_cast<int16x8_t*>(
-              &accumulator.accumulation[perspective][i][0]);
-          auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-          constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-          for (IndexType j = 0; j < kNumChunks; ++j) {
-            accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-          }
-
-  #else
-          for (IndexType j = 0; j < kHalfDimensions; ++j) {
-            accumulator.accumulation[perspective][i][j] += weights_[offset + j];
-          }
-  #endif
-
-        }
+    // Load a chunk of weights of a feature as int16
+    int16x8_t LoadWeights(IndexType offset, IndexType j) const {
+      if constexpr (sizeof(WeightType) == 1) {
+        return vmovl_s8(vld1_s8(&weights_[offset + j * 8]));
+      } else {
+        return reinterpret_cast<const int16x8_t*>(&weights_[offset])[j];
       }
-
-      accumulator.computed_accumulation = true;
-      accumulator.computed_score = false;
     }
+  #endif
 
-    // Calculate cumulative value using difference calculation
-    void UpdateAccumulator(const Position& pos) const {
-      const auto prev_accumulator = pos.state()->previous->accumulator;
-      auto& accumulator = pos.state()->accumulator;
-      IndexType i = 0;
-      Features::IndexList removed_indices[2], added_indices[2];
-      bool reset[2];
-      RawFeatures::AppendChangedIndices(pos, kRefreshTriggers[i],
-                                        removed_indices, added_indices, reset);
-      for (Color perspective : { WHITE, BLACK }) {
+    // Add the weights of a feature to an accumulation
+    void AddWeights(std::int16_t* accumulation, IndexType index) const {
+      const IndexType offset = kHalfDimensions * index;
 
   #if defined(USE_AVX2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m256i*>(
-            &accumulator.accumulation[perspective][i][0]);
+      auto acc = reinterpret_cast<__m256i*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+  #if defined(__MINGW32__) || defined(__MINGW64__)
+        _mm256_storeu_si256(&acc[j], _mm256_add_epi16(_mm256_loadu_si256(&acc[j]), LoadWeights(offset, j)));
+  #else
+        acc[j] = _mm256_add_epi16(acc[j], LoadWeights(offset, j));
+  #endif
+      }
 
   #elif defined(USE_SSE2)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<__m128i*>(
-            &accumulator.accumulation[perspective][i][0]);
+      auto acc = reinterpret_cast<__m128i*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        acc[j] = _mm_add_epi16(acc[j], LoadWeights(offset, j));
+      }
 
   #elif defined(USE_NEON)
-        constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
-        auto accumulation = reinterpret_cast<int16x8_t*>(
-            &accumulator.accumulation[perspective][i][0]);
+      auto acc = reinterpret_cast<int16x8_t*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        acc[j] = vaddq_s16(acc[j], LoadWeights(offset, j));
+      }
+
+  #else
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        accumulation[j] += weights_[offset + j];
+      }
   #endif
+    }
 
-        if (reset[perspective]) {
-          std::memcpy(accumulator.accumulation[perspective][i], biases_,
-                      kHalfDimensions * sizeof(BiasType));
-        } else {
-          std::memcpy(accumulator.accumulation[perspective][i],
-                      prev_accumulator.accumulation[perspective][i],
-                      kHalfDimensions * sizeof(BiasType));
-          // Difference calculation for the deactivated features
-          for (const auto index : removed_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
+    // Subtract the weights of a feature from an accumulation
+    void SubtractWeights(std::int16_t* accumulation, IndexType index) const {
+      const IndexType offset = kHalfDimensions * index;
 
   #if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_sub_epi16(accumulation[j], column[j]);
-            }
+      auto acc = reinterpret_cast<__m256i*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+  #if defined(__MINGW32__) || defined(__MINGW64__)
+        _mm256_storeu_si256(&acc[j], _mm256_sub_epi16(_mm256_loadu_si256(&acc[j]), LoadWeights(offset, j)));
+  #else
+        acc[j] = _mm256_sub_epi16(acc[j], LoadWeights(offset, j));
+  #endif
+      }
 
   #elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_sub_epi16(accumulation[j], column[j]);
-            }
+      auto acc = reinterpret_cast<__m128i*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        acc[j] = _mm_sub_epi16(acc[j], LoadWeights(offset, j));
+      }
 
   #elif defined(USE_NEON)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vsubq_s16(accumulation[j], column[j]);
-            }
+      auto acc = reinterpret_cast<int16x8_t*>(accumulation);
+      constexpr IndexType kNumChunks = kHalfDimensions / (kSimdWidth / 2);
+      for (IndexType j = 0; j < kNumChunks; ++j) {
+        acc[j] = vsubq_s16(acc[j], LoadWeights(offset, j));
+      }
 
   #else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] -=
-                  weights_[offset + j];
-            }
+      for (IndexType j = 0; j < kHalfDimensions; ++j) {
+        accumulation[j] -= weights_[offset + j];
+      }
   #endif
+    }
 
-          }
+    // Calculate the accumulation for one perspective from all active
+    // features. If the position has a refresh cache only the difference
+    // to the cached entry for the king square is applied.
+    void RefreshPerspective(const Position& pos, Color perspective,
+                            const Features::IndexList& active,
+                            std::int16_t* accumulation) const {
+      // With only a few pieces on the board a refresh from scratch is
+      // cheaper than looking up and updating a cache entry
+      AccumulatorCache* cache = active.size() >= kMinCachedFeatures ?
+                                pos.accumulator_cache() : nullptr;
+      if (cache == nullptr) {
+        std::memcpy(accumulation, biases_, kHalfDimensions * sizeof(BiasType));
+        for (const auto index : active) {
+          AddWeights(accumulation, index);
         }
-        { // Difference calculation for the activated features
-          for (const auto index : added_indices[perspective]) {
-            const IndexType offset = kHalfDimensions * index;
+        return;
+      }
 
-  #if defined(USE_AVX2)
-            auto column = reinterpret_cast<const __m256i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm256_add_epi16(accumulation[j], column[j]);
-            }
+      // All active features share the same king square
+      const IndexType king_sq = active[0] / kFeaturesPerKingSquare;
+      const IndexType base = king_sq * kFeaturesPerKingSquare;
+      auto& entry = cache->entries[perspective][king_sq];
+      if (!entry.valid) {
+        std::memcpy(entry.accumulation, biases_,
+                    kHalfDimensions * sizeof(BiasType));
+        std::memset(entry.active, 0, sizeof(entry.active));
+        entry.valid = true;
+      }
 
-  #elif defined(USE_SSE2)
-            auto column = reinterpret_cast<const __m128i*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = _mm_add_epi16(accumulation[j], column[j]);
-            }
+      constexpr std::size_t kNumWords = sizeof(entry.active) / sizeof(entry.active[0]);
+      std::uint64_t now[kNumWords] = {};
+      for (const auto index : active) {
+        const IndexType f = index - base;
+        now[f / 64] |= 1ULL << (f % 64);
+      }
+      for (std::size_t w = 0; w < kNumWords; ++w) {
+        std::uint64_t removed = entry.active[w] & ~now[w];
+        std::uint64_t added = now[w] & ~entry.active[w];
+        while (removed) {
+          SubtractWeights(entry.accumulation,
+                          base + w * 64 + __builtin_ctzll(removed));
+          removed &= removed - 1;
+        }
+        while (added) {
+          AddWeights(entry.accumulation,
+                     base + w * 64 + __builtin_ctzll(added));
+          added &= added - 1;
+        }
+        entry.active[w] = now[w];
+      }
+      std::memcpy(accumulation, entry.accumulation,
+                  kHalfDimensions * sizeof(BiasType));
+    }
 
-  #elif defined(USE_NEON)
-            auto column = reinterpret_cast<const int16x8_t*>(&weights_[offset]);
-            for (IndexType j = 0; j < kNumChunks; ++j) {
-              accumulation[j] = vaddq_s16(accumulation[j], column[j]);
-            }
+    // Calculate cumulative value without using difference calculation
+    void RefreshAccumulator(const Position& pos) const {
+      auto& accumulator = pos.state()->accumulator;
+#ifdef STATS
+      pos.m_refreshes++;
+#endif
+      IndexType i = 0;
+      Features::IndexList active_indices[2];
+      RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
+                                       active_indices);
+      for (Color perspective : { WHITE, BLACK }) {
+        RefreshPerspective(pos, perspective, active_indices[perspective],
+                           accumulator.accumulation[perspective][i]);
+      }
 
-  #else
-            for (IndexType j = 0; j < kHalfDimensions; ++j) {
-              accumulator.accumulation[perspective][i][j] +=
-                  weights_[offset + j];
-            }
-  #endif
+      accumulator.computed_accumulation = true;
+      accumulator.computed_score = false;
+    }
+
+    // Calculate cumulative value using difference calculation. The
+    // accumulator of the current position is built from the accumulator
+    // of the ancestor by applying the changes of all moves in between.
+    // path holds the states from the current position back to, but not
+    // including, the ancestor.
+    void UpdateAccumulator(const Position& pos, const StateInfo* ancestor,
+                           const StateInfo* const path[], int length,
+                           const bool reset[2]) const {
+      auto& accumulator = pos.state()->accumulator;
+#ifdef STATS
+      pos.m_updates++;
+#endif
+      IndexType i = 0;
+      Features::IndexList active_indices[2];
+      if (reset[WHITE] || reset[BLACK]) {
+        RawFeatures::AppendActiveIndices(pos, kRefreshTriggers[i],
+                                         active_indices);
+      }
+      for (Color perspective : { WHITE, BLACK }) {
+        auto accumulation = accumulator.accumulation[perspective][i];
+        if (reset[perspective]) {
+          RefreshPerspective(pos, perspective, active_indices[perspective],
+                             accumulation);
+          continue;
+        }
 
+        std::memcpy(accumulation,
+                    ancestor->accumulator.accumulation[perspective][i],
+                    kHalfDimensions * sizeof(BiasType));
+        for (int k = length - 1; k >= 0; --k) {
+          Features::IndexList removed_indices, added_indices;
+          RawFeatures::AppendChangedIndices(pos, path[k]->dirtyPiece,
+                                            kRefreshTriggers[i], perspective,
+                                            &removed_indices, &added_indices);
+          for (const auto index : removed_indices) {
+            SubtractWeights(accumulation, index);
+          }
+          for (const auto index : added_indices) {
+            AddWeights(accumulation, index);
           }
         }
       }
@@ -344,13 +466,18 @@ namespace Eval::NNUE {
     }
 
     using BiasType = std::int16_t;
-    using WeightType = std::int16_t;
+    using WeightType = WeightT;
+
+    template <typename> friend class BasicFeatureTransformer;
 
     alignas(kCacheLineSize) BiasType biases_[kHalfDimensions];
     alignas(kCacheLineSize)
         WeightType weights_[kHalfDimensions * kInputDimensions];
   };
 
+  using FeatureTransformer = BasicFeatureTransformer<std::int16_t>;
+  using CompactFeatureTransformer = BasicFeatureTransformer<std::int8_t>;
+
 }  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
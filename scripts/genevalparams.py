@@ -5,7 +5,7 @@ import tempfile
 
 def write_array_variable(outputfile, name, value):
     values = value[1:-1].split(',')
-    str = f'int {name} = {{\n    '
+    str = f'EVALPARAM {name} = {{\n    '
     count = 0
     for v in values:
         v = v.lstrip().rstrip()
@@ -24,7 +24,7 @@ def write_array_variable(outputfile, name, value):
 
 def write_variable(outputfile, name, value):
     if not '[' in name:
-        outputfile.write(f'int {name} = {value};\n')
+        outputfile.write(f'EVALPARAM {name} = {value};\n')
     else:
         write_array_variable(outputfile, name, value)
 
@@ -93,7 +93,7 @@ with open(outputpath) as paramfile:
         if len(line) == 0:
             tmpfile.write('\n');
             continue
-        if line.find('int') != 0:
+        if line.find('EVALPARAM') != 0:
             tmpfile.write(f'{line}\n')
             continue
         name, value = parse_variable(paramfile, line)
@@ -57,9 +57,6 @@
  */
 #define MSB(bb) bitscan_reverse((bb))
 
-/* Initialize the bitboard component */
-void bb_init(void);
-
 /*
  * Generate a bitboard of pawn moves (excluding captures).
  *
@@ -206,4 +203,12 @@ uint64_t bb_pawn_pushes(uint64_t pawns, uint64_t occ, int side);
  */
 uint64_t bb_pawn_attacks(uint64_t pawns, int side);
 
+/*
+ * Get the size of the precomputed attack tables. The tables are constant
+ * data in the executable and are shared by all engine processes.
+ *
+ * @return Returns the size in bytes.
+ */
+uint64_t bb_tables_memory(void);
+
 #endif
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -140,6 +141,8 @@ static void add_piece(struct position *pos, int piece, int square)
     SETBIT(pos->bb_pieces[piece], square);
     SETBIT(pos->bb_sides[COLOR(piece)], square);
     pos->pieces[square] = piece;
+    pos->psq[MIDDLEGAME][COLOR(piece)] += eval_psq[piece][square][MIDDLEGAME];
+    pos->psq[ENDGAME][COLOR(piece)] += eval_psq[piece][square][ENDGAME];
 }
 
 static void remove_piece(struct position *pos, int piece, int square)
@@ -147,6 +150,8 @@ static void remove_piece(struct position *pos, int piece, int square)
     CLEARBIT(pos->bb_pieces[piece], square);
     CLEARBIT(pos->bb_sides[COLOR(piece)], square);
     pos->pieces[square] = NO_PIECE;
+    pos->psq[MIDDLEGAME][COLOR(piece)] -= eval_psq[piece][square][MIDDLEGAME];
+    pos->psq[ENDGAME][COLOR(piece)] -= eval_psq[piece][square][ENDGAME];
 }
 
 static void move_piece(struct position *pos, int piece, int from, int to)
@@ -164,6 +169,8 @@ static struct unmake* push_history(struct position *pos)
     elem = &pos->history[pos->ply];
     pos->ply++;
     pos->sply++;
+    pos->checkinfo[pos->ply&(CHECKINFO_SIZE-1)].valid = false;
+    pos->attackinfo[pos->ply&(CHECKINFO_SIZE-1)].valid = false;
 
     return elem;
 }
@@ -199,6 +206,8 @@ void board_reset(struct position *pos)
 
     pos->key = 0ULL;
     pos->pawnkey = 0ULL;
+    pos->materialkey = 0ULL;
+    memset(pos->psq, 0, sizeof(pos->psq));
 
     pos->ep_sq = NO_SQUARE;
     pos->castle = 0;
@@ -206,6 +215,40 @@ void board_reset(struct position *pos)
     pos->ply = 0;
     pos->sply = 0;
     pos->fifty = 0;
+    pos->start_ply = 0;
+    for (k=0;k<CHECKINFO_SIZE;k++) {
+        pos->checkinfo[k].valid = false;
+        pos->attackinfo[k].valid = false;
+    }
+}
+
+void board_copy_root(struct position *dst, struct position *src)
+{
+    int first;
+    int k;
+
+    assert(valid_position(src));
+    assert(dst != NULL);
+
+    memcpy(dst, src, offsetof(struct position, history));
+
+    /*
+     * Only the reversible part of the history is needed for detecting
+     * repetitions. The last two moves are used by the history heuristics.
+     */
+    first = MAX(src->ply-(MAX(src->fifty, 2)), 0);
+    memcpy(&dst->history[first], &src->history[first],
+           (src->ply-first)*sizeof(struct unmake));
+
+    dst->worker = src->worker;
+    dst->state = src->state;
+    memcpy(dst->start_pieces, src->pieces, NSQUARES*sizeof(uint8_t));
+    dst->start_side = src->stm;
+    dst->start_ply = src->ply;
+    for (k=0;k<CHECKINFO_SIZE;k++) {
+        dst->checkinfo[k].valid = false;
+        dst->attackinfo[k].valid = false;
+    }
 }
 
 void board_start_position(struct position *pos)
@@ -245,6 +288,210 @@ bool board_in_check(struct position *pos, int side)
                           FLIP_COLOR(side));
 }
 
+static void find_blockers(struct position *pos, int side,
+                          struct checkinfo *ci)
+{
+    uint64_t snipers;
+    uint64_t between;
+    int      kingsq;
+    int      opp;
+    int      sq;
+
+    kingsq = LSB(pos->bb_pieces[KING+side]);
+    opp = FLIP_COLOR(side);
+
+    /* Find opponent sliders that would attack the king on an empty board */
+    snipers = (bb_bishop_moves(0ULL, kingsq)&
+               (pos->bb_pieces[BISHOP+opp]|pos->bb_pieces[QUEEN+opp]))|
+              (bb_rook_moves(0ULL, kingsq)&
+               (pos->bb_pieces[ROOK+opp]|pos->bb_pieces[QUEEN+opp]));
+
+    ci->blockers[side] = 0ULL;
+    ci->pinners[side] = 0ULL;
+    while (snipers != 0ULL) {
+        sq = POPBIT(&snipers);
+        between = between_mask[kingsq][sq]&pos->bb_all;
+        if ((between != 0ULL) && (ISOLATE(between) == between)) {
+            ci->blockers[side] |= between;
+            if ((between&pos->bb_sides[side]) != 0ULL) {
+                ci->pinners[side] |= sq_mask[sq];
+            }
+        }
+    }
+}
+
+struct checkinfo* board_checkinfo(struct position *pos)
+{
+    struct checkinfo *ci;
+    int              kingsq;
+    int              stm;
+    int              opp;
+
+    assert(valid_position(pos));
+
+    ci = &pos->checkinfo[pos->ply&(CHECKINFO_SIZE-1)];
+    if (ci->valid && (ci->ply == pos->ply)) {
+        return ci;
+    }
+
+    stm = pos->stm;
+    opp = FLIP_COLOR(stm);
+    ci->checkers = bb_attacks_to(pos, pos->bb_all,
+                                 LSB(pos->bb_pieces[KING+stm]), opp);
+    find_blockers(pos, WHITE, ci);
+    find_blockers(pos, BLACK, ci);
+
+    /* Squares from which each piece would attack the opponent king */
+    kingsq = LSB(pos->bb_pieces[KING+opp]);
+    ci->check_squares[PAWN+stm] = bb_pawn_attacks_to(kingsq, stm);
+    ci->check_squares[KNIGHT+stm] = bb_knight_moves(kingsq);
+    ci->check_squares[BISHOP+stm] = bb_bishop_moves(pos->bb_all, kingsq);
+    ci->check_squares[ROOK+stm] = bb_rook_moves(pos->bb_all, kingsq);
+    ci->check_squares[QUEEN+stm] = ci->check_squares[BISHOP+stm]|
+                                   ci->check_squares[ROOK+stm];
+    ci->check_squares[KING+stm] = 0ULL;
+    ci->ply = pos->ply;
+    ci->valid = true;
+
+    return ci;
+}
+
+static void add_attacks(struct attackinfo *ai, int piece, uint64_t attacks)
+{
+    int side = COLOR(piece);
+
+    ai->attacked_by[piece] |= attacks;
+    ai->attacked2[side] |= (attacks&ai->attacked[side]);
+    ai->attacked[side] |= attacks;
+}
+
+struct attackinfo* board_attackinfo(struct position *pos)
+{
+    struct attackinfo *ai;
+    uint64_t          pieces;
+    uint64_t          pawns;
+    int               piece;
+    int               side;
+    int               sq;
+
+    assert(valid_position(pos));
+
+    ai = &pos->attackinfo[pos->ply&(CHECKINFO_SIZE-1)];
+    if (ai->valid && (ai->ply == pos->ply)) {
+        return ai;
+    }
+
+    memset(ai, 0, sizeof(struct attackinfo));
+    for (side=0;side<NSIDES;side++) {
+        /*
+         * Pawn captures towards each side are added separately so that
+         * squares attacked by two pawns are found.
+         */
+        pawns = pos->bb_pieces[PAWN+side];
+        if (side == WHITE) {
+            add_attacks(ai, PAWN+side, (pawns&(~file_mask[FILE_A]))<<7);
+            add_attacks(ai, PAWN+side, (pawns&(~file_mask[FILE_H]))<<9);
+        } else {
+            add_attacks(ai, PAWN+side, (pawns&(~file_mask[FILE_A]))>>9);
+            add_attacks(ai, PAWN+side, (pawns&(~file_mask[FILE_H]))>>7);
+        }
+
+        for (piece=KNIGHT+side;piece<NPIECES;piece+=2) {
+            pieces = pos->bb_pieces[piece];
+            while (pieces != 0ULL) {
+                sq = POPBIT(&pieces);
+                add_attacks(ai, piece,
+                            bb_moves_for_piece(pos->bb_all, sq, piece));
+            }
+        }
+    }
+    ai->ply = pos->ply;
+    ai->valid = true;
+
+    return ai;
+}
+
+bool board_has_attackinfo(struct position *pos)
+{
+    struct attackinfo *ai;
+
+    ai = &pos->attackinfo[pos->ply&(CHECKINFO_SIZE-1)];
+    return ai->valid && (ai->ply == pos->ply);
+}
+
+void board_set_attackinfo(struct position *pos, uint64_t *attacked_by,
+                          uint64_t *attacked, uint64_t *attacked2)
+{
+    struct attackinfo *ai;
+
+    ai = &pos->attackinfo[pos->ply&(CHECKINFO_SIZE-1)];
+    memcpy(ai->attacked_by, attacked_by, sizeof(ai->attacked_by));
+    memcpy(ai->attacked, attacked, sizeof(ai->attacked));
+    memcpy(ai->attacked2, attacked2, sizeof(ai->attacked2));
+    ai->ply = pos->ply;
+    ai->valid = true;
+}
+
+bool board_is_move_legal(struct position *pos, uint32_t move)
+{
+    struct checkinfo *ci;
+    uint64_t         occ;
+    uint64_t         captured;
+    int              from;
+    int              to;
+    int              kingsq;
+    int              opp;
+
+    assert(valid_position(pos));
+    assert(valid_move(move));
+    assert(board_is_move_pseudo_legal(pos, move));
+
+    from = FROM(move);
+    to = TO(move);
+    opp = FLIP_COLOR(pos->stm);
+
+    /*
+     * For king moves check that the destination square is not attacked.
+     * The king is removed from the board first so that it does not block
+     * attacks along the line it moves on.
+     */
+    if (pos->pieces[from] == (KING+pos->stm)) {
+        return bb_attacks_to(pos, pos->bb_all&~sq_mask[from], to, opp) == 0ULL;
+    }
+
+    /*
+     * For en passant captures two pieces disappear from the line of the
+     * king so check that the king is not attacked after the move has been
+     * made. The captured pawn can not attack the king so it is excluded.
+     */
+    kingsq = LSB(pos->bb_pieces[KING+pos->stm]);
+    if (ISENPASSANT(move)) {
+        captured = sq_mask[(pos->stm == WHITE)?to-8:to+8];
+        occ = ((pos->bb_all&~sq_mask[from])&~captured)|sq_mask[to];
+        return (bb_attacks_to(pos, occ, kingsq, opp)&~captured) == 0ULL;
+    }
+
+    /*
+     * For other moves the check information is enough. When in check
+     * the move has to capture the checking piece or block it, which is
+     * impossible if there are several checking pieces. In addition a
+     * pinned piece can only move along the line of the pin.
+     */
+    ci = board_checkinfo(pos);
+    if (ci->checkers != 0ULL) {
+        if (ISOLATE(ci->checkers) != ci->checkers) {
+            return false;
+        }
+        if (((ci->checkers|between_mask[kingsq][LSB(ci->checkers)])&
+             sq_mask[to]) == 0ULL) {
+            return false;
+        }
+    }
+
+    return ((ci->blockers[pos->stm]&sq_mask[from]) == 0ULL) ||
+           ((line_mask[from][kingsq]&sq_mask[to]) != 0ULL);
+}
+
 bool board_make_move(struct position *pos, uint32_t move)
 {
     struct unmake *elem;
@@ -260,6 +507,14 @@ bool board_make_move(struct position *pos, uint32_t move)
     assert(board_is_move_pseudo_legal(pos, move));
     assert(pos->ply < MAX_MOVES);
 
+    /*
+     * Reject illegal moves before making them to avoid
+     * having to undo them again.
+     */
+    if (!board_is_move_legal(pos, move)) {
+        return false;
+    }
+
     from = FROM(move);
     to = TO(move);
     promotion = PROMOTION(move);
@@ -278,6 +533,7 @@ bool board_make_move(struct position *pos, uint32_t move)
     elem->fifty = pos->fifty;
     elem->key = pos->key;
     elem->pawnkey = pos->pawnkey;
+    elem->materialkey = pos->materialkey;
 
     /* Check if the move enables an en passant capture */
     if ((VALUE(piece) == PAWN) && (abs(to-from) == 16)) {
@@ -298,6 +554,10 @@ bool board_make_move(struct position *pos, uint32_t move)
     if (VALUE(piece) == PAWN) {
         pos->pawnkey = key_update_piece(pos->pawnkey, piece, from);
     }
+    if (ISPROMOTION(move)) {
+        pos->materialkey = key_update_material(pos->materialkey, piece,
+                                    BITCOUNT(pos->bb_pieces[piece]));
+    }
 
     /* If necessary remove captured piece */
     if (ISCAPTURE(move)) {
@@ -306,6 +566,8 @@ bool board_make_move(struct position *pos, uint32_t move)
         if (VALUE(capture) == PAWN) {
             pos->pawnkey = key_update_piece(pos->pawnkey, capture, to);
         }
+        pos->materialkey = key_update_material(pos->materialkey, capture,
+                                    BITCOUNT(pos->bb_pieces[capture]));
     } else if (ISENPASSANT(move)) {
         ep = (pos->stm == WHITE)?to-8:to+8;
         remove_piece(pos, PAWN+FLIP_COLOR(pos->stm), ep);
@@ -313,12 +575,17 @@ bool board_make_move(struct position *pos, uint32_t move)
         pos->pawnkey = key_update_piece(pos->pawnkey,
                                         PAWN+FLIP_COLOR(pos->stm),
                                         ep);
+        pos->materialkey = key_update_material(pos->materialkey,
+                    PAWN+FLIP_COLOR(pos->stm),
+                    BITCOUNT(pos->bb_pieces[PAWN+FLIP_COLOR(pos->stm)]));
     }
 
     /* Add piece to new position */
     if (ISPROMOTION(move)) {
         add_piece(pos, promotion, to);
         pos->key = key_update_piece(pos->key, promotion, to);
+        pos->materialkey = key_update_material(pos->materialkey, promotion,
+                                    BITCOUNT(pos->bb_pieces[promotion])-1);
     } else {
         add_piece(pos, piece, to);
         pos->key = key_update_piece(pos->key, piece, to);
@@ -354,9 +621,15 @@ bool board_make_move(struct position *pos, uint32_t move)
     pos->stm = FLIP_COLOR(pos->stm);
     pos->key = key_update_side(pos->key, pos->stm);
 
-    /* Prefetch hash table entries */
+    /*
+     * Prefetch hash table entries for the new position as soon as
+     * the keys are known so that the memory access overlaps with
+     * the rest of the update. The pawn and material tables only
+     * need to be touched if the corresponding key changed.
+     */
     if (pos->state != NULL) {
-        hash_prefetch(pos->worker);
+        hash_prefetch(pos->worker, pos->pawnkey != elem->pawnkey,
+                      pos->materialkey != elem->materialkey);
     }
 
     /* Update bitboard of all pieces */
@@ -367,18 +640,12 @@ bool board_make_move(struct position *pos, uint32_t move)
         nnue_make_move(pos->nnue_pos, from, to, TYPE(move), promotion, piece);
     }
 
-    /*
-     * If the king was left in check then the move
-     * was illegal and should be undone.
-     */
-    if (board_in_check(pos, FLIP_COLOR(pos->stm))) {
-        board_unmake_move(pos);
-        return false;
-    }
-
+    assert(!board_in_check(pos, FLIP_COLOR(pos->stm)));
     assert(pos->key == key_generate(pos));
     assert(pos->pawnkey == key_generate_pawnkey(pos));
+    assert(pos->materialkey == key_generate_materialkey(pos));
     assert(valid_position(pos));
+    assert(validate_psq(pos));
     assert(validate_nnue(pos));
 
     return true;
@@ -404,6 +671,7 @@ void board_unmake_move(struct position *pos)
     pos->fifty = elem->fifty;
     pos->key = elem->key;
     pos->pawnkey = elem->pawnkey;
+    pos->materialkey = elem->materialkey;
 
     /* Extract some information for later use */
     to = TO(move);
@@ -461,7 +729,9 @@ void board_unmake_move(struct position *pos)
 
     assert(pos->key == key_generate(pos));
     assert(pos->pawnkey == key_generate_pawnkey(pos));
+    assert(pos->materialkey == key_generate_materialkey(pos));
     assert(valid_position(pos));
+    assert(validate_psq(pos));
     assert(validate_nnue(pos));
 }
 
@@ -482,6 +752,7 @@ void board_make_null_move(struct position *pos)
     elem->fifty = pos->fifty;
     elem->key = pos->key;
     elem->pawnkey = pos->pawnkey;
+    elem->materialkey = pos->materialkey;
 
     /* Update the state structure */
     pos->ep_sq = NO_SQUARE;
@@ -493,9 +764,9 @@ void board_make_null_move(struct position *pos)
     pos->stm = FLIP_COLOR(pos->stm);
     pos->key = key_update_side(pos->key, pos->stm);
 
-    /* Prefetch hash table entries */
+    /* Prefetch hash table entries, pawns and material are unchanged */
     if (pos->state != NULL) {
-        hash_prefetch(pos->worker);
+        hash_prefetch(pos->worker, false, false);
     }
 
     /* Update NNUE */
@@ -505,6 +776,7 @@ void board_make_null_move(struct position *pos)
 
     assert(pos->key == key_generate(pos));
     assert(pos->pawnkey == key_generate_pawnkey(pos));
+    assert(pos->materialkey == key_generate_materialkey(pos));
     assert(valid_position(pos));
     assert(validate_nnue(pos));
 }
@@ -523,6 +795,7 @@ void board_unmake_null_move(struct position *pos)
     pos->fifty = elem->fifty;
     pos->key = elem->key;
     pos->pawnkey = elem->pawnkey;
+    pos->materialkey = elem->materialkey;
 
     /* Update the state structure */
     if (pos->stm == WHITE) {
@@ -537,6 +810,7 @@ void board_unmake_null_move(struct position *pos)
 
     assert(pos->key == key_generate(pos));
     assert(pos->pawnkey == key_generate_pawnkey(pos));
+    assert(pos->materialkey == key_generate_materialkey(pos));
     assert(valid_position(pos));
     assert(validate_nnue(pos));
 }
@@ -554,9 +828,14 @@ bool board_is_repetition(struct position *pos)
      * counter can be used here as well.
      *
      * Also there is no need to consider position where the other side is to
-     * move so only check every other position in the history.
+     * move so only check every other position in the history. The position
+     * two plies back can never be the same either since both sides have
+     * moved since then, so at least four plies are needed for a repetition.
      */
-    idx = pos->ply - 2;
+    if (pos->fifty < 4) {
+        return false;
+    }
+    idx = pos->ply - 4;
     while ((idx >= 0) && (idx >= (pos->ply - pos->fifty))) {
         if (pos->history[idx].key == pos->key) {
             return true;
@@ -567,6 +846,66 @@ bool board_is_repetition(struct position *pos)
     return false;
 }
 
+bool board_has_upcoming_repetition(struct position *pos)
+{
+    uint32_t move;
+    int      end;
+    int      idx;
+    int      from;
+    int      to;
+
+    assert(valid_position(pos));
+
+    /*
+     * Look for a previous position, with the other side to move, that
+     * differs from the current position by a single reversible move.
+     * Positions before a null move are not considered.
+     */
+    end = pos->ply - (MIN(pos->fifty, pos->ply));
+    if ((pos->ply - end < 3) ||
+        (pos->history[pos->ply-1].move == NULLMOVE)) {
+        return false;
+    }
+    for (idx=pos->ply-3;idx>=end;idx-=2) {
+        if ((pos->history[idx+1].move == NULLMOVE) ||
+            (pos->history[idx].move == NULLMOVE)) {
+            break;
+        }
+        move = key_cuckoo_move(pos->key^pos->history[idx].key);
+        if (move == NOMOVE) {
+            continue;
+        }
+
+        /* The move is stored for both directions */
+        from = FROM(move);
+        to = TO(move);
+        if (pos->pieces[from] == NO_PIECE) {
+            from = TO(move);
+            to = FROM(move);
+        }
+        if ((pos->pieces[from] == NO_PIECE) || (pos->pieces[to] != NO_PIECE)) {
+            continue;
+        }
+
+        /* The path between the two squares must be free */
+        if ((bb_moves_for_piece(pos->bb_all, from, pos->pieces[from])&
+             sq_mask[to]) == 0ULL) {
+            continue;
+        }
+
+        /*
+         * Inside the search tree either side can repeat the position.
+         * Before the root only the side to move can do it.
+         */
+        if ((pos->sply > (pos->ply - idx)) ||
+            (COLOR(pos->pieces[from]) == pos->stm)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool board_has_non_pawn(struct position *pos, int side)
 {
     assert(valid_position(pos));
@@ -743,12 +1082,11 @@ bool board_is_move_pseudo_legal(struct position *pos, uint32_t move)
 
 bool board_move_gives_check(struct position *pos, uint32_t move)
 {
-    bool gives_check;
-    int  from;
-    int  to;
-    int  src_piece;
-    int  dest_piece;
-    int  capture;
+    struct checkinfo *ci;
+    bool             gives_check;
+    int              from;
+    int              to;
+    int              kingsq;
 
     assert(valid_position(pos));
     assert(valid_move(move));
@@ -766,59 +1104,31 @@ bool board_move_gives_check(struct position *pos, uint32_t move)
         return gives_check;
     }
 
-    /* Extract move information */
     from = FROM(move);
     to = TO(move);
-    src_piece = pos->pieces[from];
-    dest_piece = ISPROMOTION(move)?PROMOTION(move):src_piece;
-    capture = pos->pieces[to];
+    kingsq = LSB(pos->bb_pieces[KING+FLIP_COLOR(pos->stm)]);
+    ci = board_checkinfo(pos);
 
-    /* Remove piece from the source square */
-    CLEARBIT(pos->bb_pieces[src_piece], from);
-    CLEARBIT(pos->bb_sides[pos->stm], from);
-    CLEARBIT(pos->bb_all, from);
-    pos->pieces[from] = NO_PIECE;
-
-    /* Remove captured piece from the destination square */
-    if (capture != NO_PIECE) {
-        CLEARBIT(pos->bb_pieces[capture], to);
-        CLEARBIT(pos->bb_sides[FLIP_COLOR(pos->stm)], to);
-        CLEARBIT(pos->bb_all, to);
-        pos->pieces[to] = NO_PIECE;
-    }
-
-    /* Add piece to the destination square */
-    SETBIT(pos->bb_pieces[dest_piece], to);
-    SETBIT(pos->bb_sides[pos->stm], to);
-    SETBIT(pos->bb_all, to);
-    pos->pieces[to] = dest_piece;
-
-    /* Check if opponent king is attacked */
-    gives_check = bb_is_attacked(pos,
-                                LSB(pos->bb_pieces[KING+FLIP_COLOR(pos->stm)]),
-                                pos->stm);
-
-    /* Remove piece from the desination square */
-    CLEARBIT(pos->bb_pieces[dest_piece], to);
-    CLEARBIT(pos->bb_sides[pos->stm], to);
-    CLEARBIT(pos->bb_all, to);
-    pos->pieces[to] = NO_PIECE;
-
-    /* Put captured piece back on destination square */
-    if (capture != NO_PIECE) {
-        SETBIT(pos->bb_pieces[capture], to);
-        SETBIT(pos->bb_sides[FLIP_COLOR(pos->stm)], to);
-        SETBIT(pos->bb_all, to);
-        pos->pieces[to] = capture;
-    }
-
-    /* Put the piece back on source square */
-    SETBIT(pos->bb_pieces[src_piece], from);
-    SETBIT(pos->bb_sides[pos->stm], from);
-    SETBIT(pos->bb_all, from);
-    pos->pieces[from] = src_piece;
-
-    return gives_check;
+    /*
+     * Check for a direct check. The piece moved by a promotion is not
+     * covered by the check squares and it may also attack the king along
+     * the line it moved away from.
+     */
+    if (ISPROMOTION(move)) {
+        if ((bb_moves_for_piece(pos->bb_all&~sq_mask[from], to,
+                                PROMOTION(move))&sq_mask[kingsq]) != 0ULL) {
+            return true;
+        }
+    } else if ((ci->check_squares[pos->pieces[from]]&sq_mask[to]) != 0ULL) {
+        return true;
+    }
+
+    /*
+     * Check for a discovered check, which happens when a piece blocking
+     * an attack on the opponent king leaves the line of the attack.
+     */
+    return ((ci->blockers[FLIP_COLOR(pos->stm)]&sq_mask[from]) != 0ULL) &&
+           ((line_mask[from][kingsq]&sq_mask[to]) == 0ULL);
 }
 
 void board_quiet(struct position *pos, struct movelist *pv)
@@ -29,6 +29,16 @@
  */
 void board_reset(struct position *pos);
 
+/*
+ * Copy a position to be used as the root of a search. Only the part of
+ * the history that can be accessed during the search is copied. The
+ * NNUE data is not copied.
+ *
+ * @param dst The position to copy to.
+ * @param src The position to copy.
+ */
+void board_copy_root(struct position *dst, struct position *src);
+
 /*
  * Initialize a board structure to the chess starting posuition.
  *
@@ -54,14 +64,65 @@ bool board_setup_from_fen(struct position *pos, char *fenstr);
  */
 bool board_in_check(struct position *pos, int side);
 
+/*
+ * Get check and pin information for the position. The information is
+ * computed the first time it is requested for a ply and then reused
+ * until a new move is made at the same ply.
+ *
+ * @param pos The chess board.
+ * @return Returns the check information.
+ */
+struct checkinfo* board_checkinfo(struct position *pos);
+
+/*
+ * Get the attack maps for the position. The maps are computed the
+ * first time they are requested for a ply, unless they have already
+ * been stored by the evaluation, and then reused until a new move is
+ * made at the same ply.
+ *
+ * @param pos The chess board.
+ * @return Returns the attack maps.
+ */
+struct attackinfo* board_attackinfo(struct position *pos);
+
+/*
+ * Check if the attack maps for the position are available without
+ * having to compute them.
+ *
+ * @param pos The chess board.
+ * @return Returns true if the attack maps are available.
+ */
+bool board_has_attackinfo(struct position *pos);
+
+/*
+ * Store attack maps that have been computed for the position, for
+ * instance by the evaluation, so that they can be reused.
+ *
+ * @param pos The chess board.
+ * @param attacked_by Squares attacked by each piece type.
+ * @param attacked Squares attacked by each side.
+ * @param attacked2 Squares attacked at least twice by each side.
+ */
+void board_set_attackinfo(struct position *pos, uint64_t *attacked_by,
+                          uint64_t *attacked, uint64_t *attacked2);
+
+/*
+ * Check if a pseudo-legal move is legal, that is if it does not leave
+ * the king in check. The check is done without making the move.
+ *
+ * @param pos The board structure.
+ * @param move The move to check.
+ * @return Returns true if the move is legal.
+ */
+bool board_is_move_legal(struct position *pos, uint32_t move);
+
 /*
  * Make a move.
  *
  * @param pos The chess board.
  * @param move The move to make.
  * @param Returns false if the move was illegal (left the king in check),
- *        true otherwise. If the move was illegal the it is automatically
- *        undone.
+ *        true otherwise. If the move was illegal then it is not made.
  */
 bool board_make_move(struct position *pos, uint32_t move);
 
@@ -94,6 +155,16 @@ void board_unmake_null_move(struct position *pos);
  */
 bool board_is_repetition(struct position *pos);
 
+/*
+ * Check if the side to move can reach a previous position with a single
+ * reversible move. Inside the search tree such a position is a draw since
+ * either side can repeat the position.
+ *
+ * @param pos The chess board.
+ * @return Returns true if a repetition is possible.
+ */
+bool board_has_upcoming_repetition(struct position *pos);
+
 /*
  * Check if a specific player has a non-pawn, non-king piece.
  *
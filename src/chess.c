@@ -29,6 +29,7 @@
 #include "engine.h"
 #include "search.h"
 #include "eval.h"
+#include "key.h"
 #include "nnue.h"
 
 uint64_t sq_mask[NSQUARES];
@@ -53,6 +54,10 @@ uint64_t front_span[NSIDES][NSQUARES];
 
 uint64_t rear_span[NSIDES][NSQUARES];
 
+uint64_t between_mask[NSQUARES][NSQUARES];
+
+uint64_t line_mask[NSQUARES][NSQUARES];
+
 uint64_t king_zone[NSIDES][NSQUARES];
 
 char piece2char[NPIECES+1] = {
@@ -98,6 +103,41 @@ uint64_t outpost_squares[NSIDES];
 
 uint64_t space_eval_squares[NSIDES];
 
+static void init_line_masks(void)
+{
+    static const int deltas[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1},
+                                     {1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+    uint64_t         ray;
+    uint64_t         line;
+    int              from;
+    int              to;
+    int              file;
+    int              rank;
+    int              k;
+
+    memset(between_mask, 0, sizeof(between_mask));
+    memset(line_mask, 0, sizeof(line_mask));
+
+    for (from=0;from<NSQUARES;from++) {
+        for (k=0;k<8;k++) {
+            line = bb_slider_moves(0ULL, from, deltas[k][0], deltas[k][1])|
+                   bb_slider_moves(0ULL, from, -deltas[k][0], -deltas[k][1])|
+                   sq_mask[from];
+            ray = 0ULL;
+            file = FILENR(from) + deltas[k][0];
+            rank = RANKNR(from) + deltas[k][1];
+            while (!SQUAREOFFBOARD(file, rank)) {
+                to = SQUARE(file, rank);
+                between_mask[from][to] = ray;
+                line_mask[from][to] = line;
+                ray |= sq_mask[to];
+                file += deltas[k][0];
+                rank += deltas[k][1];
+            }
+        }
+    }
+}
+
 static void init_king_zones(void)
 {
     int sq;
@@ -338,6 +378,12 @@ void chess_data_init(void)
 
     /* Initialize king attack zone masks */
     init_king_zones();
+
+    /* Initialize line and between masks */
+    init_line_masks();
+
+    /* Initialize tables for detecting upcoming repetitions */
+    key_init_cuckoo();
 }
 
 struct gamestate* create_game_state(void)
@@ -355,6 +401,7 @@ struct gamestate* create_game_state(void)
     board_reset(&state->pos);
     board_start_position(&state->pos);
     state->multipv = 1;
+    state->vote_share = -1;
 
     return state;
 }
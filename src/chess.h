@@ -22,9 +22,11 @@
 #include <stdbool.h>
 #include <time.h>
 #include <setjmp.h>
+#include <stddef.h>
 
 #include "thread.h"
 #include "config.h"
+#include "stats.h"
 
 /* The maximum length of the string representation of a move */
 #define MAX_MOVESTR_LENGTH 7
@@ -222,6 +224,24 @@ enum {
 /* The maximum number of possible plies in the search tree */
 #define MAX_PLY MAX_SEARCH_DEPTH+MAX_QUIESCENCE_DEPTH
 
+/*
+ * Size of the triangular principle variation table. The line at ply p
+ * can hold at most MAX_PLY-p moves.
+ */
+#define PV_TABLE_SIZE (((MAX_PLY)*((MAX_PLY)+1))/2)
+
+/* Offset of the principle variation for a ply in the table */
+#define PV_OFFSET(p) (((p)*(2*(MAX_PLY)+1-(p)))/2)
+
+/*
+ * The number of plies of check information kept by a position. Must
+ * be a power of 2.
+ */
+#define CHECKINFO_SIZE 64
+
+/* Size of the per-worker move stack used by the move selectors */
+#define MOVE_STACK_SIZE ((MAX_PLY)*MAX_MOVES)
+
 /*
  * The material value for pawns. This value is not tuned in order to
  * make sure there is fix base value for all scores.
@@ -267,8 +287,11 @@ struct moveselector {
     uint32_t killer;
     /* Counter move for this position */
     uint32_t counter;
-    /* Additional information for the availables moves */
-    struct moveinfo moveinfo[MAX_MOVES];
+    /*
+     * Additional information for the availables moves. Points into
+     * the move stack of the worker.
+     */
+    struct moveinfo *moveinfo;
     /* Index of the last move plus one */
     int last_idx;
     /* The number of bad tactical moves */
@@ -288,6 +311,60 @@ struct moveselector {
     bool tactical_only;
 };
 
+/*
+ * Check and pin information for a position. It is computed the first
+ * time it is needed at a node (see board_checkinfo) and then reused for
+ * all moves searched from the node.
+ */
+struct checkinfo {
+    /* Flag indicating if the information is up to date */
+    bool valid;
+    /*
+     * The ply the information was computed for. Entries are shared by
+     * plies that are CHECKINFO_SIZE apart so the information is only
+     * used if the ply matches.
+     */
+    int ply;
+    /* Pieces giving check to the side to move */
+    uint64_t checkers;
+    /*
+     * Pieces of either side that are the only piece between the king of
+     * a side and an opponent slider.
+     */
+    uint64_t blockers[NSIDES];
+    /* Opponent sliders pinning a piece of a side to its king */
+    uint64_t pinners[NSIDES];
+    /*
+     * Squares from which a piece of the side to move would give
+     * check. Indexed by piece, only the entries for the side to
+     * move are valid.
+     */
+    uint64_t check_squares[NPIECES];
+};
+
+/*
+ * Attack maps for a position. The maps are stored by the evaluation, or
+ * computed the first time they are needed at a node (see
+ * board_attackinfo), and then reused by the static exchange evaluation
+ * for all moves searched from the node.
+ */
+struct attackinfo {
+    /* Flag indicating if the information is up to date */
+    bool valid;
+    /* The ply the maps were computed for (see struct checkinfo) */
+    int ply;
+    /* Squares attacked by each piece type */
+    uint64_t attacked_by[NPIECES];
+    /* Squares attacked by a side */
+    uint64_t attacked[NSIDES];
+    /*
+     * Squares attacked at least twice by a side. The maps stored by the
+     * evaluation do not include squares attacked by the king and a
+     * single pawn.
+     */
+    uint64_t attacked2[NSIDES];
+};
+
 /* Struct for unmaking a move */
 struct unmake {
     /* The move to unmake */
@@ -306,6 +383,8 @@ struct unmake {
     uint64_t key;
     /* The unique pawn key before the move was made */
     uint64_t pawnkey;
+    /* The material key before the move was made */
+    uint64_t materialkey;
 };
 
 /* An opening book entry */
@@ -319,12 +398,6 @@ struct book_entry {
  * which represents a single position.
  */
 struct tt_item {
-    /*
-     * The key of this position. It is split into two parts in order to
-     * avoid the need for 8-byte alignment of the struct.
-     */
-    uint32_t key_low;
-    uint32_t key_high;
     /* The best move found */
     uint32_t move;
     /*
@@ -345,6 +418,57 @@ struct tt_item {
     uint8_t date;
 };
 
+#ifdef TT_COMPACT
+/*
+ * The compact stored form of a transposition table item, using 10 bytes
+ * per item. Only the upper 16 bits of the position key are stored and
+ * for moves only the from/to squares and the promotion piece are kept.
+ * The move type flags are recovered from the position when the item is
+ * read.
+ */
+struct tt_entry {
+    /* The upper 16 bits of the position key */
+    uint16_t key;
+    /* The best move found, without move type flags */
+    uint16_t move;
+    /* The score for the position */
+    int16_t score;
+    /* The static evaluation of the position */
+    int16_t eval_score;
+    /* The depth to which the position was searched */
+    uint8_t depth;
+    /*
+     * The score type in the lower 2 bits and the time when the
+     * position was stored in the upper 6 bits.
+     */
+    uint8_t genbound;
+};
+#else
+/*
+ * The stored form of a transposition table item. The move, score,
+ * static evaluation, depth and type are packed into a single 64-bit
+ * data word and the check word holds the position key XOR:ed with the
+ * data word. An item is only considered a match if XOR:ing the two words
+ * gives back the key of the position. This means that items that were
+ * torn by concurrent writes from different workers are rejected without
+ * the need for any locking. The words are split into two parts in order
+ * to avoid the need for 8-byte alignment of the struct.
+ */
+struct tt_entry {
+    /* The position key XOR:ed with the data word */
+    uint32_t check_low;
+    uint32_t check_high;
+    /* The packed item data */
+    uint32_t data_low;
+    uint32_t data_high;
+    /*
+     * The time when the position was stored. Only used for replacement
+     * decisions so it is not covered by the check word.
+     */
+    uint8_t date;
+};
+#endif
+
 /* The number of items stored in each transposition table bucket */
 #define TT_BUCKET_SIZE 3
 
@@ -354,12 +478,16 @@ struct tt_item {
  */
 struct tt_bucket {
     /* Items stored in this bucket */
-    struct tt_item items[TT_BUCKET_SIZE];
+    struct tt_entry items[TT_BUCKET_SIZE];
     /*
      * Padding added to make sure that the
      * size of the struct is a power-of-2.
      */
+#ifdef TT_COMPACT
+    uint16_t padding;
+#else
     uint32_t padding;
+#endif
 };
 
 /*
@@ -392,6 +520,18 @@ struct pawntt_item {
     uint8_t padding[24];
 };
 
+/*
+ * An item in the evaluation cache. Only the upper 32 bits of
+ * the position key are stored since the lower bits are used
+ * for indexing the cache.
+ */
+struct evalcache_item {
+    /* The upper 32 bits of the position key */
+    uint32_t key;
+    /* The static evaluation score */
+    int32_t score;
+};
+
 /* Internal representation of a chess position */
 struct position {
     /*
@@ -412,6 +552,16 @@ struct position {
      * the pawns in the current position.
      */
     uint64_t pawnkey;
+    /*
+     * Key that identifies the material (the number of
+     * pieces of each kind) in the current position.
+     */
+    uint64_t materialkey;
+    /*
+     * Material and piece/square table scores for each phase
+     * and side. Updated incrementally when pieces are moved.
+     */
+    int psq[NPHASES][NSIDES];
     /* The en-passant target square */
     int ep_sq;
     /* Castling availability for both sides */
@@ -426,51 +576,61 @@ struct position {
     int fifty;
     /* Fullmove counter */
     int fullmove;
-    /* Game history used for undoing moves */
+    /*
+     * Game history used for undoing moves. All fields above are
+     * copied as a block by board_copy_root.
+     */
     struct unmake history[MAX_HISTORY_SIZE];
     int eval_stack[MAX_HISTORY_SIZE];
+    /*
+     * Check information indexed by ply modulo CHECKINFO_SIZE. The entry
+     * for a ply is invalidated each time a move is made.
+     */
+    struct checkinfo checkinfo[CHECKINFO_SIZE];
+    /* Attack maps, indexed and invalidated in the same way */
+    struct attackinfo attackinfo[CHECKINFO_SIZE];
 
     /* Pointers to the owning worker and the active game state */
     struct search_worker *worker;
     struct gamestate *state;
 
-    /* NNUE data */
+    /* NNUE data, the position at ply start_ply */
     uint8_t start_pieces[NSQUARES];
     int start_side;
+    int start_ply;
     void *nnue_pos;
 };
 
 /* Per-thread worker instance */
 struct search_worker {
-    /* The id of this thread */
+    /*
+     * Data for the worker thread. These fields are initialized by the
+     * thread creating the worker, all other fields are cleared by the
+     * thread owning the worker (see SEARCH_WORKER_DATA_OFFSET).
+     */
     int id;
-    /* The current position */
-    struct position pos;
+    thread_t thread;
+    int action;
+    int numa_node;
+    int cpu;
+#ifdef TIMETRACE
+    struct timetrace_buffer *timetrace;
+#endif
+    event_t start_event;
+    event_t done_event;
+
     /*
-     * Parameter used during the search to keep track of the current
-     * principle variation at a certain depth. After the search the
-     * complete variation can be found in pv_table[0].
+     * Counters that are updated frequently by the worker and read by
+     * other threads during search. They are kept on separate cache
+     * lines from the rest of the worker.
      */
-    struct movelist pv_table[MAX_PLY];
-    /* Tables used for killer move heuristics */
-    uint32_t killer_table[MAX_PLY];
-    /* Table used for counter move heuristics */
-    uint32_t countermove_table[NPIECES][NSQUARES];
-    /* Tables used for history heuristics */
-    int history_table[NPIECES][NSQUARES];
-    int counter_history[NPIECES][NSQUARES][NPIECES][NSQUARES];
-    int follow_history[NPIECES][NSQUARES][NPIECES][NSQUARES];
-    /* Pawn transposition table */
-    struct pawntt_item *pawntt;
-    /* The number of entries in the pawn transposition table */
-    int pawntt_size;
-    /* Indicates if the engine is resolving a fail-low at the root */
-    bool resolving_root_fail;
-    bool resolving_tt_fail;
+    _Alignas(CACHE_LINE_SIZE)
     /* The number of nodes searched so far */
     uint64_t nodes;
     /* The number of quiscence nodes searched so far */
     uint64_t qnodes;
+    /* The number of tablebase hits */
+    uint64_t tbhits;
     /* The current search depth in plies */
     int depth;
     /* The current selective search depth in plies */
@@ -479,8 +639,64 @@ struct search_worker {
     uint32_t currmove;
     /* The number of the move currently being searched (one-based) */
     int currmovenumber;
-    /* The number of tablebase hits */
-    uint64_t tbhits;
+    /* Indicates if the engine is resolving a fail-low at the root */
+    bool resolving_root_fail;
+    bool resolving_tt_fail;
+    /*
+     * Indicates if the worker is searching an alternative to the ponder
+     * move instead of the position being pondered on.
+     */
+    bool ponder_alternative;
+
+    /* The current position */
+    _Alignas(CACHE_LINE_SIZE) struct position pos;
+    /*
+     * Triangular table used during the search to keep track of the
+     * current principle variation at each ply. The line for a ply starts
+     * at PV_OFFSET(ply) and its length is found in pv_length. After the
+     * search the complete variation is found at the start of the table.
+     */
+    uint32_t pv_table[PV_TABLE_SIZE];
+    int pv_length[MAX_PLY+1];
+    /*
+     * Stack holding the moves of the active move selectors, at most one
+     * per ply. The moves for a ply start where the moves for the previous
+     * ply end, and move_stack_end keeps track of where that is. Nodes
+     * without a move selector inherit the end from the previous ply.
+     */
+    struct moveinfo move_stack[MOVE_STACK_SIZE];
+    int move_stack_end[MAX_PLY+1];
+    /* Tables used for killer move heuristics */
+    uint32_t killer_table[MAX_PLY];
+    /* Table used for counter move heuristics */
+    uint32_t countermove_table[NPIECES][NSQUARES];
+    /*
+     * Tables used for history heuristics. The continuation history
+     * tables use 16-bit scores to keep their size down.
+     */
+    int history_table[NPIECES][NSQUARES];
+    int16_t counter_history[NPIECES][NSQUARES][NPIECES][NSQUARES];
+    int16_t follow_history[NPIECES][NSQUARES][NPIECES][NSQUARES];
+    /* Pawn transposition table */
+    struct pawntt_item *pawntt;
+    /* The number of entries in the pawn transposition table */
+    int pawntt_size;
+    /* Evaluation cache */
+    struct evalcache_item *evalcache;
+    /* The number of entries in the evaluation cache */
+    int evalcache_size;
+    /* Evaluation cache statistics */
+    uint64_t evalcache_lookups;
+    uint64_t evalcache_hits;
+    /* Transposition table statistics */
+    uint64_t tt_lookups;
+    uint64_t tt_hits;
+    uint64_t tt_stores;
+    uint64_t tt_overwrites;
+#ifdef STATS
+    /* Detailed search statistics */
+    struct search_stats stats;
+#endif
 
     /* PV information */
     int multipv;
@@ -488,15 +704,26 @@ struct search_worker {
     uint32_t mpv_moves[MAX_MULTIPV_LINES];
     struct pvinfo mpv_lines[MAX_MULTIPV_LINES];
 
-    /* Data for the worker thread */
-    thread_t thread;
-    int action;
+    /*
+     * Information used by the time management. The number of nodes
+     * spent on each root move (indexed by from and to square), the best
+     * move of the previous iteration and a decaying count (in percent)
+     * of how often the best move has changed between iterations.
+     */
+    uint64_t root_nodes[NSQUARES][NSQUARES];
+    uint32_t prev_best_move;
+    int best_move_changes;
+
+    /* Environment used to abort the search */
     jmp_buf env;
 
     /* Pointer to the active game state */
     struct gamestate *state;
 };
 
+/* Offset of the part of struct search_worker owned by the worker thread */
+#define SEARCH_WORKER_DATA_OFFSET offsetof(struct search_worker, nodes)
+
 /* Data structure holding the state of an ongoing game */
 struct gamestate {
     /* The current position */
@@ -528,8 +755,21 @@ struct gamestate {
     uint32_t ponder_move;
     /* Information about the highest completed depth */
     int completed_depth;
+    /*
+     * The share (in percent) of the worker votes that the best move
+     * got, or -1 if the move was not selected by a vote.
+     */
+    int vote_share;
     /* The number of lines to search */
     int multipv;
+    /* The maximum number of nodes to search, or 0 for no limit */
+    uint64_t max_nodes;
+    /*
+     * Flag indicating that the state is searched by a single worker
+     * independently of all other workers. Such searches ignore time
+     * control and input and never stop other workers.
+     */
+    bool standalone;
 };
 
 /* Bitboard mask for each square */
@@ -613,6 +853,19 @@ extern uint64_t front_span[NSIDES][NSQUARES];
  */
 extern uint64_t rear_span[NSIDES][NSQUARES];
 
+/*
+ * Masks of the squares strictly between two squares on the same rank,
+ * file or diagonal. Empty if the squares are not aligned.
+ */
+extern uint64_t between_mask[NSQUARES][NSQUARES];
+
+/*
+ * Masks of the complete line (rank, file or diagonal) through two
+ * squares, including the squares themselves. Empty if the squares are
+ * not aligned.
+ */
+extern uint64_t line_mask[NSQUARES][NSQUARES];
+
 /*
  * Masks for the king zone for all sides/squares. The king zone
  * is defined as illustrated below:
@@ -26,6 +26,9 @@
 /* The name of the log file */
 #define LOGFILE_NAME "marvin.log"
 
+/* The name of the timing trace file (only used by timetrace builds) */
+#define TIMETRACE_FILE_NAME "marvin-trace.json"
+
 /*
  * The size of the main hash tables (in MB). This value
  * can be configured at runtime by using the UCI Hash option.
@@ -35,8 +38,63 @@
 #define MAX_MAIN_HASH_SIZE_32BIT 1024
 #define MAX_MAIN_HASH_SIZE_64BIT 131072
 
-/* The size to use for the pawn hash tables (in MB) */
-#define PAWN_HASH_SIZE 2
+/*
+ * The size to use for the pawn hash tables (in MB). This value
+ * can be configured at runtime by using the UCI PawnHash option.
+ */
+#define DEFAULT_PAWN_HASH_SIZE 2
+#define MIN_PAWN_HASH_SIZE 1
+#define MAX_PAWN_HASH_SIZE 256
+
+/* The size to use for the shared material table (in MB) */
+#define MATERIAL_HASH_SIZE 1
+
+/* The size to use for the evaluation caches (in MB) */
+#define EVAL_CACHE_SIZE 1
+
+#define TB_CACHE_SIZE 8
+
+/*
+ * The maximum number of nodes per millisecond that can be configured
+ * for the nodestime mode. A value of zero disables the mode. The value
+ * can be configured at runtime by using the UCI NodesTime option.
+ */
+#define MAX_NODES_TIME 100000
+
+/*
+ * The default and maximum move overhead (in milliseconds). The overhead
+ * is the time lost on each move outside of the engine, for instance due
+ * to network latency. It can be configured at runtime by using the UCI
+ * MoveOverhead option.
+ */
+#define DEFAULT_MOVE_OVERHEAD 50
+#define MAX_MOVE_OVERHEAD 5000
+
+/*
+ * The maximum number of alternative opponent replies that can be
+ * searched by helpers while pondering. The number can be configured
+ * at runtime by using the UCI WidePonder option.
+ */
+#define MAX_WIDE_PONDER_MOVES 8
+
+/*
+ * The default and maximum minimum interval (in milliseconds) between
+ * information updates sent during search. A value of zero sends all
+ * updates. The interval can be configured at runtime by using the UCI
+ * InfoInterval option.
+ */
+#define DEFAULT_INFO_INTERVAL 0
+#define MAX_INFO_INTERVAL 5000
+
+/*
+ * The maximum memory limit (in MB). The limit caps the total memory used
+ * by the engine and a value of zero means no limit. It can be configured
+ * at runtime by using the UCI MemoryLimit option.
+ */
+#define MAX_MEMORY_LIMIT 1048576
+
+/* The cache line size */
+#define CACHE_LINE_SIZE 64
 
 /* The maximum number of supported worker threads */
 #define MAX_WORKERS 512
@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "debug.h"
 #include "bitboard.h"
@@ -30,6 +32,7 @@
 #include "movegen.h"
 #include "board.h"
 #include "thread.h"
+#include "engine.h"
 
 /* Pointer to log file. */
 static FILE *logfp = NULL;
@@ -37,8 +40,105 @@ static FILE *logfp = NULL;
 /* The log level */
 static int log_level = 0;
 
-/* Lock for synchronizing log file writes */
-static mutex_t log_lock;
+/*
+ * Messages are not written to the log file by the logging thread.
+ * Instead they are put in a lock-free queue that is drained by a
+ * dedicated logger thread, so that search threads never wait for
+ * file I/O. The queue is a bounded multi-producer queue where each
+ * slot has a sequence number telling if it is free or holds a message.
+ * Messages are written in the order they were queued and each line is
+ * prefixed with the time the message was logged. If the queue is full
+ * the message is dropped and the number of dropped messages is reported
+ * in the log instead.
+ */
+#define LOG_QUEUE_SIZE 1024
+#define LOG_MESSAGE_SIZE 1024
+#define LOG_DRAIN_INTERVAL 10
+
+struct log_slot {
+    atomic_size_t seq;
+    time_t        time;
+    char          text[LOG_MESSAGE_SIZE];
+};
+
+static struct log_slot log_queue[LOG_QUEUE_SIZE];
+static atomic_size_t log_tail;
+static size_t log_head;
+static atomic_uint log_dropped;
+
+/* Data for the logger thread */
+static thread_t logger_thread;
+static event_t logger_event;
+static atomic_bool logger_exit;
+static bool at_line_start = true;
+
+static void write_log_message(struct log_slot *slot)
+{
+    struct tm *tm;
+    time_t    secs;
+    char      *iter;
+    char      *end;
+
+    /* Prefix each new line with the time the message was logged */
+    secs = slot->time/1000;
+    tm = localtime(&secs);
+    iter = slot->text;
+    while (*iter != '\0') {
+        if (at_line_start && (tm != NULL)) {
+            fprintf(logfp, "%02d:%02d:%02d.%03d ", tm->tm_hour, tm->tm_min,
+                    tm->tm_sec, (int)(slot->time%1000));
+        }
+        end = strchr(iter, '\n');
+        if (end == NULL) {
+            fputs(iter, logfp);
+            at_line_start = false;
+            break;
+        }
+        fwrite(iter, 1, end-iter+1, logfp);
+        at_line_start = true;
+        iter = end + 1;
+    }
+}
+
+/* Write all queued messages to the log file */
+static void drain_log_queue(void)
+{
+    struct log_slot *slot;
+    unsigned int    dropped;
+
+    while (true) {
+        slot = &log_queue[log_head&(LOG_QUEUE_SIZE-1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+            (log_head+1)) {
+            break;
+        }
+        write_log_message(slot);
+        atomic_store_explicit(&slot->seq, log_head+LOG_QUEUE_SIZE,
+                              memory_order_release);
+        log_head++;
+    }
+
+    dropped = atomic_exchange(&log_dropped, 0);
+    if (dropped > 0) {
+        fprintf(logfp, "%s%u log messages dropped\n",
+                at_line_start?"":"\n", dropped);
+        at_line_start = true;
+    }
+    fflush(logfp);
+}
+
+static thread_retval_t logger_thread_func(void *data)
+{
+    (void)data;
+
+    while (!atomic_load(&logger_exit)) {
+        (void)event_wait_timeout(&logger_event, LOG_DRAIN_INTERVAL);
+        drain_log_queue();
+    }
+    drain_log_queue();
+
+    return (thread_retval_t)0;
+}
 
 static bool browse_display_move(struct position *pos, uint32_t move, int id,
                                 bool pv, int current_score)
@@ -133,9 +233,10 @@ static void browse_display_position(struct position *pos,
 
 void dbg_set_log_level(int level)
 {
-    char path[256];
-    char *home;
+    char   path[256];
+    char   *home;
     time_t t;
+    int    k;
 
     assert(logfp == NULL);
 
@@ -152,9 +253,6 @@ void dbg_set_log_level(int level)
         return;
     }
 
-    /* Initialize lock */
-    mutex_init(&log_lock);
-
     /*
      * Open the log file. First try to open the it in the current
      * working directory. If that fails use the users home directory.
@@ -167,13 +265,26 @@ void dbg_set_log_level(int level)
             logfp = fopen(path, "a");
         }
     }
-    if (logfp != NULL) {
-        setbuf(logfp, NULL);
+    if (logfp == NULL) {
+        return;
     }
 
     /* Write a timestamp to the log */
     t = time(NULL);
     fprintf(logfp, "\n%s\n", ctime(&t));
+    fflush(logfp);
+
+    /* Start the logger thread with an empty queue */
+    for (k=0;k<LOG_QUEUE_SIZE;k++) {
+        atomic_init(&log_queue[k].seq, k);
+    }
+    atomic_init(&log_tail, 0);
+    log_head = 0;
+    atomic_init(&log_dropped, 0);
+    atomic_init(&logger_exit, false);
+    at_line_start = true;
+    event_init(&logger_event);
+    thread_create(&logger_thread, (thread_func_t)logger_thread_func, NULL);
 }
 
 int dbg_get_log_level(void)
@@ -184,15 +295,22 @@ int dbg_get_log_level(void)
 void dbg_log_close(void)
 {
     if (logfp != NULL) {
+        atomic_store(&logger_exit, true);
+        event_set(&logger_event);
+        thread_join(&logger_thread);
+        event_destroy(&logger_event);
         fclose(logfp);
         logfp = NULL;
-        mutex_destroy(&log_lock);
     }
 }
 
 void dbg_log_info(int level, char *fmt, ...)
 {
-    va_list ap;
+    va_list         ap;
+    struct log_slot *slot;
+    size_t          pos;
+    size_t          seq;
+    int             len;
 
     assert(fmt != NULL);
 
@@ -200,13 +318,34 @@ void dbg_log_info(int level, char *fmt, ...)
         return;
     }
 
-    mutex_lock(&log_lock);
+    /* Claim the next free slot in the queue */
+    pos = atomic_load_explicit(&log_tail, memory_order_relaxed);
+    while (true) {
+        slot = &log_queue[pos&(LOG_QUEUE_SIZE-1)];
+        seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&log_tail, &pos, pos+1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (seq < pos) {
+            atomic_fetch_add(&log_dropped, 1);
+            return;
+        } else {
+            pos = atomic_load_explicit(&log_tail, memory_order_relaxed);
+        }
+    }
 
+    /* Fill in the message and hand the slot over to the logger thread */
+    slot->time = get_current_time();
     va_start(ap, fmt);
-    vfprintf(logfp, fmt, ap);
+    len = vsnprintf(slot->text, LOG_MESSAGE_SIZE, fmt, ap);
     va_end(ap);
-
-    mutex_unlock(&log_lock);
+    if (len >= LOG_MESSAGE_SIZE) {
+        slot->text[LOG_MESSAGE_SIZE-2] = '\n';
+    }
+    atomic_store_explicit(&slot->seq, pos+1, memory_order_release);
 }
 
 void dbg_print_board(struct position *pos)
@@ -286,7 +425,7 @@ void dbg_browse_transposition_table(struct position *pos)
 {
     bool            stop;
     int             depth;
-    char            buffer[10];
+    char            *cmd;
     int             id;
     struct movelist list;
     bool            leafnodes[MAX_MOVES];
@@ -303,19 +442,20 @@ void dbg_browse_transposition_table(struct position *pos)
         }
         printf("Enter command: ");
 
-        if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
+        cmd = engine_read_command();
+        if (cmd == NULL) {
             return;
         }
 
-        if (!strncmp(buffer, "q", 1)) {
+        if (!strncmp(cmd, "q", 1)) {
             stop = true;
-        } else if (!strncmp(buffer, "u", 1)) {
+        } else if (!strncmp(cmd, "u", 1)) {
             if (depth > 0) {
                 depth--;
                 board_unmake_move(pos);
             }
         } else {
-            if ((sscanf(buffer, "%d", &id) == 1) && (id <= list.size) &&
+            if ((sscanf(cmd, "%d", &id) == 1) && (id <= list.size) &&
                 leafnodes[id-1]) {
                 depth++;
                 board_make_move(pos, list.moves[id-1]);
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #include "engine.h"
 #include "uci.h"
@@ -36,6 +37,14 @@
 #include "thread.h"
 #include "smp.h"
 #include "board.h"
+#include "bitboard.h"
+#include "hash.h"
+#include "fen.h"
+#include "nnue.h"
+#include "selfplay.h"
+#include "sfen.h"
+#include "tbprobe.h"
+#include "tbprefetch.h"
 
 /* Size of the receive buffer */
 #define RX_BUFFER_SIZE 4096
@@ -43,6 +52,19 @@
 /* Size of the transmit buffer */
 #define TX_BUFFER_SIZE 4096
 
+/* Size of the buffer used for batching output */
+#define OUTPUT_BUFFER_SIZE 16384
+
+/* A resource being loaded by a background thread */
+struct load_task {
+    thread_t thread;
+    bool     running;
+    bool     result;
+    char     path[MAX_PATH_LENGTH+1];
+    bool     use_index;
+    int      warmup;
+};
+
 /* Global engine variables */
 enum protocol engine_protocol = PROTOCOL_UNSPECIFIED;
 char engine_syzygy_path[MAX_PATH_LENGTH+1] = {'\0'};
@@ -50,6 +72,8 @@ int engine_default_hash_size = DEFAULT_MAIN_HASH_SIZE;
 int engine_default_num_threads = 1;
 bool engine_using_nnue = false;
 char engine_eval_file[MAX_PATH_LENGTH+1] = {'\0'};
+int engine_info_interval = DEFAULT_INFO_INTERVAL;
+int engine_memory_limit = 0;
 
 /* Buffer used for receiving commands */
 static char rx_buffer[RX_BUFFER_SIZE+1];
@@ -66,6 +90,179 @@ static char pending_cmd_buffer[RX_BUFFER_SIZE+1];
 /* Lock used to synchronize command output */
 static mutex_t tx_lock;
 
+/*
+ * Output waiting to be sent. Information sent during search is collected
+ * here so that several lines can be written at once.
+ */
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static int output_length = 0;
+
+/*
+ * The time when the last principle variation and the last other search
+ * update were sent, and a flag indicating if a principle variation update
+ * has been held back since then. Principle variations are timed separately
+ * so that frequent updates of other kinds can not hold them back.
+ */
+static time_t last_pv_info_time = 0;
+static time_t last_info_time = 0;
+static bool pv_info_pending = false;
+
+/* The number of commands that can be queued by the input thread */
+#define INPUT_QUEUE_SIZE 64
+
+/*
+ * Commands read from stdin by the input thread. The input event is set
+ * whenever a command is queued and the space event whenever a command
+ * is removed from the queue.
+ */
+static char input_queue[INPUT_QUEUE_SIZE][RX_BUFFER_SIZE+1];
+static int input_head = 0;
+static int input_count = 0;
+static bool input_eof = false;
+static mutex_t input_lock;
+static event_t input_event;
+static event_t input_space_event;
+static thread_t input_thread;
+
+/*
+ * Tablebases, network and opening book are loaded in the background so
+ * that the GUI gets answers to the protocol handshake right away. Only
+ * the main thread starts and waits for loading.
+ */
+static struct load_task tablebase_task;
+static struct load_task network_task;
+static struct load_task book_task;
+
+/* Data for the batch command */
+struct batch_info {
+    FILE     *infp;
+    FILE     *outfp;
+    int      depth;
+    uint64_t nodes;
+    int      npositions;
+};
+
+static bool batch_next(struct gamestate *state, void *data)
+{
+    struct batch_info *info = data;
+    char              line[FEN_MAX_LENGTH+1];
+    char              *iter;
+
+    while (fgets(line, sizeof(line), info->infp) != NULL) {
+        iter = strpbrk(line, "\r\n");
+        if (iter != NULL) {
+            *iter = '\0';
+        }
+        iter = skip_whitespace(line);
+        if ((*iter == '\0') || !board_setup_from_fen(&state->pos, iter)) {
+            continue;
+        }
+
+        state->sd = info->depth;
+        state->max_nodes = info->nodes;
+        return true;
+    }
+
+    return false;
+}
+
+static void batch_done(struct gamestate *state, struct pvinfo *line,
+                       void *data)
+{
+    struct batch_info *info = data;
+    char              fenstr[FEN_MAX_LENGTH];
+    char              movestr[MAX_MOVESTR_LENGTH];
+    int               k;
+
+    fen_build_string(&state->pos, fenstr);
+    fprintf(info->outfp, "%s; bestmove ", fenstr);
+    if (state->best_move != NOMOVE) {
+        move2str(state->best_move, movestr);
+        fprintf(info->outfp, "%s", movestr);
+    } else {
+        fprintf(info->outfp, "none");
+    }
+    fprintf(info->outfp, "; score %d; depth %d; pv", line->score,
+            line->depth);
+    for (k=0;k<line->pv.size;k++) {
+        move2str(line->pv.moves[k], movestr);
+        fprintf(info->outfp, " %s", movestr);
+    }
+    fprintf(info->outfp, "\n");
+    fflush(info->outfp);
+
+    info->npositions++;
+}
+
+/*
+ * Custom command
+ * Syntax: batch <infile> <outfile> [depth <depth>] [nodes <nodes>]
+ *
+ * Searches all positions in <infile>, one FEN string per line, and writes
+ * the result for each position to <outfile>. Each worker thread searches
+ * its own position.
+ */
+static void cmd_batch(char *cmd)
+{
+    struct batch_info info;
+    char              infile[MAX_PATH_LENGTH+1];
+    char              outfile[MAX_PATH_LENGTH+1];
+    char              *iter;
+    char              *limits;
+    uint64_t          nodes;
+    int               depth;
+    int               len;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        printf("Usage: batch <infile> <outfile> [depth <d>] [nodes <n>]\n");
+        return;
+    }
+    iter = skip_whitespace(iter);
+    if (sscanf(iter, "%1024s %1024s%n", infile, outfile, &len) != 2) {
+        printf("Usage: batch <infile> <outfile> [depth <d>] [nodes <n>]\n");
+        return;
+    }
+
+    /* Parse search limits */
+    info.depth = MAX_SEARCH_DEPTH;
+    info.nodes = 0ULL;
+    limits = iter + len;
+    iter = strstr(limits, "depth");
+    if ((iter != NULL) && (sscanf(iter, "depth %d", &depth) == 1) &&
+        (depth > 0)) {
+        info.depth = MIN(depth, MAX_SEARCH_DEPTH);
+    }
+    iter = strstr(limits, "nodes");
+    if ((iter != NULL) && (sscanf(iter, "nodes %"PRIu64"", &nodes) == 1)) {
+        info.nodes = nodes;
+    }
+    if ((info.depth == MAX_SEARCH_DEPTH) && (info.nodes == 0ULL)) {
+        printf("A depth or node limit is required\n");
+        return;
+    }
+
+    info.infp = fopen(infile, "r");
+    if (info.infp == NULL) {
+        printf("Failed to open %s\n", infile);
+        return;
+    }
+    info.outfp = fopen(outfile, "w");
+    if (info.outfp == NULL) {
+        printf("Failed to open %s\n", outfile);
+        fclose(info.infp);
+        return;
+    }
+    info.npositions = 0;
+
+    tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
+    smp_search_batch(batch_next, batch_done, &info);
+
+    fclose(info.infp);
+    fclose(info.outfp);
+    printf("Searched %d positions\n", info.npositions);
+}
+
 /*
  * Custom command
  * Syntax: browse
@@ -75,6 +272,73 @@ static void cmd_browse(struct gamestate *state)
     dbg_browse_transposition_table(&state->pos);
 }
 
+/*
+ * Custom command
+ * Syntax: convert <infile> <outfile> [compress]
+ *
+ * Converts a file with training records (see sfen.h). Both plain and
+ * compressed input files are handled. The output is compressed if
+ * the compress option is given.
+ */
+static void cmd_convert(char *cmd)
+{
+    struct sfen_reader *reader;
+    struct sfen_writer *writer;
+    struct sfen_record record;
+    char               infile[MAX_PATH_LENGTH+1];
+    char               outfile[MAX_PATH_LENGTH+1];
+    char               *iter;
+    FILE               *infp;
+    FILE               *outfp;
+    uint64_t           nrecords;
+    int                len;
+    bool               ok;
+
+    iter = strchr(cmd, ' ');
+    if ((iter == NULL) ||
+        (sscanf(skip_whitespace(iter), "%1024s %1024s%n", infile, outfile,
+                &len) != 2)) {
+        printf("Usage: convert <infile> <outfile> [compress]\n");
+        return;
+    }
+    iter = skip_whitespace(iter) + len;
+
+    infp = fopen(infile, "rb");
+    if (infp == NULL) {
+        printf("Failed to open %s\n", infile);
+        return;
+    }
+    outfp = fopen(outfile, "wb");
+    if (outfp == NULL) {
+        printf("Failed to open %s\n", outfile);
+        fclose(infp);
+        return;
+    }
+
+    reader = sfen_reader_create(infp);
+    writer = sfen_writer_create(outfp, strstr(iter, "compress") != NULL);
+    nrecords = 0ULL;
+    ok = (reader != NULL) && (writer != NULL);
+    while (ok && sfen_reader_read(reader, &record)) {
+        ok = sfen_writer_write(writer, &record);
+        nrecords++;
+    }
+    if (reader != NULL) {
+        sfen_reader_destroy(reader);
+    }
+    if (writer != NULL) {
+        ok = sfen_writer_destroy(writer) && ok;
+    }
+
+    fclose(infp);
+    fclose(outfp);
+    if (ok) {
+        printf("Converted %"PRIu64" records\n", nrecords);
+    } else {
+        printf("Failed to convert %s\n", infile);
+    }
+}
+
 /*
  * Custom command
  * Syntax: display
@@ -86,11 +350,12 @@ static void cmd_display(struct gamestate *state)
 
 /*
  * Custom command
- * Syntax: divide <depth>
+ * Syntax: divide <depth> [<hash size in MB>]
  */
 static void cmd_divide(char *cmd, struct gamestate *state)
 {
     int  depth;
+    int  hash_size;
     char *iter;
 
     iter = strchr(cmd, ' ');
@@ -99,11 +364,15 @@ static void cmd_divide(char *cmd, struct gamestate *state)
     }
     iter++;
 
-    if (sscanf(iter, "%d", &depth) != 1) {
+    hash_size = 0;
+    if (sscanf(iter, "%d %d", &depth, &hash_size) < 1) {
+        return;
+    }
+    if ((depth < 1) || (hash_size < 0)) {
         return;
     }
 
-    test_run_divide(&state->pos, depth);
+    test_run_divide(&state->pos, depth, hash_size);
 }
 
 /*
@@ -129,11 +398,318 @@ static void cmd_eval(struct gamestate *state)
 
 /*
  * Custom command
- * Syntax: perft <depth>
+ * Syntax: hashstats
+ *
+ * Reports how the main transposition table was used during the latest
+ * search. A high overwrite rate indicates that a larger table would help.
+ */
+static void cmd_hashstats(void)
+{
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stores;
+    uint64_t overwrites;
+
+    smp_tt_stats(&lookups, &hits, &stores, &overwrites);
+
+    printf("Size: %d MB\n", hash_tt_size());
+    printf("Policy: %s\n",
+           (hash_tt_policy() == TT_POLICY_ANALYSIS)?"analysis":"game");
+    printf("Usage: %.1f%%\n", hash_tt_usage()/10.0);
+    printf("Lookups: %"PRIu64"\n", lookups);
+    printf("Hits: %"PRIu64" (%.1f%%)\n", hits,
+           (lookups > 0)?(hits*100.0)/lookups:0.0);
+    printf("Misses: %"PRIu64"\n", lookups - hits);
+    printf("Stores: %"PRIu64"\n", stores);
+    printf("Overwrites: %"PRIu64" (%.1f%%)\n", overwrites,
+           (stores > 0)?(overwrites*100.0)/stores:0.0);
+}
+
+/*
+ * Custom command
+ * Syntax: loadhash <file>
+ *
+ * The size of the loaded table becomes the value of the Hash option,
+ * and is reported as its default from then on.
+ */
+static void cmd_loadhash(char *cmd)
+{
+    char *iter;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        return;
+    }
+    iter = skip_whitespace(iter);
+
+    if (hash_tt_load(iter)) {
+        engine_default_hash_size = MAX(hash_tt_size(), MIN_MAIN_HASH_SIZE);
+        printf("Loaded %d MB transposition table from %s\n", hash_tt_size(),
+               iter);
+    } else {
+        printf("Failed to load transposition table from %s\n", iter);
+    }
+}
+
+/*
+ * Custom command
+ * Syntax: makebook <pgnfile> <bookfile> [maxply <n>] [mingames <n>]
+ *                  [memory <mb>]
+ *
+ * Builds an opening book in Polyglot format from the games in <pgnfile>.
+ * The games are parsed using all worker threads.
+ */
+static void cmd_makebook(char *cmd)
+{
+    struct polybook_build_options options;
+    char                          pgnfile[MAX_PATH_LENGTH+1];
+    char                          bookfile[MAX_PATH_LENGTH+1];
+    char                          *iter;
+    char                          *limits;
+    uint64_t                      ngames;
+    uint64_t                      nentries;
+    int                           value;
+    int                           len;
+
+    polybook_init_build_options(&options);
+    iter = strchr(cmd, ' ');
+    if ((iter == NULL) ||
+        (sscanf(skip_whitespace(iter), "%1024s %1024s%n", pgnfile, bookfile,
+                &len) != 2)) {
+        printf("Usage: makebook <pgnfile> <bookfile> [maxply <n>] "
+               "[mingames <n>] [memory <mb>]\n");
+        return;
+    }
+    limits = skip_whitespace(iter) + len;
+
+    /* Parse options */
+    iter = strstr(limits, "maxply");
+    if ((iter != NULL) && (sscanf(iter, "maxply %d", &value) == 1) &&
+        (value > 0)) {
+        options.maxply = value;
+    }
+    iter = strstr(limits, "mingames");
+    if ((iter != NULL) && (sscanf(iter, "mingames %d", &value) == 1) &&
+        (value > 0)) {
+        options.mingames = value;
+    }
+    iter = strstr(limits, "memory");
+    if ((iter != NULL) && (sscanf(iter, "memory %d", &value) == 1) &&
+        (value > 0)) {
+        options.memory = value;
+    }
+    options.nthreads = smp_number_of_workers();
+
+    if (polybook_build(pgnfile, bookfile, &options, &ngames, &nentries)) {
+        printf("Added %"PRIu64" games, wrote %"PRIu64" entries\n", ngames,
+               nentries);
+    } else {
+        printf("Failed to build %s\n", bookfile);
+    }
+}
+
+static void print_memory(char *name, uint64_t size)
+{
+    printf("%-24s %10.1f MB\n", name, size/(1024.0*1024.0));
+}
+
+/*
+ * Custom command
+ * Syntax: memusage
+ *
+ * Reports the memory used by each part of the engine. Memory mapped
+ * files are listed separately since they are shared between processes.
+ */
+static void cmd_memusage(struct gamestate *state)
+{
+    char     name[32];
+    uint64_t workers;
+    uint64_t pawntt;
+    uint64_t evalcache;
+    uint64_t nnue;
+    uint64_t network;
+    uint64_t network_mapped;
+    uint64_t book;
+    uint64_t book_mapped;
+    uint64_t gamestate;
+    uint64_t total;
+
+    smp_memory_usage(&workers, &pawntt, &evalcache, &nnue);
+    network = nnue_network_memory(&network_mapped);
+    book = polybook_memory(&book_mapped);
+    gamestate = sizeof(struct gamestate);
+    if (state->pos.nnue_pos != NULL) {
+        gamestate += nnue_pos_memory(state->pos.nnue_pos);
+    }
+    total = engine_memory_usage(state);
+
+    print_memory("Transposition table", hash_tt_memory());
+    sprintf(name, "Search workers (%d)", smp_number_of_workers());
+    print_memory(name, workers);
+    print_memory("Pawn hash tables", pawntt);
+    print_memory("Evaluation caches", evalcache);
+    print_memory("NNUE positions", nnue);
+    print_memory("NNUE network", network);
+    print_memory("Material table", hash_material_memory());
+    print_memory("Tablebase cache", hash_tbcache_memory());
+    print_memory("Opening book index", book);
+    print_memory("Game state", gamestate);
+    print_memory("Total", total);
+    printf("\n");
+    print_memory("Mapped network", network_mapped);
+    print_memory("Mapped opening book", book_mapped);
+    print_memory("Attack tables", bb_tables_memory());
+    printf("\n");
+    if ((engine_memory_limit > 0) &&
+        (total > engine_memory_limit*1024ULL*1024ULL)) {
+        printf("Memory limit: %d MB (exceeded by %.1f MB)\n",
+               engine_memory_limit,
+               (total-engine_memory_limit*1024ULL*1024ULL)/(1024.0*1024.0));
+    } else if (engine_memory_limit > 0) {
+        printf("Memory limit: %d MB\n", engine_memory_limit);
+    } else {
+        printf("Memory limit: none\n");
+    }
+}
+
+/*
+ * Custom command
+ * Syntax: mergehash <file>
+ */
+static void cmd_mergehash(char *cmd)
+{
+    char *iter;
+    int  nmerged;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        return;
+    }
+    iter = skip_whitespace(iter);
+
+    nmerged = hash_tt_merge(iter);
+    if (nmerged >= 0) {
+        printf("Merged %d items from %s\n", nmerged, iter);
+    } else {
+        printf("Failed to merge transposition table items from %s\n", iter);
+    }
+}
+
+/* Number of positions evaluated together by the nnue command */
+#define NNUE_BATCH_SIZE 256
+
+/* Data for the nnue command */
+struct nnue_batch {
+    struct position pos;
+    void            *nnue_pos[NNUE_BATCH_SIZE];
+    int             scores[NNUE_BATCH_SIZE];
+    char            fens[NNUE_BATCH_SIZE][FEN_MAX_LENGTH+1];
+};
+
+/*
+ * Custom command
+ * Syntax: nnue <infile> <outfile>
+ *
+ * Evaluates all positions in <infile>, one FEN string per line, with the
+ * NNUE network and writes the scores, from the point of view of the side
+ * to move, to <outfile>. The positions are evaluated in batches.
+ */
+static void cmd_nnue(char *cmd)
+{
+    struct nnue_batch *batch;
+    char              infile[MAX_PATH_LENGTH+1];
+    char              outfile[MAX_PATH_LENGTH+1];
+    char              line[FEN_MAX_LENGTH+1];
+    char              *iter;
+    FILE              *infp;
+    FILE              *outfp;
+    time_t            start;
+    time_t            elapsed;
+    int               npositions;
+    int               n;
+    int               k;
+
+    iter = strchr(cmd, ' ');
+    if ((iter == NULL) ||
+        (sscanf(skip_whitespace(iter), "%1024s %1024s", infile, outfile) != 2)) {
+        printf("Usage: nnue <infile> <outfile>\n");
+        return;
+    }
+    if (!engine_using_nnue) {
+        printf("No network loaded\n");
+        return;
+    }
+
+    infp = fopen(infile, "r");
+    if (infp == NULL) {
+        printf("Failed to open %s\n", infile);
+        return;
+    }
+    outfp = fopen(outfile, "w");
+    if (outfp == NULL) {
+        printf("Failed to open %s\n", outfile);
+        fclose(infp);
+        return;
+    }
+    batch = malloc(sizeof(struct nnue_batch));
+    memset(&batch->pos, 0, sizeof(struct position));
+    for (k=0;k<NNUE_BATCH_SIZE;k++) {
+        batch->nnue_pos[k] = nnue_create_pos();
+    }
+
+    start = get_current_time();
+    npositions = 0;
+    n = 0;
+    while (true) {
+        /* Collect a batch of positions */
+        iter = fgets(line, sizeof(line), infp);
+        if (iter != NULL) {
+            iter = strpbrk(line, "\r\n");
+            if (iter != NULL) {
+                *iter = '\0';
+            }
+            iter = skip_whitespace(line);
+            batch->pos.nnue_pos = batch->nnue_pos[n];
+            if ((*iter == '\0') || !board_setup_from_fen(&batch->pos, iter)) {
+                continue;
+            }
+            strcpy(batch->fens[n], iter);
+            n++;
+            if (n < NNUE_BATCH_SIZE) {
+                continue;
+            }
+        }
+
+        /* Evaluate the batch */
+        nnue_evaluate_batch(batch->nnue_pos, n, batch->scores);
+        for (k=0;k<n;k++) {
+            fprintf(outfp, "%s; score %d\n", batch->fens[k], batch->scores[k]);
+        }
+        npositions += n;
+        n = 0;
+        if (iter == NULL) {
+            break;
+        }
+    }
+    elapsed = get_current_time() - start;
+
+    for (k=0;k<NNUE_BATCH_SIZE;k++) {
+        nnue_destroy_pos(batch->nnue_pos[k]);
+    }
+    free(batch);
+    fclose(infp);
+    fclose(outfp);
+    printf("Evaluated %d positions in %d ms\n", npositions, (int)elapsed);
+}
+
+/*
+ * Custom command
+ * Syntax: perft <depth> [<hash size in MB>]
  */
 static void cmd_perft(char *cmd, struct gamestate *state)
 {
     int  depth;
+    int  hash_size;
     char *iter;
 
     iter = strchr(cmd, ' ');
@@ -142,23 +718,392 @@ static void cmd_perft(char *cmd, struct gamestate *state)
     }
     iter++;
 
-    if (sscanf(iter, "%d", &depth) != 1) {
+    hash_size = 0;
+    if (sscanf(iter, "%d %d", &depth, &hash_size) < 1) {
+        return;
+    }
+    if ((depth < 1) || (hash_size < 0)) {
+        return;
+    }
+
+    test_run_perft(&state->pos, depth, hash_size);
+}
+
+/*
+ * Custom command
+ * Syntax: savehash <file>
+ */
+static void cmd_savehash(char *cmd)
+{
+    char *iter;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        return;
+    }
+    iter = skip_whitespace(iter);
+
+    if (hash_tt_save(iter)) {
+        printf("Saved transposition table to %s\n", iter);
+    } else {
+        printf("Failed to save transposition table to %s\n", iter);
+    }
+}
+
+/*
+ * Custom command
+ * Syntax: savenet <file> [compact]
+ *
+ * Saves the current network in the memory mapped format. With compact
+ * the weights of the feature transformer are quantized to 8 bits.
+ */
+static void cmd_savenet(char *cmd)
+{
+    char     file[MAX_PATH_LENGTH+1];
+    char     *iter;
+    uint64_t nsaturated;
+    bool     compact;
+    int      len;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        return;
+    }
+    iter = skip_whitespace(iter);
+    if (sscanf(iter, "%1024s%n", file, &len) != 1) {
+        return;
+    }
+    compact = strstr(iter+len, "compact") != NULL;
+
+    if (nnue_save_eval_file(file, compact, &nsaturated)) {
+        printf("Saved mappable network to %s\n", file);
+        if (nsaturated > 0) {
+            printf("%"PRIu64" weights saturated by quantization\n",
+                   nsaturated);
+        }
+    } else {
+        printf("Failed to save network to %s\n", file);
+    }
+}
+
+/*
+ * Custom command
+ * Syntax: selfplay <outfile> <ngames> [depth <d>] [nodes <n>] [random <r>]
+ *                  [evallimit <e>] [compress]
+ *
+ * Generates training data by letting the engine play <ngames> games
+ * against itself. The games are played concurrently, one per worker
+ * thread, and all searched positions are written to <outfile> as packed
+ * training records, optionally compressed.
+ */
+static void cmd_selfplay(char *cmd)
+{
+    struct selfplay_options options;
+    char                    outfile[MAX_PATH_LENGTH+1];
+    char                    *iter;
+    char                    *limits;
+    FILE                    *fp;
+    uint64_t                nodes;
+    uint64_t                npositions;
+    int                     value;
+    int                     len;
+
+    selfplay_init_options(&options);
+    iter = strchr(cmd, ' ');
+    if ((iter == NULL) ||
+        (sscanf(skip_whitespace(iter), "%1024s %d%n", outfile,
+                &options.ngames, &len) != 2) ||
+        (options.ngames <= 0)) {
+        printf("Usage: selfplay <outfile> <ngames> [depth <d>] [nodes <n>] "
+               "[random <r>] [evallimit <e>] [compress]\n");
+        return;
+    }
+    limits = skip_whitespace(iter) + len;
+
+    /* Parse options */
+    iter = strstr(limits, "depth");
+    if ((iter != NULL) && (sscanf(iter, "depth %d", &value) == 1) &&
+        (value > 0)) {
+        options.depth = MIN(value, MAX_SEARCH_DEPTH);
+    }
+    iter = strstr(limits, "nodes");
+    if ((iter != NULL) && (sscanf(iter, "nodes %"PRIu64"", &nodes) == 1)) {
+        options.nodes = nodes;
+        if (strstr(limits, "depth") == NULL) {
+            options.depth = MAX_SEARCH_DEPTH;
+        }
+    }
+    iter = strstr(limits, "random");
+    if ((iter != NULL) && (sscanf(iter, "random %d", &value) == 1) &&
+        (value >= 0)) {
+        options.random_plies = value;
+    }
+    iter = strstr(limits, "evallimit");
+    if ((iter != NULL) && (sscanf(iter, "evallimit %d", &value) == 1) &&
+        (value > 0)) {
+        options.eval_limit = value;
+    }
+    options.compress = strstr(limits, "compress") != NULL;
+    options.nthreads = smp_number_of_workers();
+
+    fp = fopen(outfile, "wb");
+    if (fp == NULL) {
+        printf("Failed to open %s\n", outfile);
         return;
     }
 
-    test_run_perft(&state->pos, depth);
+    tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
+    npositions = selfplay_run(fp, &options);
+
+    fclose(fp);
+    printf("Played %d games, wrote %"PRIu64" positions\n", options.ngames,
+           npositions);
 }
 
 /*
  * Custom command
- * Syntax: quiet
+ * Syntax: sharehash <file> [mindepth]
+ *
+ * Writes all transposition table items searched to at least mindepth
+ * (default 8) to a file that can be merged by other engine instances
+ * with the mergehash command.
+ */
+static void cmd_sharehash(char *cmd)
+{
+    char file[MAX_PATH_LENGTH+1];
+    char *iter;
+    int  min_depth;
+    int  nshared;
+    int  len;
+
+    iter = strchr(cmd, ' ');
+    if (iter == NULL) {
+        return;
+    }
+    iter = skip_whitespace(iter);
+    if (sscanf(iter, "%1024s%n", file, &len) != 1) {
+        return;
+    }
+    if (sscanf(iter+len, "%d", &min_depth) != 1) {
+        min_depth = 8;
+    }
+
+    nshared = hash_tt_share(file, min_depth);
+    if (nshared >= 0) {
+        printf("Shared %d items to %s\n", nshared, file);
+    } else {
+        printf("Failed to share transposition table items to %s\n", file);
+    }
+}
+
+/* The number of lines handled in each block by the quiet command */
+#define QUIET_BLOCK_SIZE 4096
+
+/* The maximum length of a line handled by the quiet command */
+#define QUIET_LINE_LENGTH 1024
+
+/* Data for the quiet command */
+struct quiet_block {
+    char       (*lines)[QUIET_LINE_LENGTH+1];
+    char       (*results)[QUIET_LINE_LENGTH+1];
+    int        nlines;
+    atomic_int next_line;
+};
+
+/* Data for a single thread used by the quiet command */
+struct quiet_thread {
+    thread_t           thread;
+    struct position    *pos;
+    struct quiet_block *block;
+};
+
+static char* skip_fields(char *str, int nfields)
+{
+    int k;
+
+    for (k=0;k<nfields;k++) {
+        str = skip_whitespace(str);
+        while ((*str != '\0') && !isspace((unsigned char)*str)) {
+            str++;
+        }
+    }
+
+    return str;
+}
+
+/*
+ * Resolve a position to a quiet one. Any EPD operations or move
+ * counters are kept in the result.
  */
-static void cmd_quiet(struct gamestate *state)
+static void quiet_line(struct position *pos, char *line, char *result)
+{
+    struct movelist pv;
+    char            fenstr[FEN_MAX_LENGTH];
+    char            *rest;
+    bool            has_counters;
+    int             k;
+
+    result[0] = '\0';
+    if (!board_setup_from_fen(pos, line) ||
+        (BITCOUNT(pos->bb_pieces[WHITE_KING]) != 1) ||
+        (BITCOUNT(pos->bb_pieces[BLACK_KING]) != 1)) {
+        return;
+    }
+    board_quiet(pos, &pv);
+    for (k=0;k<pv.size;k++) {
+        (void)board_make_move(pos, pv.moves[k]);
+    }
+    fen_build_string(pos, fenstr);
+
+    /*
+     * FEN strings are written in full. For EPD strings only the first
+     * four fields are written, followed by the operations.
+     */
+    rest = skip_fields(line, 4);
+    has_counters = isdigit((unsigned char)*skip_whitespace(rest));
+    if (has_counters) {
+        rest = skip_fields(line, 6);
+    } else {
+        *skip_fields(fenstr, 4) = '\0';
+    }
+    snprintf(result, QUIET_LINE_LENGTH+1, "%s%s", fenstr, rest);
+}
+
+static thread_retval_t quiet_thread_func(void *data)
+{
+    struct quiet_thread *thread = data;
+    struct quiet_block  *block = thread->block;
+    int                 k;
+
+    while ((k=atomic_fetch_add(&block->next_line, 1)) < block->nlines) {
+        quiet_line(thread->pos, block->lines[k], block->results[k]);
+    }
+
+    return (thread_retval_t)0;
+}
+
+/*
+ * Resolve all positions in a file to quiet positions. The file is
+ * processed in blocks that are split between several threads.
+ */
+static void quiet_file(char *infile, char *outfile)
+{
+    struct quiet_block  block;
+    struct quiet_thread *threads;
+    char                *iter;
+    FILE                *infp;
+    FILE                *outfp;
+    time_t              start;
+    int                 nthreads;
+    int                 npositions;
+    int                 k;
+
+    infp = fopen(infile, "r");
+    if (infp == NULL) {
+        printf("Failed to open %s\n", infile);
+        return;
+    }
+    outfp = fopen(outfile, "w");
+    if (outfp == NULL) {
+        printf("Failed to open %s\n", outfile);
+        fclose(infp);
+        return;
+    }
+
+    block.lines = malloc(QUIET_BLOCK_SIZE*sizeof(*block.lines));
+    block.results = malloc(QUIET_BLOCK_SIZE*sizeof(*block.results));
+    nthreads = MAX(smp_number_of_workers(), 1);
+    threads = malloc(nthreads*sizeof(struct quiet_thread));
+    for (k=0;k<nthreads;k++) {
+        threads[k].pos = malloc(sizeof(struct position));
+        memset(threads[k].pos, 0, sizeof(struct position));
+        if (engine_using_nnue) {
+            threads[k].pos->nnue_pos = nnue_create_pos();
+        }
+        threads[k].block = &block;
+    }
+
+    start = get_current_time();
+    npositions = 0;
+    while (true) {
+        /* Read a block of positions */
+        block.nlines = 0;
+        while ((block.nlines < QUIET_BLOCK_SIZE) &&
+               (fgets(block.lines[block.nlines], QUIET_LINE_LENGTH+1,
+                      infp) != NULL)) {
+            iter = strpbrk(block.lines[block.nlines], "\r\n");
+            if (iter != NULL) {
+                *iter = '\0';
+            }
+            if (*skip_whitespace(block.lines[block.nlines]) != '\0') {
+                block.nlines++;
+            }
+        }
+        if (block.nlines == 0) {
+            break;
+        }
+
+        /* Resolve the positions and write them in the original order */
+        atomic_init(&block.next_line, 0);
+        for (k=0;k<nthreads;k++) {
+            thread_create(&threads[k].thread,
+                          (thread_func_t)quiet_thread_func, &threads[k]);
+        }
+        for (k=0;k<nthreads;k++) {
+            thread_join(&threads[k].thread);
+        }
+        for (k=0;k<block.nlines;k++) {
+            if (block.results[k][0] != '\0') {
+                fprintf(outfp, "%s\n", block.results[k]);
+                npositions++;
+            }
+        }
+    }
+
+    for (k=0;k<nthreads;k++) {
+        if (threads[k].pos->nnue_pos != NULL) {
+            nnue_destroy_pos(threads[k].pos->nnue_pos);
+        }
+        free(threads[k].pos);
+    }
+    free(threads);
+    free(block.lines);
+    free(block.results);
+    fclose(infp);
+    fclose(outfp);
+    printf("Converted %d positions in %d ms\n", npositions,
+           (int)(get_current_time()-start));
+}
+
+/*
+ * Custom command
+ * Syntax: quiet [<infile> <outfile>]
+ *
+ * Prints the sequence of captures leading to a quiet position. If
+ * <infile> is given all positions in it, one FEN or EPD string per line,
+ * are resolved to quiet positions that are written to <outfile>. Multiple
+ * threads are used for this and the order of the positions is kept.
+ */
+static void cmd_quiet(char *cmd, struct gamestate *state)
 {
     struct position pos;
     struct movelist pv;
     int             k;
     char            movestr[MAX_MOVESTR_LENGTH];
+    char            infile[MAX_PATH_LENGTH+1];
+    char            outfile[MAX_PATH_LENGTH+1];
+    char            *iter;
+
+    iter = strchr(cmd, ' ');
+    if (iter != NULL) {
+        if (sscanf(skip_whitespace(iter), "%1024s %1024s", infile,
+                   outfile) != 2) {
+            printf("Usage: quiet [<infile> <outfile>]\n");
+            return;
+        }
+        quiet_file(infile, outfile);
+        return;
+    }
 
     pv.size = 0;
     pos = state->pos;
@@ -172,6 +1117,210 @@ static void cmd_quiet(struct gamestate *state)
     printf("\n");
 }
 
+/*
+ * The input thread reads commands from stdin and queues them. This way
+ * commands received during a search can be handled as soon as they
+ * arrive without polling stdin.
+ */
+static thread_retval_t input_thread_func(void *data)
+{
+    char line[RX_BUFFER_SIZE+1];
+    bool eof;
+
+    (void)data;
+
+    do {
+        eof = fgets(line, sizeof(line), stdin) == NULL;
+
+        mutex_lock(&input_lock);
+        while (input_count == INPUT_QUEUE_SIZE) {
+            mutex_unlock(&input_lock);
+            event_wait(&input_space_event);
+            mutex_lock(&input_lock);
+        }
+        if (eof) {
+            input_eof = true;
+        } else {
+            strcpy(input_queue[(input_head+input_count)%INPUT_QUEUE_SIZE],
+                   line);
+            input_count++;
+        }
+        mutex_unlock(&input_lock);
+        event_set(&input_event);
+    } while (!eof);
+
+    return (thread_retval_t)0;
+}
+
+static bool input_available(void)
+{
+    bool available;
+
+    mutex_lock(&input_lock);
+    available = input_count > 0;
+    mutex_unlock(&input_lock);
+
+    return available;
+}
+
+static thread_retval_t load_tablebases_func(void *data)
+{
+    struct load_task *task = data;
+
+    task->result = tb_init(task->path);
+    tbprefetch_warmup(task->warmup);
+
+    return (thread_retval_t)0;
+}
+
+static thread_retval_t load_network_func(void *data)
+{
+    struct load_task *task = data;
+
+    task->result = nnue_init(task->path);
+
+    return (thread_retval_t)0;
+}
+
+static thread_retval_t load_book_func(void *data)
+{
+    struct load_task *task = data;
+
+    task->result = polybook_open(task->path, task->use_index);
+
+    return (thread_retval_t)0;
+}
+
+static void finish_task(struct load_task *task)
+{
+    if (task->running) {
+        thread_join(&task->thread);
+        task->running = false;
+    }
+}
+
+static void start_task(struct load_task *task, thread_func_t func, char *path)
+{
+    finish_task(task);
+    strncpy(task->path, path, MAX_PATH_LENGTH);
+    task->path[MAX_PATH_LENGTH] = '\0';
+    task->result = false;
+    task->running = true;
+    thread_create(&task->thread, func, task);
+}
+
+uint64_t engine_fixed_memory(void)
+{
+    uint64_t mapped;
+    uint64_t size;
+
+    size = hash_material_memory() + hash_tbcache_memory() +
+           nnue_network_memory(&mapped) + polybook_memory(&mapped) +
+           sizeof(struct gamestate);
+    if (engine_using_nnue) {
+        size += nnue_pos_memory(NULL);
+    }
+
+    return size;
+}
+
+uint64_t engine_memory_usage(struct gamestate *state)
+{
+    uint64_t workers;
+    uint64_t pawntt;
+    uint64_t evalcache;
+    uint64_t nnue;
+    uint64_t mapped;
+    uint64_t size;
+
+    smp_memory_usage(&workers, &pawntt, &evalcache, &nnue);
+    size = hash_tt_memory() + workers + pawntt + evalcache + nnue +
+           nnue_network_memory(&mapped) + hash_material_memory() +
+           hash_tbcache_memory() + polybook_memory(&mapped) +
+           sizeof(struct gamestate);
+    if ((state != NULL) && (state->pos.nnue_pos != NULL)) {
+        size += nnue_pos_memory(state->pos.nnue_pos);
+    }
+
+    return size;
+}
+
+int engine_check_memory_limit(struct gamestate *state)
+{
+    uint64_t used;
+    int      used_mb;
+
+    if (engine_memory_limit == 0) {
+        return 0;
+    }
+    used = engine_memory_usage(state);
+    if (used <= engine_memory_limit*1024ULL*1024ULL) {
+        return 0;
+    }
+
+    used_mb = (int)((used+1024ULL*1024ULL-1)/(1024ULL*1024ULL));
+    LOG_INFO1("Memory limit of %d MB cannot be met, %d MB is used\n",
+              engine_memory_limit, used_mb);
+    return used_mb;
+}
+
+void engine_load_tablebases(char *path, int warmup)
+{
+    if ((tablebase_task.path[0] != '\0') &&
+        !strcmp(tablebase_task.path, path) &&
+        (tablebase_task.running || tablebase_task.result)) {
+        return;
+    }
+
+    /* The prefetch thread must be idle when the tablebases are replaced */
+    finish_task(&tablebase_task);
+    tbprefetch_cancel();
+    tablebase_task.warmup = warmup;
+    start_task(&tablebase_task, (thread_func_t)load_tablebases_func, path);
+}
+
+void engine_load_network(char *file)
+{
+    start_task(&network_task, (thread_func_t)load_network_func, file);
+}
+
+void engine_load_book(char *file, bool use_index)
+{
+    finish_task(&book_task);
+    book_task.use_index = use_index;
+    start_task(&book_task, (thread_func_t)load_book_func, file);
+}
+
+void engine_wait_for_loading(struct gamestate *state, int resources)
+{
+    if ((resources&LOAD_TABLEBASES) != 0) {
+        finish_task(&tablebase_task);
+    }
+    if ((resources&LOAD_BOOK) != 0) {
+        finish_task(&book_task);
+    }
+    if (((resources&LOAD_NETWORK) != 0) && network_task.running) {
+        finish_task(&network_task);
+        engine_using_nnue = network_task.result;
+        smp_clear_eval_caches();
+        if (engine_using_nnue && (state != NULL)) {
+            if (state->pos.nnue_pos == NULL) {
+                state->pos.nnue_pos = nnue_create_pos();
+            }
+            nnue_setup_pos(state->pos.nnue_pos, state->pos.start_pieces,
+                           state->pos.start_side);
+        }
+    }
+}
+
+void engine_init(void)
+{
+    mutex_init(&input_lock);
+    event_init(&input_event);
+    event_init(&input_space_event);
+    thread_create(&input_thread, (thread_func_t)input_thread_func, NULL);
+}
+
 void engine_loop(struct gamestate *state)
 {
     char *cmd;
@@ -194,20 +1343,55 @@ void engine_loop(struct gamestate *state)
             }
         }
 
+        /*
+         * Wait for background loading before handling commands that may
+         * use the loaded resources. The handshake and options are handled
+         * right away, and a search only waits for what it needs.
+         */
+        if (strncmp(cmd, "uci", 3) && strncmp(cmd, "xboard", 6) &&
+            strncmp(cmd, "protover", 8) && strncmp(cmd, "setoption", 9) &&
+            strncmp(cmd, "go", 2)) {
+            engine_wait_for_loading(state, LOAD_ALL);
+        }
+
         /* Custom commands */
         handled = true;
-        if (!strncmp(cmd, "browse", 6)) {
+        if (!strncmp(cmd, "batch", 5)) {
+            cmd_batch(cmd);
+        } else if (!strncmp(cmd, "browse", 6)) {
             cmd_browse(state);
+        } else if (!strncmp(cmd, "convert", 7)) {
+            cmd_convert(cmd);
         } else if (!strncmp(cmd, "display", 7)) {
             cmd_display(state);
         } else if (!strncmp(cmd, "divide", 6)) {
             cmd_divide(cmd, state);
         } else if (!strncmp(cmd, "eval", 4)) {
             cmd_eval(state);
+        } else if (!strncmp(cmd, "hashstats", 9)) {
+            cmd_hashstats();
+        } else if (!strncmp(cmd, "loadhash", 8)) {
+            cmd_loadhash(cmd);
+        } else if (!strncmp(cmd, "makebook", 8)) {
+            cmd_makebook(cmd);
+        } else if (!strncmp(cmd, "memusage", 8)) {
+            cmd_memusage(state);
+        } else if (!strncmp(cmd, "mergehash", 9)) {
+            cmd_mergehash(cmd);
+        } else if (!strncmp(cmd, "nnue", 4)) {
+            cmd_nnue(cmd);
         } else if (!strncmp(cmd, "perft", 5)) {
             cmd_perft(cmd, state);
         } else if (!strncmp(cmd, "quiet", 5)) {
-            cmd_quiet(state);
+            cmd_quiet(cmd, state);
+        } else if (!strncmp(cmd, "savehash", 8)) {
+            cmd_savehash(cmd);
+        } else if (!strncmp(cmd, "savenet", 7)) {
+            cmd_savenet(cmd);
+        } else if (!strncmp(cmd, "selfplay", 8)) {
+            cmd_selfplay(cmd);
+        } else if (!strncmp(cmd, "sharehash", 9)) {
+            cmd_sharehash(cmd);
         } else {
             handled = false;
         }
@@ -231,10 +1415,22 @@ char* engine_read_command(void)
 {
     char *iter;
 
-    /* Read command from stdin */
-    if (fgets(rx_buffer, RX_BUFFER_SIZE, stdin) == NULL) {
+    /* Wait for the input thread to queue a command */
+    mutex_lock(&input_lock);
+    while ((input_count == 0) && !input_eof) {
+        mutex_unlock(&input_lock);
+        event_wait(&input_event);
+        mutex_lock(&input_lock);
+    }
+    if (input_count == 0) {
+        mutex_unlock(&input_lock);
         return NULL;
     }
+    strcpy(rx_buffer, input_queue[input_head]);
+    input_head = (input_head+1)%INPUT_QUEUE_SIZE;
+    input_count--;
+    mutex_unlock(&input_lock);
+    event_set(&input_space_event);
 
     /* Remove trailing white space */
     iter = &rx_buffer[strlen(&rx_buffer[0])-1];
@@ -248,6 +1444,61 @@ char* engine_read_command(void)
     return rx_buffer;
 }
 
+/* Must be called with tx_lock held */
+static void flush_output(void)
+{
+    if (output_length > 0) {
+        (void)fwrite(output_buffer, 1, output_length, stdout);
+        fflush(stdout);
+        output_length = 0;
+    }
+}
+
+/* Must be called with tx_lock held */
+static void buffer_output(char *format, va_list ap)
+{
+    int len;
+
+    len = vsnprintf(tx_buffer, TX_BUFFER_SIZE, format, ap);
+    len = MIN(len, TX_BUFFER_SIZE-1);
+    if ((output_length+len+1) > OUTPUT_BUFFER_SIZE) {
+        flush_output();
+    }
+    memcpy(&output_buffer[output_length], tx_buffer, len);
+    output_length += len;
+    output_buffer[output_length++] = '\n';
+
+    LOG_INFO2("<== %s\n", tx_buffer);
+}
+
+/*
+ * Check if a search update should be held back because the previous
+ * update was sent less than engine_info_interval milliseconds ago.
+ */
+static bool hold_back_info(bool pv)
+{
+    time_t now;
+
+    if (engine_info_interval == 0) {
+        return false;
+    }
+
+    now = get_current_time();
+    if (pv) {
+        pv_info_pending = (now-last_pv_info_time) < engine_info_interval;
+        if (!pv_info_pending) {
+            last_pv_info_time = now;
+        }
+        return pv_info_pending;
+    }
+    if ((now-last_info_time) < engine_info_interval) {
+        return true;
+    }
+    last_info_time = now;
+
+    return false;
+}
+
 void engine_write_command(char *format, ...)
 {
     va_list ap;
@@ -257,13 +1508,33 @@ void engine_write_command(char *format, ...)
     mutex_lock(&tx_lock);
 
     va_start(ap, format);
-    vsprintf(tx_buffer, format, ap);
-    printf("%s\n", tx_buffer);
+    buffer_output(format, ap);
     va_end(ap);
+    flush_output();
 
     mutex_unlock(&tx_lock);
+}
 
-    LOG_INFO2("<== %s\n", tx_buffer);
+void engine_write_info(char *format, ...)
+{
+    va_list ap;
+
+    assert(format != NULL);
+
+    mutex_lock(&tx_lock);
+
+    va_start(ap, format);
+    buffer_output(format, ap);
+    va_end(ap);
+
+    mutex_unlock(&tx_lock);
+}
+
+void engine_flush_output(void)
+{
+    mutex_lock(&tx_lock);
+    flush_output();
+    mutex_unlock(&tx_lock);
 }
 
 void engine_set_pending_command(char *cmd)
@@ -283,23 +1554,34 @@ void engine_clear_pending_command(void)
     pending_cmd_buffer[0] = '\0';
 }
 
-bool engine_check_input(struct search_worker *worker)
+bool engine_wait_for_input(int timeout)
 {
-    if (!poll_input()) {
+    bool available;
+    bool eof;
+
+    mutex_lock(&input_lock);
+    available = input_count > 0;
+    eof = input_eof;
+    mutex_unlock(&input_lock);
+
+    if (available) {
+        return true;
+    } else if (eof) {
+        sleep_ms(timeout);
         return false;
     }
 
-    if (engine_protocol == PROTOCOL_UCI) {
-        return uci_check_input(worker);
-    } else {
-        return xboard_check_input(worker);
-    }
+    (void)event_wait_timeout(&input_event, timeout);
 
-    return false;
+    return input_available();
 }
 
-bool engine_wait_for_input(struct search_worker *worker)
+bool engine_check_input(struct search_worker *worker)
 {
+    if (!input_available()) {
+        return false;
+    }
+
     if (engine_protocol == PROTOCOL_UCI) {
         return uci_check_input(worker);
     } else {
@@ -311,7 +1593,7 @@ bool engine_wait_for_input(struct search_worker *worker)
 
 void engine_send_pv_info(struct search_worker *worker, int score)
 {
-    if (worker->state->silent) {
+    if (worker->state->silent || hold_back_info(true)) {
         return;
     }
 
@@ -322,12 +1604,36 @@ void engine_send_pv_info(struct search_worker *worker, int score)
     }
 }
 
-void engine_send_bound_info(struct search_worker *worker, int score, bool lower)
+void engine_send_final_pv_info(struct search_worker *worker)
 {
     if (worker->state->silent) {
         return;
     }
 
+    pv_info_pending = false;
+    last_pv_info_time = get_current_time();
+    if (worker->multipv > 1) {
+        if (engine_protocol == PROTOCOL_UCI) {
+            uci_send_multipv_info(worker);
+        }
+    } else if (engine_protocol == PROTOCOL_UCI) {
+        uci_send_pv_info(worker, worker->mpv_lines[0].score);
+    } else if (engine_protocol == PROTOCOL_XBOARD) {
+        xboard_send_pv_info(worker, worker->mpv_lines[0].score);
+    }
+}
+
+bool engine_pv_info_pending(void)
+{
+    return pv_info_pending;
+}
+
+void engine_send_bound_info(struct search_worker *worker, int score, bool lower)
+{
+    if (worker->state->silent || hold_back_info(false)) {
+        return;
+    }
+
     if (engine_protocol == PROTOCOL_UCI) {
         uci_send_bound_info(worker, score, lower);
     }
@@ -335,7 +1641,7 @@ void engine_send_bound_info(struct search_worker *worker, int score, bool lower)
 
 void engine_send_move_info(struct search_worker *worker)
 {
-    if (worker->state->silent) {
+    if (worker->state->silent || hold_back_info(false)) {
         return;
     }
 
@@ -346,7 +1652,7 @@ void engine_send_move_info(struct search_worker *worker)
 
 void engine_send_multipv_info(struct search_worker *worker)
 {
-    if (worker->state->silent) {
+    if (worker->state->silent || hold_back_info(true)) {
         return;
     }
 
@@ -25,6 +25,15 @@
 /* Maximum length accepted for file paths */
 #define MAX_PATH_LENGTH 1024
 
+/*
+ * Resources that are loaded in the background, used as flags for
+ * engine_wait_for_loading.
+ */
+#define LOAD_TABLEBASES 0x01
+#define LOAD_NETWORK    0x02
+#define LOAD_BOOK       0x04
+#define LOAD_ALL        (LOAD_TABLEBASES|LOAD_NETWORK|LOAD_BOOK)
+
 /* Enum for different chess protocols */
 enum protocol {
     PROTOCOL_UNSPECIFIED,
@@ -39,6 +48,13 @@ extern int engine_default_hash_size;
 extern int engine_default_num_threads;
 extern bool engine_using_nnue;
 extern char engine_eval_file[MAX_PATH_LENGTH+1];
+extern int engine_info_interval;
+extern int engine_memory_limit;
+
+/*
+ * Initialize the engine and start the thread reading commands.
+ */
+void engine_init(void);
 
 /*
  * The main engine loop.
@@ -55,12 +71,26 @@ void engine_loop(struct gamestate *state);
 char* engine_read_command(void);
 
 /*
- * Write a command.
+ * Write a command. The command is sent immediately together with any
+ * buffered information.
  *
  * @param format. The command format string.
  */
 void engine_write_command(char *format, ...);
 
+/*
+ * Write information about an ongoing search. The information is buffered
+ * and sent together with the next command or when the output is flushed.
+ *
+ * @param format. The information format string.
+ */
+void engine_write_info(char *format, ...);
+
+/*
+ * Send all buffered information.
+ */
+void engine_flush_output(void);
+
 /*
  * Set a pending command to execute when the search finishes.
  *
@@ -79,29 +109,115 @@ char* engine_get_pending_command(void);
 void engine_clear_pending_command(void);
 
 /*
- * Function called during search to check if input has arrived.
+ * Get the amount of memory used by the parts of the engine that do
+ * not depend on the Hash and Threads settings, i.e. everything except
+ * the main transposition table and the search workers. Memory mapped
+ * files are not included since they are shared with other processes.
  *
- * @param worker The worker.
- * @return Returns true if the current search should be stopped.
+ * @return Returns the size in bytes.
  */
-bool engine_check_input(struct search_worker *worker);
+uint64_t engine_fixed_memory(void);
+
+/*
+ * Get the total amount of memory used by the engine, as reported by the
+ * memusage command. Memory mapped files are not included.
+ *
+ * @param state The game state, or NULL if there is none yet.
+ * @return Returns the size in bytes.
+ */
+uint64_t engine_memory_usage(struct gamestate *state);
+
+/*
+ * Check if the engine uses more memory than allowed by the memory limit.
+ * This happens when the limit is smaller than what the tables need at
+ * their minimum sizes. A warning is written to the log in that case.
+ *
+ * @param state The game state, or NULL if there is none yet.
+ * @return Returns the memory used (in MB) if the limit is exceeded,
+ *         otherwise 0.
+ */
+int engine_check_memory_limit(struct gamestate *state);
+
+/*
+ * Start loading Syzygy tablebases in the background. Any previous
+ * loading of tablebases is finished first. Nothing is done if the
+ * tablebases in the same path are already loaded or being loaded.
+ *
+ * @param path The path to the tablebases.
+ * @param warmup Prefetch all tables with at most this many pieces once
+ *               the tablebases have been loaded (0 for no prefetching).
+ */
+void engine_load_tablebases(char *path, int warmup);
+
+/*
+ * Start loading an NNUE network in the background. The network is put
+ * into use, and engine_using_nnue updated, when engine_wait_for_loading
+ * is called.
+ *
+ * @param file The network file.
+ */
+void engine_load_network(char *file);
+
+/*
+ * Start opening the opening book in the background.
+ *
+ * @param file The book file.
+ * @param use_index If an index of the book should be built.
+ */
+void engine_load_book(char *file, bool use_index);
+
+/*
+ * Wait for background loading of resources to finish. A network that
+ * has been loaded is put into use and the position of the game state,
+ * if any, is prepared for NNUE evaluation.
+ *
+ * @param state The game state, or NULL.
+ * @param resources The resources to wait for (LOAD_* flags).
+ */
+void engine_wait_for_loading(struct gamestate *state, int resources);
+
+/*
+ * Wait for input to arrive.
+ *
+ * @param timeout The maximum time to wait (in milliseconds).
+ * @return Returns true if there is input available.
+ */
+bool engine_wait_for_input(int timeout);
 
 /*
- * Function used to wait until input arrives.
+ * Function called during search to check if input has arrived.
  *
  * @param worker The worker.
  * @return Returns true if the current search should be stopped.
  */
-bool engine_wait_for_input(struct search_worker *worker);
+bool engine_check_input(struct search_worker *worker);
 
 /*
- * Send information about the principle variation.
+ * Send information about the principle variation. This and the other
+ * search updates below are held back if less than engine_info_interval
+ * milliseconds have passed since the last update.
  *
  * @param worker The worker
  * @param score The PV score.
  */
 void engine_send_pv_info(struct search_worker *worker, int score);
 
+/*
+ * Send the principle variation at the end of a search, even if the
+ * last update was held back because of the info interval.
+ *
+ * @param worker The worker.
+ */
+void engine_send_final_pv_info(struct search_worker *worker);
+
+/*
+ * Check if a principle variation update has been held back because
+ * of the info interval.
+ *
+ * @return Returns true if an update has been held back.
+ */
+bool engine_pv_info_pending(void);
+
 /*
  * Send information about score bound during search.
  *
@@ -24,12 +24,14 @@
 #include "evalparams.h"
 #include "validation.h"
 #include "bitboard.h"
+#include "board.h"
 #include "hash.h"
 #include "fen.h"
 #include "utils.h"
 #include "debug.h"
 #include "engine.h"
 #include "nnue.h"
+#include "search.h"
 
 /* Phase valuse for different piece types */
 #define PAWN_PHASE      0
@@ -47,6 +49,20 @@
 /* Bonus given to the side to move */
 #define TEMPO_BONUS 10
 
+/*
+ * Margin used by lazy evaluation. If the score based on material, piece
+ * square tables and pawn structure is outside the search window by more
+ * than this then the remaining terms are skipped.
+ */
+#define LAZY_EVAL_MARGIN 600
+
+/* Classification of the material with regards to mating potential */
+enum {
+    MATERIAL_NO_DRAW,
+    MATERIAL_DRAW,
+    MATERIAL_BISHOP_DRAW    /* Draw if all bishops are on the same color */
+};
+
 /* Different evaluation components */
 struct eval {
     bool in_pawntt;
@@ -63,6 +79,8 @@ struct eval {
 #endif
 };
 
+int eval_psq[NPIECES][NSQUARES][NPHASES];
+
 /* Table of attack weights for all pieces */
 static int piece_attack_weights[NPIECES] = {
     0, 0,
@@ -581,7 +599,6 @@ static void evaluate_knights(struct position *pos, struct eval *eval)
     uint64_t safe_moves;
     uint64_t attacks;
     int      sq;
-    int      index;
     int      king_sq;
     int      side;
     int      opp_side;
@@ -596,16 +613,13 @@ static void evaluate_knights(struct position *pos, struct eval *eval)
         attacks = moves;
         moves &= (~pos->bb_sides[side]);
 
-        /* Material */
-        eval->score[MIDDLEGAME][side] += KNIGHT_MATERIAL_VALUE_MG;
-        eval->score[ENDGAME][side] += KNIGHT_MATERIAL_VALUE_EG;
+        /*
+         * Material and piece/square tables. The scores are
+         * maintained incrementally in the position.
+         */
         TRACE_M(KNIGHT_MATERIAL_VALUE_MG, KNIGHT_MATERIAL_VALUE_EG, 1);
-
-        /* Piece/square tables */
-        index = (side == BLACK)?MIRROR(sq):sq;
-        eval->score[MIDDLEGAME][side] += PSQ_TABLE_KNIGHT_MG[index];
-        eval->score[ENDGAME][side] += PSQ_TABLE_KNIGHT_EG[index];
-        TRACE_OM(PSQ_TABLE_KNIGHT_MG, PSQ_TABLE_KNIGHT_EG, index, 1);
+        TRACE_OM(PSQ_TABLE_KNIGHT_MG, PSQ_TABLE_KNIGHT_EG,
+                 (side == BLACK)?MIRROR(sq):sq, 1);
 
         /* Mobility */
         safe_moves = moves&(~eval->attacked_by[PAWN+FLIP_COLOR(side)]);
@@ -645,7 +659,6 @@ static void evaluate_bishops(struct position *pos, struct eval *eval)
     uint64_t safe_moves;
     uint64_t attacks;
     int      sq;
-    int      index;
     int      king_sq;
     int      side;
     int      opp_side;
@@ -676,16 +689,13 @@ static void evaluate_bishops(struct position *pos, struct eval *eval)
         attacks = moves;
         moves &= (~pos->bb_sides[side]);
 
-        /* Material */
-        eval->score[MIDDLEGAME][side] += BISHOP_MATERIAL_VALUE_MG;
-        eval->score[ENDGAME][side] += BISHOP_MATERIAL_VALUE_EG;
+        /*
+         * Material and piece/square tables. The scores are
+         * maintained incrementally in the position.
+         */
         TRACE_M(BISHOP_MATERIAL_VALUE_MG, BISHOP_MATERIAL_VALUE_EG, 1);
-
-        /* Piece/square tables */
-        index = (side == BLACK)?MIRROR(sq):sq;
-        eval->score[MIDDLEGAME][side] += PSQ_TABLE_BISHOP_MG[index];
-        eval->score[ENDGAME][side] += PSQ_TABLE_BISHOP_EG[index];
-        TRACE_OM(PSQ_TABLE_BISHOP_MG, PSQ_TABLE_BISHOP_EG, index, 1);
+        TRACE_OM(PSQ_TABLE_BISHOP_MG, PSQ_TABLE_BISHOP_EG,
+                 (side == BLACK)?MIRROR(sq):sq, 1);
 
         /* Mobility */
         safe_moves = moves&(~eval->attacked_by[PAWN+FLIP_COLOR(side)]);
@@ -717,7 +727,6 @@ static void evaluate_rooks(struct position *pos, struct eval *eval)
     uint64_t safe_moves;
     uint64_t attacks;
     int      sq;
-    int      index;
     int      file;
     int      king_sq;
     int      side;
@@ -735,16 +744,13 @@ static void evaluate_rooks(struct position *pos, struct eval *eval)
         attacks = moves;
         moves &= (~pos->bb_sides[side]);
 
-        /* Material */
-        eval->score[MIDDLEGAME][side] += ROOK_MATERIAL_VALUE_MG;
-        eval->score[ENDGAME][side] += ROOK_MATERIAL_VALUE_EG;
+        /*
+         * Material and piece/square tables. The scores are
+         * maintained incrementally in the position.
+         */
         TRACE_M(ROOK_MATERIAL_VALUE_MG, ROOK_MATERIAL_VALUE_EG, 1);
-
-        /* Piece/square tables */
-        index = (side == BLACK)?MIRROR(sq):sq;
-        eval->score[MIDDLEGAME][side] += PSQ_TABLE_ROOK_MG[index];
-        eval->score[ENDGAME][side] += PSQ_TABLE_ROOK_EG[index];
-        TRACE_OM(PSQ_TABLE_ROOK_MG, PSQ_TABLE_ROOK_EG, index, 1);
+        TRACE_OM(PSQ_TABLE_ROOK_MG, PSQ_TABLE_ROOK_EG,
+                 (side == BLACK)?MIRROR(sq):sq, 1);
 
         /* Open and half-open files */
         if ((file_mask[file]&all_pawns) == 0ULL) {
@@ -800,7 +806,6 @@ static void evaluate_queens(struct position *pos, struct eval *eval)
     uint64_t unsafe;
     int      opp_side;
     int      sq;
-    int      index;
     int      file;
     int      king_sq;
     int      side;
@@ -821,16 +826,13 @@ static void evaluate_queens(struct position *pos, struct eval *eval)
                  eval->attacked_by[BISHOP+opp_side]|
                  eval->attacked_by[ROOK+opp_side];
 
-        /* Material */
-        eval->score[MIDDLEGAME][side] += QUEEN_MATERIAL_VALUE_MG;
-        eval->score[ENDGAME][side] += QUEEN_MATERIAL_VALUE_EG;
+        /*
+         * Material and piece/square tables. The scores are
+         * maintained incrementally in the position.
+         */
         TRACE_M(QUEEN_MATERIAL_VALUE_MG, QUEEN_MATERIAL_VALUE_EG, 1);
-
-        /* Piece/square tables */
-        index = (side == BLACK)?MIRROR(sq):sq;
-        eval->score[MIDDLEGAME][side] += PSQ_TABLE_QUEEN_MG[index];
-        eval->score[ENDGAME][side] += PSQ_TABLE_QUEEN_EG[index];
-        TRACE_OM(PSQ_TABLE_QUEEN_MG, PSQ_TABLE_QUEEN_EG, index, 1);
+        TRACE_OM(PSQ_TABLE_QUEEN_MG, PSQ_TABLE_QUEEN_EG,
+                 (side == BLACK)?MIRROR(sq):sq, 1);
 
         /* Open and half-open files */
         if ((file_mask[file]&all_pawns) == 0ULL) {
@@ -868,7 +870,6 @@ static void evaluate_kings(struct position *pos, struct eval *eval)
     int      nattackers;
     int      score;
     int      sq;
-    int      index;
     int      side;
     uint64_t pieces;
 
@@ -877,11 +878,12 @@ static void evaluate_kings(struct position *pos, struct eval *eval)
         sq = POPBIT(&pieces);
         side = COLOR(pos->pieces[sq]);
 
-        /* Piece/square tables */
-        index = (side == BLACK)?MIRROR(sq):sq;
-        eval->score[MIDDLEGAME][side] += PSQ_TABLE_KING_MG[index];
-        eval->score[ENDGAME][side] += PSQ_TABLE_KING_EG[index];
-        TRACE_OM(PSQ_TABLE_KING_MG, PSQ_TABLE_KING_EG, index, 1);
+        /*
+         * Piece/square tables. The scores are maintained
+         * incrementally in the position.
+         */
+        TRACE_OM(PSQ_TABLE_KING_MG, PSQ_TABLE_KING_EG,
+                 (side == BLACK)?MIRROR(sq):sq, 1);
 
         /* Calculate preassure on the enemy king */
         nattackers = 0;
@@ -929,24 +931,31 @@ static void init_attack_tables(struct position *pos, struct eval *eval)
     eval->attacked[BLACK] |= eval->attacked_by[BLACK_KING];
 }
 
+static void evaluate_pawns(struct position *pos, struct eval *eval)
+{
+    /* Check if the position is present in the pawn transposition table */
+    eval->in_pawntt = (pos->worker != NULL)?
+                        hash_pawntt_lookup(pos->worker, &eval->pawntt):false;
+    if (eval->in_pawntt) {
+        return;
+    }
+
+    /* Evaluate the pawn structure and update the pawn hash table */
+    hash_pawntt_init_item(&eval->pawntt);
+    evaluate_pawn_structure(pos, eval);
+    if (pos->worker != NULL) {
+        hash_pawntt_store(pos->worker, &eval->pawntt);
+    }
+}
+
+/* Evaluate all terms. The pawn structure must already have been evaluated. */
 static void do_eval(struct position *pos, struct eval *eval)
 {
     int k;
 
-    memset(eval, 0, sizeof(struct eval));
-
     /* Init attack table */
     init_attack_tables(pos, eval);
 
-    /* Check if the position is present in the pawn transposition table */
-    eval->in_pawntt = (pos->worker != NULL)?
-                        hash_pawntt_lookup(pos->worker, &eval->pawntt):false;
-
-    /* Evaluate the position */
-    if (!eval->in_pawntt) {
-        hash_pawntt_init_item(&eval->pawntt);
-        evaluate_pawn_structure(pos, eval);
-    }
     eval->attacked_by[WHITE_PAWN] |= eval->pawntt.attacked[WHITE];
     eval->attacked_by[BLACK_PAWN] |= eval->pawntt.attacked[BLACK];
     eval->attacked[WHITE] |= eval->pawntt.attacked[WHITE];
@@ -957,6 +966,11 @@ static void do_eval(struct position *pos, struct eval *eval)
     evaluate_bishops(pos, eval);
     evaluate_rooks(pos, eval);
     evaluate_queens(pos, eval);
+
+    /* The attack tables are complete so share them with the search */
+    board_set_attackinfo(pos, eval->attacked_by, eval->attacked,
+                         eval->attacked2);
+
     evaluate_kings(pos, eval);
     evaluate_passers(pos, eval);
     evaluate_space(pos, eval);
@@ -973,54 +987,22 @@ static void do_eval(struct position *pos, struct eval *eval)
         eval->score[k][WHITE] += eval->pawntt.score[k][WHITE];
         eval->score[k][BLACK] += eval->pawntt.score[k][BLACK];
     }
-
-    /* Update the pawn hash table */
-    if (!eval->in_pawntt && (pos->worker != NULL)) {
-        hash_pawntt_store(pos->worker, &eval->pawntt);
-    }
 }
 
-int eval_evaluate(struct position *pos)
+/* Get the tapered score from the side to move's point of view */
+static int tapered_score(struct position *pos, int score[NPHASES][NSIDES],
+                         int phase)
 {
-    /* Check if NNUE or classic eval should be used */
-    if (engine_using_nnue) {
-        return nnue_evaluate(pos->nnue_pos);
-    }
-
-    struct eval eval;
-    int         k;
-    int         phase;
-    int         score[NPHASES];
-    int         tapered_score;
-
-    assert(valid_position(pos));
-
-    /*
-     * If no player have enough material left
-     * to checkmate then it's a draw.
-     */
-    if (eval_is_material_draw(pos)) {
-        return 0;
-    }
-
-    /* Evaluate the position */
-    do_eval(pos, &eval);
+    int total[NPHASES];
+    int k;
 
-    /* Summarize each evaluation term from side to moves's pov */
     for (k=0;k<NPHASES;k++) {
-        score[k] = 0;
-
-        score[k] += eval.score[k][WHITE];
-        score[k] -= eval.score[k][BLACK];
-
-        score[k] = (pos->stm == WHITE)?score[k]:-score[k];
+        total[k] = score[k][WHITE] - score[k][BLACK];
+        total[k] = (pos->stm == WHITE)?total[k]:-total[k];
     }
 
-    /* Return score adjusted for game phase */
-    phase = eval_game_phase(pos);
-    tapered_score = calculate_tapered_eval(phase, score[MIDDLEGAME],
-                                           score[ENDGAME]);
-    return tapered_score + TEMPO_BONUS;
+    return calculate_tapered_eval(phase, total[MIDDLEGAME],
+                                  total[ENDGAME]) + TEMPO_BONUS;
 }
 
 /*
@@ -1029,7 +1011,7 @@ int eval_evaluate(struct position *pos)
  * - King+Knight vs King
  * - King+Bishops vs King (if the bishops operate on the same color squares)
  */
-bool eval_is_material_draw(struct position *pos)
+static int material_draw_type(struct position *pos)
 {
     int wb;
     int wn;
@@ -1042,7 +1024,7 @@ bool eval_is_material_draw(struct position *pos)
         (pos->bb_pieces[BLACK_ROOK] != 0ULL) ||
         (pos->bb_pieces[WHITE_QUEEN] != 0ULL) ||
         (pos->bb_pieces[BLACK_QUEEN] != 0ULL)) {
-        return false;
+        return MATERIAL_NO_DRAW;
     }
 
     wn = BITCOUNT(pos->bb_pieces[WHITE_KNIGHT]);
@@ -1052,28 +1034,232 @@ bool eval_is_material_draw(struct position *pos)
 
     /* King vs King */
     if ((wn == 0) && (bn == 0) && (wb == 0) && (bb == 0)) {
-        return true;
+        return MATERIAL_DRAW;
     }
     /* Knight+King vs King */
     if ((wn == 1) && (bn == 0) && (wb == 0) && (bb == 0)) {
-        return true;
+        return MATERIAL_DRAW;
     }
     /* King vs King+Knight */
     if ((wn == 0) && (bn == 1) && (wb == 0) && (bb == 0)) {
-        return true;
+        return MATERIAL_DRAW;
+    }
+    /* King+Bishops vs King or King vs King+Bishops */
+    if ((wn == 0) && (bn == 0) && (((wb > 0) && (bb == 0)) ||
+                                   ((wb == 0) && (bb > 0)))) {
+        return MATERIAL_BISHOP_DRAW;
+    }
+
+    return MATERIAL_NO_DRAW;
+}
+
+static bool bishops_on_one_color(struct position *pos)
+{
+    uint64_t bishops;
+
+    bishops = pos->bb_pieces[WHITE_BISHOP]|pos->bb_pieces[BLACK_BISHOP];
+    return !(((bishops&white_square_mask) != 0ULL) &&
+             ((bishops&black_square_mask) != 0ULL));
+}
+
+/*
+ * Get the game phase and the draw type of the current position. Both
+ * only depend on the material so they are cached in the material table.
+ */
+static void probe_material(struct position *pos, int *phase, int *draw_type)
+{
+    if (hash_material_lookup(pos, phase, draw_type)) {
+        return;
     }
-    /* King+Bishops vs King */
-    if ((wn == 0) && (bn == 0) && (wb > 0) && (bb == 0)) {
-        return !(((pos->bb_pieces[WHITE_BISHOP]&white_square_mask) != 0ULL) &&
-                    ((pos->bb_pieces[WHITE_BISHOP]&black_square_mask) != 0ULL));
+
+    *phase = eval_game_phase(pos);
+    *draw_type = material_draw_type(pos);
+    hash_material_store(pos, *phase, *draw_type);
+}
+
+/*
+ * Evaluate the position. If lazy is not NULL then the evaluation is
+ * stopped early if the score is far outside the window given by alpha
+ * and beta, in which case lazy is set to true.
+ */
+static int evaluate_position(struct position *pos, int alpha, int beta,
+                             bool *lazy)
+{
+    /* Check if NNUE or classic eval should be used */
+    if (engine_using_nnue) {
+        return nnue_evaluate(pos->nnue_pos);
     }
-    /* King vs King+Bishops */
-    if ((wn == 0) && (bn == 0) && (wb == 0) && (bb > 0)) {
-        return !(((pos->bb_pieces[BLACK_BISHOP]&white_square_mask) != 0ULL) &&
-                    ((pos->bb_pieces[BLACK_BISHOP]&black_square_mask) != 0ULL));
+
+    struct eval eval;
+    int         phase;
+    int         score;
+    int         draw_type;
+    int         lazy_score[NPHASES][NSIDES];
+    int         k;
+
+    /*
+     * If no player have enough material left
+     * to checkmate then it's a draw.
+     */
+    probe_material(pos, &phase, &draw_type);
+    if ((draw_type == MATERIAL_DRAW) ||
+        ((draw_type == MATERIAL_BISHOP_DRAW) && bishops_on_one_color(pos))) {
+        return 0;
     }
 
-    return false;
+    /* Evaluate the pawn structure */
+    memset(&eval, 0, sizeof(struct eval));
+    evaluate_pawns(pos, &eval);
+
+    /*
+     * Check if the score based on material, piece/square tables
+     * and pawn structure alone is far enough outside the window.
+     */
+    if (lazy != NULL) {
+        for (k=0;k<NPHASES;k++) {
+            lazy_score[k][WHITE] = pos->psq[k][WHITE] +
+                                   eval.pawntt.score[k][WHITE];
+            lazy_score[k][BLACK] = pos->psq[k][BLACK] +
+                                   eval.pawntt.score[k][BLACK];
+        }
+        score = tapered_score(pos, lazy_score, phase);
+        if (((score+LAZY_EVAL_MARGIN) <= alpha) ||
+            ((score-LAZY_EVAL_MARGIN) >= beta)) {
+            *lazy = true;
+            return score;
+        }
+    }
+
+    /*
+     * Evaluate the remaining terms, starting from the incrementally
+     * updated material and piece/square table scores.
+     */
+    memcpy(eval.score, pos->psq, sizeof(eval.score));
+    do_eval(pos, &eval);
+
+    return tapered_score(pos, eval.score, phase);
+}
+
+void eval_init_psq(void)
+{
+    const int *material[NPIECES/2][NPHASES] = {
+        {NULL, NULL},
+        {&KNIGHT_MATERIAL_VALUE_MG, &KNIGHT_MATERIAL_VALUE_EG},
+        {&BISHOP_MATERIAL_VALUE_MG, &BISHOP_MATERIAL_VALUE_EG},
+        {&ROOK_MATERIAL_VALUE_MG, &ROOK_MATERIAL_VALUE_EG},
+        {&QUEEN_MATERIAL_VALUE_MG, &QUEEN_MATERIAL_VALUE_EG},
+        {NULL, NULL}
+    };
+    const int *tables[NPIECES/2][NPHASES] = {
+        {NULL, NULL},
+        {PSQ_TABLE_KNIGHT_MG, PSQ_TABLE_KNIGHT_EG},
+        {PSQ_TABLE_BISHOP_MG, PSQ_TABLE_BISHOP_EG},
+        {PSQ_TABLE_ROOK_MG, PSQ_TABLE_ROOK_EG},
+        {PSQ_TABLE_QUEEN_MG, PSQ_TABLE_QUEEN_EG},
+        {PSQ_TABLE_KING_MG, PSQ_TABLE_KING_EG}
+    };
+    int piece;
+    int sq;
+    int k;
+    int type;
+
+    /*
+     * Pawns are scored by the pawn structure evaluation
+     * so their entries are left as zero.
+     */
+    for (piece=0;piece<NPIECES;piece++) {
+        type = VALUE(piece)/2;
+        for (sq=0;sq<NSQUARES;sq++) {
+            for (k=0;k<NPHASES;k++) {
+                eval_psq[piece][sq][k] = 0;
+                if (material[type][k] != NULL) {
+                    eval_psq[piece][sq][k] += *material[type][k];
+                }
+                if (tables[type][k] != NULL) {
+                    eval_psq[piece][sq][k] +=
+                        tables[type][k][(COLOR(piece) == BLACK)?MIRROR(sq):sq];
+                }
+            }
+        }
+    }
+}
+
+void eval_generate_psq(struct position *pos, int psq[NPHASES][NSIDES])
+{
+    uint64_t pieces;
+    int      sq;
+    int      piece;
+    int      k;
+
+    memset(psq, 0, NPHASES*NSIDES*sizeof(int));
+    pieces = pos->bb_all;
+    while (pieces != 0ULL) {
+        sq = POPBIT(&pieces);
+        piece = pos->pieces[sq];
+        for (k=0;k<NPHASES;k++) {
+            psq[k][COLOR(piece)] += eval_psq[piece][sq][k];
+        }
+    }
+}
+
+int eval_evaluate(struct position *pos)
+{
+    int score;
+
+    assert(valid_position(pos));
+
+    /*
+     * Positions evaluated by a search worker are cached
+     * since the same position is often evaluated several
+     * times during a search.
+     */
+    if (pos->worker == NULL) {
+        return evaluate_position(pos, -INFINITE_SCORE, INFINITE_SCORE, NULL);
+    }
+    if (hash_evalcache_lookup(pos->worker, &score)) {
+        return score;
+    }
+    score = evaluate_position(pos, -INFINITE_SCORE, INFINITE_SCORE, NULL);
+    hash_evalcache_store(pos->worker, score);
+
+    return score;
+}
+
+int eval_evaluate_lazy(struct position *pos, int alpha, int beta)
+{
+    int  score;
+    bool lazy;
+
+    assert(valid_position(pos));
+    assert(alpha < beta);
+
+    if (pos->worker == NULL) {
+        return eval_evaluate(pos);
+    }
+    if (hash_evalcache_lookup(pos->worker, &score)) {
+        return score;
+    }
+
+    /* Scores from a lazy evaluation are not exact and are not cached */
+    lazy = false;
+    score = evaluate_position(pos, alpha, beta, &lazy);
+    if (!lazy) {
+        hash_evalcache_store(pos->worker, score);
+    }
+
+    return score;
+}
+
+bool eval_is_material_draw(struct position *pos)
+{
+    switch (material_draw_type(pos)) {
+    case MATERIAL_DRAW:
+        return true;
+    case MATERIAL_BISHOP_DRAW:
+        return bishops_on_one_color(pos);
+    default:
+        return false;
+    }
 }
 
 /*
@@ -1113,7 +1299,7 @@ void eval_generate_trace(struct position *pos, struct eval_trace *trace)
     assert(trace != NULL);
 
     /* Clear the trace */
-    memset(trace, 0, sizeof(struct eval_trace));
+    trace_clear(trace);
     memset(&eval, 0, sizeof(struct eval));
     eval.trace = trace;
 
@@ -21,6 +21,29 @@
 #include "chess.h"
 #include "trace.h"
 
+/*
+ * Material and piece/square table scores indexed by piece, square and
+ * game phase. Pawns are scored by the pawn structure evaluation and
+ * have no entries.
+ */
+extern int eval_psq[NPIECES][NSQUARES][NPHASES];
+
+/*
+ * Initialize the material and piece/square table scores from the
+ * current evaluation parameters. Must be called again whenever the
+ * parameters are changed.
+ */
+void eval_init_psq(void);
+
+/*
+ * Calculate the material and piece/square table scores of a position
+ * from scratch.
+ *
+ * @param pos The position.
+ * @param psq Location where the scores for each phase and side are stored.
+ */
+void eval_generate_psq(struct position *pos, int psq[NPHASES][NSIDES]);
+
 /*
  * Evaluate the position and assign a static score to it.
  *
@@ -30,6 +53,20 @@
  */
 int eval_evaluate(struct position *pos);
 
+/*
+ * Evaluate the position, skipping the more expensive terms if
+ * material, piece/square tables and pawn structure alone puts the
+ * score far outside the window given by alpha and beta. The returned
+ * score is then only an approximation.
+ *
+ * @param pos The position.
+ * @param alpha The lower bound of the search window.
+ * @param beta The upper bound of the search window.
+ * @return Returns the score assigned to the position from the side
+ *         to move point of view.
+ */
+int eval_evaluate_lazy(struct position *pos, int alpha, int beta);
+
 /*
  * Check if the position is a draw by insufficient material.
  *
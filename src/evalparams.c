@@ -17,38 +17,38 @@
  */
 #include "evalparams.h"
 
-int DOUBLE_PAWNS_MG = -2;
-int DOUBLE_PAWNS_EG = -23;
-int ISOLATED_PAWN_MG = -20;
-int ISOLATED_PAWN_EG = -8;
-int ROOK_OPEN_FILE_MG = 58;
-int ROOK_OPEN_FILE_EG = 0;
-int ROOK_HALF_OPEN_FILE_MG = 22;
-int ROOK_HALF_OPEN_FILE_EG = 10;
-int QUEEN_OPEN_FILE_MG = 0;
-int QUEEN_OPEN_FILE_EG = 11;
-int QUEEN_HALF_OPEN_FILE_MG = 9;
-int QUEEN_HALF_OPEN_FILE_EG = 12;
-int ROOK_ON_7TH_MG = 1;
-int ROOK_ON_7TH_EG = 29;
-int BISHOP_PAIR_MG = 47;
-int BISHOP_PAIR_EG = 72;
-int PAWN_SHIELD[3] = {-9, 36, 27};
-int PASSED_PAWN_MG[7] = {
+EVALPARAM DOUBLE_PAWNS_MG = -2;
+EVALPARAM DOUBLE_PAWNS_EG = -23;
+EVALPARAM ISOLATED_PAWN_MG = -20;
+EVALPARAM ISOLATED_PAWN_EG = -8;
+EVALPARAM ROOK_OPEN_FILE_MG = 58;
+EVALPARAM ROOK_OPEN_FILE_EG = 0;
+EVALPARAM ROOK_HALF_OPEN_FILE_MG = 22;
+EVALPARAM ROOK_HALF_OPEN_FILE_EG = 10;
+EVALPARAM QUEEN_OPEN_FILE_MG = 0;
+EVALPARAM QUEEN_OPEN_FILE_EG = 11;
+EVALPARAM QUEEN_HALF_OPEN_FILE_MG = 9;
+EVALPARAM QUEEN_HALF_OPEN_FILE_EG = 12;
+EVALPARAM ROOK_ON_7TH_MG = 1;
+EVALPARAM ROOK_ON_7TH_EG = 29;
+EVALPARAM BISHOP_PAIR_MG = 47;
+EVALPARAM BISHOP_PAIR_EG = 72;
+EVALPARAM PAWN_SHIELD[3] = {-9, 36, 27};
+EVALPARAM PASSED_PAWN_MG[7] = {
     0, 2, 0, 0, 30, 48, 153
 };
-int PASSED_PAWN_EG[7] = {
+EVALPARAM PASSED_PAWN_EG[7] = {
     0, 0, 0, 43, 84, 97, 132
 };
-int KNIGHT_MOBILITY_MG = 12;
-int BISHOP_MOBILITY_MG = 10;
-int ROOK_MOBILITY_MG = 3;
-int QUEEN_MOBILITY_MG = 4;
-int KNIGHT_MOBILITY_EG = 4;
-int BISHOP_MOBILITY_EG = 7;
-int ROOK_MOBILITY_EG = 7;
-int QUEEN_MOBILITY_EG = 6;
-int PSQ_TABLE_PAWN_MG[NSQUARES] = {
+EVALPARAM KNIGHT_MOBILITY_MG = 12;
+EVALPARAM BISHOP_MOBILITY_MG = 10;
+EVALPARAM ROOK_MOBILITY_MG = 3;
+EVALPARAM QUEEN_MOBILITY_MG = 4;
+EVALPARAM KNIGHT_MOBILITY_EG = 4;
+EVALPARAM BISHOP_MOBILITY_EG = 7;
+EVALPARAM ROOK_MOBILITY_EG = 7;
+EVALPARAM QUEEN_MOBILITY_EG = 6;
+EVALPARAM PSQ_TABLE_PAWN_MG[NSQUARES] = {
     0, 0, 0, 0, 0, 0, 0, 0,
     -20, -14, -8, -1, 8, 27, 32, -22,
     -21, -13, -4, 5, 25, 9, 19, -8,
@@ -58,7 +58,7 @@ int PSQ_TABLE_PAWN_MG[NSQUARES] = {
     48, 52, 66, 85, 47, -43, -100, -101,
     0, 0, 0, 0, 0, 0, 0, 0
 };
-int PSQ_TABLE_KNIGHT_MG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_KNIGHT_MG[NSQUARES] = {
     -76, -10, -15, 5, 35, 26, -7, -7,
     -42, -10, 19, 42, 34, 54, 29, 28,
     -3, 8, 26, 30, 64, 41, 46, 20,
@@ -68,7 +68,7 @@ int PSQ_TABLE_KNIGHT_MG[NSQUARES] = {
     1, 37, 57, 36, 55, 106, 17, 52,
     -148, -106, -33, -50, 25, -90, -40, -84
 };
-int PSQ_TABLE_BISHOP_MG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_BISHOP_MG[NSQUARES] = {
     -16, 17, 11, 0, 14, 14, 15, 2,
     30, 29, 40, 18, 33, 39, 62, 9,
     4, 39, 28, 30, 32, 43, 30, 22,
@@ -78,7 +78,7 @@ int PSQ_TABLE_BISHOP_MG[NSQUARES] = {
     -28, -3, 0, -37, -19, -6, -36, -12,
     -27, -67, -68, -52, -65, -74, -59, -66
 };
-int PSQ_TABLE_ROOK_MG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_ROOK_MG[NSQUARES] = {
     8, 14, 14, 34, 41, 40, 45, 27,
     -30, -13, -10, 13, 12, 40, 46, -23,
     -32, -20, -17, -4, 12, 28, 44, 21,
@@ -88,7 +88,7 @@ int PSQ_TABLE_ROOK_MG[NSQUARES] = {
     -6, -10, 31, 19, 32, 67, 34, 66,
     23, 22, -4, 39, 24, 42, 48, 44
 };
-int PSQ_TABLE_QUEEN_MG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_QUEEN_MG[NSQUARES] = {
     10, 4, 8, 24, 17, -9, -12, -53,
     -12, 5, 8, 30, 29, 43, 42, 9,
     -28, 1, -1, 6, 20, 19, 21, 34,
@@ -98,7 +98,7 @@ int PSQ_TABLE_QUEEN_MG[NSQUARES] = {
     -6, -47, 4, -38, -36, 55, 51, 114,
     -78, -23, -19, -1, -25, 22, 89, -7
 };
-int PSQ_TABLE_KING_MG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_KING_MG[NSQUARES] = {
     -21, 7, -46, -92, 0, -65, 3, -10,
     51, 7, -26, -73, -54, -36, 37, 35,
     -14, -20, -43, -72, -63, -60, -36, -55,
@@ -108,7 +108,7 @@ int PSQ_TABLE_KING_MG[NSQUARES] = {
     153, 18, -2, 67, 43, -6, -19, 17,
     13, 191, 179, 67, -87, 43, 98, 50
 };
-int PSQ_TABLE_PAWN_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_PAWN_EG[NSQUARES] = {
     0, 0, 0, 0, 0, 0, 0, 0,
     37, 27, 20, 14, 33, 22, 12, 13,
     36, 29, 16, 16, 21, 22, 15, 15,
@@ -118,7 +118,7 @@ int PSQ_TABLE_PAWN_EG[NSQUARES] = {
     126, 119, 73, 40, 44, 72, 93, 109,
     0, 0, 0, 0, 0, 0, 0, 0
 };
-int PSQ_TABLE_KNIGHT_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_KNIGHT_EG[NSQUARES] = {
     16, -19, 7, 19, 0, 18, -13, -23,
     24, 24, 16, 17, 22, 11, 11, 1,
     2, 25, 24, 43, 36, 15, 8, -2,
@@ -128,7 +128,7 @@ int PSQ_TABLE_KNIGHT_EG[NSQUARES] = {
     11, 7, 19, 12, 13, -11, 20, -21,
     -45, -20, 10, -8, -6, 4, -36, -98
 };
-int PSQ_TABLE_BISHOP_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_BISHOP_EG[NSQUARES] = {
     37, 32, 9, 28, 19, 14, 20, 19,
     19, 6, 20, 18, 13, 16, -1, -9,
     18, 26, 25, 29, 33, 12, 12, 15,
@@ -138,7 +138,7 @@ int PSQ_TABLE_BISHOP_EG[NSQUARES] = {
     26, 23, 25, 31, 13, 22, 16, -4,
     -7, 14, 24, 36, 22, 14, 23, 13
 };
-int PSQ_TABLE_ROOK_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_ROOK_EG[NSQUARES] = {
     34, 36, 41, 27, 23, 30, 21, 9,
     54, 35, 49, 39, 33, 24, 18, 44,
     45, 50, 56, 44, 35, 32, 17, 18,
@@ -148,7 +148,7 @@ int PSQ_TABLE_ROOK_EG[NSQUARES] = {
     49, 58, 38, 42, 44, 38, 38, 22,
     54, 43, 60, 43, 56, 52, 53, 51
 };
-int PSQ_TABLE_QUEEN_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_QUEEN_EG[NSQUARES] = {
     -32, -57, -37, -29, -25, -35, -46, -13,
     -12, -24, -18, -30, -14, -60, -63, -54,
     1, -2, 14, -1, 18, 34, 22, -23,
@@ -158,7 +158,7 @@ int PSQ_TABLE_QUEEN_EG[NSQUARES] = {
     3, 56, 50, 113, 113, 63, 73, 47,
     8, 6, 38, 28, 49, 2, -40, -16
 };
-int PSQ_TABLE_KING_EG[NSQUARES] = {
+EVALPARAM PSQ_TABLE_KING_EG[NSQUARES] = {
     -76, -51, -27, -3, -33, -23, -60, -82,
     -31, -9, 6, 24, 23, 9, -15, -33,
     -28, -5, 11, 37, 40, 25, 7, -9,
@@ -168,62 +168,62 @@ int PSQ_TABLE_KING_EG[NSQUARES] = {
     -39, 3, -4, -14, 9, 17, 59, 35,
     -46, -48, -70, -23, 16, -2, 19, -40
 };
-int KNIGHT_MATERIAL_VALUE_MG = 410;
-int BISHOP_MATERIAL_VALUE_MG = 440;
-int ROOK_MATERIAL_VALUE_MG = 651;
-int QUEEN_MATERIAL_VALUE_MG = 1453;
-int KNIGHT_MATERIAL_VALUE_EG = 374;
-int BISHOP_MATERIAL_VALUE_EG = 373;
-int ROOK_MATERIAL_VALUE_EG = 658;
-int QUEEN_MATERIAL_VALUE_EG = 1310;
-int KING_ATTACK_SCALE_MG = 27;
-int KING_ATTACK_SCALE_EG = 1;
-int KNIGHT_OUTPOST = 17;
-int PROTECTED_KNIGHT_OUTPOST = 50;
-int CANDIDATE_PASSED_PAWN_MG[6] = {
+EVALPARAM KNIGHT_MATERIAL_VALUE_MG = 410;
+EVALPARAM BISHOP_MATERIAL_VALUE_MG = 440;
+EVALPARAM ROOK_MATERIAL_VALUE_MG = 651;
+EVALPARAM QUEEN_MATERIAL_VALUE_MG = 1453;
+EVALPARAM KNIGHT_MATERIAL_VALUE_EG = 374;
+EVALPARAM BISHOP_MATERIAL_VALUE_EG = 373;
+EVALPARAM ROOK_MATERIAL_VALUE_EG = 658;
+EVALPARAM QUEEN_MATERIAL_VALUE_EG = 1310;
+EVALPARAM KING_ATTACK_SCALE_MG = 27;
+EVALPARAM KING_ATTACK_SCALE_EG = 1;
+EVALPARAM KNIGHT_OUTPOST = 17;
+EVALPARAM PROTECTED_KNIGHT_OUTPOST = 50;
+EVALPARAM CANDIDATE_PASSED_PAWN_MG[6] = {
     0, 0, 6, 10, 21, 87
 };
-int CANDIDATE_PASSED_PAWN_EG[6] = {
+EVALPARAM CANDIDATE_PASSED_PAWN_EG[6] = {
     0, 0, 6, 10, 19, 72
 };
-int FRIENDLY_KING_PASSER_DIST = -11;
-int OPPONENT_KING_PASSER_DIST = 14;
-int BACKWARD_PAWN_MG = -15;
-int BACKWARD_PAWN_EG = -2;
-int FREE_PASSED_PAWN_MG = 170;
-int FREE_PASSED_PAWN_EG = 80;
-int SPACE_SQUARE = 4;
-int CONNECTED_PAWNS_MG[7] = {
+EVALPARAM FRIENDLY_KING_PASSER_DIST = -11;
+EVALPARAM OPPONENT_KING_PASSER_DIST = 14;
+EVALPARAM BACKWARD_PAWN_MG = -15;
+EVALPARAM BACKWARD_PAWN_EG = -2;
+EVALPARAM FREE_PASSED_PAWN_MG = 170;
+EVALPARAM FREE_PASSED_PAWN_EG = 80;
+EVALPARAM SPACE_SQUARE = 4;
+EVALPARAM CONNECTED_PAWNS_MG[7] = {
     0, 7, 10, 12, 18, 4, 51
 };
-int CONNECTED_PAWNS_EG[7] = {
+EVALPARAM CONNECTED_PAWNS_EG[7] = {
     0, 0, 4, 1, 6, 58, 65
 };
-int THREAT_MINOR_BY_PAWN_MG = 56;
-int THREAT_MINOR_BY_PAWN_EG = 4;
-int THREAT_PAWN_PUSH_MG = 17;
-int THREAT_PAWN_PUSH_EG = 14;
-int THREAT_BY_KNIGHT_MG[5] = {
+EVALPARAM THREAT_MINOR_BY_PAWN_MG = 56;
+EVALPARAM THREAT_MINOR_BY_PAWN_EG = 4;
+EVALPARAM THREAT_PAWN_PUSH_MG = 17;
+EVALPARAM THREAT_PAWN_PUSH_EG = 14;
+EVALPARAM THREAT_BY_KNIGHT_MG[5] = {
     1, 11, 49, 46, 29
 };
-int THREAT_BY_KNIGHT_EG[5] = {
+EVALPARAM THREAT_BY_KNIGHT_EG[5] = {
     17, 9, 26, 5, 0
 };
-int THREAT_BY_BISHOP_MG[5] = {
+EVALPARAM THREAT_BY_BISHOP_MG[5] = {
     1, 34, 15, 22, 59
 };
-int THREAT_BY_BISHOP_EG[5] = {
+EVALPARAM THREAT_BY_BISHOP_EG[5] = {
     25, 32, 17, 10, 100
 };
-int THREAT_BY_ROOK_MG[5] = {
+EVALPARAM THREAT_BY_ROOK_MG[5] = {
     1, 27, 40, 15, 82
 };
-int THREAT_BY_ROOK_EG[5] = {
+EVALPARAM THREAT_BY_ROOK_EG[5] = {
     15, 25, 27, 18, 30
 };
-int THREAT_BY_QUEEN_MG[5] = {
+EVALPARAM THREAT_BY_QUEEN_MG[5] = {
     0, 7, 7, 0, 0
 };
-int THREAT_BY_QUEEN_EG[5] = {
+EVALPARAM THREAT_BY_QUEEN_EG[5] = {
     0, 27, 40, 11, 0
 };
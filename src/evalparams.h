@@ -20,91 +20,103 @@
 
 #include "chess.h"
 
-extern int DOUBLE_PAWNS_MG;
-extern int DOUBLE_PAWNS_EG;
-extern int ISOLATED_PAWN_MG;
-extern int ISOLATED_PAWN_EG;
-extern int ROOK_OPEN_FILE_MG;
-extern int ROOK_OPEN_FILE_EG;
-extern int ROOK_HALF_OPEN_FILE_MG;
-extern int ROOK_HALF_OPEN_FILE_EG;
-extern int QUEEN_OPEN_FILE_MG;
-extern int QUEEN_OPEN_FILE_EG;
-extern int QUEEN_HALF_OPEN_FILE_MG;
-extern int QUEEN_HALF_OPEN_FILE_EG;
-extern int ROOK_ON_7TH_MG;
-extern int ROOK_ON_7TH_EG;
-extern int BISHOP_PAIR_MG;
-extern int BISHOP_PAIR_EG;
-extern int PAWN_SHIELD[3];
-extern int PASSED_PAWN_MG[7];
-extern int PASSED_PAWN_EG[7];
-extern int PASSED_PAWN_RANK2_MG;
-extern int PASSED_PAWN_RANK3_MG;
-extern int PASSED_PAWN_RANK4_MG;
-extern int PASSED_PAWN_RANK5_MG;
-extern int PASSED_PAWN_RANK6_MG;
-extern int PASSED_PAWN_RANK7_MG;
-extern int PASSED_PAWN_RANK2_EG;
-extern int PASSED_PAWN_RANK3_EG;
-extern int PASSED_PAWN_RANK4_EG;
-extern int PASSED_PAWN_RANK5_EG;
-extern int PASSED_PAWN_RANK6_EG;
-extern int PASSED_PAWN_RANK7_EG;
-extern int KNIGHT_MOBILITY_MG;
-extern int BISHOP_MOBILITY_MG;
-extern int ROOK_MOBILITY_MG;
-extern int QUEEN_MOBILITY_MG;
-extern int KNIGHT_MOBILITY_EG;
-extern int BISHOP_MOBILITY_EG;
-extern int ROOK_MOBILITY_EG;
-extern int QUEEN_MOBILITY_EG;
-extern int PSQ_TABLE_PAWN_MG[NSQUARES];
-extern int PSQ_TABLE_KNIGHT_MG[NSQUARES];
-extern int PSQ_TABLE_BISHOP_MG[NSQUARES];
-extern int PSQ_TABLE_ROOK_MG[NSQUARES];
-extern int PSQ_TABLE_QUEEN_MG[NSQUARES];
-extern int PSQ_TABLE_KING_MG[NSQUARES];
-extern int PSQ_TABLE_PAWN_EG[NSQUARES];
-extern int PSQ_TABLE_KNIGHT_EG[NSQUARES];
-extern int PSQ_TABLE_BISHOP_EG[NSQUARES];
-extern int PSQ_TABLE_ROOK_EG[NSQUARES];
-extern int PSQ_TABLE_QUEEN_EG[NSQUARES];
-extern int PSQ_TABLE_KING_EG[NSQUARES];
-extern int KNIGHT_MATERIAL_VALUE_MG;
-extern int BISHOP_MATERIAL_VALUE_MG;
-extern int ROOK_MATERIAL_VALUE_MG;
-extern int QUEEN_MATERIAL_VALUE_MG;
-extern int KNIGHT_MATERIAL_VALUE_EG;
-extern int BISHOP_MATERIAL_VALUE_EG;
-extern int ROOK_MATERIAL_VALUE_EG;
-extern int QUEEN_MATERIAL_VALUE_EG;
-extern int KING_ATTACK_SCALE_MG;
-extern int KING_ATTACK_SCALE_EG;
-extern int KNIGHT_OUTPOST;
-extern int PROTECTED_KNIGHT_OUTPOST;
-extern int CANDIDATE_PASSED_PAWN_MG[6];
-extern int CANDIDATE_PASSED_PAWN_EG[6];
-extern int FRIENDLY_KING_PASSER_DIST;
-extern int OPPONENT_KING_PASSER_DIST;
-extern int BACKWARD_PAWN_MG;
-extern int BACKWARD_PAWN_EG;
-extern int FREE_PASSED_PAWN_MG;
-extern int FREE_PASSED_PAWN_EG;
-extern int SPACE_SQUARE;
-extern int CONNECTED_PAWNS_MG[7];
-extern int CONNECTED_PAWNS_EG[7];
-extern int THREAT_MINOR_BY_PAWN_MG;
-extern int THREAT_MINOR_BY_PAWN_EG;
-extern int THREAT_PAWN_PUSH_MG;
-extern int THREAT_PAWN_PUSH_EG;
-extern int THREAT_BY_KNIGHT_MG[5];
-extern int THREAT_BY_KNIGHT_EG[5];
-extern int THREAT_BY_BISHOP_MG[5];
-extern int THREAT_BY_BISHOP_EG[5];
-extern int THREAT_BY_ROOK_MG[5];
-extern int THREAT_BY_ROOK_EG[5];
-extern int THREAT_BY_QUEEN_MG[5];
-extern int THREAT_BY_QUEEN_EG[5];
+/*
+ * The evaluation parameters are only modified at runtime when tuning
+ * (see tuningparam.c), which requires a build with TRACE defined. In
+ * other builds they are constant so that the compiler can fold them
+ * into the evaluation.
+ */
+#ifdef TRACE
+#define EVALPARAM int
+#else
+#define EVALPARAM const int
+#endif
+
+extern EVALPARAM DOUBLE_PAWNS_MG;
+extern EVALPARAM DOUBLE_PAWNS_EG;
+extern EVALPARAM ISOLATED_PAWN_MG;
+extern EVALPARAM ISOLATED_PAWN_EG;
+extern EVALPARAM ROOK_OPEN_FILE_MG;
+extern EVALPARAM ROOK_OPEN_FILE_EG;
+extern EVALPARAM ROOK_HALF_OPEN_FILE_MG;
+extern EVALPARAM ROOK_HALF_OPEN_FILE_EG;
+extern EVALPARAM QUEEN_OPEN_FILE_MG;
+extern EVALPARAM QUEEN_OPEN_FILE_EG;
+extern EVALPARAM QUEEN_HALF_OPEN_FILE_MG;
+extern EVALPARAM QUEEN_HALF_OPEN_FILE_EG;
+extern EVALPARAM ROOK_ON_7TH_MG;
+extern EVALPARAM ROOK_ON_7TH_EG;
+extern EVALPARAM BISHOP_PAIR_MG;
+extern EVALPARAM BISHOP_PAIR_EG;
+extern EVALPARAM PAWN_SHIELD[3];
+extern EVALPARAM PASSED_PAWN_MG[7];
+extern EVALPARAM PASSED_PAWN_EG[7];
+extern EVALPARAM PASSED_PAWN_RANK2_MG;
+extern EVALPARAM PASSED_PAWN_RANK3_MG;
+extern EVALPARAM PASSED_PAWN_RANK4_MG;
+extern EVALPARAM PASSED_PAWN_RANK5_MG;
+extern EVALPARAM PASSED_PAWN_RANK6_MG;
+extern EVALPARAM PASSED_PAWN_RANK7_MG;
+extern EVALPARAM PASSED_PAWN_RANK2_EG;
+extern EVALPARAM PASSED_PAWN_RANK3_EG;
+extern EVALPARAM PASSED_PAWN_RANK4_EG;
+extern EVALPARAM PASSED_PAWN_RANK5_EG;
+extern EVALPARAM PASSED_PAWN_RANK6_EG;
+extern EVALPARAM PASSED_PAWN_RANK7_EG;
+extern EVALPARAM KNIGHT_MOBILITY_MG;
+extern EVALPARAM BISHOP_MOBILITY_MG;
+extern EVALPARAM ROOK_MOBILITY_MG;
+extern EVALPARAM QUEEN_MOBILITY_MG;
+extern EVALPARAM KNIGHT_MOBILITY_EG;
+extern EVALPARAM BISHOP_MOBILITY_EG;
+extern EVALPARAM ROOK_MOBILITY_EG;
+extern EVALPARAM QUEEN_MOBILITY_EG;
+extern EVALPARAM PSQ_TABLE_PAWN_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_KNIGHT_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_BISHOP_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_ROOK_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_QUEEN_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_KING_MG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_PAWN_EG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_KNIGHT_EG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_BISHOP_EG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_ROOK_EG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_QUEEN_EG[NSQUARES];
+extern EVALPARAM PSQ_TABLE_KING_EG[NSQUARES];
+extern EVALPARAM KNIGHT_MATERIAL_VALUE_MG;
+extern EVALPARAM BISHOP_MATERIAL_VALUE_MG;
+extern EVALPARAM ROOK_MATERIAL_VALUE_MG;
+extern EVALPARAM QUEEN_MATERIAL_VALUE_MG;
+extern EVALPARAM KNIGHT_MATERIAL_VALUE_EG;
+extern EVALPARAM BISHOP_MATERIAL_VALUE_EG;
+extern EVALPARAM ROOK_MATERIAL_VALUE_EG;
+extern EVALPARAM QUEEN_MATERIAL_VALUE_EG;
+extern EVALPARAM KING_ATTACK_SCALE_MG;
+extern EVALPARAM KING_ATTACK_SCALE_EG;
+extern EVALPARAM KNIGHT_OUTPOST;
+extern EVALPARAM PROTECTED_KNIGHT_OUTPOST;
+extern EVALPARAM CANDIDATE_PASSED_PAWN_MG[6];
+extern EVALPARAM CANDIDATE_PASSED_PAWN_EG[6];
+extern EVALPARAM FRIENDLY_KING_PASSER_DIST;
+extern EVALPARAM OPPONENT_KING_PASSER_DIST;
+extern EVALPARAM BACKWARD_PAWN_MG;
+extern EVALPARAM BACKWARD_PAWN_EG;
+extern EVALPARAM FREE_PASSED_PAWN_MG;
+extern EVALPARAM FREE_PASSED_PAWN_EG;
+extern EVALPARAM SPACE_SQUARE;
+extern EVALPARAM CONNECTED_PAWNS_MG[7];
+extern EVALPARAM CONNECTED_PAWNS_EG[7];
+extern EVALPARAM THREAT_MINOR_BY_PAWN_MG;
+extern EVALPARAM THREAT_MINOR_BY_PAWN_EG;
+extern EVALPARAM THREAT_PAWN_PUSH_MG;
+extern EVALPARAM THREAT_PAWN_PUSH_EG;
+extern EVALPARAM THREAT_BY_KNIGHT_MG[5];
+extern EVALPARAM THREAT_BY_KNIGHT_EG[5];
+extern EVALPARAM THREAT_BY_BISHOP_MG[5];
+extern EVALPARAM THREAT_BY_BISHOP_EG[5];
+extern EVALPARAM THREAT_BY_ROOK_MG[5];
+extern EVALPARAM THREAT_BY_ROOK_EG[5];
+extern EVALPARAM THREAT_BY_QUEEN_MG[5];
+extern EVALPARAM THREAT_BY_QUEEN_EG[5];
 
 #endif
@@ -185,7 +185,6 @@ bool fen_setup_board(struct position *pos, char *fenstr)
     iter = skip_whitespace(iter);
     if (*iter != '\0' && IS_DIGIT_09(*iter)) {
         /* Halfmove counter field */
-        iter++;
         if (sscanf(iter, "%d", &pos->fifty) != 1) {
             return false;
         }
@@ -227,6 +226,10 @@ bool fen_setup_board(struct position *pos, char *fenstr)
     /* Generate a key for the position */
     pos->key = key_generate(pos);
     pos->pawnkey = key_generate_pawnkey(pos);
+    pos->materialkey = key_generate_materialkey(pos);
+
+    /* Calculate material and piece/square table scores */
+    eval_generate_psq(pos, pos->psq);
 
     return true;
 }
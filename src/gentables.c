@@ -0,0 +1,445 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Build time generator for the attack tables used by bitboard.c. The
+ * program is run on the build host and writes a header with all tables
+ * as constant data so that they don't have to be computed at startup and
+ * so that they end up in read-only memory shared between processes.
+ *
+ * The slider tables are generated in two layouts, one indexed with the
+ * BMI2 pext instruction and one indexed with fancy magics. The layout
+ * is selected by bitboard.c when it is compiled so the generator itself
+ * never executes any BMI2 instructions.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "chess.h"
+
+/* Number of entries in the slider move databases */
+#define ROOK_DB_SIZE 102400
+#define BISHOP_DB_SIZE 5248
+
+/* Information about how to look up slider moves for a given square */
+struct magic {
+    uint64_t mask;
+    uint64_t magic;
+    int      shift;
+    int      offset;
+};
+
+/* Generated slider tables for one piece type and layout */
+struct slider_tables {
+    struct magic magics[NSQUARES];
+    uint64_t     moves[ROOK_DB_SIZE];
+};
+
+/* Bitboard tables for non-slider pieces */
+static uint64_t king_moves_table[NSQUARES];
+static uint64_t knight_moves_table[NSQUARES];
+static uint64_t pawn_moves_table[NSQUARES][NSIDES];
+static uint64_t pawn_attacks_from_table[NSQUARES][NSIDES];
+static uint64_t pawn_attacks_to_table[NSQUARES][NSIDES];
+
+/* Generated slider tables */
+static struct slider_tables rook_pext;
+static struct slider_tables rook_magic;
+static struct slider_tables bishop_pext;
+static struct slider_tables bishop_magic;
+
+static int offset_rook_file[4] = {1, -1, 0, 0};
+static int offset_rook_rank[4] = {0, 0, 1, -1};
+static int offset_bishop_file[4] = {-1, 1, -1, 1};
+static int offset_bishop_rank[4] = {1, 1, -1, -1};
+
+static int pop_count(uint64_t v)
+{
+    int count = 0;
+
+    while (v != 0ULL) {
+        v &= v - 1;
+        count++;
+    }
+    return count;
+}
+
+/*
+ * Portable version of the pext instruction. Extracts the bits of v
+ * selected by mask and packs them into the low bits of the result.
+ */
+static uint64_t pext(uint64_t v, uint64_t mask)
+{
+    uint64_t result = 0ULL;
+    uint64_t bit;
+
+    for (bit=1ULL;mask!=0ULL;bit<<=1) {
+        if ((v&mask&-mask) != 0ULL) {
+            result |= bit;
+        }
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+/*
+ * Generate a bitboard with all possible slider moves in a specified direction
+ * for a given square/occupancy combination.
+ */
+static uint64_t get_slider_moves(int sq, int fdir, int rdir, uint64_t occ)
+{
+    uint64_t moves = 0ULL;
+    int      target;
+    int      rank;
+    int      file;
+
+    file = FILENR(sq) + fdir;
+    rank = RANKNR(sq) + rdir;
+    while (!SQUAREOFFBOARD(file, rank)) {
+        target = SQUARE(file, rank);
+        moves |= 1ULL << target;
+        if ((occ&(1ULL << target)) != 0ULL) {
+            break;
+        }
+        file += fdir;
+        rank += rdir;
+    }
+
+    return moves;
+}
+
+/*
+ * Generate the occupancy mask for a slider in a specified direction. The
+ * last square in each direction is not included since a piece there
+ * never blocks anything.
+ */
+static uint64_t get_slider_mask(int sq, int fdir, int rdir)
+{
+    uint64_t mask = 0ULL;
+    int      rank;
+    int      file;
+
+    file = FILENR(sq) + fdir;
+    rank = RANKNR(sq) + rdir;
+    while (!SQUAREOFFBOARD(file+fdir, rank+rdir)) {
+        mask |= 1ULL << SQUARE(file, rank);
+        file += fdir;
+        rank += rdir;
+    }
+
+    return mask;
+}
+
+/*
+ * Simple xorshift64* pseudo random number generator used when searching
+ * for magics. The generator is seeded with fixed values so the search
+ * always finds the same magics.
+ */
+static uint64_t magic_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state*2685821657736338717ULL;
+}
+
+/*
+ * Find a magic for a square that maps all occupancy combinations to
+ * a table with exactly 2^nblockers entries without any destructive
+ * collisions.
+ */
+static void find_magic(struct magic *m, uint64_t *table, int rank,
+                       uint64_t *occupancies, uint64_t *moves, int nocc)
+{
+    static const uint64_t seeds[NRANKS] = {
+        728, 10316, 55013, 32803, 12281, 15100, 16645, 255
+    };
+    static int epoch[1<<12];
+    static int attempt = 0;
+    uint64_t   state;
+    uint64_t   index;
+    int        k;
+
+    state = seeds[rank];
+    while (true) {
+        /* Magics with few bits set are more likely to work */
+        do {
+            m->magic = magic_random(&state)&magic_random(&state)&
+                                                        magic_random(&state);
+        } while (pop_count((m->mask*m->magic)>>56) < 6);
+
+        /*
+         * Try to store all occupancy combinations. The epoch array
+         * keeps track of which entries have been written during the
+         * current attempt so the table doesn't have to be cleared
+         * between attempts.
+         */
+        attempt++;
+        for (k=0;k<nocc;k++) {
+            index = ((occupancies[k]&m->mask)*m->magic)>>m->shift;
+            if (epoch[index] < attempt) {
+                epoch[index] = attempt;
+                table[index] = moves[k];
+            } else if (table[index] != moves[k]) {
+                break;
+            }
+        }
+        if (k == nocc) {
+            return;
+        }
+    }
+}
+
+/*
+ * Generate the slider move databases for one piece type in both the
+ * pext and the magic layout. A good description about how magic
+ * bitboards work can be found at:
+ * http://www.afewmorelines.com/understanding-magic-bitboards-in-chess-programming/
+ */
+static bool gen_slider_tables(struct slider_tables *pext_tables,
+                              struct slider_tables *magic_tables,
+                              int *offset_file, int *offset_rank, int db_size)
+{
+    uint64_t occupancies[1<<12];
+    uint64_t moves[1<<12];
+    uint64_t mask;
+    uint64_t occ;
+    int      offset;
+    int      nblockers;
+    int      nocc;
+    int      sq;
+    int      dir;
+    int      k;
+
+    offset = 0;
+    for (sq=0;sq<NSQUARES;sq++) {
+        mask = 0ULL;
+        for (dir=0;dir<4;dir++) {
+            mask |= get_slider_mask(sq, offset_file[dir], offset_rank[dir]);
+        }
+        nblockers = pop_count(mask);
+        nocc = 1 << nblockers;
+
+        /*
+         * Enumerate all subsets of the mask using the carry-rippler
+         * trick and generate the moves for each of them.
+         */
+        occ = 0ULL;
+        for (k=0;k<nocc;k++) {
+            occupancies[k] = occ;
+            moves[k] = 0ULL;
+            for (dir=0;dir<4;dir++) {
+                moves[k] |= get_slider_moves(sq, offset_file[dir],
+                                             offset_rank[dir], occ);
+            }
+            occ = (occ - mask)&mask;
+        }
+
+        pext_tables->magics[sq].mask = mask;
+        pext_tables->magics[sq].offset = offset;
+        for (k=0;k<nocc;k++) {
+            pext_tables->moves[offset+pext(occupancies[k], mask)] = moves[k];
+        }
+
+        magic_tables->magics[sq].mask = mask;
+        magic_tables->magics[sq].shift = 64 - nblockers;
+        magic_tables->magics[sq].offset = offset;
+        find_magic(&magic_tables->magics[sq], &magic_tables->moves[offset],
+                   RANKNR(sq), occupancies, moves, nocc);
+
+        offset += nocc;
+    }
+    if (offset != db_size) {
+        fprintf(stderr, "Unexpected slider database size %d\n", offset);
+        return false;
+    }
+    return true;
+}
+
+static void gen_pawn_tables(void)
+{
+    int sq;
+    int rank;
+    int file;
+
+    for (sq=0;sq<NSQUARES;sq++) {
+        rank = RANKNR(sq);
+        file = FILENR(sq);
+
+        /* White pawns */
+        if (rank != RANK_1) {
+            if (file != FILE_A) {
+                pawn_attacks_to_table[sq][WHITE] |= 1ULL << (sq-9);
+            }
+            if (file != FILE_H) {
+                pawn_attacks_to_table[sq][WHITE] |= 1ULL << (sq-7);
+            }
+        }
+        if ((rank != RANK_1) && (rank != RANK_8)) {
+            if (file != FILE_A) {
+                pawn_attacks_from_table[sq][WHITE] |= 1ULL << (sq+7);
+            }
+            if (file != FILE_H) {
+                pawn_attacks_from_table[sq][WHITE] |= 1ULL << (sq+9);
+            }
+            pawn_moves_table[sq][WHITE] |= 1ULL << (sq+8);
+            if (rank == RANK_2) {
+                pawn_moves_table[sq][WHITE] |= 1ULL << (sq+16);
+            }
+        }
+
+        /* Black pawns */
+        if (rank != RANK_8) {
+            if (file != FILE_A) {
+                pawn_attacks_to_table[sq][BLACK] |= 1ULL << (sq+7);
+            }
+            if (file != FILE_H) {
+                pawn_attacks_to_table[sq][BLACK] |= 1ULL << (sq+9);
+            }
+        }
+        if ((rank != RANK_1) && (rank != RANK_8)) {
+            if (file != FILE_A) {
+                pawn_attacks_from_table[sq][BLACK] |= 1ULL << (sq-9);
+            }
+            if (file != FILE_H) {
+                pawn_attacks_from_table[sq][BLACK] |= 1ULL << (sq-7);
+            }
+            pawn_moves_table[sq][BLACK] |= 1ULL << (sq-8);
+            if (rank == RANK_7) {
+                pawn_moves_table[sq][BLACK] |= 1ULL << (sq-16);
+            }
+        }
+    }
+}
+
+static void gen_step_table(uint64_t *table, int *offset_file, int *offset_rank)
+{
+    int sq;
+    int k;
+    int file;
+    int rank;
+
+    for (sq=0;sq<NSQUARES;sq++) {
+        for (k=0;k<8;k++) {
+            file = FILENR(sq) + offset_file[k];
+            rank = RANKNR(sq) + offset_rank[k];
+            if (!SQUAREOFFBOARD(file, rank)) {
+                table[sq] |= 1ULL << SQUARE(file, rank);
+            }
+        }
+    }
+}
+
+/*
+ * Print a table of bitboards. Tables with more than one bitboard per
+ * square are printed as two-dimensional arrays.
+ */
+static void print_bitboards(const char *name, uint64_t *bbs, int count,
+                            int width)
+{
+    int k;
+
+    printf("static const uint64_t %s = {", name);
+    for (k=0;k<count;k++) {
+        if (width > 1) {
+            printf("%s", (k%width == 0)?"\n    {":" ");
+        } else {
+            printf("%s", (k%4 == 0)?"\n    ":" ");
+        }
+        printf("0x%016llXULL", (unsigned long long)bbs[k]);
+        if ((width > 1) && (k%width == (width - 1))) {
+            printf("}");
+        }
+        if (k < (count - 1)) {
+            printf(",");
+        }
+    }
+    printf("\n};\n\n");
+}
+
+static void print_slider_tables(const char *piece, struct slider_tables *tables,
+                                int db_size, bool pext_layout)
+{
+    char name[64];
+    int  sq;
+
+    printf("static const struct magic %s_magics[NSQUARES] = {\n", piece);
+    for (sq=0;sq<NSQUARES;sq++) {
+        if (pext_layout) {
+            printf("    {0x%016llXULL, %d}",
+                   (unsigned long long)tables->magics[sq].mask,
+                   tables->magics[sq].offset);
+        } else {
+            printf("    {0x%016llXULL, 0x%016llXULL, %d, %d}",
+                   (unsigned long long)tables->magics[sq].mask,
+                   (unsigned long long)tables->magics[sq].magic,
+                   tables->magics[sq].shift, tables->magics[sq].offset);
+        }
+        printf("%s\n", (sq < (NSQUARES - 1))?",":"");
+    }
+    printf("};\n\n");
+
+    sprintf(name, "%s_moves_db[%s_DB_SIZE]", piece,
+            strcmp(piece, "rook") == 0?"ROOK":"BISHOP");
+    print_bitboards(name, tables->moves, db_size, 1);
+}
+
+int main(void)
+{
+    int king_file[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+    int king_rank[8] = {0, -1, -1, -1, 0, 1, 1, 1};
+    int knight_file[8] = {2, 1, -1, -2, -2, -1, 1, 2};
+    int knight_rank[8] = {-1, -2, -2, -1, 1, 2, 2, 1};
+
+    if (!gen_slider_tables(&rook_pext, &rook_magic, offset_rook_file,
+                           offset_rook_rank, ROOK_DB_SIZE) ||
+        !gen_slider_tables(&bishop_pext, &bishop_magic, offset_bishop_file,
+                           offset_bishop_rank, BISHOP_DB_SIZE)) {
+        return 1;
+    }
+    gen_pawn_tables();
+    gen_step_table(king_moves_table, king_file, king_rank);
+    gen_step_table(knight_moves_table, knight_file, knight_rank);
+
+    printf("/* Generated by gentables. Do not edit. */\n\n");
+    printf("#define ROOK_DB_SIZE %d\n", ROOK_DB_SIZE);
+    printf("#define BISHOP_DB_SIZE %d\n\n", BISHOP_DB_SIZE);
+
+    printf("#ifdef USE_BMI2\n\n");
+    print_slider_tables("rook", &rook_pext, ROOK_DB_SIZE, true);
+    print_slider_tables("bishop", &bishop_pext, BISHOP_DB_SIZE, true);
+    printf("#else\n\n");
+    print_slider_tables("rook", &rook_magic, ROOK_DB_SIZE, false);
+    print_slider_tables("bishop", &bishop_magic, BISHOP_DB_SIZE, false);
+    printf("#endif\n\n");
+
+    print_bitboards("king_moves_table[NSQUARES]", king_moves_table, NSQUARES,
+                    1);
+    print_bitboards("knight_moves_table[NSQUARES]", knight_moves_table,
+                    NSQUARES, 1);
+    print_bitboards("pawn_moves_table[NSQUARES][NSIDES]",
+                    &pawn_moves_table[0][0], NSQUARES*NSIDES, NSIDES);
+    print_bitboards("pawn_attacks_from_table[NSQUARES][NSIDES]",
+                    &pawn_attacks_from_table[0][0], NSQUARES*NSIDES, NSIDES);
+    print_bitboards("pawn_attacks_to_table[NSQUARES][NSIDES]",
+                    &pawn_attacks_to_table[0][0], NSQUARES*NSIDES, NSIDES);
+
+    return 0;
+}
@@ -21,6 +21,13 @@
 #include <stdio.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <stdatomic.h>
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "hash.h"
 #include "validation.h"
@@ -29,18 +36,556 @@
 #include "utils.h"
 #include "smp.h"
 #include "config.h"
+#include "debug.h"
+#include "timetrace.h"
+#include "engine.h"
+#include "nnue.h"
 
-/* Macros for managing the hash key stored in struct tt_item */
-#define KEY_LOW(k)  ((uint32_t)((k)&0x00000000FFFFFFFF))
-#define KEY_HIGH(k) ((uint32_t)(((k)>>32)&0x00000000FFFFFFFF))
-#define KEY_EQUALS(k, i) \
-                (k) == ((((uint64_t)(i)->key_high)<<32)|(uint64_t)(i)->key_low)
-#define KEY_IS_ZERO(i) ((i)->key_low == 0ULL) && ((i)->key_high == 0ULL)
+/*
+ * Transposition table files start with a header padded to a full
+ * page so that the table itself can be mapped directly from the file.
+ */
+#define TT_FILE_MAGIC "MARVINTT"
+#define TT_FILE_VERSION 1
+#define TT_FILE_HEADER_SIZE 4096
+#ifdef TT_COMPACT
+#define TT_FILE_FORMAT 1
+#else
+#define TT_FILE_FORMAT 0
+#endif
+
+/* Header of a transposition table file */
+struct tt_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t bucket_size;
+    uint8_t date;
+    uint64_t nbuckets;
+};
+
+/*
+ * Files used for sharing transposition table items between engine
+ * instances. The header is followed by a list of records, each holding
+ * an item together with the index of the bucket it was stored in.
+ */
+#define TT_SHARE_MAGIC "MARVTTSH"
+#define TT_SHARE_VERSION 1
+
+/* Header of a transposition table share file */
+struct tt_share_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t entry_size;
+    uint64_t nbuckets;
+    uint64_t nrecords;
+};
+
+/* A shared transposition table item */
+struct tt_share_record {
+    uint64_t idx;
+    struct tt_entry entry;
+};
+
+/* Page type used when the table is mapped from a file */
+#define TT_PAGES_FILE -1
 
 /* Main transposition table */
 static struct tt_bucket *transposition_table = NULL;
 static uint64_t tt_size = 0ULL;
+
+/*
+ * The size (in MB) last requested for the main table. The table may be
+ * smaller than this in order to stay within the memory limit.
+ */
+static int tt_requested_size = 0;
 static uint8_t tt_date = 0;
+static int tt_policy = TT_POLICY_GAME;
+
+/*
+ * With the analysis policy items age this many times slower and
+ * exact items are valued as if searched this many plies deeper.
+ */
+#define ANALYSIS_AGE_DIVISOR 8
+#define ANALYSIS_EXACT_BONUS 2
+
+/*
+ * Cache of tablebase WDL probe results shared by all workers. Each item
+ * holds the position key with the lowest bits replaced by the probe
+ * result plus one, so an item is read and written as a single word
+ * without locking. A value of zero indicates an empty item.
+ */
+#define TBCACHE_RESULT_MASK 0x7ULL
+static atomic_uint_least64_t *tbcache = NULL;
+static uint64_t tbcache_size = 0ULL;
+
+/*
+ * Table of material dependent evaluation information shared by all
+ * workers. Each item holds the material key with the lowest bits
+ * replaced by the game phase, a set of flags and a valid bit so that
+ * an item is read and written as a single word without locking.
+ */
+#define MATERIAL_PHASE_BITS 9
+#define MATERIAL_FLAGS_BITS 2
+#define MATERIAL_VALID_BIT (1ULL << (MATERIAL_PHASE_BITS+MATERIAL_FLAGS_BITS))
+#define MATERIAL_DATA_MASK ((MATERIAL_VALID_BIT << 1) - 1)
+static atomic_uint_least64_t *material_table = NULL;
+static uint64_t material_table_size = 0ULL;
+
+/*
+ * State for clearing the main table in the background. While a clear is
+ * pending all items stored before clear_date are treated as invalid.
+ */
+struct clear_task {
+    thread_t thread;
+    uint64_t start;
+    uint64_t end;
+};
+static struct clear_task *clear_tasks = NULL;
+static int nclear_tasks = 0;
+static atomic_int nclear_running = 0;
+static atomic_bool clear_pending = false;
+static uint8_t clear_date = 0;
+
+/* Data used by threads transferring items when resizing the main table */
+struct resize_task {
+    thread_t thread;
+    struct tt_bucket *old_table;
+    uint64_t old_size;
+    uint64_t start;
+    uint64_t end;
+};
+
+#ifdef TT_COMPACT
+/* Macros for managing the packed fields in struct tt_entry */
+#define KEY_CHECK(k)        ((uint16_t)((k)>>48))
+#define GENBOUND(d, t)      ((uint8_t)((((d)&DATE_MASK)<<2)|((t)&0x03)))
+#define GENBOUND_TYPE(g)    ((g)&0x03)
+#define GENBOUND_DATE(g)    ((g)>>2)
+#define DATE_MASK           0x3F
+#define DATE_AGE(a, b)      ((uint8_t)(((a)-(b))&DATE_MASK))
+#define PACKED_MOVE(m)      ((uint16_t)((m)&0x0000FFFF))
+
+/*
+ * Only the from/to squares and the promotion piece are stored for
+ * moves. The move type flags are recovered from the position.
+ * The caller still has to check that the move is pseudo legal.
+ */
+static uint32_t expand_move(struct position *pos, uint16_t packed)
+{
+    int from;
+    int to;
+    int promotion;
+    int piece;
+    int flags;
+
+    if (packed == NOMOVE) {
+        return NOMOVE;
+    }
+
+    from = FROM(packed);
+    to = TO(packed);
+    promotion = PROMOTION(packed);
+    piece = pos->pieces[from];
+
+    flags = NORMAL;
+    if (pos->pieces[to] != NO_PIECE) {
+        flags |= CAPTURE;
+    }
+    if (promotion != NO_PIECE) {
+        flags |= PROMOTION;
+    }
+    if ((VALUE(piece) == PAWN) && (to == pos->ep_sq)) {
+        flags |= EN_PASSANT;
+    } else if (VALUE(piece) == KING) {
+        if (to == (from+2)) {
+            flags |= KINGSIDE_CASTLE;
+        } else if (to == (from-2)) {
+            flags |= QUEENSIDE_CASTLE;
+        }
+    }
+
+    return MOVE(from, to, promotion, flags);
+}
+
+static bool entry_is_empty(struct tt_entry *entry)
+{
+    return (entry->key == 0) && (entry->move == 0) && (entry->genbound == 0);
+}
+
+static bool entry_matches(struct tt_entry *entry, uint64_t key)
+{
+    return (entry->key == KEY_CHECK(key)) && !entry_is_empty(entry);
+}
+
+static int entry_depth(struct tt_entry *entry)
+{
+    return entry->depth;
+}
+
+static uint8_t entry_date(struct tt_entry *entry)
+{
+    return GENBOUND_DATE(entry->genbound);
+}
+
+static int entry_type(struct tt_entry *entry)
+{
+    return GENBOUND_TYPE(entry->genbound);
+}
+
+/*
+ * Only the upper bits of the key are stored so the bucket of an item
+ * is only known when the table shrinks.
+ */
+static bool entry_rehash(struct tt_entry *entry, uint64_t old_idx,
+                         uint64_t old_size, uint64_t *idx)
+{
+    (void)entry;
+
+    if (tt_size > old_size) {
+        return false;
+    }
+    *idx = old_idx&(tt_size-1);
+    return true;
+}
+
+static void entry_set_date(struct tt_entry *entry, uint8_t date)
+{
+    entry->genbound = GENBOUND(date, GENBOUND_TYPE(entry->genbound));
+}
+
+static bool entry_same_position(struct tt_entry *a, struct tt_entry *b)
+{
+    return (a->key == b->key) && !entry_is_empty(a) && !entry_is_empty(b);
+}
+
+static bool entry_read(struct tt_entry *entry, struct position *pos,
+                       struct tt_item *item)
+{
+    if (!entry_matches(entry, pos->key)) {
+        return false;
+    }
+
+    item->move = expand_move(pos, entry->move);
+    item->type = GENBOUND_TYPE(entry->genbound);
+    item->depth = entry->depth;
+    item->score = entry->score;
+    item->eval_score = entry->eval_score;
+    item->date = GENBOUND_DATE(entry->genbound);
+
+    return true;
+}
+
+static void entry_write(struct tt_entry *entry, uint64_t key, uint32_t move,
+                        int depth, int score, int type, int eval_score)
+{
+    entry->key = KEY_CHECK(key);
+    entry->move = PACKED_MOVE(move);
+    entry->score = (int16_t)score;
+    entry->eval_score = (int16_t)eval_score;
+    entry->depth = depth;
+    entry->genbound = GENBOUND(tt_date, type);
+}
+#else
+/* Macros for managing the split 64-bit words stored in struct tt_entry */
+#define LOW(w)  ((uint32_t)((w)&0x00000000FFFFFFFF))
+#define HIGH(w) ((uint32_t)(((w)>>32)&0x00000000FFFFFFFF))
+#define JOIN(h, l) ((((uint64_t)(h))<<32)|(uint64_t)(l))
+#define DATE_AGE(a, b) ((uint8_t)((a)-(b)))
+
+/* Macros for packing item data into the data word of struct tt_entry */
+#define DATA_MOVE(d)        ((uint32_t)((d)&0x00000000003FFFFF))
+#define DATA_TYPE(d)        ((int)(((d)>>22)&0x0000000000000003))
+#define DATA_DEPTH(d)       ((int)(((d)>>24)&0x00000000000000FF))
+#define DATA_SCORE(d)       ((int16_t)(((d)>>32)&0x000000000000FFFF))
+#define DATA_EVAL(d)        ((int16_t)(((d)>>48)&0x000000000000FFFF))
+#define DATA(m, t, d, s, e) (((uint64_t)(m)) | \
+                             (((uint64_t)(t))<<22) | \
+                             (((uint64_t)(d))<<24) | \
+                             (((uint64_t)(uint16_t)(s))<<32) | \
+                             (((uint64_t)(uint16_t)(e))<<48))
+
+static bool entry_is_empty(struct tt_entry *entry)
+{
+    return (entry->check_low == 0) && (entry->check_high == 0) &&
+           (entry->data_low == 0) && (entry->data_high == 0);
+}
+
+static bool entry_matches(struct tt_entry *entry, uint64_t key)
+{
+    uint64_t data;
+    uint64_t check;
+
+    data = JOIN(entry->data_high, entry->data_low);
+    check = JOIN(entry->check_high, entry->check_low);
+
+    return (check^data) == key;
+}
+
+static int entry_depth(struct tt_entry *entry)
+{
+    return DATA_DEPTH(JOIN(entry->data_high, entry->data_low));
+}
+
+static uint8_t entry_date(struct tt_entry *entry)
+{
+    return entry->date;
+}
+
+static int entry_type(struct tt_entry *entry)
+{
+    return DATA_TYPE(JOIN(entry->data_high, entry->data_low));
+}
+
+/* The full key can be recovered so items can always be rehashed */
+static bool entry_rehash(struct tt_entry *entry, uint64_t old_idx,
+                         uint64_t old_size, uint64_t *idx)
+{
+    uint64_t key;
+
+    (void)old_idx;
+    (void)old_size;
+
+    key = JOIN(entry->check_high, entry->check_low)^
+                                    JOIN(entry->data_high, entry->data_low);
+    *idx = key&(tt_size-1);
+    return true;
+}
+
+static void entry_set_date(struct tt_entry *entry, uint8_t date)
+{
+    entry->date = date;
+}
+
+static bool entry_same_position(struct tt_entry *a, struct tt_entry *b)
+{
+    return !entry_is_empty(a) && !entry_is_empty(b) &&
+           ((JOIN(a->check_high, a->check_low)^
+                                JOIN(a->data_high, a->data_low)) ==
+            (JOIN(b->check_high, b->check_low)^
+                                JOIN(b->data_high, b->data_low)));
+}
+
+static bool entry_read(struct tt_entry *entry, struct position *pos,
+                       struct tt_item *item)
+{
+    uint64_t data;
+    uint64_t check;
+
+    /*
+     * The data word is read once and then only that copy is used,
+     * so a matching check word guarantees that the returned data
+     * is consistent.
+     */
+    data = JOIN(entry->data_high, entry->data_low);
+    check = JOIN(entry->check_high, entry->check_low);
+    if ((check^data) != pos->key) {
+        return false;
+    }
+
+    item->move = DATA_MOVE(data);
+    item->type = DATA_TYPE(data);
+    item->depth = DATA_DEPTH(data);
+    item->score = DATA_SCORE(data);
+    item->eval_score = DATA_EVAL(data);
+    item->date = entry->date;
+
+    return true;
+}
+
+static void entry_write(struct tt_entry *entry, uint64_t key, uint32_t move,
+                        int depth, int score, int type, int eval_score)
+{
+    uint64_t data;
+    uint64_t check;
+
+    assert(DATA_MOVE(move) == move);
+
+    data = DATA(move, type, depth, score, eval_score);
+    check = key^data;
+    entry->check_high = HIGH(check);
+    entry->check_low = LOW(check);
+    entry->data_high = HIGH(data);
+    entry->data_low = LOW(data);
+    entry->date = tt_date;
+}
+#endif
+
+static uint8_t entry_age(struct tt_entry *entry)
+{
+    return DATE_AGE(tt_date, entry_date(entry));
+}
+
+static bool entry_valid(struct tt_entry *entry)
+{
+    if (!atomic_load_explicit(&clear_pending, memory_order_relaxed)) {
+        return true;
+    }
+    return entry_age(entry) <= DATE_AGE(tt_date, clear_date);
+}
+
+static int entry_value(struct tt_entry *entry)
+{
+    int depth;
+
+    /*
+     * The main idea is to prefer searches to a higher depth
+     * and to prefer newer searches before older ones.
+     */
+    if (tt_policy == TT_POLICY_GAME) {
+        return (256 - entry_age(entry) - 1) + entry_depth(entry)*256;
+    }
+
+    /*
+     * When analysing the results of earlier searches of the same
+     * position stay useful for a long time, so depth dominates and
+     * exact items, which make up the PV, are protected further.
+     */
+    depth = entry_depth(entry);
+    if (entry_type(entry) == TT_EXACT) {
+        depth += ANALYSIS_EXACT_BONUS;
+    }
+    return (256 - entry_age(entry)/ANALYSIS_AGE_DIVISOR - 1) + depth*256;
+}
+
+static thread_retval_t clear_func(void *data)
+{
+    struct clear_task *task = data;
+    struct tt_entry   *entry;
+    uint64_t          idx;
+    int               k;
+
+    /*
+     * Only wipe items that are invalid. Items stored by searches
+     * started after the clear was requested are left alone.
+     */
+    for (idx=task->start;idx<task->end;idx++) {
+        for (k=0;k<TT_BUCKET_SIZE;k++) {
+            entry = &transposition_table[idx].items[k];
+            if (!entry_is_empty(entry) && !entry_valid(entry)) {
+                memset(entry, 0, sizeof(struct tt_entry));
+            }
+        }
+    }
+
+    if (atomic_fetch_sub(&nclear_running, 1) == 1) {
+        atomic_store(&clear_pending, false);
+    }
+
+    return (thread_retval_t)0;
+}
+
+static void wait_for_clear(void)
+{
+    int k;
+
+    if (clear_tasks == NULL) {
+        return;
+    }
+
+    TIMETRACE_BEGIN(NULL, "wait for tt clear");
+    for (k=0;k<nclear_tasks;k++) {
+        thread_join(&clear_tasks[k].thread);
+    }
+    TIMETRACE_END(NULL, "wait for tt clear");
+    free(clear_tasks);
+    clear_tasks = NULL;
+    nclear_tasks = 0;
+    assert(!atomic_load(&clear_pending));
+}
+
+/*
+ * Store an item in a bucket if there is an empty slot or an item of
+ * lower value. Returns true if the item was stored.
+ */
+static bool transfer_entry(struct tt_bucket *bucket, struct tt_entry *entry)
+{
+    struct tt_entry *worst_entry;
+    int             worst_value;
+    int             value;
+    int             k;
+
+    worst_entry = NULL;
+    worst_value = INT_MAX;
+    for (k=0;k<TT_BUCKET_SIZE;k++) {
+        if (entry_is_empty(&bucket->items[k])) {
+            worst_entry = &bucket->items[k];
+            break;
+        }
+        value = entry_value(&bucket->items[k]);
+        if (value < worst_value) {
+            worst_value = value;
+            worst_entry = &bucket->items[k];
+        }
+    }
+    assert(worst_entry != NULL);
+
+    if (entry_is_empty(worst_entry) || (entry_value(entry) > worst_value)) {
+        memcpy(worst_entry, entry, sizeof(struct tt_entry));
+        return true;
+    }
+    return false;
+}
+
+static thread_retval_t resize_func(void *data)
+{
+    struct resize_task *task = data;
+    struct tt_entry    *entry;
+    uint64_t           smaller;
+    uint64_t           idx;
+    uint64_t           old_idx;
+    uint64_t           new_idx;
+    int                k;
+
+    /*
+     * Each task handles a range of buckets in the smaller of the two
+     * tables. All buckets in the larger table that share the same low
+     * index bits are then processed by the same task so no two tasks
+     * ever write to the same bucket.
+     */
+    smaller = MIN(task->old_size, tt_size);
+    for (idx=task->start;idx<task->end;idx++) {
+        for (old_idx=idx;old_idx<task->old_size;old_idx+=smaller) {
+            for (k=0;k<TT_BUCKET_SIZE;k++) {
+                entry = &task->old_table[old_idx].items[k];
+                if (entry_is_empty(entry) || !entry_valid(entry) ||
+                    !entry_rehash(entry, old_idx, task->old_size, &new_idx)) {
+                    continue;
+                }
+                (void)transfer_entry(&transposition_table[new_idx], entry);
+            }
+        }
+    }
+
+    return (thread_retval_t)0;
+}
+
+/* Flag indicating if large pages should be used for the main table */
+static bool use_large_pages = false;
+
+/* The type of pages backing the main transposition table */
+static int tt_page_type = LARGE_PAGES_NONE;
+
+static void* tt_malloc(uint64_t size)
+{
+    if (use_large_pages) {
+        return large_pages_malloc(size, &tt_page_type);
+    }
+    tt_page_type = LARGE_PAGES_NONE;
+    return aligned_malloc(CACHE_LINE_SIZE, size);
+}
+
+static void tt_free(struct tt_bucket *table, uint64_t size, int page_type)
+{
+    if (page_type == TT_PAGES_FILE) {
+#ifndef WINDOWS
+        munmap(((char*)table)-TT_FILE_HEADER_SIZE, size+TT_FILE_HEADER_SIZE);
+#endif
+        return;
+    }
+    large_pages_free(table, size, page_type);
+}
 
 static int largest_power_of_2(uint64_t size, int item_size)
 {
@@ -60,15 +605,16 @@ static int largest_power_of_2(uint64_t size, int item_size)
 static void allocate_tt(int size)
 {
     tt_size = largest_power_of_2(size, sizeof(struct tt_bucket));
-    transposition_table = aligned_malloc(CACHE_LINE_SIZE,
-                                         tt_size*sizeof(struct tt_bucket));
+    transposition_table = tt_malloc(tt_size*sizeof(struct tt_bucket));
     if (transposition_table == NULL) {
         tt_size = largest_power_of_2(MIN_MAIN_HASH_SIZE,
                                      sizeof(struct tt_bucket));
-        transposition_table = aligned_malloc(CACHE_LINE_SIZE,
-                                             tt_size*sizeof(struct tt_bucket));
+        transposition_table = tt_malloc(tt_size*sizeof(struct tt_bucket));
     }
     assert(transposition_table != NULL);
+
+    LOG_INFO1("Allocated %d MB transposition table using %s\n",
+              hash_tt_size(), hash_tt_page_type());
 }
 
 static void allocate_pawntt(struct search_worker *worker, int size)
@@ -79,24 +625,181 @@ static void allocate_pawntt(struct search_worker *worker, int size)
     assert(worker->pawntt != NULL);
 }
 
+static void allocate_evalcache(struct search_worker *worker, int size)
+{
+    worker->evalcache_size = largest_power_of_2(size,
+                                                sizeof(struct evalcache_item));
+    worker->evalcache = aligned_malloc(CACHE_LINE_SIZE,
+                        worker->evalcache_size*sizeof(struct evalcache_item));
+    assert(worker->evalcache != NULL);
+}
+
+/*
+ * Get the largest size (in MB), at most size, that the main table can
+ * have without the engine exceeding the memory limit. Positions of
+ * workers that have not yet searched with NNUE are counted as well.
+ */
+static int fit_tt_size(int size)
+{
+    uint64_t limit;
+    uint64_t used;
+    uint64_t workers;
+    uint64_t pawntt;
+    uint64_t evalcache;
+    uint64_t nnue;
+    uint64_t available;
+
+    if (engine_memory_limit == 0) {
+        return size;
+    }
+
+    smp_memory_usage(&workers, &pawntt, &evalcache, &nnue);
+    if (engine_using_nnue) {
+        nnue = MAX(nnue, smp_number_of_workers()*nnue_pos_memory(NULL));
+    }
+    used = engine_fixed_memory() + workers + pawntt + evalcache + nnue;
+    limit = engine_memory_limit*1024ULL*1024ULL;
+    available = (limit > used)?(limit-used)/(1024ULL*1024ULL):0ULL;
+    if (available < (uint64_t)size) {
+        size = (int)available;
+    }
+
+    return MAX(size, MIN_MAIN_HASH_SIZE);
+}
+
 int hash_tt_max_size(void)
 {
 	return is64bit()?MAX_MAIN_HASH_SIZE_64BIT:MAX_MAIN_HASH_SIZE_32BIT;
 }
 
+int hash_tt_size(void)
+{
+    return (int)((tt_size*sizeof(struct tt_bucket))/(1024ULL*1024ULL));
+}
+
+void hash_tt_set_large_pages(bool enabled)
+{
+    use_large_pages = enabled;
+}
+
+bool hash_tt_large_pages(void)
+{
+    return use_large_pages;
+}
+
+void hash_tt_set_policy(int policy)
+{
+    assert((policy == TT_POLICY_GAME) || (policy == TT_POLICY_ANALYSIS));
+
+    tt_policy = policy;
+}
+
+int hash_tt_policy(void)
+{
+    return tt_policy;
+}
+
+const char* hash_tt_page_type(void)
+{
+    switch (tt_page_type) {
+    case LARGE_PAGES_1GB:
+        return "1GB huge pages";
+    case LARGE_PAGES_2MB:
+        return "2MB huge pages";
+    case LARGE_PAGES_TRANSPARENT:
+        return "transparent huge pages";
+    case TT_PAGES_FILE:
+        return "a memory mapped file";
+    case LARGE_PAGES_NONE:
+    default:
+        return "normal pages";
+    }
+}
+
 void hash_tt_create_table(int size)
 {
 	assert((size >= MIN_MAIN_HASH_SIZE) && (size <= hash_tt_max_size()));
 	
     hash_tt_destroy_table();
 
+    tt_requested_size = size;
+    allocate_tt(fit_tt_size(size));
+    hash_tt_clear_table();
+}
+
+void hash_tt_resize_table(int size)
+{
+    struct tt_bucket   *old_table;
+    uint64_t           old_size;
+    int                old_page_type;
+    struct resize_task *task_list;
+    uint64_t           smaller;
+    uint64_t           per_thread;
+    int                nthreads;
+    int                k;
+
+	assert((size >= MIN_MAIN_HASH_SIZE) && (size <= hash_tt_max_size()));
+
+    if (transposition_table == NULL) {
+        hash_tt_create_table(size);
+        return;
+    }
+
+    /* Nothing to do if the number of buckets doesn't change */
+    tt_requested_size = size;
+    size = fit_tt_size(size);
+    if ((uint64_t)largest_power_of_2(size, sizeof(struct tt_bucket)) ==
+                                                                    tt_size) {
+        return;
+    }
+
+    /*
+     * Keeping both tables around while moving items could exceed the
+     * memory limit so with a limit the old table is simply replaced.
+     */
+    if (engine_memory_limit > 0) {
+        hash_tt_destroy_table();
+        allocate_tt(size);
+        hash_tt_clear_table();
+        return;
+    }
+
+    /* Allocate the new table while keeping the old one around */
+    wait_for_clear();
+    old_table = transposition_table;
+    old_size = tt_size;
+    old_page_type = tt_page_type;
     allocate_tt(size);
     hash_tt_clear_table();
+
+    /* Move over as many items as possible to the new table */
+    nthreads = smp_number_of_workers();
+    smaller = MIN(old_size, tt_size);
+    if ((uint64_t)nthreads > smaller) {
+        nthreads = 1;
+    }
+    per_thread = smaller/nthreads;
+    task_list = malloc(sizeof(struct resize_task)*nthreads);
+    for (k=0;k<nthreads;k++) {
+        task_list[k].old_table = old_table;
+        task_list[k].old_size = old_size;
+        task_list[k].start = per_thread*k;
+        task_list[k].end = (k == (nthreads-1))?smaller:per_thread*(k+1);
+        thread_create(&task_list[k].thread, resize_func, &task_list[k]);
+    }
+    for (k=0;k<nthreads;k++) {
+        thread_join(&task_list[k].thread);
+    }
+    free(task_list);
+
+    tt_free(old_table, old_size*sizeof(struct tt_bucket), old_page_type);
 }
 
 void hash_tt_destroy_table(void)
 {
-    aligned_free(transposition_table);
+    wait_for_clear();
+    tt_free(transposition_table, tt_size*sizeof(struct tt_bucket),
+            tt_page_type);
     transposition_table = NULL;
     tt_size = 0ULL;
     tt_date = 0;
@@ -106,12 +809,62 @@ void hash_tt_clear_table(void)
 {
     assert(transposition_table != NULL);
 
+    wait_for_clear();
+
+    /*
+     * In NUMA mode the clearing threads are spread over the
+     * nodes so that the table is interleaved between them.
+     */
+    TIMETRACE_BEGIN(NULL, "tt clear");
     parallel_memset(transposition_table, 0, tt_size*sizeof(struct tt_bucket),
-                    smp_number_of_workers());
+                    MAX(smp_number_of_workers(), 1),
+                    smp_numa_mode()?thread_number_of_nodes():0);
+    TIMETRACE_END(NULL, "tt clear");
+}
+
+void hash_tt_clear_table_async(void)
+{
+    uint64_t per_thread;
+    int      k;
+
+    assert(transposition_table != NULL);
+
+    wait_for_clear();
+
+    /*
+     * Start a new generation. Until the background clear has
+     * finished all items from older generations are ignored.
+     */
+    tt_date++;
+    clear_date = tt_date;
+
+    nclear_tasks = smp_number_of_workers();
+    if ((uint64_t)nclear_tasks > tt_size) {
+        nclear_tasks = 1;
+    }
+    atomic_store(&nclear_running, nclear_tasks);
+    atomic_store(&clear_pending, true);
+    TIMETRACE_INSTANT(NULL, "tt clear started", nclear_tasks);
+
+    per_thread = tt_size/nclear_tasks;
+    clear_tasks = malloc(sizeof(struct clear_task)*nclear_tasks);
+    for (k=0;k<nclear_tasks;k++) {
+        clear_tasks[k].start = per_thread*k;
+        clear_tasks[k].end = (k == (nclear_tasks-1))?
+                                                tt_size:per_thread*(k+1);
+        thread_create(&clear_tasks[k].thread, clear_func, &clear_tasks[k]);
+    }
 }
 
 void hash_tt_age_table(void)
 {
+    /*
+     * Searches never store items while the table is being cleared
+     * since the clear could otherwise tear an item that is being
+     * written, which TT_COMPACT builds can not detect.
+     */
+    wait_for_clear();
+
     tt_date++;
 }
 
@@ -120,16 +873,17 @@ void hash_tt_store(struct position *pos, uint32_t move, int depth, int score,
 {
     uint64_t         idx;
     struct tt_bucket *bucket;
-    struct tt_item   *item;
-    struct tt_item   *worst_item;
-    int              item_score;
+    struct tt_entry  *entry;
+    struct tt_entry  *worst_entry;
+    int              entry_score;
     int              worst_score;
+    bool             overwrite;
     int              k;
-    uint8_t          age;
 
     assert(valid_position(pos));
     assert(valid_move(move));
     assert((score > -INFINITE_SCORE) && (score < INFINITE_SCORE));
+    assert((depth >= 0) && (depth <= UINT8_MAX));
 
     if (transposition_table == NULL) {
         return;
@@ -149,15 +903,20 @@ void hash_tt_store(struct position *pos, uint32_t move, int depth, int score,
      * found in a different part of the tree.
      *
      * The same reasoning also applies to tablebase wins/losses so
-     * they are treated the same way.
+     * they are treated the same way, with one exception. A tablebase
+     * win is still at least a tablebase win from another part of the
+     * tree, so wins can be stored as lower bounds and losses as upper
+     * bounds. Mates found through the position are then not hidden.
      */
     if (score > KNOWN_WIN) {
-        if (type != TT_EXACT) {
+        if ((type != TT_EXACT) &&
+            ((type != TT_BETA) || (score > TABLEBASE_WIN))) {
             return;
         }
         score += pos->sply;
     } else if (score < -KNOWN_WIN) {
-        if (type != TT_EXACT) {
+        if ((type != TT_EXACT) &&
+            ((type != TT_ALPHA) || (score < TABLEBASE_LOSS))) {
             return;
         }
         score -= pos->sply;
@@ -168,22 +927,30 @@ void hash_tt_store(struct position *pos, uint32_t move, int depth, int score,
     bucket = &transposition_table[idx];
 
     /*
-     * Iterate over all items and find the best
+     * Iterate over all entries and find the best
      * location to store this position at.
      */
-    worst_item = NULL;
+    worst_entry = NULL;
     worst_score = INT_MAX;
+    overwrite = true;
     for (k=0;k<TT_BUCKET_SIZE;k++) {
-        item = &bucket->items[k];
+        entry = &bucket->items[k];
 
         /*
          * If the same position is already stored then
          * replace it if the new search is to a greater
-         * depth or if the item have an older date.
+         * depth or if the entry have an older date. When
+         * analysing, deeper results from earlier searches
+         * are kept unless the new item is an exact score
+         * replacing a bound.
          */
-        if (KEY_EQUALS(pos->key, item)) {
-            if ((depth >= item->depth) || (tt_date != item->date)) {
-                worst_item = item;
+        if (entry_matches(entry, pos->key) && entry_valid(entry)) {
+            if ((depth >= entry_depth(entry)) ||
+                ((tt_policy == TT_POLICY_GAME) && (entry_age(entry) != 0)) ||
+                ((tt_policy == TT_POLICY_ANALYSIS) && (type == TT_EXACT) &&
+                 (entry_type(entry) != TT_EXACT))) {
+                worst_entry = entry;
+                overwrite = false;
                 break;
             }
 
@@ -192,43 +959,45 @@ void hash_tt_store(struct position *pos, uint32_t move, int depth, int score,
              * the current position.
              */
             return;
-        } else if (KEY_IS_ZERO(item)) {
-            worst_item = item;
+        } else if (entry_is_empty(entry)) {
+            worst_entry = entry;
+            overwrite = false;
             break;
         }
 
         /*
-         * Calculate a score for the item. The main idea is to
-         * prefer searches to a higher depth and to prefer
-         * newer searches before older ones.
+         * Calculate a score for the entry. Entries that are waiting
+         * to be cleared are always replaced first.
          */
-        age = tt_date - item->date;
-        item_score = (256 - age - 1) + item->depth*256;
+        entry_score = entry_valid(entry)?entry_value(entry):-1;
+
+        /* Remeber the entry with the worst score */
+        if (entry_score < worst_score) {
+            worst_score = entry_score;
+            worst_entry = entry;
+        }
+    }
+    assert(worst_entry != NULL);
 
-        /* Remeber the item with the worst score */
-        if (item_score < worst_score) {
-            worst_score = item_score;
-            worst_item = item;
+    /*
+     * Keep track of how often items for other positions are thrown
+     * away. Items waiting to be cleared are not counted.
+     */
+    if (pos->worker != NULL) {
+        pos->worker->tt_stores++;
+        if (overwrite && entry_valid(worst_entry)) {
+            pos->worker->tt_overwrites++;
         }
     }
-    assert(worst_item != NULL);
 
-    /* Replace the worst item */
-    worst_item->key_high = KEY_HIGH(pos->key);
-    worst_item->key_low = KEY_LOW(pos->key);
-    worst_item->move = move;
-    worst_item->score = (int16_t)score;
-    worst_item->eval_score = (int16_t)eval_score;
-    worst_item->depth = depth;
-    worst_item->type = type;
-    worst_item->date = tt_date;
+    /* Replace the worst entry */
+    entry_write(worst_entry, pos->key, move, depth, score, type, eval_score);
 }
 
 bool hash_tt_lookup(struct position *pos, struct tt_item *item)
 {
     uint64_t         idx;
     struct tt_bucket *bucket;
-    struct tt_item   *tmp;
     int              k;
 
     assert(valid_position(pos));
@@ -243,13 +1012,18 @@ bool hash_tt_lookup(struct position *pos, struct tt_item *item)
     bucket = &transposition_table[idx];
 
     /*
-     * Find the first item, if any, that have
-     * the same key as the current position.
+     * Find the first entry, if any, that have the same key as the
+     * current position.
      */
+    if (pos->worker != NULL) {
+        pos->worker->tt_lookups++;
+    }
     for (k=0;k<TT_BUCKET_SIZE;k++) {
-        tmp = &bucket->items[k];
-        if (KEY_EQUALS(pos->key, tmp)) {
-            memcpy(item, tmp, sizeof(struct tt_item));
+        if (entry_valid(&bucket->items[k]) &&
+            entry_read(&bucket->items[k], pos, item)) {
+            if (pos->worker != NULL) {
+                pos->worker->tt_hits++;
+            }
             return true;
         }
     }
@@ -257,6 +1031,282 @@ bool hash_tt_lookup(struct position *pos, struct tt_item *item)
     return false;
 }
 
+bool hash_tt_save(char *file)
+{
+    struct tt_file_header header;
+    FILE                  *fp;
+    char                  padding[TT_FILE_HEADER_SIZE];
+    bool                  ok;
+
+    assert(file != NULL);
+
+    if (transposition_table == NULL) {
+        return false;
+    }
+    wait_for_clear();
+
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(struct tt_file_header));
+    memcpy(header.magic, TT_FILE_MAGIC, sizeof(header.magic));
+    header.version = TT_FILE_VERSION;
+    header.format = TT_FILE_FORMAT;
+    header.bucket_size = sizeof(struct tt_bucket);
+    header.date = tt_date;
+    header.nbuckets = tt_size;
+    memset(padding, 0, sizeof(padding));
+    memcpy(padding, &header, sizeof(struct tt_file_header));
+
+    ok = (fwrite(padding, TT_FILE_HEADER_SIZE, 1, fp) == 1) &&
+         (fwrite(transposition_table, sizeof(struct tt_bucket), tt_size, fp) ==
+                                                                    tt_size);
+    fclose(fp);
+
+    return ok;
+}
+
+bool hash_tt_load(char *file)
+{
+    struct tt_file_header header;
+    struct tt_bucket      *table;
+    uint64_t              size;
+    FILE                  *fp;
+    bool                  ok;
+#ifndef WINDOWS
+    struct stat           sb;
+    int                   fd;
+    void                  *mapping;
+#endif
+
+    assert(file != NULL);
+
+    /* Read and validate the header */
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    ok = fread(&header, sizeof(struct tt_file_header), 1, fp) == 1;
+    ok = ok && !memcmp(header.magic, TT_FILE_MAGIC, sizeof(header.magic)) &&
+         (header.version == TT_FILE_VERSION) &&
+         (header.format == TT_FILE_FORMAT) &&
+         (header.bucket_size == sizeof(struct tt_bucket)) &&
+         (header.nbuckets > 0) &&
+         ((header.nbuckets&(header.nbuckets-1)) == 0) &&
+         (header.nbuckets*sizeof(struct tt_bucket) <=
+                                    hash_tt_max_size()*1024ULL*1024ULL);
+    if (!ok) {
+        fclose(fp);
+        return false;
+    }
+    size = header.nbuckets*sizeof(struct tt_bucket);
+
+#ifdef WINDOWS
+    /* Without mmap the table is read into newly allocated memory */
+    table = aligned_malloc(CACHE_LINE_SIZE, size);
+    if (table == NULL) {
+        fclose(fp);
+        return false;
+    }
+    if ((fseek(fp, TT_FILE_HEADER_SIZE, SEEK_SET) != 0) ||
+        (fread(table, sizeof(struct tt_bucket), header.nbuckets, fp) !=
+                                                        header.nbuckets)) {
+        aligned_free(table);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    hash_tt_destroy_table();
+    tt_page_type = LARGE_PAGES_NONE;
+#else
+    fclose(fp);
+
+    /*
+     * Map the file privately so that the table is paged in on demand
+     * and changes made during search are never written back.
+     */
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if ((fstat(fd, &sb) != 0) ||
+        ((uint64_t)sb.st_size != (size+TT_FILE_HEADER_SIZE))) {
+        close(fd);
+        return false;
+    }
+    mapping = mmap(NULL, size+TT_FILE_HEADER_SIZE, PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    table = (struct tt_bucket*)(((char*)mapping)+TT_FILE_HEADER_SIZE);
+
+    hash_tt_destroy_table();
+    tt_page_type = TT_PAGES_FILE;
+#endif
+
+    transposition_table = table;
+    tt_size = header.nbuckets;
+    tt_date = header.date;
+    tt_requested_size = MAX(hash_tt_size(), MIN_MAIN_HASH_SIZE);
+
+    LOG_INFO1("Loaded %d MB transposition table from %s\n", hash_tt_size(),
+              file);
+
+    return true;
+}
+
+/*
+ * Merge an item into a bucket. An item for the same position is only
+ * replaced by a deeper item, otherwise the usual replacement policy
+ * decides if the item is stored.
+ */
+static bool merge_entry(struct tt_bucket *bucket, struct tt_entry *entry)
+{
+    int k;
+
+    for (k=0;k<TT_BUCKET_SIZE;k++) {
+        if (!entry_same_position(&bucket->items[k], entry)) {
+            continue;
+        }
+        if (entry_depth(entry) <= entry_depth(&bucket->items[k])) {
+            return false;
+        }
+        memcpy(&bucket->items[k], entry, sizeof(struct tt_entry));
+        return true;
+    }
+    return transfer_entry(bucket, entry);
+}
+
+int hash_tt_share(char *file, int min_depth)
+{
+    struct tt_share_header header;
+    struct tt_share_record record;
+    struct tt_entry        *entry;
+    FILE                   *fp;
+    uint64_t               idx;
+    int                    k;
+    bool                   ok;
+
+    assert(file != NULL);
+
+    if (transposition_table == NULL) {
+        return -1;
+    }
+    wait_for_clear();
+
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    /*
+     * Write a preliminary header and update the number
+     * of records once all items have been written.
+     */
+    memset(&header, 0, sizeof(struct tt_share_header));
+    memcpy(header.magic, TT_SHARE_MAGIC, sizeof(header.magic));
+    header.version = TT_SHARE_VERSION;
+    header.format = TT_FILE_FORMAT;
+    header.entry_size = sizeof(struct tt_entry);
+    header.nbuckets = tt_size;
+    ok = fwrite(&header, sizeof(struct tt_share_header), 1, fp) == 1;
+
+    memset(&record, 0, sizeof(struct tt_share_record));
+    for (idx=0;(idx<tt_size)&&ok;idx++) {
+        for (k=0;k<TT_BUCKET_SIZE;k++) {
+            entry = &transposition_table[idx].items[k];
+            if (entry_is_empty(entry) || (entry_depth(entry) < min_depth)) {
+                continue;
+            }
+            record.idx = idx;
+            record.entry = *entry;
+            if (fwrite(&record, sizeof(struct tt_share_record), 1, fp) != 1) {
+                ok = false;
+                break;
+            }
+            header.nrecords++;
+        }
+    }
+
+    ok = ok && (fseek(fp, 0, SEEK_SET) == 0) &&
+         (fwrite(&header, sizeof(struct tt_share_header), 1, fp) == 1);
+    fclose(fp);
+
+    return ok?(int)header.nrecords:-1;
+}
+
+int hash_tt_merge(char *file)
+{
+    struct tt_share_header header;
+    struct tt_share_record record;
+    FILE                   *fp;
+    uint64_t               k;
+    uint64_t               idx;
+    int                    nmerged;
+
+    assert(file != NULL);
+
+    if (transposition_table == NULL) {
+        return -1;
+    }
+    wait_for_clear();
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    if ((fread(&header, sizeof(struct tt_share_header), 1, fp) != 1) ||
+        memcmp(header.magic, TT_SHARE_MAGIC, sizeof(header.magic)) ||
+        (header.version != TT_SHARE_VERSION) ||
+        (header.format != TT_FILE_FORMAT) ||
+        (header.entry_size != sizeof(struct tt_entry)) ||
+        (header.nbuckets == 0) ||
+        ((header.nbuckets&(header.nbuckets-1)) != 0)) {
+        fclose(fp);
+        return -1;
+    }
+
+    /*
+     * Shared items are treated as if they were stored by the most
+     * recent search so that they compete on equal terms with the
+     * items that are already in the table.
+     */
+    nmerged = 0;
+    for (k=0;k<header.nrecords;k++) {
+        if (fread(&record, sizeof(struct tt_share_record), 1, fp) != 1) {
+            break;
+        }
+        if ((record.idx >= header.nbuckets) ||
+            !entry_rehash(&record.entry, record.idx, header.nbuckets, &idx)) {
+            continue;
+        }
+        entry_set_date(&record.entry, tt_date);
+        if (merge_entry(&transposition_table[idx], &record.entry)) {
+            nmerged++;
+        }
+    }
+    fclose(fp);
+
+    return nmerged;
+}
+
+void hash_tt_apply_memory_limit(void)
+{
+    if (transposition_table != NULL) {
+        hash_tt_resize_table(tt_requested_size);
+    }
+}
+
+uint64_t hash_tt_memory(void)
+{
+    return tt_size*sizeof(struct tt_bucket);
+}
+
 /* Transposition table usage is estimated based on the first 1000 buckets */
 int hash_tt_usage(void)
 {
@@ -269,7 +1319,8 @@ int hash_tt_usage(void)
     for (k=0;k<=1000;k++) {
         bucket = &transposition_table[k];
         for (idx=0;idx<TT_BUCKET_SIZE;idx++) {
-            if (bucket->items[idx].date > 0) {
+            if (!entry_is_empty(&bucket->items[idx]) &&
+                entry_valid(&bucket->items[idx])) {
                 nused++;
             }
         }
@@ -288,6 +1339,13 @@ void hash_pawntt_create_table(struct search_worker *worker, int size)
     hash_pawntt_clear_table(worker);
 }
 
+uint64_t hash_pawntt_memory(struct search_worker *worker)
+{
+    assert(worker != NULL);
+
+    return worker->pawntt_size*sizeof(struct pawntt_item);
+}
+
 void hash_pawntt_destroy_table(struct search_worker *worker)
 {
     aligned_free(worker->pawntt);
@@ -365,8 +1423,226 @@ bool hash_pawntt_lookup(struct search_worker *worker, struct pawntt_item *item)
     return found && item->used;
 }
 
-void hash_prefetch(struct search_worker *worker)
+void hash_evalcache_create_table(struct search_worker *worker, int size)
+{
+    assert(size >= 0);
+
+    hash_evalcache_destroy_table(worker);
+
+    allocate_evalcache(worker, size);
+    hash_evalcache_clear_table(worker);
+}
+
+uint64_t hash_evalcache_memory(struct search_worker *worker)
+{
+    assert(worker != NULL);
+
+    return worker->evalcache_size*sizeof(struct evalcache_item);
+}
+
+void hash_evalcache_destroy_table(struct search_worker *worker)
+{
+    aligned_free(worker->evalcache);
+    worker->evalcache = NULL;
+    worker->evalcache_size = 0;
+}
+
+void hash_evalcache_clear_table(struct search_worker *worker)
+{
+    assert(worker != NULL);
+
+    if (worker->evalcache != NULL) {
+        memset(worker->evalcache, 0,
+               worker->evalcache_size*sizeof(struct evalcache_item));
+    }
+    worker->evalcache_lookups = 0ULL;
+    worker->evalcache_hits = 0ULL;
+}
+
+void hash_evalcache_store(struct search_worker *worker, int score)
+{
+    uint64_t key;
+    uint32_t idx;
+
+    assert(valid_position(&worker->pos));
+
+    if (worker->evalcache == NULL) {
+        return;
+    }
+
+    /* Find the correct position in the table and always replace */
+    key = worker->pos.key;
+    idx = (uint32_t)(key&(worker->evalcache_size-1));
+    worker->evalcache[idx].key = (uint32_t)(key >> 32);
+    worker->evalcache[idx].score = score;
+}
+
+bool hash_evalcache_lookup(struct search_worker *worker, int *score)
+{
+    struct evalcache_item *item;
+    uint64_t              key;
+
+    assert(valid_position(&worker->pos));
+    assert(score != NULL);
+
+    if (worker->evalcache == NULL) {
+        return false;
+    }
+
+    /*
+     * Find the correct position in the table and check
+     * if it contains an item for this position.
+     */
+    key = worker->pos.key;
+    item = &worker->evalcache[key&(worker->evalcache_size-1)];
+    worker->evalcache_lookups++;
+    if (item->key != (uint32_t)(key >> 32)) {
+        return false;
+    }
+    worker->evalcache_hits++;
+    *score = item->score;
+
+    return true;
+}
+
+void hash_tbcache_create_table(int size)
+{
+    uint64_t k;
+
+    assert(size >= 0);
+
+    aligned_free(tbcache);
+    tbcache_size = largest_power_of_2(size, sizeof(atomic_uint_least64_t));
+    tbcache = aligned_malloc(CACHE_LINE_SIZE,
+                             tbcache_size*sizeof(atomic_uint_least64_t));
+    assert(tbcache != NULL);
+    for (k=0;k<tbcache_size;k++) {
+        atomic_store_explicit(&tbcache[k], 0ULL, memory_order_relaxed);
+    }
+}
+
+uint64_t hash_tbcache_memory(void)
+{
+    return tbcache_size*sizeof(atomic_uint_least64_t);
+}
+
+void hash_tbcache_store(struct position *pos, unsigned int result)
+{
+    assert(valid_position(pos));
+    assert(result < TBCACHE_RESULT_MASK);
+
+    if (tbcache == NULL) {
+        return;
+    }
+
+    /* Always replace */
+    atomic_store_explicit(&tbcache[pos->key&(tbcache_size-1)],
+                          (pos->key&(~TBCACHE_RESULT_MASK))|(result+1),
+                          memory_order_relaxed);
+}
+
+bool hash_tbcache_lookup(struct position *pos, unsigned int *result)
+{
+    uint64_t item;
+
+    assert(valid_position(pos));
+    assert(result != NULL);
+
+    if (tbcache == NULL) {
+        return false;
+    }
+
+    item = atomic_load_explicit(&tbcache[pos->key&(tbcache_size-1)],
+                                memory_order_relaxed);
+    if ((item == 0ULL) ||
+        ((item&(~TBCACHE_RESULT_MASK)) != (pos->key&(~TBCACHE_RESULT_MASK)))) {
+        return false;
+    }
+    *result = (unsigned int)(item&TBCACHE_RESULT_MASK) - 1;
+
+    return true;
+}
+
+void hash_material_create_table(int size)
+{
+    uint64_t k;
+
+    assert(size >= 0);
+
+    aligned_free(material_table);
+    material_table_size = largest_power_of_2(size,
+                                             sizeof(atomic_uint_least64_t));
+    material_table = aligned_malloc(CACHE_LINE_SIZE,
+                            material_table_size*sizeof(atomic_uint_least64_t));
+    assert(material_table != NULL);
+    for (k=0;k<material_table_size;k++) {
+        atomic_store_explicit(&material_table[k], 0ULL, memory_order_relaxed);
+    }
+}
+
+uint64_t hash_material_memory(void)
+{
+    return material_table_size*sizeof(atomic_uint_least64_t);
+}
+
+void hash_material_store(struct position *pos, int phase, int flags)
+{
+    uint64_t item;
+
+    assert(valid_position(pos));
+    assert((phase >= 0) && (phase < (1 << MATERIAL_PHASE_BITS)));
+    assert((flags >= 0) && (flags < (1 << MATERIAL_FLAGS_BITS)));
+
+    if (material_table == NULL) {
+        return;
+    }
+
+    /* Always replace */
+    item = (pos->materialkey&(~MATERIAL_DATA_MASK))|MATERIAL_VALID_BIT|
+           (((uint64_t)flags) << MATERIAL_PHASE_BITS)|(uint64_t)phase;
+    atomic_store_explicit(
+                &material_table[pos->materialkey&(material_table_size-1)],
+                item, memory_order_relaxed);
+}
+
+bool hash_material_lookup(struct position *pos, int *phase, int *flags)
 {
-    PREFETCH_ADDRESS(&transposition_table[worker->pos.key&(tt_size-1)]);
-    PREFETCH_ADDRESS(&worker->pawntt[worker->pos.pawnkey&(worker->pawntt_size-1)]);
+    uint64_t item;
+
+    assert(valid_position(pos));
+    assert(phase != NULL);
+    assert(flags != NULL);
+
+    if (material_table == NULL) {
+        return false;
+    }
+
+    item = atomic_load_explicit(
+                &material_table[pos->materialkey&(material_table_size-1)],
+                memory_order_relaxed);
+    if (((item&MATERIAL_VALID_BIT) == 0ULL) ||
+        ((item&(~MATERIAL_DATA_MASK)) !=
+                                (pos->materialkey&(~MATERIAL_DATA_MASK)))) {
+        return false;
+    }
+    *phase = (int)(item&((1ULL << MATERIAL_PHASE_BITS) - 1));
+    *flags = (int)((item >> MATERIAL_PHASE_BITS)&
+                   ((1ULL << MATERIAL_FLAGS_BITS) - 1));
+
+    return true;
+}
+
+void hash_prefetch(struct search_worker *worker, bool pawns, bool material)
+{
+    struct position *pos = &worker->pos;
+
+    PREFETCH_ADDRESS(&transposition_table[pos->key&(tt_size-1)]);
+    PREFETCH_ADDRESS(&worker->evalcache[pos->key&(worker->evalcache_size-1)]);
+    if (pawns) {
+        PREFETCH_ADDRESS(&worker->pawntt[pos->pawnkey&(worker->pawntt_size-1)]);
+    }
+    if (material) {
+        PREFETCH_ADDRESS(
+                    &material_table[pos->materialkey&(material_table_size-1)]);
+    }
 }
@@ -29,6 +29,17 @@ enum {
     TT_ALPHA
 };
 
+/* Replacement policies for the main transposition table */
+enum {
+    /* Prefer items from the current search */
+    TT_POLICY_GAME,
+    /*
+     * Prefer deep items and exact scores, letting items from earlier
+     * searches age slowly. Suited for long analysis sessions.
+     */
+    TT_POLICY_ANALYSIS
+};
+
 /*
  * Get the maximum transposition table size.
  *
@@ -37,12 +48,80 @@ enum {
 int hash_tt_max_size(void);
 
 /*
- * Create the main transposition table.
+ * Get the size of the main transposition table.
+ *
+ * @return Returns the size in MB.
+ */
+int hash_tt_size(void);
+
+/*
+ * Get the amount of memory used by the main transposition table.
+ *
+ * @return Returns the size in bytes.
+ */
+uint64_t hash_tt_memory(void);
+
+/*
+ * Enable or disable the use of large pages for the main transposition
+ * table. Only takes effect the next time the table is created.
+ *
+ * @param enabled If large pages should be used.
+ */
+void hash_tt_set_large_pages(bool enabled);
+
+/*
+ * Check if large pages are requested for the main transposition table.
+ *
+ * @return Returns true if large pages are requested.
+ */
+bool hash_tt_large_pages(void);
+
+/*
+ * Set the replacement policy for the main transposition table.
+ *
+ * @param policy The policy to use (TT_POLICY_GAME or TT_POLICY_ANALYSIS).
+ */
+void hash_tt_set_policy(int policy);
+
+/*
+ * Get the replacement policy for the main transposition table.
+ *
+ * @return Returns the policy in use.
+ */
+int hash_tt_policy(void);
+
+/*
+ * Get a description of the type of pages backing the main
+ * transposition table.
+ *
+ * @return Returns a string describing the page type.
+ */
+const char* hash_tt_page_type(void);
+
+/*
+ * Create the main transposition table. If a memory limit is set the
+ * table is made smaller when needed to stay within the limit.
  *
  * @param size The amount of memory to use for the table (in MB).
  */
 void hash_tt_create_table(int size);
 
+/*
+ * Change the size of the main transposition table. As many items as
+ * possible are kept when moving to the new table. If the size results
+ * in the same number of buckets the table is left untouched.
+ *
+ * @param size The amount of memory to use for the table (in MB).
+ */
+void hash_tt_resize_table(int size);
+
+/*
+ * Resize the main transposition table to the last requested size, or
+ * as close to it as the memory limit allows. Should be called when the
+ * memory used by the rest of the engine changes.
+ */
+void hash_tt_apply_memory_limit(void);
+
 /*
  * Destroy the main transposition table.
  */
@@ -54,7 +133,16 @@ void hash_tt_destroy_table(void);
 void hash_tt_clear_table(void);
 
 /*
- * Increase the age of the main transposition table.
+ * Clear the main transposition table in the background. All current
+ * items are invalidated immediately and are then wiped by background
+ * threads while the engine continues. The next search waits for the
+ * clear to finish, see hash_tt_age_table.
+ */
+void hash_tt_clear_table_async(void);
+
+/*
+ * Increase the age of the main transposition table. Called before each
+ * search, and waits for any background clear to finish first.
  */
 void hash_tt_age_table(void);
 
@@ -80,6 +168,52 @@ void hash_tt_store(struct position *pos, uint32_t move, int depth, int score,
  */
 bool hash_tt_lookup(struct position *pos, struct tt_item *item);
 
+/*
+ * Save the main transposition table to a file.
+ *
+ * @param file The file to write to.
+ * @return Returns true if the table was saved successfully.
+ */
+bool hash_tt_save(char *file);
+
+/*
+ * Load the main transposition table from a file written by hash_tt_save.
+ * Where supported the file is memory mapped and used directly as storage
+ * for the table. Files written with a different format, or which doesn't
+ * fit within the maximum hash size, are rejected and the current table is
+ * kept.
+ *
+ * @param file The file to read from.
+ * @return Returns true if the table was loaded successfully.
+ */
+bool hash_tt_load(char *file);
+
+/*
+ * Write the items in the main transposition table that have been searched
+ * to at least a certain depth to a file. Other engine instances, for
+ * instance on other machines analysing the same position, can then merge
+ * the items into their own tables using hash_tt_merge. The exchange is
+ * manual, there is no transport between instances and node counts and
+ * best moves are not combined.
+ *
+ * @param file The file to write to.
+ * @param min_depth The minimum depth of the items to write.
+ * @return Returns the number of items written, or -1 on failure.
+ */
+int hash_tt_share(char *file, int min_depth);
+
+/*
+ * Merge items from a file written by hash_tt_share into the main
+ * transposition table. Items are only merged if the file was written
+ * with the same table format. The usual replacement policy decides if
+ * an item replaces an item already in the table.
+ *
+ * @param file The file to read from.
+ * @return Returns the number of items that were stored in the table,
+ *         or -1 on failure.
+ */
+int hash_tt_merge(char *file);
+
 /*
  * Get the transposition table usage.
  *
@@ -102,6 +236,14 @@ void hash_pawntt_create_table(struct search_worker *worker, int size);
  */
 void hash_pawntt_destroy_table(struct search_worker *worker);
 
+/*
+ * Get the amount of memory used by the pawn transposition table.
+ *
+ * @param worker The worker.
+ * @return Returns the size in bytes.
+ */
+uint64_t hash_pawntt_memory(struct search_worker *worker);
+
 /*
  * Clear the pawn transposition table.
  *
@@ -135,10 +277,131 @@ void hash_pawntt_store(struct search_worker *worker, struct pawntt_item *item);
 bool hash_pawntt_lookup(struct search_worker *worker, struct pawntt_item *item);
 
 /*
- * Prefetch hash table entries for a specific position.
+ * Create the evaluation cache.
+ *
+ * @param worker The worker.
+ * @param size The amount of memory to use for the cache (in MB).
+ */
+void hash_evalcache_create_table(struct search_worker *worker, int size);
+
+/*
+ * Destroy the evaluation cache.
+ *
+ * @param worker The worker.
+ */
+void hash_evalcache_destroy_table(struct search_worker *worker);
+
+/*
+ * Get the amount of memory used by the evaluation cache.
+ *
+ * @param worker The worker.
+ * @return Returns the size in bytes.
+ */
+uint64_t hash_evalcache_memory(struct search_worker *worker);
+
+/*
+ * Clear the evaluation cache.
+ *
+ * @param worker The worker.
+ */
+void hash_evalcache_clear_table(struct search_worker *worker);
+
+/*
+ * Store the static evaluation of the current position in the
+ * evaluation cache.
+ *
+ * @param worker The worker.
+ * @param score The score to store.
+ */
+void hash_evalcache_store(struct search_worker *worker, int score);
+
+/*
+ * Lookup the current position in the evaluation cache.
+ *
+ * @param worker The worker.
+ * @param score Location where the found score is stored.
+ * @return Returns true if the position was found, false otherwise.
+ */
+bool hash_evalcache_lookup(struct search_worker *worker, int *score);
+
+/*
+ * Create the tablebase cache. The cache holds the results of tablebase
+ * WDL probes and is shared by all workers.
+ *
+ * @param size The amount of memory to use for the cache (in MB).
+ */
+void hash_tbcache_create_table(int size);
+
+/*
+ * Get the amount of memory used by the tablebase cache.
+ *
+ * @return Returns the size in bytes.
+ */
+uint64_t hash_tbcache_memory(void);
+
+/*
+ * Store the result of a tablebase WDL probe in the tablebase cache.
+ *
+ * @param pos The board structure.
+ * @param result The result of the probe.
+ */
+void hash_tbcache_store(struct position *pos, unsigned int result);
+
+/*
+ * Lookup the current position in the tablebase cache.
+ *
+ * @param pos The board structure.
+ * @param result Location where the found result is stored.
+ * @return Returns true if the position was found, false otherwise.
+ */
+bool hash_tbcache_lookup(struct position *pos, unsigned int *result);
+
+/*
+ * Create the material table. The table holds evaluation information
+ * that only depends on the material of a position and is shared by
+ * all workers.
+ *
+ * @param size The amount of memory to use for the table (in MB).
+ */
+void hash_material_create_table(int size);
+
+/*
+ * Get the amount of memory used by the material table.
+ *
+ * @return Returns the size in bytes.
+ */
+uint64_t hash_material_memory(void);
+
+/*
+ * Store material information for the current position.
+ *
+ * @param pos The board structure.
+ * @param phase The game phase (0-256).
+ * @param flags Evaluation flags (0-3).
+ */
+void hash_material_store(struct position *pos, int phase, int flags);
+
+/*
+ * Lookup the material of the current position in the material table.
+ *
+ * @param pos The board structure.
+ * @param phase Location where the found game phase is stored.
+ * @param flags Location where the found flags are stored.
+ * @return Returns true if the material was found, false otherwise.
+ */
+bool hash_material_lookup(struct position *pos, int *phase, int *flags);
+
+/*
+ * Prefetch hash table entries for the current position of a worker.
+ * The transposition table and evaluation cache entries are always
+ * prefetched.
  *
  * @param worker The worker.
+ * @param pawns Indicates if the pawn transposition table entry should
+ *              be prefetched as well.
+ * @param material Indicates if the material table entry should be
+ *                 prefetched as well.
  */
-void hash_prefetch(struct search_worker *worker);
+void hash_prefetch(struct search_worker *worker, bool pawns, bool material);
 
 #endif
@@ -28,6 +28,9 @@
 /* The maximum allowed history score */
 #define MAX_HISTORY_SCORE (INT_MAX/3)
 
+/* The maximum allowed continuation history score */
+#define MAX_CONT_HISTORY_SCORE INT16_MAX
+
 /* The maximum depth used for history scores */
 #define MAX_HISTORY_DEPTH 20
 
@@ -39,9 +42,27 @@ void history_clear_tables(struct search_worker *worker)
 {
     memset(worker->history_table, 0, sizeof(int)*NPIECES*NSQUARES);
     memset(worker->counter_history, 0,
-           sizeof(int)*NPIECES*NSQUARES*NPIECES*NSQUARES);
+           sizeof(int16_t)*NPIECES*NSQUARES*NPIECES*NSQUARES);
     memset(worker->follow_history, 0,
-           sizeof(int)*NPIECES*NSQUARES*NPIECES*NSQUARES);
+           sizeof(int16_t)*NPIECES*NSQUARES*NPIECES*NSQUARES);
+}
+
+/*
+ * Apply a bonus or penalty to a continuation history score. The
+ * result saturates at the limits of the 16-bit table entries.
+ */
+static int16_t update_cont_history(int16_t entry, int delta)
+{
+    int score;
+
+    score = entry + UP*delta - entry*abs(delta)/DOWN;
+    if (score > MAX_CONT_HISTORY_SCORE) {
+        score = MAX_CONT_HISTORY_SCORE;
+    } else if (score < -MAX_CONT_HISTORY_SCORE) {
+        score = -MAX_CONT_HISTORY_SCORE;
+    }
+
+    return (int16_t)score;
 }
 
 void history_update_tables(struct search_worker *worker, struct movelist *list,
@@ -99,111 +120,106 @@ void history_update_tables(struct search_worker *worker, struct movelist *list,
         if (move_c != NOMOVE) {
             prev_to = TO(move_c);
             prev_piece = pos->history[pos->ply-1].piece;
-            score = worker->counter_history[prev_piece][prev_to][piece][to];
-            score += UP*delta - score*abs(delta)/DOWN;
             worker->counter_history[prev_piece][prev_to][piece][to] =
-                                                MIN(score, MAX_HISTORY_SCORE);
+                update_cont_history(
+                    worker->counter_history[prev_piece][prev_to][piece][to],
+                    delta);
         }
 
         /* Update follow up history table */
         if (move_f != NOMOVE) {
             prev_to = TO(move_f);
             prev_piece = pos->history[pos->ply-2].piece;
-            score = worker->follow_history[prev_piece][prev_to][piece][to];
-            score += UP*delta - score*abs(delta)/DOWN;
             worker->follow_history[prev_piece][prev_to][piece][to] =
-                                                MIN(score, MAX_HISTORY_SCORE);
+                update_cont_history(
+                    worker->follow_history[prev_piece][prev_to][piece][to],
+                    delta);
         }
     }
 }
 
-int history_get_score(struct search_worker *worker, uint32_t move)
+/*
+ * Get the continuation history rows for the current node. If there is
+ * no previous move then a row with all zero scores is used instead.
+ */
+static void get_continuation_rows(struct search_worker *worker,
+                                  const int16_t **counter_row,
+                                  const int16_t **follow_row)
 {
-    struct position *pos;
-    int             score;
-    int             to;
-    int             piece;
-    int             prev_move;
-    int             prev_to;
-    int             prev_piece;
+    static const int16_t zero_row[NPIECES*NSQUARES] = {0};
+    struct position      *pos = &worker->pos;
+    struct unmake        *prev;
 
-    assert(valid_move(move));
+    *counter_row = zero_row;
+    *follow_row = zero_row;
+    if ((pos->ply < 1) || ISNULLMOVE(pos->history[pos->ply-1].move)) {
+        return;
+    }
+    prev = &pos->history[pos->ply-1];
+    *counter_row = &worker->counter_history[prev->piece][TO(prev->move)][0][0];
 
-    pos = &worker->pos;
-    piece = pos->pieces[FROM(move)];
-    to = TO(move);
-
-    /* Add score from history table */
-    score = worker->history_table[piece][to];
-
-    /* Add score from counter history table */
-    prev_move = ((pos->ply >= 1) &&
-                !ISNULLMOVE(pos->history[pos->ply-1].move))?
-                pos->history[pos->ply-1].move:NOMOVE;
-    if (prev_move != NOMOVE) {
-        prev_to = TO(prev_move);
-        prev_piece = pos->history[pos->ply-1].piece;
-        score += worker->counter_history[prev_piece][prev_to][piece][to];
+    if ((pos->ply < 2) || ISNULLMOVE(pos->history[pos->ply-2].move)) {
+        return;
     }
+    prev = &pos->history[pos->ply-2];
+    *follow_row = &worker->follow_history[prev->piece][TO(prev->move)][0][0];
+}
+
+void history_score_moves(struct search_worker *worker, struct moveinfo *moves,
+                         int count)
+{
+    struct position *pos = &worker->pos;
+    const int16_t   *counter_row;
+    const int16_t   *follow_row;
+    const int       *history_row;
+    int             idx[MAX_MOVES];
+    int             k;
+
+    assert(count <= MAX_MOVES);
 
-    /* Add score from follow up history table */
-    prev_move = ((pos->ply >= 2) &&
-                !ISNULLMOVE(pos->history[pos->ply-1].move) &&
-                !ISNULLMOVE(pos->history[pos->ply-2].move))?
-                pos->history[pos->ply-2].move:NOMOVE;
-    if (prev_move != NOMOVE) {
-        prev_to = TO(prev_move);
-        prev_piece = pos->history[pos->ply-2].piece;
-        score += worker->follow_history[prev_piece][prev_to][piece][to];
+    get_continuation_rows(worker, &counter_row, &follow_row);
+    history_row = &worker->history_table[0][0];
+
+    /*
+     * Calculate the table index of each quiet move and prefetch
+     * the continuation history entries before they are needed.
+     */
+    for (k=0;k<count;k++) {
+        if (ISTACTICAL(moves[k].move)) {
+            idx[k] = -1;
+            continue;
+        }
+        idx[k] = pos->pieces[FROM(moves[k].move)]*NSQUARES +
+                                                        TO(moves[k].move);
+        PREFETCH_ADDRESS(&counter_row[idx[k]]);
+        PREFETCH_ADDRESS(&follow_row[idx[k]]);
     }
 
-    return score;
+    /* Assign scores */
+    for (k=0;k<count;k++) {
+        if (idx[k] < 0) {
+            continue;
+        }
+        moves[k].score = history_row[idx[k]] + counter_row[idx[k]] +
+                         follow_row[idx[k]];
+    }
 }
 
 void history_get_scores(struct search_worker *worker, uint32_t move,
                         int *hist, int *chist, int *fhist)
 {
-    struct position *pos;
-    int             to;
-    int             piece;
-    int             prev_move;
-    int             prev_to;
-    int             prev_piece;
+    const int16_t *counter_row;
+    const int16_t *follow_row;
+    int           idx;
 
     assert(valid_move(move));
 
-    pos = &worker->pos;
-    piece = pos->pieces[FROM(move)];
-    to = TO(move);
-
-    /* Initialize history values */
-    *hist = 0;
-    *chist = 0;
-    *fhist = 0;
-
-    /* Add score from history table */
-    *hist = worker->history_table[piece][to];
-
-    /* Add score from counter history table */
-    prev_move = ((pos->ply >= 1) &&
-                !ISNULLMOVE(pos->history[pos->ply-1].move))?
-                pos->history[pos->ply-1].move:NOMOVE;
-    if (prev_move != NOMOVE) {
-        prev_to = TO(prev_move);
-        prev_piece = pos->history[pos->ply-1].piece;
-        *chist = worker->counter_history[prev_piece][prev_to][piece][to];
-    }
+    get_continuation_rows(worker, &counter_row, &follow_row);
+    idx = worker->pos.pieces[FROM(move)]*NSQUARES + TO(move);
 
-    /* Add score from follow up history table */
-    prev_move = ((pos->ply >= 2) &&
-                !ISNULLMOVE(pos->history[pos->ply-1].move) &&
-                !ISNULLMOVE(pos->history[pos->ply-2].move))?
-                pos->history[pos->ply-2].move:NOMOVE;
-    if (prev_move != NOMOVE) {
-        prev_to = TO(prev_move);
-        prev_piece = pos->history[pos->ply-2].piece;
-        *fhist = worker->follow_history[prev_piece][prev_to][piece][to];
-    }
+    *hist = (&worker->history_table[0][0])[idx];
+    *chist = counter_row[idx];
+    *fhist = follow_row[idx];
 }
 
 void killer_clear_table(struct search_worker *worker)
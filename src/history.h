@@ -41,13 +41,16 @@ void history_update_tables(struct search_worker *worker, struct movelist *list,
                            int depth);
 
 /*
- * Get a combined history score for a move.
+ * Assign combined history scores to the quiet moves in a list. The
+ * history rows for the current node are looked up once for all moves.
+ * Tactical moves are left untouched.
  *
  * @param worker The worker.
- * @param move The move.
- * @return The combined history score.
+ * @param moves The moves to score.
+ * @param count The number of moves.
  */
-int history_get_score(struct search_worker *worker, uint32_t move);
+void history_score_moves(struct search_worker *worker, struct moveinfo *moves,
+                         int count);
 
 /*
  * Get the individual history table scores.
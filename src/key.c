@@ -17,6 +17,7 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "key.h"
 #include "utils.h"
@@ -464,6 +465,82 @@ static uint64_t castle_values[16] = {
     17026459123590339232ULL, 15031333701544438364ULL
 };
 
+/*
+ * Cuckoo tables with the key differences and moves of all reversible
+ * moves on an empty board. Every move is stored in one of two slots
+ * selected by the hash functions below.
+ */
+#define CUCKOO_SIZE 8192
+#define CUCKOO_H1(k) ((int)((k)&(CUCKOO_SIZE-1)))
+#define CUCKOO_H2(k) ((int)(((k) >> 16)&(CUCKOO_SIZE-1)))
+static uint64_t cuckoo_keys[CUCKOO_SIZE];
+static uint32_t cuckoo_moves[CUCKOO_SIZE];
+
+void key_init_cuckoo(void)
+{
+    uint64_t diff;
+    uint64_t tmp_key;
+    uint32_t move;
+    uint32_t tmp_move;
+    int      piece;
+    int      from;
+    int      to;
+    int      idx;
+    int      count;
+
+    memset(cuckoo_keys, 0, sizeof(cuckoo_keys));
+    memset(cuckoo_moves, 0, sizeof(cuckoo_moves));
+
+    count = 0;
+    for (piece=WHITE_KNIGHT;piece<NPIECES;piece++) {
+        for (from=0;from<NSQUARES;from++) {
+            for (to=from+1;to<NSQUARES;to++) {
+                if ((bb_moves_for_piece(0ULL, from, piece)&sq_mask[to]) ==
+                    0ULL) {
+                    continue;
+                }
+
+                /* Insert the move, moving other moves out of the way */
+                diff = piece_values[piece][from]^piece_values[piece][to]^
+                       color_values[WHITE]^color_values[BLACK];
+                move = MOVE(from, to, NO_PIECE, NORMAL);
+                idx = CUCKOO_H1(diff);
+                while (true) {
+                    tmp_key = cuckoo_keys[idx];
+                    cuckoo_keys[idx] = diff;
+                    diff = tmp_key;
+                    tmp_move = cuckoo_moves[idx];
+                    cuckoo_moves[idx] = move;
+                    move = tmp_move;
+                    if (move == NOMOVE) {
+                        break;
+                    }
+                    idx = (idx == CUCKOO_H1(diff))?
+                                            CUCKOO_H2(diff):CUCKOO_H1(diff);
+                }
+                count++;
+            }
+        }
+    }
+    assert(count == 3668);
+}
+
+uint32_t key_cuckoo_move(uint64_t diff)
+{
+    int idx;
+
+    idx = CUCKOO_H1(diff);
+    if (cuckoo_keys[idx] == diff) {
+        return cuckoo_moves[idx];
+    }
+    idx = CUCKOO_H2(diff);
+    if (cuckoo_keys[idx] == diff) {
+        return cuckoo_moves[idx];
+    }
+
+    return NOMOVE;
+}
+
 uint64_t key_generate(struct position *pos)
 {
     uint64_t key;
@@ -517,12 +594,43 @@ uint64_t key_generate_pawnkey(struct position *pos)
     return key;
 }
 
+uint64_t key_generate_materialkey(struct position *pos)
+{
+    uint64_t key;
+    int      piece;
+    int      count;
+    int      k;
+
+    assert(valid_position(pos));
+
+    /*
+     * The piece-square values are reused with the square
+     * replaced by the index of the piece among all pieces
+     * of the same kind.
+     */
+    key = 0ULL;
+    for (piece=0;piece<NPIECES;piece++) {
+        count = BITCOUNT(pos->bb_pieces[piece]);
+        for (k=0;k<count;k++) {
+            key ^= piece_values[piece][k];
+        }
+    }
+
+    return key;
+}
+
 uint64_t key_update_piece(uint64_t key, int piece, int sq)
 {
     key ^= piece_values[piece][sq];
     return key;
 }
 
+uint64_t key_update_material(uint64_t key, int piece, int index)
+{
+    key ^= piece_values[piece][index];
+    return key;
+}
+
 uint64_t key_update_ep_square(uint64_t key, int old_sq, int new_sq)
 {
     if (old_sq != NO_SQUARE) {
@@ -22,6 +22,22 @@
 
 #include "chess.h"
 
+/*
+ * Initialize the tables used for finding reversible moves that
+ * lead to a given key.
+ */
+void key_init_cuckoo(void);
+
+/*
+ * Find the reversible move that changes a key by a certain difference.
+ * The move connects two squares in either direction and is found for
+ * any non-pawn piece of either color.
+ *
+ * @param diff The difference between the two keys.
+ * @return Returns the move or NOMOVE if there is no such move.
+ */
+uint32_t key_cuckoo_move(uint64_t diff);
+
 /*
  * Generate a unique key for a chess position.
  *
@@ -38,6 +54,15 @@ uint64_t key_generate(struct position *pos);
  */
 uint64_t key_generate_pawnkey(struct position *pos);
 
+/*
+ * Generate a key for the material of a chess position. The key
+ * only depends on the number of pieces of each kind.
+ *
+ * @param pos A chess position.
+ * @return Returns a key for the material.
+ */
+uint64_t key_generate_materialkey(struct position *pos);
+
 /*
  * Update a piece in the key.
  *
@@ -48,6 +73,17 @@ uint64_t key_generate_pawnkey(struct position *pos);
  */
 uint64_t key_update_piece(uint64_t key, int piece, int sq);
 
+/*
+ * Update the material key when a piece is added or removed.
+ *
+ * @param key The key to update.
+ * @param piece The piece to add/remove.
+ * @param index The number of pieces of the same kind, not counting
+ *              the piece being added/removed.
+ * @return Returns the updated key.
+ */
+uint64_t key_update_material(uint64_t key, int piece, int index);
+
 /*
  * Update the en passant square in the key.
  *
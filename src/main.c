@@ -20,10 +20,12 @@
 #include <time.h>
 #include <string.h>
 #include <limits.h>
+#include <inttypes.h>
 
 #include "utils.h"
 #include "chess.h"
 #include "board.h"
+#include "eval.h"
 #include "bitboard.h"
 #include "debug.h"
 #include "movegen.h"
@@ -33,18 +35,29 @@
 #include "test.h"
 #include "tbprobe.h"
 #include "smp.h"
+#include "timectl.h"
 #include "hash.h"
 #include "see.h"
 #include "search.h"
 #include "nnue.h"
+#include "timetrace.h"
+#include "tbprefetch.h"
 
 /* The maximum length of a line in the configuration file */
 #define CFG_MAX_LINE_LENGTH 1024
 
 /* Configration values */
+static bool use_book_index = false;
+static int tb_warmup_pieces = 0;
+
 static void cleanup(void)
 {
+    engine_wait_for_loading(NULL, LOAD_ALL);
+    tbprefetch_destroy();
     dbg_log_close();
+#ifdef TIMETRACE
+    timetrace_close();
+#endif
 }
 
 static void read_config_file(void)
@@ -69,11 +82,44 @@ static void read_config_file(void)
         } else if (sscanf(line, "LOG_LEVEL=%d", &int_val) == 1) {
             dbg_set_log_level(int_val);
         } else if (sscanf(line, "SYZYGY_PATH=%s", engine_syzygy_path) == 1) {
-            tb_init(engine_syzygy_path);
+            /* Tablebases are initialized once all options are known */
+        } else if (sscanf(line, "TB_EAGER_MAPPING=%d", &int_val) == 1) {
+            tb_set_eager_mapping(int_val != 0);
+        } else if (sscanf(line, "TB_WARMUP=%d", &int_val) == 1) {
+            tb_warmup_pieces = int_val;
         } else if (sscanf(line, "NUM_THREADS=%d", &int_val) == 1) {
             engine_default_num_threads = CLAMP(int_val, 1, MAX_WORKERS);
+        } else if (sscanf(line, "LARGE_PAGES=%d", &int_val) == 1) {
+            hash_tt_set_large_pages(int_val != 0);
+        } else if (sscanf(line, "BOOK_INDEX=%d", &int_val) == 1) {
+            use_book_index = int_val != 0;
+        } else if (sscanf(line, "ANALYSIS_MODE=%d", &int_val) == 1) {
+            hash_tt_set_policy((int_val != 0)?TT_POLICY_ANALYSIS:
+                                              TT_POLICY_GAME);
+        } else if (sscanf(line, "MEMORY_LIMIT=%d", &int_val) == 1) {
+            engine_memory_limit = CLAMP(int_val, 0, MAX_MEMORY_LIMIT);
+        } else if (sscanf(line, "PAWN_HASH_SIZE=%d", &int_val) == 1) {
+            smp_set_pawn_hash_size(CLAMP(int_val, MIN_PAWN_HASH_SIZE,
+                                         MAX_PAWN_HASH_SIZE));
+        } else if (sscanf(line, "NUMA=%d", &int_val) == 1) {
+            smp_set_numa_mode(int_val != 0);
+        } else if (sscanf(line, "THREAD_AFFINITY=%d", &int_val) == 1) {
+            smp_set_pinning(int_val != 0);
+        } else if (sscanf(line, "ABDADA=%d", &int_val) == 1) {
+            smp_set_abdada_mode(int_val != 0);
+        } else if (sscanf(line, "WIDE_PONDER=%d", &int_val) == 1) {
+            smp_set_wide_ponder_moves(CLAMP(int_val, 0,
+                                            MAX_WIDE_PONDER_MOVES));
+        } else if (sscanf(line, "NODES_TIME=%d", &int_val) == 1) {
+            tc_set_nodestime(CLAMP(int_val, 0, MAX_NODES_TIME));
+        } else if (sscanf(line, "MOVE_OVERHEAD=%d", &int_val) == 1) {
+            tc_set_move_overhead(int_val);
+        } else if (sscanf(line, "ADAPTIVE_OVERHEAD=%d", &int_val) == 1) {
+            tc_set_adaptive_overhead(int_val != 0);
+        } else if (sscanf(line, "INFO_INTERVAL=%d", &int_val) == 1) {
+            engine_info_interval = CLAMP(int_val, 0, MAX_INFO_INTERVAL);
         } else if (sscanf(line, "EVAL_FILE=%s", engine_eval_file) == 1) {
-            engine_using_nnue = nnue_init(engine_eval_file);
+            engine_load_network(engine_eval_file);
         }
 
         /* Next line */
@@ -82,6 +128,11 @@ static void read_config_file(void)
 
 	/* Clean up */
 	fclose(fp);
+
+    /* Start loading tablebases */
+    if (engine_syzygy_path[0] != '\0') {
+        engine_load_tablebases(engine_syzygy_path, tb_warmup_pieces);
+    }
 }
 
 static void print_version(void)
@@ -90,9 +141,76 @@ static void print_version(void)
     printf("%s\n", APP_AUTHOR);
 }
 
+static void print_bench_usage(void)
+{
+    printf("Usage: marvin -b [options]\n");
+    printf("  --threads <n>: The number of threads to use (default 1).\n");
+    printf("  --hash <size>: The hash size in MB.\n");
+    printf("  --depth <n>: The depth to search each position to.\n");
+    printf("  --nodes <n>: The number of nodes to search per position.\n");
+    printf("  --movetime <ms>: The time to search each position for.\n");
+    printf("  --fens <file>: File with one FEN string per line.\n");
+    printf("  --json: Report the result as JSON.\n");
+    printf("  --scaling <n>: Report scaling for 1, 2, 4, ..., n threads.\n");
+    printf("  --pin: Pin each thread to its own processor.\n");
+}
+
+/*
+ * Parse the options for the benchmark. Options are given as pairs of
+ * an option name and a value after the -b/--bench flag.
+ */
+static bool parse_bench_options(int argc, char *argv[],
+                                struct bench_options *options)
+{
+    uint64_t nodes;
+    int      k;
+
+    test_init_bench_options(options);
+
+    for (k=2;k<argc;k++) {
+        if (!strcmp(argv[k], "--json")) {
+            options->json = true;
+            continue;
+        } else if (!strcmp(argv[k], "--pin")) {
+            options->pin = true;
+            continue;
+        }
+        if (k == (argc - 1)) {
+            return false;
+        }
+        if (!strcmp(argv[k], "--threads")) {
+            options->threads = CLAMP(atoi(argv[k+1]), 1, MAX_WORKERS);
+        } else if (!strcmp(argv[k], "--hash")) {
+            options->hash_size = CLAMP(atoi(argv[k+1]), MIN_MAIN_HASH_SIZE,
+                                       hash_tt_max_size());
+        } else if (!strcmp(argv[k], "--depth")) {
+            options->depth = CLAMP(atoi(argv[k+1]), 1, MAX_SEARCH_DEPTH);
+        } else if (!strcmp(argv[k], "--nodes")) {
+            if (sscanf(argv[k+1], "%"SCNu64, &nodes) != 1) {
+                return false;
+            }
+            options->nodes = nodes;
+            options->depth = MAX_SEARCH_DEPTH;
+        } else if (!strcmp(argv[k], "--movetime")) {
+            options->movetime = MAX(atoi(argv[k+1]), 0);
+            options->depth = MAX_SEARCH_DEPTH;
+        } else if (!strcmp(argv[k], "--scaling")) {
+            options->scaling = CLAMP(atoi(argv[k+1]), 1, MAX_WORKERS);
+        } else if (!strcmp(argv[k], "--fens")) {
+            options->fen_file = argv[k+1];
+        } else {
+            return false;
+        }
+        k++;
+    }
+
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
-    struct gamestate *state;
+    struct gamestate     *state;
+    struct bench_options bench_options;
 
     /* Register a clean up function */
     atexit(cleanup);
@@ -104,14 +222,44 @@ int main(int argc, char *argv[])
     /* Seed random number generator */
     srand((unsigned int)time(NULL));
 
+    /* Use the embedded network, if any, unless configured otherwise */
+    strcpy(engine_eval_file, NNUE_EMBEDDED_EVAL_FILE);
+    engine_using_nnue = nnue_init(engine_eval_file);
+    if (!engine_using_nnue) {
+        engine_eval_file[0] = '\0';
+    }
+
+    /* Start the thread used for prefetching tablebase files */
+    tbprefetch_init();
+
     /* Read configuration file */
     read_config_file();
 
+#ifdef TIMETRACE
+    /* Record a timing trace of all searches */
+    (void)timetrace_open(TIMETRACE_FILE_NAME);
+#endif
+
     /* Initialize components */
+    engine_init();
     chess_data_init();
-    bb_init();
+    eval_init_psq();
     search_init();
-    polybook_open(BOOKFILE_NAME);
+    engine_load_book(BOOKFILE_NAME, use_book_index);
+
+    /* Setup material table */
+    hash_material_create_table(MATERIAL_HASH_SIZE);
+
+    /* Setup cache for tablebase probes */
+    hash_tbcache_create_table(TB_CACHE_SIZE);
+
+    /*
+     * The size of the network and the book index must be known in
+     * order to size the remaining tables to fit within a memory limit.
+     */
+    if (engine_memory_limit > 0) {
+        engine_wait_for_loading(NULL, LOAD_NETWORK|LOAD_BOOK);
+    }
 
     /* Setup SMP */
     smp_init();
@@ -119,11 +267,17 @@ int main(int argc, char *argv[])
 
     /* Setup main transposition table */
     hash_tt_create_table(engine_default_hash_size);
+    (void)engine_check_memory_limit(NULL);
 
     /* Handle command line options */
-    if ((argc == 2) &&
+    if ((argc >= 2) &&
         (!strncmp(argv[1], "-b", 2) || !strncmp(argv[1], "--bench", 6))) {
-        test_run_benchmark();
+        if (!parse_bench_options(argc, argv, &bench_options)) {
+            print_bench_usage();
+            return 1;
+        }
+        engine_wait_for_loading(NULL, LOAD_ALL);
+        test_run_benchmark(&bench_options);
         return 0;
     } else if ((argc == 2) &&
                (!strncmp(argv[1], "-v", 2) ||
@@ -142,6 +296,7 @@ int main(int argc, char *argv[])
     engine_loop(state);
 
     /* Clean up */
+    engine_wait_for_loading(state, LOAD_ALL);
     polybook_close();
     destroy_game_state(state);
     smp_destroy_workers();
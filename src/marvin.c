@@ -0,0 +1,215 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "marvin.h"
+#include "chess.h"
+#include "board.h"
+#include "config.h"
+#include "engine.h"
+#include "eval.h"
+#include "fen.h"
+#include "hash.h"
+#include "history.h"
+#include "nnue.h"
+#include "search.h"
+#include "smp.h"
+#include "tbprobe.h"
+#include "timectl.h"
+#include "utils.h"
+
+/* Engine instance */
+struct marvin_engine {
+    struct gamestate     *state;
+    struct search_worker *worker;
+};
+
+bool marvin_init(int hash_size, const char *eval_file,
+                 const char *syzygy_path)
+{
+    bool ok = true;
+
+    /* Use the embedded network, if any, unless configured otherwise */
+    if (eval_file != NULL) {
+        strncpy(engine_eval_file, eval_file, MAX_PATH_LENGTH);
+        engine_using_nnue = nnue_init(engine_eval_file);
+        ok = engine_using_nnue;
+    } else {
+        strcpy(engine_eval_file, NNUE_EMBEDDED_EVAL_FILE);
+        engine_using_nnue = nnue_init(engine_eval_file);
+    }
+    if (!engine_using_nnue) {
+        engine_eval_file[0] = '\0';
+    }
+
+    /* Initialize components */
+    chess_data_init();
+    eval_init_psq();
+    search_init();
+    smp_init();
+    hash_tt_create_table(CLAMP(hash_size, MIN_MAIN_HASH_SIZE,
+                               hash_tt_max_size()));
+    hash_material_create_table(MATERIAL_HASH_SIZE);
+    hash_tbcache_create_table(TB_CACHE_SIZE);
+    if (syzygy_path != NULL) {
+        strncpy(engine_syzygy_path, syzygy_path, MAX_PATH_LENGTH);
+        ok = tb_init(engine_syzygy_path) && ok;
+    }
+
+    /*
+     * Searches are only limited by depth and nodes, which are
+     * handled by each instance.
+     */
+    tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
+
+    return ok;
+}
+
+void marvin_cleanup(void)
+{
+    tb_free();
+    hash_tt_destroy_table();
+    smp_destroy();
+}
+
+struct marvin_engine* marvin_create_engine(void)
+{
+    struct marvin_engine *engine;
+
+    engine = malloc(sizeof(struct marvin_engine));
+    if (engine == NULL) {
+        return NULL;
+    }
+    engine->state = create_game_state();
+    engine->worker = smp_create_standalone_worker();
+    if ((engine->state == NULL) || (engine->worker == NULL)) {
+        marvin_destroy_engine(engine);
+        return NULL;
+    }
+    engine->state->silent = true;
+    engine->state->standalone = true;
+    engine->state->multipv = 1;
+
+    return engine;
+}
+
+void marvin_destroy_engine(struct marvin_engine *engine)
+{
+    assert(engine != NULL);
+
+    if (engine->worker != NULL) {
+        smp_destroy_standalone_worker(engine->worker);
+    }
+
+    /*
+     * The state is not released with destroy_game_state since
+     * that would destroy the shared transposition table as well.
+     */
+    if (engine->state != NULL) {
+        if (engine->state->pos.nnue_pos != NULL) {
+            nnue_destroy_pos(engine->state->pos.nnue_pos);
+        }
+        free(engine->state);
+    }
+    free(engine);
+}
+
+void marvin_new_game(struct marvin_engine *engine)
+{
+    assert(engine != NULL);
+
+    history_clear_tables(engine->worker);
+    board_start_position(&engine->state->pos);
+}
+
+bool marvin_set_position(struct marvin_engine *engine, const char *fen)
+{
+    char fenstr[FEN_MAX_LENGTH+1];
+
+    assert(engine != NULL);
+
+    if (fen == NULL) {
+        board_start_position(&engine->state->pos);
+        return true;
+    }
+
+    strncpy(fenstr, fen, FEN_MAX_LENGTH);
+    fenstr[FEN_MAX_LENGTH] = '\0';
+    if (!board_setup_from_fen(&engine->state->pos, fenstr)) {
+        board_start_position(&engine->state->pos);
+        return false;
+    }
+    return true;
+}
+
+bool marvin_make_move(struct marvin_engine *engine, const char *move)
+{
+    char     movestr[MAX_MOVESTR_LENGTH];
+    uint32_t m;
+
+    assert(engine != NULL);
+    assert(move != NULL);
+
+    strncpy(movestr, move, MAX_MOVESTR_LENGTH-1);
+    movestr[MAX_MOVESTR_LENGTH-1] = '\0';
+    m = str2move(movestr, &engine->state->pos);
+    if (m == NOMOVE) {
+        return false;
+    }
+    return board_make_move(&engine->state->pos, m);
+}
+
+bool marvin_search(struct marvin_engine *engine, int depth, uint64_t nodes,
+                   char *move, int *score)
+{
+    struct gamestate *state;
+
+    assert(engine != NULL);
+    assert(move != NULL);
+
+    /*
+     * There is no way to stop a search from the outside so
+     * a search without limits would never return.
+     */
+    if ((depth <= 0) && (nodes == 0)) {
+        move[0] = '\0';
+        return false;
+    }
+
+    state = engine->state;
+    state->sd = ((depth > 0) && (depth < MAX_SEARCH_DEPTH))?
+                                                    depth:MAX_SEARCH_DEPTH;
+    state->max_nodes = nodes;
+
+    smp_search_standalone(engine->worker, state);
+    if (state->best_move == NOMOVE) {
+        move[0] = '\0';
+        if (score != NULL) {
+            *score = engine->worker->mpv_lines[0].score;
+        }
+        return false;
+    }
+
+    move2str(state->best_move, move);
+    if (score != NULL) {
+        *score = engine->worker->mpv_lines[0].score;
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARVIN_H
+#define MARVIN_H
+
+/*
+ * Library interface for running the engine inside another program
+ * (built with make libmarvin). Read-only data such as attack tables,
+ * the network and the tablebases are loaded once per process and
+ * shared by all engine instances, as is the transposition table.
+ * Each instance owns its own position and search tables so different
+ * instances can search concurrently from different threads. A single
+ * instance must only be used by one thread at a time.
+ *
+ * Searches are limited by depth and/or nodes. Clock based time
+ * controls are not supported since the time control is per process,
+ * and there is no way to stop a running search. Since the
+ * transposition table is shared, instances searching concurrently
+ * can affect each other's results.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The maximum length of a move string, including the terminating '\0' */
+#define MARVIN_MAX_MOVESTR_LENGTH 7
+
+/* Engine instance */
+struct marvin_engine;
+
+/*
+ * Initialize the data shared by all engine instances. Must be called
+ * once before any instance is created.
+ *
+ * @param hash_size The size of the shared transposition table (in MB).
+ * @param eval_file The network to use, or NULL to use the classic
+ *                  evaluation (or the embedded network, if any).
+ * @param syzygy_path Path to the Syzygy tablebases, or NULL.
+ * @return Returns true if the library was initialized. Returns false
+ *         if a network or tablebase path was given but could not
+ *         be loaded.
+ */
+bool marvin_init(int hash_size, const char *eval_file,
+                 const char *syzygy_path);
+
+/*
+ * Release the data shared by all engine instances. All instances must
+ * have been destroyed first.
+ */
+void marvin_cleanup(void);
+
+/*
+ * Create a new engine instance. The instance is setup to the
+ * starting position.
+ *
+ * @return Returns the new instance, or NULL on failure.
+ */
+struct marvin_engine* marvin_create_engine(void);
+
+/*
+ * Destroy an engine instance.
+ *
+ * @param engine The instance to destroy.
+ */
+void marvin_destroy_engine(struct marvin_engine *engine);
+
+/*
+ * Prepare an instance for a new game. Clears all history from
+ * previous searches and sets up the starting position.
+ *
+ * @param engine The instance.
+ */
+void marvin_new_game(struct marvin_engine *engine);
+
+/*
+ * Setup a position.
+ *
+ * @param engine The instance.
+ * @param fen The position in FEN notation, or NULL for the starting
+ *            position.
+ * @return Returns false if the FEN string is invalid. The instance is
+ *         then setup to the starting position.
+ */
+bool marvin_set_position(struct marvin_engine *engine, const char *fen);
+
+/*
+ * Play a move in the current position.
+ *
+ * @param engine The instance.
+ * @param move The move in coordinate notation (for instance e2e4 or e7e8q).
+ * @return Returns false if the move is not legal.
+ */
+bool marvin_make_move(struct marvin_engine *engine, const char *move);
+
+/*
+ * Search the current position for the best move.
+ *
+ * @param engine The instance.
+ * @param depth The maximum depth to search to, or 0 for no depth limit.
+ * @param nodes The maximum number of nodes to search, or 0 for no
+ *              node limit. At least one of depth and nodes must be
+ *              non-zero.
+ * @param move Location to store the best move at. It must have room for
+ *             at least MARVIN_MAX_MOVESTR_LENGTH characters.
+ * @param score Location to store the score (in centipawns from the point
+ *              of view of the side to move) at. Can be NULL.
+ * @return Returns false if there are no legal moves in the position,
+ *         or if neither a depth nor a node limit was given.
+ */
+bool marvin_search(struct marvin_engine *engine, int depth, uint64_t nodes,
+                   char *move, int *score);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,525 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the kernels that dominate the time spent searching.
+ * Each kernel is run over the built-in benchmark positions and the time
+ * per operation is reported as the mean and standard deviation over a
+ * number of samples.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <inttypes.h>
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+
+#include "chess.h"
+#include "config.h"
+#include "board.h"
+#include "engine.h"
+#include "eval.h"
+#include "hash.h"
+#include "key.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "search.h"
+#include "see.h"
+#include "smp.h"
+#include "test.h"
+#include "utils.h"
+
+/* Default number of samples to take for each kernel */
+#define DEFAULT_SAMPLES 10
+
+/* Default minimum time (in ms) for each sample */
+#define DEFAULT_SAMPLE_TIME 50
+
+/* The number of random keys used for the transposition table kernels */
+#define NTTKEYS (1024*1024)
+
+/* The transposition table sizes (in MB) to benchmark */
+static int tt_sizes[] = {1, 16, 256};
+
+/* Data shared by all kernels */
+struct bench_data {
+    /* The positions to run the kernels on */
+    struct position *pos;
+    int             npos;
+    /* The legal moves of each position */
+    struct movelist *legal;
+    /* The captures of each position */
+    struct movelist *captures;
+    /* Random keys for the transposition table kernels */
+    uint64_t        *keys;
+    /* Results are accumulated here to keep the compiler honest */
+    uint64_t        sink;
+};
+
+/*
+ * A kernel. Runs one pass over the positions and returns the number of
+ * operations performed.
+ */
+typedef uint64_t (*kernel_func_t)(struct bench_data *data);
+
+struct kernel {
+    char          *name;
+    kernel_func_t func;
+    bool          nnue;
+};
+
+static uint64_t current_time_ns(void)
+{
+#ifdef WINDOWS
+    LARGE_INTEGER count;
+    LARGE_INTEGER freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (count.QuadPart/freq.QuadPart)*1000000000ULL +
+           ((count.QuadPart%freq.QuadPart)*1000000000ULL)/freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t next_random(uint64_t *seed)
+{
+    /* xorshift64* */
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed*0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * Switch between NNUE and the classic evaluation. The NNUE state of
+ * all positions is refreshed when switching to NNUE since it is not
+ * maintained while the classic evaluation is used.
+ */
+static void use_nnue(struct bench_data *data, bool enable)
+{
+    int k;
+
+    engine_using_nnue = enable;
+    if (!enable) {
+        return;
+    }
+    for (k=0;k<data->npos;k++) {
+        nnue_setup_pos(data->pos[k].nnue_pos, data->pos[k].pieces,
+                       data->pos[k].stm);
+    }
+}
+
+/*
+ * Forget the check information and attack maps cached for a position.
+ * Kernels that use them call this for each position so that they are
+ * calculated every time, like they are for each new node in the search.
+ */
+static void clear_cached_info(struct position *pos)
+{
+    pos->checkinfo[pos->ply&(CHECKINFO_SIZE-1)].valid = false;
+    pos->attackinfo[pos->ply&(CHECKINFO_SIZE-1)].valid = false;
+}
+
+static uint64_t kernel_gen_moves(struct bench_data *data)
+{
+    struct movelist list;
+    int             k;
+
+    for (k=0;k<data->npos;k++) {
+        clear_cached_info(&data->pos[k]);
+        gen_moves(&data->pos[k], &list);
+        data->sink += list.size;
+    }
+
+    return data->npos;
+}
+
+static uint64_t kernel_gen_legal_moves(struct bench_data *data)
+{
+    struct movelist list;
+    int             k;
+
+    for (k=0;k<data->npos;k++) {
+        clear_cached_info(&data->pos[k]);
+        gen_legal_moves(&data->pos[k], &list);
+        data->sink += list.size;
+    }
+
+    return data->npos;
+}
+
+static uint64_t kernel_make_unmake(struct bench_data *data)
+{
+    struct position *pos;
+    struct movelist *legal;
+    uint64_t        nops = 0ULL;
+    int             k;
+    int             i;
+
+    for (k=0;k<data->npos;k++) {
+        pos = &data->pos[k];
+        legal = &data->legal[k];
+        for (i=0;i<legal->size;i++) {
+            data->sink += board_make_move(pos, legal->moves[i]);
+            board_unmake_move(pos);
+        }
+        nops += legal->size;
+    }
+
+    return nops;
+}
+
+static uint64_t kernel_see(struct bench_data *data)
+{
+    struct position *pos;
+    struct movelist *captures;
+    uint64_t        nops = 0ULL;
+    int             k;
+    int             i;
+
+    for (k=0;k<data->npos;k++) {
+        pos = &data->pos[k];
+        captures = &data->captures[k];
+        clear_cached_info(pos);
+        for (i=0;i<captures->size;i++) {
+            data->sink += see_ge(pos, captures->moves[i], 0);
+        }
+        nops += captures->size;
+    }
+
+    return nops;
+}
+
+static uint64_t kernel_evaluate(struct bench_data *data)
+{
+    int k;
+
+    for (k=0;k<data->npos;k++) {
+        data->sink += eval_evaluate(&data->pos[k]);
+    }
+
+    return data->npos;
+}
+
+static uint64_t kernel_nnue_refresh(struct bench_data *data)
+{
+    struct position *pos;
+    int             k;
+
+    for (k=0;k<data->npos;k++) {
+        pos = &data->pos[k];
+        nnue_setup_pos(pos->nnue_pos, pos->pieces, pos->stm);
+        data->sink += nnue_evaluate(pos->nnue_pos);
+    }
+
+    return data->npos;
+}
+
+/*
+ * Make a move, evaluate the resulting position and unmake the move. The
+ * accumulator of the child position is updated incrementally from the
+ * parent, which is how the search uses the network.
+ */
+static uint64_t kernel_nnue_update(struct bench_data *data)
+{
+    struct position *pos;
+    struct movelist *legal;
+    uint64_t        nops = 0ULL;
+    int             k;
+    int             i;
+
+    for (k=0;k<data->npos;k++) {
+        pos = &data->pos[k];
+        legal = &data->legal[k];
+        for (i=0;i<legal->size;i++) {
+            (void)board_make_move(pos, legal->moves[i]);
+            data->sink += nnue_evaluate(pos->nnue_pos);
+            board_unmake_move(pos);
+        }
+        nops += legal->size;
+    }
+
+    return nops;
+}
+
+static uint64_t kernel_tt_store(struct bench_data *data)
+{
+    struct position *pos = &data->pos[0];
+    uint64_t        key;
+    int             k;
+
+    for (k=0;k<NTTKEYS;k++) {
+        key = data->keys[k];
+        pos->key = key;
+        hash_tt_store(pos, data->legal[0].moves[0],
+                      (int)(key%MAX_SEARCH_DEPTH), (int)(key%1000), TT_EXACT,
+                      0);
+    }
+    pos->key = key_generate(pos);
+
+    return NTTKEYS;
+}
+
+static uint64_t kernel_tt_lookup(struct bench_data *data)
+{
+    struct position *pos = &data->pos[0];
+    struct tt_item  item;
+    int             k;
+
+    for (k=0;k<NTTKEYS;k++) {
+        pos->key = data->keys[k];
+        data->sink += hash_tt_lookup(pos, &item);
+    }
+    pos->key = key_generate(pos);
+
+    return NTTKEYS;
+}
+
+/*
+ * Run a kernel and report the time per operation. The number of passes
+ * in each sample is calibrated so that a sample takes at least
+ * sample_time ms.
+ */
+static void run_kernel(struct bench_data *data, char *name, kernel_func_t func,
+                       int nsamples, int sample_time)
+{
+    uint64_t start;
+    uint64_t elapsed;
+    uint64_t nops;
+    int      npasses;
+    double   *ns_per_op;
+    double   mean;
+    double   var;
+    double   best;
+    int      k;
+    int      i;
+
+    /* Calibrate, which also warms up caches */
+    npasses = 0;
+    start = current_time_ns();
+    do {
+        (void)func(data);
+        npasses++;
+        elapsed = current_time_ns() - start;
+    } while (elapsed < (uint64_t)sample_time*1000000ULL);
+
+    ns_per_op = malloc(nsamples*sizeof(double));
+    for (k=0;k<nsamples;k++) {
+        nops = 0ULL;
+        start = current_time_ns();
+        for (i=0;i<npasses;i++) {
+            nops += func(data);
+        }
+        elapsed = current_time_ns() - start;
+        ns_per_op[k] = (nops > 0)?(double)elapsed/nops:0.0;
+    }
+
+    mean = 0.0;
+    best = ns_per_op[0];
+    for (k=0;k<nsamples;k++) {
+        mean += ns_per_op[k];
+        best = MIN(best, ns_per_op[k]);
+    }
+    mean /= nsamples;
+    var = 0.0;
+    for (k=0;k<nsamples;k++) {
+        var += (ns_per_op[k] - mean)*(ns_per_op[k] - mean);
+    }
+    var = (nsamples > 1)?var/(nsamples - 1):0.0;
+    free(ns_per_op);
+
+    printf("%-20s %12.1f %10.1f %8.1f%% %12.1f\n", name, mean, sqrt(var),
+           (mean > 0.0)?100.0*sqrt(var)/mean:0.0, best);
+}
+
+static bool setup_positions(struct bench_data *data, bool nnue)
+{
+    struct movelist *captures;
+    char            **fens;
+    uint32_t        move;
+    int             k;
+    int             i;
+
+    fens = test_bench_positions(&data->npos);
+    data->pos = aligned_malloc(CACHE_LINE_SIZE,
+                               data->npos*sizeof(struct position));
+    data->legal = malloc(data->npos*sizeof(struct movelist));
+    data->captures = malloc(data->npos*sizeof(struct movelist));
+    for (k=0;k<data->npos;k++) {
+        memset(&data->pos[k], 0, sizeof(struct position));
+        data->pos[k].nnue_pos = nnue?nnue_create_pos():NULL;
+        if (!board_setup_from_fen(&data->pos[k], fens[k])) {
+            printf("Invalid position: %s\n", fens[k]);
+            return false;
+        }
+        gen_legal_moves(&data->pos[k], &data->legal[k]);
+
+        captures = &data->captures[k];
+        captures->size = 0;
+        for (i=0;i<data->legal[k].size;i++) {
+            move = data->legal[k].moves[i];
+            if (ISCAPTURE(move) || ISENPASSANT(move)) {
+                captures->moves[captures->size++] = move;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void print_usage(void)
+{
+    printf("Usage: microbench [options]\n");
+    printf("  --samples <n>: The number of samples per kernel (default %d).\n",
+           DEFAULT_SAMPLES);
+    printf("  --time <ms>: The minimum time per sample (default %d).\n",
+           DEFAULT_SAMPLE_TIME);
+    printf("  --kernel <name>: Only run kernels whose name start with"
+           " <name>.\n");
+    printf("  --evalfile <file>: The network to use instead of the embedded"
+           " one.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct kernel kernels[] = {
+        {"gen_moves", kernel_gen_moves, false},
+        {"gen_legal_moves", kernel_gen_legal_moves, false},
+        {"make_unmake", kernel_make_unmake, false},
+        {"see_ge", kernel_see, false},
+        {"eval_classic", kernel_evaluate, false},
+        {"eval_nnue", kernel_evaluate, true},
+        {"nnue_refresh", kernel_nnue_refresh, true},
+        {"nnue_update", kernel_nnue_update, true}
+    };
+    struct bench_data data;
+    char              name[32];
+    char              *filter = NULL;
+    uint64_t          seed;
+    bool              nnue;
+    int               nsamples = DEFAULT_SAMPLES;
+    int               sample_time = DEFAULT_SAMPLE_TIME;
+    int               size;
+    int               k;
+
+    setbuf(stdout, NULL);
+
+    /* Parse arguments */
+    strcpy(engine_eval_file, NNUE_EMBEDDED_EVAL_FILE);
+    for (k=1;k<argc;k++) {
+        if (k == (argc - 1)) {
+            print_usage();
+            return 1;
+        }
+        if (!strcmp(argv[k], "--samples")) {
+            nsamples = MAX(atoi(argv[k+1]), 1);
+        } else if (!strcmp(argv[k], "--time")) {
+            sample_time = MAX(atoi(argv[k+1]), 1);
+        } else if (!strcmp(argv[k], "--kernel")) {
+            filter = argv[k+1];
+        } else if (!strcmp(argv[k], "--evalfile")) {
+            strncpy(engine_eval_file, argv[k+1], MAX_PATH_LENGTH);
+        } else {
+            print_usage();
+            return 1;
+        }
+        k++;
+    }
+
+    /* Initialize components */
+    nnue = nnue_init(engine_eval_file);
+    if (!nnue) {
+        printf("No network available, skipping NNUE kernels\n");
+    }
+    engine_using_nnue = false;
+    chess_data_init();
+    eval_init_psq();
+    search_init();
+    smp_init();
+    hash_material_create_table(MATERIAL_HASH_SIZE);
+    if (!setup_positions(&data, nnue)) {
+        return 1;
+    }
+    data.sink = 0ULL;
+    data.keys = malloc(NTTKEYS*sizeof(uint64_t));
+    seed = 0x9E3779B97F4A7C15ULL;
+    for (k=0;k<NTTKEYS;k++) {
+        data.keys[k] = next_random(&seed);
+    }
+
+    printf("%d positions, %d samples per kernel\n", data.npos, nsamples);
+    printf("%-20s %12s %10s %9s %12s\n", "kernel", "ns/op", "stddev",
+           "rsd", "min");
+
+    for (k=0;k<(int)(sizeof(kernels)/sizeof(struct kernel));k++) {
+        if ((filter != NULL) &&
+            strncmp(kernels[k].name, filter, strlen(filter))) {
+            continue;
+        }
+        if (kernels[k].nnue && !nnue) {
+            continue;
+        }
+        use_nnue(&data, kernels[k].nnue);
+        run_kernel(&data, kernels[k].name, kernels[k].func, nsamples,
+                   sample_time);
+    }
+    use_nnue(&data, false);
+
+    /*
+     * The transposition table is probed with random keys so that the
+     * accesses are spread over the whole table as in a real search.
+     */
+    for (k=0;k<(int)(sizeof(tt_sizes)/sizeof(int));k++) {
+        size = MIN(tt_sizes[k], hash_tt_max_size());
+        hash_tt_create_table(size);
+        sprintf(name, "tt_store_%dmb", size);
+        if ((filter == NULL) || !strncmp(name, filter, strlen(filter))) {
+            run_kernel(&data, name, kernel_tt_store, nsamples, sample_time);
+        }
+        sprintf(name, "tt_lookup_%dmb", size);
+        if ((filter == NULL) || !strncmp(name, filter, strlen(filter))) {
+            (void)kernel_tt_store(&data);
+            run_kernel(&data, name, kernel_tt_lookup, nsamples, sample_time);
+        }
+        hash_tt_destroy_table();
+    }
+
+    /* Print the sink so that no kernel can be optimized away */
+    printf("checksum %016"PRIx64"\n", data.sink);
+
+    for (k=0;k<data.npos;k++) {
+        if (data.pos[k].nnue_pos != NULL) {
+            nnue_destroy_pos(data.pos[k].nnue_pos);
+        }
+    }
+    aligned_free(data.pos);
+    free(data.legal);
+    free(data.captures);
+    free(data.keys);
+    smp_destroy();
+
+    return 0;
+}
@@ -279,7 +279,7 @@ void gen_moves(struct position *pos, struct movelist *list)
     list->size = 0;
 
     /* If the side to move is in check then generate evasions */
-    if (board_in_check(pos, pos->stm)) {
+    if (board_checkinfo(pos)->checkers != 0ULL) {
         gen_check_evasions(pos, list);
         return;
     }
@@ -304,10 +304,9 @@ void gen_legal_moves(struct position *pos, struct movelist *list)
     gen_moves(pos, &temp_list);
     for (k=0;k<temp_list.size;k++) {
         move = temp_list.moves[k];
-        if (board_make_move(pos, move)) {
+        if (board_is_move_legal(pos, move)) {
             list->moves[count++] = move;
             list->size++;
-            board_unmake_move(pos);
         }
     }
 }
@@ -359,7 +358,7 @@ void gen_check_evasion_quiet(struct position *pos, struct movelist *list)
      * more to try. But if there is only one attacker and
      * the attacker is a slider then also try to block it.
      */
-    attackers = bb_attacks_to(pos, pos->bb_all, kingsq, FLIP_COLOR(pos->stm));
+    attackers = board_checkinfo(pos)->checkers;
     if (BITCOUNT(attackers) > 1) {
         return;
     }
@@ -451,7 +450,7 @@ void gen_check_evasion_tactical(struct position *pos, struct movelist *list)
      * more to try. But if there is only one attacker
      * then also try to capture the attacking piece.
      */
-    attackers = bb_attacks_to(pos, pos->bb_all, kingsq, FLIP_COLOR(pos->stm));
+    attackers = board_checkinfo(pos)->checkers;
     if (BITCOUNT(attackers) > 1) {
         return;
     }
@@ -76,8 +76,12 @@ static void add_moves(struct search_worker *worker, struct moveselector *ms,
     uint32_t        move;
     struct moveinfo *info;
     struct position *pos = &worker->pos;
+    int             first;
+    int             nquiet;
     int             k;
 
+    first = ms->last_idx;
+    nquiet = 0;
     for (k=0;k<list->size;k++) {
         move = list->moves[k];
 
@@ -91,67 +95,71 @@ static void add_moves(struct search_worker *worker, struct moveselector *ms,
             continue;
         }
 
-        /*
-         * If the SEE score is positive (normal moves or good captures) then
-         * the move is added to the moveinfo list. If the SEE score is
-         * negative (bad captures) then the move is added to be bad tacticals
-         * list.
-         */
-        if (ISTACTICAL(move) && !see_ge(pos, move, 0)) {
-            info = &ms->moveinfo[MAX_MOVES-1-ms->nbadtacticals];
-            ms->nbadtacticals++;
-        } else {
-            info = &ms->moveinfo[ms->last_idx];
-            ms->last_idx++;
-        }
+        info = &ms->moveinfo[ms->last_idx];
+        ms->last_idx++;
         info->move = move;
 
-        /* Assign a score to the move */
+        /* Assign a score to tactical moves */
         if (ISTACTICAL(move)) {
             info->score = mvvlva(pos, move);
         } else {
-            info->score = history_get_score(worker, move);
+            nquiet++;
         }
     }
+
+    /* Assign history scores to all quiet moves in one pass */
+    if (nquiet > 0) {
+        history_score_moves(worker, &ms->moveinfo[first], ms->last_idx-first);
+    }
+
+    /* Make sure searches at the next ply don't overwrite the moves */
+    worker->move_stack_end[pos->sply] =
+                        (int)(ms->moveinfo-worker->move_stack) + ms->last_idx;
+    assert(worker->move_stack_end[pos->sply] <= MOVE_STACK_SIZE);
 }
 
-static uint32_t select_move(struct moveselector *ms)
+/*
+ * Sort the moves in the range [start, end) in order of decreasing
+ * score. The lists are short so an insertion sort is used.
+ */
+static void sort_moves(struct moveselector *ms, int start, int end)
 {
-    int             iter;
-    int             best;
-    int             start;
     struct moveinfo temp;
-    struct moveinfo *info_iter;
-    struct moveinfo *info_best;
-
-    /* Check if there are moves available */
-    if (ms->idx >= ms->last_idx) {
-        return NOMOVE;
-    }
+    int             k;
+    int             l;
 
-    /* Try the moves in order of their score */
-    start = ms->idx;
-    iter = start + 1;
-    best = start;
-    info_iter = &ms->moveinfo[iter];
-    info_best = &ms->moveinfo[best];
-    while (iter < ms->last_idx) {
-        if (info_iter->score > info_best->score) {
-            best = iter;
-            info_best = &ms->moveinfo[best];
+    for (k=start+1;k<end;k++) {
+        temp = ms->moveinfo[k];
+        for (l=k;(l>start)&&(ms->moveinfo[l-1].score<temp.score);l--) {
+            ms->moveinfo[l] = ms->moveinfo[l-1];
         }
-        iter++;
-        info_iter++;
+        ms->moveinfo[l] = temp;
     }
+}
 
-    /* Swap moves */
-    if (best != start) {
-        temp = *info_best;
-        ms->moveinfo[best] = ms->moveinfo[start];
-        ms->moveinfo[start] = temp;
+/*
+ * Get the next good tactical move. The SEE score is only calculated when
+ * a move is about to be searched so that it is not wasted on moves that
+ * are never reached because of a cutoff. Moves with a negative SEE score
+ * are moved to the start of the list and searched in the bad tactical
+ * phase.
+ */
+static uint32_t select_good_tactical(struct moveselector *ms,
+                                     struct position *pos)
+{
+    uint32_t move;
+
+    while (ms->idx < ms->last_idx) {
+        move = ms->moveinfo[ms->idx].move;
+        if (see_ge(pos, move, 0)) {
+            return move;
+        }
+        ms->moveinfo[ms->nbadtacticals] = ms->moveinfo[ms->idx];
+        ms->nbadtacticals++;
+        ms->idx++;
     }
 
-    return ms->moveinfo[start].move;
+    return NOMOVE;
 }
 
 static bool get_move(struct moveselector *ms, struct search_worker *worker,
@@ -180,15 +188,18 @@ static bool get_move(struct moveselector *ms, struct search_worker *worker,
             gen_promotion_moves(pos, &list, ms->underpromote);
         }
         add_moves(worker, ms, &list);
+        sort_moves(ms, 0, ms->last_idx);
         ms->phase++;
         ms->idx = 0;
         /* Fall through */
     case PHASE_GOOD_TACTICAL:
-        if (ms->idx < ms->last_idx) {
-            break;
+        *move = select_good_tactical(ms, pos);
+        if (*move != NOMOVE) {
+            ms->idx++;
+            return true;
         }
         if (ms->tactical_only && !ms->in_check) {
-            break;
+            return false;
         }
         ms->phase++;
         /* Fall through */
@@ -219,7 +230,9 @@ static bool get_move(struct moveselector *ms, struct search_worker *worker,
         } else {
             gen_quiet_moves(pos, &list);
         }
+        ms->idx = ms->last_idx;
         add_moves(worker, ms, &list);
+        sort_moves(ms, ms->idx, ms->last_idx);
         ms->phase++;
         /* Fall through */
     case PHASE_MOVES:
@@ -229,8 +242,8 @@ static bool get_move(struct moveselector *ms, struct search_worker *worker,
         ms->phase++;
         /* Fall through */
     case PHASE_ADD_BAD_TACTICAL:
-        ms->last_idx = MAX_MOVES;
-        ms->idx = MAX_MOVES - ms->nbadtacticals;
+        ms->idx = 0;
+        ms->last_idx = ms->nbadtacticals;
         ms->phase++;
         /* Fall through */
     case PHASE_BAD_TACTICAL:
@@ -245,22 +258,34 @@ static bool get_move(struct moveselector *ms, struct search_worker *worker,
         return false;
     }
 
-    /* Select the next move to search */
-    *move = select_move(ms);
+    /* The moves are already sorted so just take the next one */
+    *move = ms->moveinfo[ms->idx].move;
     ms->idx++;
 
-    return *move != NOMOVE;
+    return true;
 }
 
 void select_init_node(struct moveselector *ms, struct search_worker *worker,
                       bool tactical_only, bool in_check, uint32_t ttmove)
 {
     struct position *pos = &worker->pos;
+    int             base;
+
+    assert(pos->sply < MAX_PLY);
+
+    /* Allocate space for the moves after the moves of the parent node */
+    base = (pos->sply > 0)?worker->move_stack_end[pos->sply-1]:0;
+    ms->moveinfo = &worker->move_stack[base];
+    worker->move_stack_end[pos->sply] = base;
 
     ms->phase = PHASE_TT;
     ms->tactical_only = tactical_only;
     ms->underpromote = !tactical_only;
-    if ((ttmove == NOMOVE) || !board_is_move_pseudo_legal(pos, ttmove)) {
+    if (ttmove == NOMOVE) {
+        ms->ttmove = NOMOVE;
+    } else if (!board_is_move_pseudo_legal(pos, ttmove)) {
+        /* The entry belongs to a different position with a matching key */
+        STATS_INC(worker, tt_collisions);
         ms->ttmove = NOMOVE;
     } else if (tactical_only && !in_check && !ISTACTICAL(ttmove)) {
         ms->ttmove = NOMOVE;
@@ -280,7 +305,38 @@ bool select_get_move(struct moveselector *ms, struct search_worker *worker,
 {
     assert(move != NULL);
 
+#ifndef STATS
     return get_move(ms, worker, move);
+#else
+    if (!get_move(ms, worker, move)) {
+        return false;
+    }
+
+    /* The phase has already been advanced past the source of the move */
+    switch (ms->phase) {
+    case PHASE_GEN_TACTICAL:
+        STATS_INC(worker, moves[STATS_MOVE_TT]);
+        break;
+    case PHASE_GOOD_TACTICAL:
+        STATS_INC(worker, moves[STATS_MOVE_GOOD_TACTICAL]);
+        break;
+    case PHASE_COUNTER:
+        STATS_INC(worker, moves[STATS_MOVE_KILLER]);
+        break;
+    case PHASE_GEN_MOVES:
+        STATS_INC(worker, moves[STATS_MOVE_COUNTER]);
+        break;
+    case PHASE_MOVES:
+        STATS_INC(worker, moves[STATS_MOVE_QUIET]);
+        break;
+    case PHASE_BAD_TACTICAL:
+        STATS_INC(worker, moves[STATS_MOVE_BAD_TACTICAL]);
+        break;
+    default:
+        break;
+    }
+    return true;
+#endif
 }
 
 bool select_is_bad_capture_phase(struct moveselector *ms)
@@ -21,15 +21,220 @@
 
 #include "nnue.h"
 
+/* A set of NNUE kernels built for a specific instruction set */
+struct nnue_kernels {
+    const char *name;
+    Value (*evaluate)(const Position &pos);
+    void (*evaluate_batch)(const Position* const *positions, int n,
+                           int *scores);
+    bool (*load_eval_file)(const std::string &eval_file);
+    bool (*load_eval_data)(const char *data, std::size_t size);
+    bool (*save_eval_file)(const std::string &eval_file, bool compact,
+                           std::size_t *saturated);
+    std::size_t (*memory_usage)(std::size_t *mapped);
+};
+
+#ifdef CPU_DISPATCH
+/*
+ * The NNUE code is built once for each supported instruction set with
+ * the NNUE namespace renamed to NNUE_<isa>. The fastest set supported
+ * by the CPU is selected at runtime.
+ */
+#define DECLARE_NNUE_KERNELS(isa)                                       \
+    namespace Eval::NNUE_##isa {                                        \
+        Value evaluate(const Position &pos);                            \
+        void evaluate_batch(const Position* const *positions, int n,    \
+                            int *scores);                               \
+        bool load_eval_file(const std::string &eval_file);              \
+        bool load_eval_data(const char *data, std::size_t size);        \
+        bool save_eval_file(const std::string &eval_file, bool compact, \
+                            std::size_t *saturated);                    \
+        std::size_t memory_usage(std::size_t *mapped);                  \
+    }
+DECLARE_NNUE_KERNELS(sse2)
+DECLARE_NNUE_KERNELS(ssse3)
+DECLARE_NNUE_KERNELS(sse41)
+DECLARE_NNUE_KERNELS(avx2)
+DECLARE_NNUE_KERNELS(avx512)
+DECLARE_NNUE_KERNELS(vnni)
+
+#define NNUE_KERNELS(name, isa)                                         \
+    {name, Eval::NNUE_##isa::evaluate, Eval::NNUE_##isa::evaluate_batch, \
+     Eval::NNUE_##isa::load_eval_file, Eval::NNUE_##isa::load_eval_data,  \
+     Eval::NNUE_##isa::save_eval_file, Eval::NNUE_##isa::memory_usage}
+
+static const struct nnue_kernels kernel_table[] = {
+    NNUE_KERNELS("SSE2", sse2),
+    NNUE_KERNELS("SSSE3", ssse3),
+    NNUE_KERNELS("SSE4.1", sse41),
+    NNUE_KERNELS("AVX2", avx2),
+    NNUE_KERNELS("AVX-512", avx512),
+    NNUE_KERNELS("VNNI", vnni)
+};
+
+static const struct nnue_kernels* select_kernels(void)
+{
+    int idx = 0;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        idx = 1;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        idx = 2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        idx = 3;
+    }
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+        idx = 4;
+        if (__builtin_cpu_supports("avx512vnni") &&
+            __builtin_cpu_supports("avx512vl")) {
+            idx = 5;
+        }
+    }
+
+    return &kernel_table[idx];
+}
+#else
+#if defined(USE_VNNI)
+#define KERNEL_NAME "VNNI"
+#elif defined(USE_AVX512)
+#define KERNEL_NAME "AVX-512"
+#elif defined(USE_AVX2)
+#define KERNEL_NAME "AVX2"
+#elif defined(USE_SSE41)
+#define KERNEL_NAME "SSE4.1"
+#elif defined(USE_SSSE3)
+#define KERNEL_NAME "SSSE3"
+#elif defined(USE_SSE2)
+#define KERNEL_NAME "SSE2"
+#elif defined(USE_NEON_DOTPROD)
+#define KERNEL_NAME "NEON dotprod"
+#elif defined(USE_NEON)
+#define KERNEL_NAME "NEON"
+#else
+#define KERNEL_NAME "generic"
+#endif
+
+static const struct nnue_kernels builtin_kernels = {
+    KERNEL_NAME, Eval::NNUE::evaluate, Eval::NNUE::evaluate_batch,
+    Eval::NNUE::load_eval_file, Eval::NNUE::load_eval_data,
+    Eval::NNUE::save_eval_file, Eval::NNUE::memory_usage
+};
+
+static const struct nnue_kernels* select_kernels(void)
+{
+    return &builtin_kernels;
+}
+#endif
+
+ExtPieceSquare kpp_board_index[PIECE_NB] = {
+ // convention: W - us, B - them
+ // viewed from other side, W and B are reversed
+    { PS_NONE,     PS_NONE     },
+    { PS_W_PAWN,   PS_B_PAWN   },
+    { PS_W_KNIGHT, PS_B_KNIGHT },
+    { PS_W_BISHOP, PS_B_BISHOP },
+    { PS_W_ROOK,   PS_B_ROOK   },
+    { PS_W_QUEEN,  PS_B_QUEEN  },
+    { PS_W_KING,   PS_B_KING   },
+    { PS_NONE,     PS_NONE     },
+    { PS_NONE,     PS_NONE     },
+    { PS_B_PAWN,   PS_W_PAWN   },
+    { PS_B_KNIGHT, PS_W_KNIGHT },
+    { PS_B_BISHOP, PS_W_BISHOP },
+    { PS_B_ROOK,   PS_W_ROOK   },
+    { PS_B_QUEEN,  PS_W_QUEEN  },
+    { PS_B_KING,   PS_W_KING   },
+    { PS_NONE,     PS_NONE     }
+};
+
+#ifdef EMBEDDED_EVAL_FILE
+/*
+ * Network embedded in the executable at build time. The data is aligned
+ * so that networks in the memory mapped format can be used in place.
+ */
+#ifdef WINDOWS
+#define EMBEDDED_SECTION ".section .rdata,\"dr\"\n"
+#else
+#define EMBEDDED_SECTION ".section .rodata\n"
+#endif
+__asm__(EMBEDDED_SECTION
+        ".balign 4096\n"
+        ".global marvin_embedded_eval_data\n"
+        "marvin_embedded_eval_data:\n"
+        ".incbin \"" EMBEDDED_EVAL_FILE "\"\n"
+        ".global marvin_embedded_eval_end\n"
+        "marvin_embedded_eval_end:\n"
+        ".byte 0\n"
+        ".previous\n");
+extern "C" const char marvin_embedded_eval_data[];
+extern "C" const char marvin_embedded_eval_end[];
+#endif
+
 static bool eval_uses_nnue;
 static std::string loaded_eval_file;
+static const struct nnue_kernels *kernels = NULL;
+
+/*
+ * Counter that is incremented each time a network is loaded. Used to
+ * detect when the accumulator refresh caches are out of date.
+ */
+static int network_generation = 0;
 
 Position::Position()
 {
+    m_cache = NULL;
+    m_cacheGeneration = 0;
+#ifdef STATS
+    m_evals = 0;
+    m_updates = 0;
+    m_refreshes = 0;
+#endif
+    m_stackCapacity = NNUE_INITIAL_STACK_SIZE;
+    m_stateStack = (StateInfo*)aligned_malloc(64,
+                                        m_stackCapacity*sizeof(StateInfo));
     clear();
 }
 
 Position::Position(const Position &p)
+{
+    m_cache = NULL;
+    m_cacheGeneration = 0;
+#ifdef STATS
+    m_evals = 0;
+    m_updates = 0;
+    m_refreshes = 0;
+#endif
+    m_stackCapacity = NNUE_INITIAL_STACK_SIZE;
+    m_stateStack = (StateInfo*)aligned_malloc(64,
+                                        m_stackCapacity*sizeof(StateInfo));
+    copy_root(p);
+}
+
+Position::~Position()
+{
+    aligned_free(m_stateStack);
+    if (m_cache != NULL) {
+        aligned_free(m_cache);
+    }
+}
+
+Position& Position::operator=(const Position &p)
+{
+    if (this != &p) {
+        copy_root(p);
+    }
+    return *this;
+}
+
+/*
+ * Copy the pieces and the accumulator of the current state. The history
+ * is not copied since the copy is never unmade past its root.
+ */
+void Position::copy_root(const Position &p)
 {
     std::memcpy(m_evalList.piece_id_list, p.m_evalList.piece_id_list,
                 sizeof(m_evalList.piece_id_list));
@@ -38,11 +243,38 @@ Position::Position(const Position &p)
     std::memcpy(m_evalList.pieceListFb, p.m_evalList.pieceListFb,
                 sizeof(m_evalList.pieceListFb));
     m_stm = p.m_stm;
-    std::memset(m_stateStack, 0, sizeof(m_stateStack));
+    m_stateStack[0] = *p.m_currentState;
+    m_stateStack[0].previous = NULL;
     m_currentState = &m_stateStack[0];
     m_stackSize = 1;
 }
 
+StateInfo* Position::push_state()
+{
+    StateInfo *old_stack;
+    int       k;
+
+    if (m_stackSize == m_stackCapacity) {
+        old_stack = m_stateStack;
+        m_stateStack = (StateInfo*)aligned_malloc(64,
+                                    2*m_stackCapacity*sizeof(StateInfo));
+        std::memcpy(m_stateStack, old_stack,
+                    m_stackCapacity*sizeof(StateInfo));
+        for (k=1;k<m_stackSize;k++) {
+            m_stateStack[k].previous = &m_stateStack[k-1];
+        }
+        m_currentState = &m_stateStack[m_stackSize-1];
+        m_stackCapacity *= 2;
+        aligned_free(old_stack);
+    }
+
+    StateInfo *info = &m_stateStack[m_stackSize++];
+    info->previous = m_currentState;
+    m_currentState = info;
+
+    return info;
+}
+
 StateInfo* Position::state() const
 {
     return m_currentState;
@@ -58,12 +290,34 @@ const EvalList* Position::eval_list() const
     return &m_evalList;
 }
 
+/*
+ * The refresh cache is allocated the first time it is needed so that
+ * positions that are never evaluated don't pay for it.
+ */
+Eval::NNUECommon::AccumulatorCache* Position::accumulator_cache() const
+{
+    if (m_cache == NULL) {
+        m_cache = (Eval::NNUECommon::AccumulatorCache*)aligned_malloc(64,
+                                    sizeof(Eval::NNUECommon::AccumulatorCache));
+        if (m_cache == NULL) {
+            return NULL;
+        }
+        m_cacheGeneration = -1;
+    }
+    if (m_cacheGeneration != network_generation) {
+        std::memset(m_cache, 0, sizeof(Eval::NNUECommon::AccumulatorCache));
+        m_cacheGeneration = network_generation;
+    }
+
+    return m_cache;
+}
+
 void Position::clear()
 {
     std::memset(m_evalList.piece_id_list, 0, sizeof(m_evalList.piece_id_list));
     std::memset(m_evalList.pieceListFw, 0, sizeof(m_evalList.pieceListFw));
     std::memset(m_evalList.pieceListFb, 0, sizeof(m_evalList.pieceListFb));
-    std::memset(m_stateStack, 0, sizeof(m_stateStack));
+    std::memset(&m_stateStack[0], 0, sizeof(StateInfo));
     m_currentState = &m_stateStack[0];
     m_stackSize = 1;
     m_stm = WHITE;
@@ -133,10 +387,7 @@ void Position::make_move(int from, int to, int type, int promotion, int piece)
     PieceId dp1 = PIECE_ID_NONE;
 
     // Update state pointers
-    StateInfo &info = m_stateStack[m_stackSize++];
-    assert(m_stackSize > 1);
-    info.previous = m_currentState;
-    m_currentState = &info;
+    push_state();
     auto &dp = m_currentState->dirtyPiece;
 
     // Initialize accumulator
@@ -268,11 +519,11 @@ void Position::unmake_move(int from, int to, int type, int captured,
 
 void Position::make_null_move()
 {
-    StateInfo &info = m_stateStack[m_stackSize++];
-    std::memcpy(&info, m_currentState, sizeof(StateInfo));
-    assert(m_stackSize > 1);
-    info.previous = m_currentState;
-    m_currentState = &info;
+    StateInfo *info = push_state();
+    StateInfo *prev = info->previous;
+    std::memcpy(info, prev, sizeof(StateInfo));
+    info->previous = prev;
+    info->dirtyPiece.dirty_num = 0;
     m_currentState->accumulator.computed_score = false;
 
     m_stm = (Color)((int)m_stm ^ 1);
@@ -292,15 +543,66 @@ void Position::unmake_null_move()
 bool nnue_init(char *eval_file)
 {
     eval_uses_nnue = false;
+    if (kernels == NULL) {
+        kernels = select_kernels();
+    }
     std::string name{eval_file};
-    if (Eval::NNUE::load_eval_file(name)) {
+    network_generation++;
+    if (name == NNUE_EMBEDDED_EVAL_FILE) {
+#ifdef EMBEDDED_EVAL_FILE
+        eval_uses_nnue = kernels->load_eval_data(marvin_embedded_eval_data,
+                                marvin_embedded_eval_end -
+                                marvin_embedded_eval_data);
+#endif
+    } else {
+        eval_uses_nnue = kernels->load_eval_file(name);
+    }
+    if (eval_uses_nnue) {
         loaded_eval_file = name;
-        eval_uses_nnue = true;
     }
 
     return eval_uses_nnue;
 }
 
+bool nnue_save_eval_file(char *file, bool compact, uint64_t *nsaturated)
+{
+    std::size_t saturated;
+    bool        ok;
+
+    if (!eval_uses_nnue) {
+        return false;
+    }
+    ok = kernels->save_eval_file(std::string{file}, compact, &saturated);
+    *nsaturated = saturated;
+    return ok;
+}
+
+uint64_t nnue_network_memory(uint64_t *mapped)
+{
+    std::size_t shared;
+    std::size_t size;
+
+    *mapped = 0ULL;
+    if (!eval_uses_nnue) {
+        return 0ULL;
+    }
+    size = kernels->memory_usage(&shared);
+    *mapped = shared;
+    return size;
+}
+
+uint64_t nnue_pos_memory(void *pos)
+{
+    Position *p = (Position*)pos;
+
+    if (p == NULL) {
+        return sizeof(Position) + NNUE_INITIAL_STACK_SIZE*sizeof(StateInfo) +
+               sizeof(Eval::NNUECommon::AccumulatorCache);
+    }
+    return sizeof(Position) + p->m_stackCapacity*sizeof(StateInfo) +
+           ((p->m_cache != NULL)?sizeof(Eval::NNUECommon::AccumulatorCache):0);
+}
+
 void* nnue_create_pos(void)
 {
     assert(eval_uses_nnue);
@@ -377,7 +679,53 @@ int nnue_evaluate(void *pos)
     assert(eval_uses_nnue);
     assert(pos != NULL);
 
-    return (int)Eval::NNUE::evaluate(*((Position*)pos));
+#ifdef STATS
+    ((Position*)pos)->m_evals++;
+#endif
+    return (int)kernels->evaluate(*((Position*)pos));
+}
+
+void nnue_evaluate_batch(void **pos, int npos, int *scores)
+{
+    assert(eval_uses_nnue);
+    assert(pos != NULL);
+    assert(scores != NULL);
+
+#ifdef STATS
+    for (int k=0;k<npos;k++) {
+        ((Position*)pos[k])->m_evals++;
+    }
+#endif
+    kernels->evaluate_batch((Position**)pos, npos, scores);
+}
+
+#ifdef STATS
+void nnue_get_stats(void *pos, uint64_t *evals, uint64_t *updates,
+                    uint64_t *refreshes)
+{
+    assert(pos != NULL);
+
+    *evals = ((Position*)pos)->m_evals;
+    *updates = ((Position*)pos)->m_updates;
+    *refreshes = ((Position*)pos)->m_refreshes;
+}
+
+void nnue_clear_stats(void *pos)
+{
+    assert(pos != NULL);
+
+    ((Position*)pos)->m_evals = 0;
+    ((Position*)pos)->m_updates = 0;
+    ((Position*)pos)->m_refreshes = 0;
+}
+#endif
+
+const char* nnue_kernel_name(void)
+{
+    if (kernels == NULL) {
+        kernels = select_kernels();
+    }
+    return kernels->name;
 }
 
 bool nnue_compare_pos(void *pos1, void *pos2)
@@ -73,22 +73,34 @@ extern "C" void aligned_free(void *ptr);
 
 struct StateInfo {
     StateInfo *previous;
-    Eval::NNUE::Accumulator accumulator;
+    Eval::NNUECommon::Accumulator accumulator;
     DirtyPiece dirtyPiece;
 };
 
+/*
+ * The initial number of entries in the state stack. The stack grows
+ * if more entries are needed, which only happens for positions that
+ * hold a long game history.
+ */
+#define NNUE_INITIAL_STACK_SIZE 256
+
 class Position {
 public:
     Position();
-    Position(const Position &p); 
+    Position(const Position &p);
+    ~Position();
+    Position& operator=(const Position &p);
 
     // Methods called by NNUE
     StateInfo* state() const;
     Color side_to_move() const;
     const EvalList* eval_list() const;
+    Eval::NNUECommon::AccumulatorCache* accumulator_cache() const;
 
     // Internal methods
     void clear();
+    void copy_root(const Position &p);
+    StateInfo* push_state();
     PieceId piece_id_on(Square sq);
     Piece cvt_piece(int piece);
     void setup(uint8_t *pieces, int side);
@@ -98,15 +110,30 @@ public:
     void unmake_null_move();
 
     Color m_stm;
-    StateInfo m_stateStack[1024];
+    StateInfo *m_stateStack;
     int m_stackSize;
+    int m_stackCapacity;
     EvalList m_evalList;
     StateInfo *m_currentState;
+    mutable Eval::NNUECommon::AccumulatorCache *m_cache;
+    mutable int m_cacheGeneration;
+#ifdef STATS
+    mutable uint64_t m_evals;
+    mutable uint64_t m_updates;
+    mutable uint64_t m_refreshes;
+#endif
 };
 
 #endif // __cplusplus
 
+/* Name used to refer to a network embedded in the executable */
+#define NNUE_EMBEDDED_EVAL_FILE "<embedded>"
+
 EXTERN bool nnue_init(char *eval_file);
+EXTERN bool nnue_save_eval_file(char *file, bool compact,
+                                uint64_t *nsaturated);
+EXTERN uint64_t nnue_network_memory(uint64_t *mapped);
+EXTERN uint64_t nnue_pos_memory(void *pos);
 EXTERN void* nnue_create_pos(void);
 EXTERN void nnue_destroy_pos(void *pos);
 EXTERN void nnue_copy_pos(void *source, void *dest);
@@ -118,6 +145,13 @@ EXTERN void nnue_unmake_move(void *pos, int from, int to, int type,
 EXTERN void nnue_make_null_move(void *pos);
 EXTERN void nnue_unmake_null_move(void *pos);
 EXTERN int nnue_evaluate(void *pos);
+EXTERN void nnue_evaluate_batch(void **pos, int npos, int *scores);
 EXTERN bool nnue_compare_pos(void *pos1, void *pos2);
+EXTERN const char* nnue_kernel_name(void);
+#ifdef STATS
+EXTERN void nnue_get_stats(void *pos, uint64_t *evals, uint64_t *updates,
+                           uint64_t *refreshes);
+EXTERN void nnue_clear_stats(void *pos);
+#endif
 
 #endif
@@ -25,6 +25,7 @@
 
 #ifdef __cplusplus
 
+#include <cstddef>
 #include <string>
 
 class Position;
@@ -112,9 +113,15 @@ namespace Eval {
   namespace NNUE {
 
     Value evaluate(const Position& pos);
+    void  evaluate_batch(const Position* const* positions, int n,
+                         int* scores);
     Value compute_eval(const Position& pos);
     void  update_eval(const Position& pos);
     bool  load_eval_file(const std::string& evalFile);
+    bool  load_eval_data(const char* data, std::size_t size);
+    bool  save_eval_file(const std::string& evalFile, bool compact,
+                         std::size_t* saturated);
+    std::size_t memory_usage(std::size_t* mapped);
 
   } // namespace NNUE
 
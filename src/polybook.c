@@ -16,13 +16,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <assert.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "polybook.h"
+#include "board.h"
+#include "engine.h"
 #include "validation.h"
 #include "utils.h"
 #include "movegen.h"
+#include "nnue.h"
+#include "thread.h"
 
 /* Polyglot random numbers */
 static const uint64_t poly_random64[781] = {
@@ -327,6 +339,88 @@ struct polybook_entry {
 static FILE *bookfp = NULL;
 static long booksize = 0;
 
+/*
+ * Memory mapped book data. When the book is mapped the entries are
+ * read directly from memory instead of through bookfp. The mapping is
+ * read-only and shared so several engine processes using the same book
+ * can share a single copy of it in the page cache.
+ */
+static uint8_t *bookdata = NULL;
+
+static bool map_book(char *path)
+{
+#ifndef WINDOWS
+    struct stat sb;
+    int         fd;
+    void        *mapping;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if ((fstat(fd, &sb) != 0) || (sb.st_size <= 0)) {
+        close(fd);
+        return false;
+    }
+    mapping = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapping, sb.st_size, MADV_RANDOM);
+
+    bookdata = mapping;
+    booksize = sb.st_size;
+
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+static void unmap_book(void)
+{
+#ifndef WINDOWS
+    munmap(bookdata, booksize);
+#endif
+    bookdata = NULL;
+    booksize = 0;
+}
+
+/*
+ * Optional index mapping Polyglot keys to the first book entry with
+ * that key. It is an open addressing hash table with linear probing
+ * and a power-of-2 number of slots. Empty slots have a count of zero.
+ */
+struct book_index_slot {
+    uint64_t key;
+    uint32_t first;
+    uint32_t count;
+};
+static struct book_index_slot *bookindex = NULL;
+static uint64_t bookindex_size = 0ULL;
+
+/*
+ * Header of the sidecar file used for storing the index. The number of
+ * used slots and a checksum of the slots are used for rejecting index
+ * files that are corrupt or too full to be probed efficiently.
+ */
+#define INDEX_FILE_SUFFIX ".idx"
+#define INDEX_FILE_MAGIC "MVBKIDX2"
+struct book_index_header {
+    char magic[8];
+    uint64_t booksize;
+    uint64_t nslots;
+    uint64_t nused;
+    uint64_t checksum;
+};
+
+static bool book_is_open(void)
+{
+    return (bookdata != NULL) || (bookfp != NULL);
+}
+
 static uint8_t engine2poly_piece(uint8_t piece)
 {
     if ((piece&0x01) == 0) {
@@ -450,26 +544,230 @@ static uint64_t generate_polykey(struct position *pos)
 static bool read_book_entry(long offset, struct polybook_entry *entry)
 {
     uint8_t buffer[16];
+    uint8_t *data;
     size_t  nbytes;
 
-    if (fseek(bookfp, offset, SEEK_SET) != 0) {
+    if (bookdata != NULL) {
+        if ((offset < 0) || ((offset+BOOK_ENTRY_SIZE) > booksize)) {
+            return false;
+        }
+        data = bookdata + offset;
+    } else {
+        if (fseek(bookfp, offset, SEEK_SET) != 0) {
+            return false;
+        }
+
+        nbytes = fread(buffer, 1, 16, bookfp);
+        if (nbytes != 16) {
+            return false;
+        }
+        data = buffer;
+    }
+
+    entry->key = read_uint64(data);
+    entry->move = read_uint16(data+8);
+    entry->weight = read_uint16(data+10);
+    entry->learn = read_uint32(data+12);
+
+    return true;
+}
+
+/*
+ * Find the slot for a key, or the empty slot where it would be stored.
+ * Probing stops after visiting all slots so that a full table can not
+ * cause an endless loop, in which case NULL is returned.
+ */
+static struct book_index_slot* index_find_slot(uint64_t key)
+{
+    uint64_t idx;
+    uint64_t k;
+
+    idx = key&(bookindex_size-1);
+    for (k=0;k<bookindex_size;k++) {
+        if ((bookindex[idx].count == 0) || (bookindex[idx].key == key)) {
+            return &bookindex[idx];
+        }
+        idx = (idx+1)&(bookindex_size-1);
+    }
+    return NULL;
+}
+
+/*
+ * Calculate a checksum of the index and count the number of used slots.
+ * Returns false if any slot refers to entries outside of the book.
+ */
+static bool index_checksum(uint64_t *checksum, uint64_t *nused)
+{
+    struct book_index_slot *slot;
+    uint64_t               nentries;
+    uint64_t               k;
+
+    nentries = booksize/BOOK_ENTRY_SIZE;
+    *checksum = 0ULL;
+    *nused = 0ULL;
+    for (k=0;k<bookindex_size;k++) {
+        slot = &bookindex[k];
+        *checksum = (*checksum^slot->key^
+                     ((((uint64_t)slot->first) << 32)|slot->count))*
+                                                        0x100000001B3ULL;
+        if (slot->count == 0) {
+            continue;
+        }
+        if (((uint64_t)slot->first+slot->count) > nentries) {
+            return false;
+        }
+        (*nused)++;
+    }
+
+    return true;
+}
+
+static void index_free(void)
+{
+    free(bookindex);
+    bookindex = NULL;
+    bookindex_size = 0ULL;
+}
+
+static bool index_build(void)
+{
+    struct polybook_entry  entry;
+    struct book_index_slot *slot;
+    long                   nentries;
+    long                   k;
+    uint64_t               prev_key;
+
+    /* Use a load factor of at most 50% */
+    nentries = booksize/BOOK_ENTRY_SIZE;
+    bookindex_size = 1ULL;
+    while (bookindex_size < (uint64_t)(2*nentries)) {
+        bookindex_size <<= 1ULL;
+    }
+    bookindex = calloc(bookindex_size, sizeof(struct book_index_slot));
+    if (bookindex == NULL) {
+        bookindex_size = 0ULL;
         return false;
     }
 
-    nbytes = fread(buffer, 1, 16, bookfp);
-    if (nbytes != 16) {
+    /* Entries are sorted by key so each key is a contiguous range */
+    slot = NULL;
+    prev_key = 0ULL;
+    for (k=0;k<nentries;k++) {
+        if (!read_book_entry(k*BOOK_ENTRY_SIZE, &entry)) {
+            index_free();
+            return false;
+        }
+        if ((slot == NULL) || (entry.key != prev_key)) {
+            slot = index_find_slot(entry.key);
+            if (slot == NULL) {
+                index_free();
+                return false;
+            }
+            slot->key = entry.key;
+            slot->first = k;
+            prev_key = entry.key;
+        }
+        slot->count++;
+    }
+
+    return true;
+}
+
+static bool index_load(char *file)
+{
+    struct book_index_header header;
+    FILE                     *fp;
+    uint64_t                 checksum;
+    uint64_t                 nused;
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+        memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) ||
+        (header.booksize != (uint64_t)booksize) ||
+        (header.nslots == 0) ||
+        ((header.nslots&(header.nslots-1)) != 0) ||
+        ((2*header.nused) > header.nslots)) {
+        fclose(fp);
         return false;
     }
 
-    entry->key = read_uint64(buffer);
-    entry->move = read_uint16(buffer+8);
-    entry->weight = read_uint16(buffer+10);
-    entry->learn = read_uint32(buffer+12);
+    bookindex_size = header.nslots;
+    bookindex = malloc(bookindex_size*sizeof(struct book_index_slot));
+    if ((bookindex == NULL) ||
+        (fread(bookindex, sizeof(struct book_index_slot), bookindex_size, fp) !=
+                                                            bookindex_size)) {
+        index_free();
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    /*
+     * Reject the index if it is corrupt, or if it is fuller than the
+     * header claims since probing then gets slow.
+     */
+    if (!index_checksum(&checksum, &nused) ||
+        (checksum != header.checksum) ||
+        (nused != header.nused)) {
+        index_free();
+        return false;
+    }
 
     return true;
 }
 
-static int find_key(uint64_t key)
+static void index_save(char *file)
+{
+    struct book_index_header header;
+    FILE                     *fp;
+    bool                     ok;
+
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.booksize = booksize;
+    header.nslots = bookindex_size;
+    if (!index_checksum(&header.checksum, &header.nused)) {
+        fclose(fp);
+        remove(file);
+        return;
+    }
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+         (fwrite(bookindex, sizeof(struct book_index_slot), bookindex_size,
+                 fp) == bookindex_size);
+    fclose(fp);
+    if (!ok) {
+        remove(file);
+    }
+}
+
+static void index_open(char *path)
+{
+    char *file;
+
+    file = malloc(strlen(path)+strlen(INDEX_FILE_SUFFIX)+1);
+    strcpy(file, path);
+    strcat(file, INDEX_FILE_SUFFIX);
+
+    /*
+     * Use the sidecar file if it matches the book. Otherwise build
+     * a new index and try to save it for the next time.
+     */
+    if (!index_load(file) && index_build()) {
+        index_save(file);
+    }
+
+    free(file);
+}
+
+static int search_key(uint64_t key)
 {
     struct polybook_entry entry;
     int                   left;
@@ -499,10 +797,32 @@ static int find_key(uint64_t key)
     return key == entry.key?left:-1;
 }
 
-bool polybook_open(char *path)
+static int find_key(uint64_t key)
+{
+    struct book_index_slot *slot;
+
+    if (bookindex != NULL) {
+        slot = index_find_slot(key);
+        if (slot != NULL) {
+            return (slot->count > 0)?(int)slot->first:-1;
+        }
+    }
+
+    return search_key(key);
+}
+
+bool polybook_open(char *path, bool use_index)
 {
     assert(path != NULL);
 
+    /* Prefer mapping the book and fall back to regular file access */
+    if (map_book(path)) {
+        if (use_index) {
+            index_open(path);
+        }
+        return true;
+    }
+
     bookfp = fopen(path, "rb");
     if (bookfp == NULL) {
         return false;
@@ -517,12 +837,19 @@ bool polybook_open(char *path)
         polybook_close();
         return false;
     }
+    if (use_index) {
+        index_open(path);
+    }
 
     return true;
 }
 
 void polybook_close(void)
 {
+    index_free();
+    if (bookdata != NULL) {
+        unmap_book();
+    }
     if (bookfp != NULL) {
         fclose(bookfp);
         bookfp = NULL;
@@ -530,6 +857,15 @@ void polybook_close(void)
     }
 }
 
+uint64_t polybook_memory(uint64_t *mapped)
+{
+    assert(mapped != NULL);
+
+    *mapped = (bookdata != NULL)?(uint64_t)booksize:0ULL;
+
+    return bookindex_size*sizeof(struct book_index_slot);
+}
+
 /*
  * A description of the opening book format can be found at:
  * http://hgm.nubati.net/book_format.html
@@ -548,7 +884,7 @@ uint32_t polybook_probe(struct position *pos)
 
     assert(valid_position(pos));
 
-    if (bookfp == NULL) {
+    if (!book_is_open()) {
         return NOMOVE;
     }
 
@@ -607,7 +943,7 @@ struct book_entry* polybook_get_entries(struct position *pos, int *nentries)
 
     assert(valid_position(pos));
 
-    if (bookfp == NULL) {
+    if (!book_is_open()) {
         *nentries = 0;
         return NULL;
     }
@@ -651,3 +987,880 @@ struct book_entry* polybook_get_entries(struct position *pos, int *nentries)
 
     return bookentries;
 }
+
+/* Default values for book building options */
+#define DEFAULT_BUILD_MAX_PLY 30
+#define DEFAULT_BUILD_MIN_GAMES 3
+#define DEFAULT_BUILD_MEMORY 256
+
+/* The amount of PGN text read at a time by a book building thread */
+#define PGN_BLOCK_SIZE (1024*1024)
+
+/* The maximum length of PGN tokens and tag values */
+#define MAX_PGN_TOKEN 255
+
+/* A move collected from the games while building a book */
+struct build_entry {
+    uint64_t key;
+    uint16_t move;
+    uint32_t count;
+    uint32_t weight;
+};
+
+/* Shared data for all book building threads */
+struct build_data {
+    struct polybook_build_options *options;
+    FILE                          *pgnfp;
+    mutex_t                       lock;
+    bool                          eof;
+    /* Text following the last complete game read from the PGN file */
+    char                          *carry;
+    size_t                        ncarry;
+    size_t                        carry_size;
+    /* Sorted runs of entries spilled to temporary files */
+    FILE                          **runs;
+    int                           nruns;
+    int                           runs_size;
+    bool                          error;
+};
+
+/* Data for a single book building thread */
+struct build_thread {
+    thread_t           thread;
+    struct build_data  *data;
+    struct position    *pos;
+    char               *text;
+    size_t             text_size;
+    struct build_entry *entries;
+    int                nentries;
+    int                max_entries;
+    uint64_t           ngames;
+    struct build_entry game[MAX_HISTORY_SIZE];
+};
+
+/* The next entry of a sorted run while merging runs */
+struct run_cursor {
+    FILE               *fp;
+    struct build_entry entry;
+};
+
+static void write_uint_be(uint8_t *buffer, uint64_t value, int nbytes)
+{
+    int k;
+
+    for (k=nbytes-1;k>=0;k--) {
+        buffer[k] = (uint8_t)(value&0xFF);
+        value >>= 8;
+    }
+}
+
+static uint16_t engine2poly_move(uint32_t move)
+{
+    int from;
+    int to;
+    int promotion;
+
+    /* Castling is encoded as the king capturing its own rook */
+    from = FROM(move);
+    to = TO(move);
+    if (ISKINGSIDECASTLE(move)) {
+        to = from + 3;
+    } else if (ISQUEENSIDECASTLE(move)) {
+        to = from - 4;
+    }
+    promotion = ISPROMOTION(move)?VALUE(PROMOTION(move))/2:0;
+
+    return (uint16_t)(FILENR(to) | (RANKNR(to)<<3) | (FILENR(from)<<6) |
+                      (RANKNR(from)<<9) | (promotion<<12));
+}
+
+static int san2piece(char c)
+{
+    switch (c) {
+    case 'N':
+        return KNIGHT;
+    case 'B':
+        return BISHOP;
+    case 'R':
+        return ROOK;
+    case 'Q':
+        return QUEEN;
+    case 'K':
+        return KING;
+    default:
+        return NO_PIECE;
+    }
+}
+
+/*
+ * Convert a move in Standard Algebraic Notation to the internal format.
+ * Returns NOMOVE if the move is illegal or ambiguous.
+ */
+static uint32_t san2move(struct position *pos, char *san)
+{
+    struct movelist list;
+    uint32_t        move;
+    uint32_t        found;
+    int             len;
+    int             start;
+    int             piece;
+    int             promotion;
+    int             to;
+    int             from_file;
+    int             from_rank;
+    int             nfound;
+    int             k;
+
+    gen_legal_moves(pos, &list);
+
+    /* Remove check indicators and annotations */
+    len = strlen(san);
+    while ((len > 0) && (strchr("+#!?", san[len-1]) != NULL)) {
+        len--;
+    }
+    if (len < 2) {
+        return NOMOVE;
+    }
+
+    /* Castling */
+    if (!strncmp(san, "O-O", 3) || !strncmp(san, "0-0", 3)) {
+        for (k=0;k<list.size;k++) {
+            move = list.moves[k];
+            if ((len == 3) && ISKINGSIDECASTLE(move)) {
+                return move;
+            } else if ((len == 5) && ISQUEENSIDECASTLE(move)) {
+                return move;
+            }
+        }
+        return NOMOVE;
+    }
+
+    /* Moving piece and promotion */
+    start = 0;
+    piece = san2piece(san[0]);
+    if (piece != NO_PIECE) {
+        start = 1;
+    } else {
+        piece = PAWN;
+    }
+    promotion = NO_PIECE;
+    if ((piece == PAWN) && (san2piece(san[len-1]) != NO_PIECE)) {
+        promotion = san2piece(san[len-1]);
+        len--;
+        if (san[len-1] == '=') {
+            len--;
+        }
+    }
+
+    /* Destination square */
+    if ((len-start < 2) || (san[len-2] < 'a') || (san[len-2] > 'h') ||
+        (san[len-1] < '1') || (san[len-1] > '8')) {
+        return NOMOVE;
+    }
+    to = SQUARE(san[len-2]-'a', san[len-1]-'1');
+
+    /* Disambiguation (or the origin square of moves in long notation) */
+    from_file = -1;
+    from_rank = -1;
+    for (k=start;k<len-2;k++) {
+        if ((san[k] >= 'a') && (san[k] <= 'h')) {
+            from_file = san[k] - 'a';
+        } else if ((san[k] >= '1') && (san[k] <= '8')) {
+            from_rank = san[k] - '1';
+        } else if ((san[k] != 'x') && (san[k] != '-')) {
+            return NOMOVE;
+        }
+    }
+
+    found = NOMOVE;
+    nfound = 0;
+    for (k=0;k<list.size;k++) {
+        move = list.moves[k];
+        if ((TO(move) != to) || (pos->pieces[FROM(move)] != piece+pos->stm) ||
+            ((from_file != -1) && (FILENR(FROM(move)) != from_file)) ||
+            ((from_rank != -1) && (RANKNR(FROM(move)) != from_rank)) ||
+            ISKINGSIDECASTLE(move) || ISQUEENSIDECASTLE(move)) {
+            continue;
+        }
+        if (ISPROMOTION(move) != (promotion != NO_PIECE)) {
+            continue;
+        }
+        if (ISPROMOTION(move) && (VALUE(PROMOTION(move)) != promotion)) {
+            continue;
+        }
+        found = move;
+        nfound++;
+    }
+
+    return (nfound == 1)?found:NOMOVE;
+}
+
+static int compare_build_entries(const void *a, const void *b)
+{
+    const struct build_entry *e1 = a;
+    const struct build_entry *e2 = b;
+
+    if (e1->key != e2->key) {
+        return (e1->key < e2->key)?-1:1;
+    }
+    return (int)e1->move - (int)e2->move;
+}
+
+static int compare_build_weights(const void *a, const void *b)
+{
+    const struct build_entry *e1 = a;
+    const struct build_entry *e2 = b;
+
+    if (e1->weight != e2->weight) {
+        return (e1->weight > e2->weight)?-1:1;
+    }
+    return (int)e1->move - (int)e2->move;
+}
+
+/* Sort the entries of a thread and combine entries for the same move */
+static void compact_entries(struct build_thread *thread)
+{
+    struct build_entry *entries = thread->entries;
+    int                n;
+    int                k;
+
+    if (thread->nentries == 0) {
+        return;
+    }
+    qsort(entries, thread->nentries, sizeof(struct build_entry),
+          compare_build_entries);
+
+    n = 0;
+    for (k=1;k<thread->nentries;k++) {
+        if ((entries[k].key == entries[n].key) &&
+            (entries[k].move == entries[n].move)) {
+            entries[n].count += entries[k].count;
+            entries[n].weight += entries[k].weight;
+        } else {
+            entries[++n] = entries[k];
+        }
+    }
+    thread->nentries = n + 1;
+}
+
+/* Write the (compacted) entries of a thread to a new sorted run */
+static void spill_entries(struct build_thread *thread)
+{
+    struct build_data *data = thread->data;
+    FILE              *fp;
+    FILE              **runs;
+    bool              ok;
+
+    fp = tmpfile();
+    ok = (fp != NULL) &&
+         (fwrite(thread->entries, sizeof(struct build_entry),
+                 thread->nentries, fp) == (size_t)thread->nentries) &&
+         (fflush(fp) == 0);
+    thread->nentries = 0;
+
+    mutex_lock(&data->lock);
+    if (ok && (data->nruns == data->runs_size)) {
+        runs = realloc(data->runs, 2*(data->runs_size+1)*sizeof(FILE*));
+        if (runs != NULL) {
+            data->runs = runs;
+            data->runs_size = 2*(data->runs_size+1);
+        } else {
+            ok = false;
+        }
+    }
+    if (ok) {
+        data->runs[data->nruns++] = fp;
+    } else {
+        data->error = true;
+        if (fp != NULL) {
+            fclose(fp);
+        }
+    }
+    mutex_unlock(&data->lock);
+}
+
+static void add_entry(struct build_thread *thread, struct build_entry *entry)
+{
+    if (thread->nentries == thread->max_entries) {
+        /*
+         * Combine duplicates to make room. The entries are only written
+         * to a run when that does not free up a significant amount of
+         * memory since every run has to be merged in the end.
+         */
+        compact_entries(thread);
+        if (thread->nentries > (3*thread->max_entries)/4) {
+            spill_entries(thread);
+        }
+    }
+    thread->entries[thread->nentries++] = *entry;
+}
+
+/* Find the start of the last game that begins after the first position */
+static size_t find_last_game(char *text, size_t len)
+{
+    size_t k;
+
+    for (k=len-1;k>0;k--) {
+        if ((text[k-1] == '\n') && (len-k >= 7) &&
+            !strncmp(&text[k], "[Event ", 7)) {
+            return k;
+        }
+    }
+    return 0;
+}
+
+static bool ensure_capacity(char **buffer, size_t *size, size_t needed)
+{
+    char *larger;
+
+    if (needed <= *size) {
+        return true;
+    }
+    larger = realloc(*buffer, needed);
+    if (larger == NULL) {
+        return false;
+    }
+    *buffer = larger;
+    *size = needed;
+
+    return true;
+}
+
+/*
+ * Read the next block of complete games from the PGN file. Text after
+ * the last complete game in the block is kept for the next block. The
+ * text is stored from the second character of the buffer and the first
+ * character is a newline so that the parser can always look at the
+ * preceding character to detect the start of a line.
+ */
+static bool read_pgn_block(struct build_thread *thread)
+{
+    struct build_data *data = thread->data;
+    size_t            len;
+    size_t            end;
+    size_t            n;
+    bool              ok;
+
+    mutex_lock(&data->lock);
+    ok = ensure_capacity(&thread->text, &thread->text_size,
+                         data->ncarry+PGN_BLOCK_SIZE+2);
+    len = 0;
+    if (ok) {
+        memcpy(thread->text+1, data->carry, data->ncarry);
+        len = data->ncarry;
+        data->ncarry = 0;
+    }
+    while (ok && !data->eof) {
+        ok = ensure_capacity(&thread->text, &thread->text_size,
+                             len+PGN_BLOCK_SIZE+2);
+        if (!ok) {
+            break;
+        }
+        n = fread(thread->text+1+len, 1, PGN_BLOCK_SIZE, data->pgnfp);
+        len += n;
+        if (n < PGN_BLOCK_SIZE) {
+            data->eof = true;
+            break;
+        }
+        end = find_last_game(thread->text+1, len);
+        if (end > 0) {
+            ok = ensure_capacity(&data->carry, &data->carry_size, len-end);
+            if (ok) {
+                memcpy(data->carry, thread->text+1+end, len-end);
+                data->ncarry = len - end;
+                len = end;
+            }
+            break;
+        }
+    }
+    if (!ok) {
+        data->error = true;
+        data->eof = true;
+        len = 0;
+    }
+    mutex_unlock(&data->lock);
+
+    if (len > 0) {
+        thread->text[0] = '\n';
+        thread->text[len+1] = '\0';
+    }
+    return len > 0;
+}
+
+/* Parse a tag pair. The value is truncated if it is too long. */
+static char* parse_tag(char *iter, char *name, char *value)
+{
+    int k;
+
+    iter++;
+    for (k=0;(*iter != '\0') && !isspace((unsigned char)*iter) &&
+             (*iter != ']') && (*iter != '\n');iter++) {
+        if (k < MAX_PGN_TOKEN) {
+            name[k++] = *iter;
+        }
+    }
+    name[k] = '\0';
+    while ((*iter != '\0') && (*iter != '"') && (*iter != '\n')) {
+        iter++;
+    }
+    k = 0;
+    if (*iter == '"') {
+        iter++;
+        while ((*iter != '\0') && (*iter != '"') && (*iter != '\n')) {
+            if ((*iter == '\\') && (iter[1] != '\0') && (iter[1] != '\n')) {
+                iter++;
+            }
+            if (k < MAX_PGN_TOKEN) {
+                value[k++] = *iter;
+            }
+            iter++;
+        }
+    }
+    value[k] = '\0';
+
+    /* Skip the rest of the line */
+    while ((*iter != '\0') && (*iter != '\n')) {
+        iter++;
+    }
+
+    return iter;
+}
+
+static char* skip_comment(char *iter)
+{
+    while ((*iter != '\0') && (*iter != '}')) {
+        iter++;
+    }
+    return (*iter == '}')?iter+1:iter;
+}
+
+static char* skip_line(char *iter)
+{
+    while ((*iter != '\0') && (*iter != '\n')) {
+        iter++;
+    }
+    return iter;
+}
+
+static char* skip_variation(char *iter)
+{
+    int depth;
+
+    depth = 0;
+    while (*iter != '\0') {
+        if (*iter == '{') {
+            iter = skip_comment(iter);
+            continue;
+        } else if (*iter == '(') {
+            depth++;
+        } else if ((*iter == ')') && (--depth == 0)) {
+            return iter + 1;
+        }
+        iter++;
+    }
+    return iter;
+}
+
+static int parse_result(char *str)
+{
+    if (!strcmp(str, "1-0")) {
+        return 1;
+    } else if (!strcmp(str, "0-1")) {
+        return -1;
+    } else if (!strcmp(str, "1/2-1/2")) {
+        return 0;
+    }
+    return 2;
+}
+
+static bool is_result_token(char *token)
+{
+    return !strcmp(token, "1-0") || !strcmp(token, "0-1") ||
+           !strcmp(token, "1/2-1/2") || !strcmp(token, "*");
+}
+
+/*
+ * Parse a single game and add its positions to the entries of the
+ * thread. Returns a pointer to the text following the game.
+ */
+static char* parse_game(struct build_thread *thread, char *iter)
+{
+    struct position *pos = thread->pos;
+    char            name[MAX_PGN_TOKEN+1];
+    char            value[MAX_PGN_TOKEN+1];
+    char            token[MAX_PGN_TOKEN+1];
+    char            *san;
+    uint32_t        move;
+    int             maxply;
+    int             result;
+    int             nmoves;
+    int             k;
+    bool            valid;
+
+    maxply = thread->data->options->maxply;
+    result = 2;
+    nmoves = 0;
+    valid = true;
+    board_start_position(pos);
+
+    /* Tag pairs */
+    while (true) {
+        while (isspace((unsigned char)*iter)) {
+            iter++;
+        }
+        if (*iter != '[') {
+            break;
+        }
+        iter = parse_tag(iter, name, value);
+        if (!strcmp(name, "Result")) {
+            result = parse_result(value);
+        } else if (!strcmp(name, "FEN")) {
+            valid = valid && board_setup_from_fen(pos, value);
+        } else if (!strcmp(name, "Variant")) {
+            valid = valid && !strcmp(value, "Standard");
+        }
+    }
+    valid = valid && (result != 2);
+
+    /* Movetext */
+    while (*iter != '\0') {
+        if (isspace((unsigned char)*iter) || (*iter == ')') ||
+            (*iter == '}')) {
+            iter++;
+            continue;
+        }
+        if ((*iter == '[') && (iter[-1] == '\n')) {
+            /* The game is missing a termination marker */
+            break;
+        } else if (*iter == '{') {
+            iter = skip_comment(iter);
+            continue;
+        } else if ((*iter == ';') || ((*iter == '%') && (iter[-1] == '\n'))) {
+            iter = skip_line(iter);
+            continue;
+        } else if (*iter == '(') {
+            iter = skip_variation(iter);
+            continue;
+        }
+
+        for (k=0;(*iter != '\0') && !isspace((unsigned char)*iter) &&
+                 (strchr("{}();[", *iter) == NULL);iter++) {
+            if (k < MAX_PGN_TOKEN) {
+                token[k++] = *iter;
+            }
+        }
+        token[k] = '\0';
+        if (k == 0) {
+            iter++;
+            continue;
+        }
+        if (is_result_token(token)) {
+            break;
+        }
+        if ((token[0] == '$') || !valid || (nmoves >= maxply)) {
+            continue;
+        }
+
+        /* Skip move numbers */
+        san = token;
+        if (strncmp(san, "0-0", 3)) {
+            while (isdigit((unsigned char)*san)) {
+                san++;
+            }
+        }
+        while (*san == '.') {
+            san++;
+        }
+        if (*san == '\0') {
+            continue;
+        }
+
+        move = san2move(pos, san);
+        if (move == NOMOVE) {
+            valid = false;
+            continue;
+        }
+        thread->game[nmoves].key = generate_polykey(pos);
+        thread->game[nmoves].move = engine2poly_move(move);
+        thread->game[nmoves].count = 1;
+        thread->game[nmoves].weight = (pos->stm == WHITE)?result+1:1-result;
+        nmoves++;
+        (void)board_make_move(pos, move);
+    }
+
+    /*
+     * Moves are weighted by the result for the player making the move,
+     * 2 for a win and 1 for a draw. Games with an unknown result are
+     * not used.
+     */
+    if (result != 2) {
+        for (k=0;k<nmoves;k++) {
+            add_entry(thread, &thread->game[k]);
+        }
+        thread->ngames++;
+    }
+
+    /* Skip to the next game */
+    while ((*iter != '\0') && ((*iter != '[') || (iter[-1] != '\n'))) {
+        iter++;
+    }
+
+    return iter;
+}
+
+static thread_retval_t build_thread_func(void *arg)
+{
+    struct build_thread *thread = arg;
+    char                *iter;
+
+    while (read_pgn_block(thread)) {
+        iter = thread->text + 1;
+        while (*iter != '\0') {
+            iter = parse_game(thread, iter);
+        }
+    }
+
+    compact_entries(thread);
+    if (thread->nentries > 0) {
+        spill_entries(thread);
+    }
+
+    return (thread_retval_t)0;
+}
+
+static bool read_run_entry(struct run_cursor *cursor)
+{
+    return fread(&cursor->entry, sizeof(struct build_entry), 1,
+                 cursor->fp) == 1;
+}
+
+static void sift_down(struct run_cursor *heap, int n, int k)
+{
+    struct run_cursor tmp;
+    int               child;
+
+    while ((child=2*k+1) < n) {
+        if ((child+1 < n) &&
+            (compare_build_entries(&heap[child+1].entry,
+                                   &heap[child].entry) < 0)) {
+            child++;
+        }
+        if (compare_build_entries(&heap[k].entry, &heap[child].entry) <= 0) {
+            break;
+        }
+        tmp = heap[k];
+        heap[k] = heap[child];
+        heap[child] = tmp;
+        k = child;
+    }
+}
+
+/*
+ * Write all moves for a position to the book. Weights are scaled to
+ * fit in 16 bits and moves are ordered by decreasing weight.
+ */
+static bool write_book_position(FILE *fp, struct build_entry *moves, int n,
+                                int mingames, uint64_t *nentries)
+{
+    uint8_t  buffer[BOOK_ENTRY_SIZE];
+    uint32_t max_weight;
+    int      count;
+    int      k;
+
+    count = 0;
+    max_weight = 0;
+    for (k=0;k<n;k++) {
+        if ((moves[k].count >= (uint32_t)mingames) && (moves[k].weight > 0)) {
+            moves[count++] = moves[k];
+            max_weight = MAX(max_weight, moves[k].weight);
+        }
+    }
+    qsort(moves, count, sizeof(struct build_entry), compare_build_weights);
+
+    for (k=0;k<count;k++) {
+        if (max_weight > 0xFFFF) {
+            moves[k].weight = (uint32_t)(((uint64_t)moves[k].weight*0xFFFF)/
+                                         max_weight);
+            moves[k].weight = MAX(moves[k].weight, 1);
+        }
+        write_uint_be(buffer, moves[k].key, 8);
+        write_uint_be(buffer+8, moves[k].move, 2);
+        write_uint_be(buffer+10, moves[k].weight, 2);
+        write_uint_be(buffer+12, 0, 4);
+        if (fwrite(buffer, BOOK_ENTRY_SIZE, 1, fp) != 1) {
+            return false;
+        }
+    }
+    *nentries += count;
+
+    return true;
+}
+
+/* Merge all sorted runs into a book sorted by key */
+static bool merge_runs(struct build_data *data, FILE *fp, uint64_t *nentries)
+{
+    struct run_cursor  *heap;
+    struct build_entry moves[MAX_MOVES];
+    struct build_entry entry;
+    int                nmoves;
+    int                n;
+    int                k;
+    bool               ok;
+
+    heap = malloc((data->nruns+1)*sizeof(struct run_cursor));
+    if (heap == NULL) {
+        return false;
+    }
+    n = 0;
+    for (k=0;k<data->nruns;k++) {
+        rewind(data->runs[k]);
+        heap[n].fp = data->runs[k];
+        if (read_run_entry(&heap[n])) {
+            n++;
+        }
+    }
+    for (k=n/2-1;k>=0;k--) {
+        sift_down(heap, n, k);
+    }
+
+    ok = true;
+    nmoves = 0;
+    while (ok && (n > 0)) {
+        entry = heap[0].entry;
+        if (!read_run_entry(&heap[0])) {
+            heap[0] = heap[--n];
+        }
+        sift_down(heap, n, 0);
+
+        /* Runs from different threads can contain the same move */
+        if ((nmoves > 0) && (moves[nmoves-1].key == entry.key) &&
+            (moves[nmoves-1].move == entry.move)) {
+            moves[nmoves-1].count += entry.count;
+            moves[nmoves-1].weight += entry.weight;
+            continue;
+        }
+        if ((nmoves > 0) && (moves[nmoves-1].key != entry.key)) {
+            ok = write_book_position(fp, moves, nmoves,
+                                     data->options->mingames, nentries);
+            nmoves = 0;
+        }
+        /* Only Polyglot key collisions can exceed the number of moves */
+        if (nmoves < MAX_MOVES) {
+            moves[nmoves++] = entry;
+        }
+    }
+    if (ok && (nmoves > 0)) {
+        ok = write_book_position(fp, moves, nmoves, data->options->mingames,
+                                 nentries);
+    }
+    free(heap);
+
+    return ok;
+}
+
+void polybook_init_build_options(struct polybook_build_options *options)
+{
+    assert(options != NULL);
+
+    options->nthreads = 1;
+    options->maxply = DEFAULT_BUILD_MAX_PLY;
+    options->mingames = DEFAULT_BUILD_MIN_GAMES;
+    options->memory = DEFAULT_BUILD_MEMORY;
+}
+
+bool polybook_build(char *pgnfile, char *bookfile,
+                    struct polybook_build_options *options, uint64_t *ngames,
+                    uint64_t *nentries)
+{
+    struct build_data   data;
+    struct build_thread *threads;
+    FILE                *bookfp;
+    uint64_t            size;
+    int                 max_entries;
+    int                 k;
+    bool                ok;
+
+    assert(pgnfile != NULL);
+    assert(bookfile != NULL);
+    assert(options != NULL);
+    assert(options->nthreads > 0);
+    assert(ngames != NULL);
+    assert(nentries != NULL);
+
+    *ngames = 0ULL;
+    *nentries = 0ULL;
+    options->maxply = CLAMP(options->maxply, 1, MAX_HISTORY_SIZE-1);
+    memset(&data, 0, sizeof(data));
+    data.options = options;
+    data.pgnfp = fopen(pgnfile, "rb");
+    if (data.pgnfp == NULL) {
+        return false;
+    }
+    mutex_init(&data.lock);
+
+    /* Split the memory budget between the threads */
+    size = ((uint64_t)options->memory*1024*1024)/
+                            (options->nthreads*sizeof(struct build_entry));
+    size = CLAMP(size, MAX_HISTORY_SIZE,
+                 INT32_MAX/sizeof(struct build_entry));
+    max_entries = (int)size;
+
+    threads = calloc(options->nthreads, sizeof(struct build_thread));
+    ok = threads != NULL;
+    for (k=0;ok && (k<options->nthreads);k++) {
+        threads[k].data = &data;
+        threads[k].max_entries = max_entries;
+        threads[k].entries = malloc(max_entries*sizeof(struct build_entry));
+        threads[k].pos = calloc(1, sizeof(struct position));
+        ok = (threads[k].entries != NULL) && (threads[k].pos != NULL);
+        if (ok && engine_using_nnue) {
+            threads[k].pos->nnue_pos = nnue_create_pos();
+        }
+    }
+
+    /* Parse the games and write sorted runs of entries */
+    if (ok) {
+        for (k=0;k<options->nthreads;k++) {
+            thread_create(&threads[k].thread,
+                          (thread_func_t)build_thread_func, &threads[k]);
+        }
+        for (k=0;k<options->nthreads;k++) {
+            thread_join(&threads[k].thread);
+        }
+        ok = !data.error;
+    }
+    for (k=0;(threads != NULL) && (k<options->nthreads);k++) {
+        *ngames += threads[k].ngames;
+        free(threads[k].entries);
+        free(threads[k].text);
+        if (threads[k].pos != NULL) {
+            if (threads[k].pos->nnue_pos != NULL) {
+                nnue_destroy_pos(threads[k].pos->nnue_pos);
+            }
+            free(threads[k].pos);
+        }
+    }
+    free(threads);
+    fclose(data.pgnfp);
+    free(data.carry);
+
+    /* Merge the runs into the book */
+    if (ok) {
+        bookfp = fopen(bookfile, "wb");
+        ok = bookfp != NULL;
+        if (ok) {
+            ok = merge_runs(&data, bookfp, nentries);
+            ok = (fclose(bookfp) == 0) && ok;
+            if (!ok) {
+                remove(bookfile);
+            }
+        }
+    }
+    for (k=0;k<data.nruns;k++) {
+        fclose(data.runs[k]);
+    }
+    free(data.runs);
+    mutex_destroy(&data.lock);
+
+    return ok;
+}
@@ -24,15 +24,27 @@
  * Open the opening book.
  *
  * @param path The path of the opening book.
+ * @param use_index If an index should be used to find positions in the
+ *                  book. The index is loaded from <path>.idx if it exists
+ *                  and otherwise built and saved to that file.
  * @return Returns true if the book was sucessfully opened.
  */
-bool polybook_open(char *path);
+bool polybook_open(char *path, bool use_index);
 
 /*
  * Close the opening book.
  */
 void polybook_close(void);
 
+/*
+ * Get the amount of memory used by the opening book.
+ *
+ * @param mapped Set to the size of the memory mapped book file, which is
+ *               shared with other processes using the same book.
+ * @return Returns the size of the allocated book index in bytes.
+ */
+uint64_t polybook_memory(uint64_t *mapped);
+
 /*
  * Try to find a move to play in the opening book.
  *
@@ -51,4 +63,43 @@ uint32_t polybook_probe(struct position *pos);
  */
 struct book_entry* polybook_get_entries(struct position *pos, int *nentries);
 
+/* Options for building an opening book from PGN games */
+struct polybook_build_options {
+    /* The number of threads to parse games in */
+    int nthreads;
+    /* Only moves played within this many plies from the start are added */
+    int maxply;
+    /* Moves played in fewer games than this are left out */
+    int mingames;
+    /* The amount of memory (in MB) used for collecting moves */
+    int memory;
+};
+
+/*
+ * Initialize book building options to default values.
+ *
+ * @param options The options to initialize.
+ */
+void polybook_init_build_options(struct polybook_build_options *options);
+
+/*
+ * Build an opening book in Polyglot format from a file with PGN games.
+ * Blocks of games are parsed concurrently by several threads. Each
+ * thread collects the played moves in a bounded amount of memory and
+ * writes them as sorted runs to temporary files when the memory is
+ * full. The runs are then merged into a book sorted by key. Moves are
+ * weighted by the result for the player making the move, 2 for a win
+ * and 1 for a draw.
+ *
+ * @param pgnfile The file with PGN games.
+ * @param bookfile The book file to create.
+ * @param options The options to use.
+ * @param ngames Set to the number of games that were used.
+ * @param nentries Set to the number of entries written to the book.
+ * @return Returns true if the book was successfully created.
+ */
+bool polybook_build(char *pgnfile, char *bookfile,
+                    struct polybook_build_options *options, uint64_t *ngames,
+                    uint64_t *nentries);
+
 #endif
@@ -40,14 +40,16 @@
 #include "smp.h"
 #include "fen.h"
 #include "history.h"
-
-/* Calculates if it is time to check the clock and poll for commands */
-#define CHECKUP(n) (((n)&1023)==0)
+#include "timetrace.h"
 
 /* Different exceptions that can happen during search */
-#define EXCEPTION_COMMAND 1
-#define EXCEPTION_STOP 2
-#define EXCEPTION_TIMEOUT 3
+#define EXCEPTION_STOP 1
+
+/*
+ * Interval (in nodes) at which limits that depend on the total
+ * node count are checked. Must be a power of two.
+ */
+#define NODE_CHECK_INTERVAL 1024
 
 /* Configuration constants for null move pruning */
 #define NULLMOVE_DEPTH 3
@@ -89,6 +91,16 @@ static int lmp_counts[] = {0, 4, 6, 8, 12, 17, 24, 33, 44, 57, 72};
 /* Configuration constants for singular extensions */
 #define SE_DEPTH 8
 
+/*
+ * Additional depth given to tablebase results when they are stored in the
+ * transposition table. The result is exact so it should be preferred over
+ * entries from searches to a similar depth.
+ */
+#define TABLEBASE_TT_DEPTH_BONUS 6
+
+/* The minimum depth for deferring moves searched by other workers */
+#define ABDADA_DEPTH 4
+
 /* Configuration for continuation history pruning */
 #define HISTORY_PRUNING_DEPTH 3
 static int counter_history_pruning_margin[] = {0, 0, -500, -1000};
@@ -97,6 +109,25 @@ static int followup_history_pruning_margin[] = {0, -500, -1000, -2000};
 /* Table of base reductions for LMR indexed by depth and move number */
 static int lmr_reductions[64][64];
 
+static bool get_next_move(struct moveselector *ms,
+                          struct search_worker *worker,
+                          struct movelist *deferred, int *deferidx,
+                          uint32_t *move)
+{
+    /*
+     * Once the move selector runs out of moves the
+     * deferred moves are returned.
+     */
+    if ((*deferidx == 0) && select_get_move(ms, worker, move)) {
+        return true;
+    }
+    if (*deferidx < deferred->size) {
+        *move = deferred->moves[(*deferidx)++];
+        return true;
+    }
+    return false;
+}
+
 static bool check_tt_cutoff(struct tt_item *item, int depth, int alpha,
                             int beta, int score)
 {
@@ -207,9 +238,30 @@ static bool probe_wdl_tables(struct search_worker *worker, int alpha, int beta,
     unsigned int    res;
     struct position *pos;
     bool            cutoff;
+    uint64_t        start;
 
     pos = &worker->pos;
-    res = tb_probe_wdl(pos->bb_sides[WHITE], pos->bb_sides[BLACK],
+
+    /*
+     * WDL tables can only be probed in positions without castling
+     * rights where the fifty move counter was just reset so other
+     * positions are rejected before checking the cache.
+     */
+    if ((pos->fifty != 0) || (pos->castle != 0)) {
+        *score = 0;
+        return false;
+    }
+
+    /*
+     * Probing the tables can be slow, especially if the tablebase files
+     * are not in the page cache, so results are cached in memory.
+     */
+    STATS_INC(worker, tb_probes);
+    if (hash_tbcache_lookup(pos, &res)) {
+        STATS_INC(worker, tb_cache_hits);
+    } else {
+        start = STATS_TIME();
+        res = tb_probe_wdl(pos->bb_sides[WHITE], pos->bb_sides[BLACK],
                     pos->bb_pieces[WHITE_KING]|pos->bb_pieces[BLACK_KING],
                     pos->bb_pieces[WHITE_QUEEN]|pos->bb_pieces[BLACK_QUEEN],
                     pos->bb_pieces[WHITE_ROOK]|pos->bb_pieces[BLACK_ROOK],
@@ -219,9 +271,12 @@ static bool probe_wdl_tables(struct search_worker *worker, int alpha, int beta,
                     pos->fifty, pos->castle,
                     pos->ep_sq != NO_SQUARE?pos->ep_sq:0,
                     pos->stm == WHITE);
-    if (res == TB_RESULT_FAILED) {
-        *score = 0;
-        return false;
+        STATS_ADD(worker, tb_probe_time, STATS_TIME()-start);
+        if (res == TB_RESULT_FAILED) {
+            *score = 0;
+            return false;
+        }
+        hash_tbcache_store(pos, res);
     }
     worker->tbhits++;
 
@@ -244,26 +299,52 @@ static bool probe_wdl_tables(struct search_worker *worker, int alpha, int beta,
     return cutoff;
 }
 
-static void copy_pv(struct movelist *from, struct movelist *to)
+static void copy_pv(struct search_worker *worker, struct movelist *to)
 {
-    int k;
+    to->size = worker->pv_length[0];
+    memcpy(to->moves, worker->pv_table, to->size*sizeof(uint32_t));
+}
+
+static void update_pv(struct search_worker *worker, uint32_t move)
+{
+    uint32_t *line;
+    int      sply;
+
+    sply = worker->pos.sply;
+    line = &worker->pv_table[PV_OFFSET(sply)];
+    line[0] = move;
+    memcpy(&line[1], &worker->pv_table[PV_OFFSET(sply+1)],
+           worker->pv_length[sply+1]*sizeof(uint32_t));
+    worker->pv_length[sply] = worker->pv_length[sply+1] + 1;
+}
 
-    to->size = from->size;
-    for (k=0;k<from->size;k++) {
-        to->moves[k] = from->moves[k];
+static void stop_search(struct search_worker *worker)
+{
+    if (!worker->state->standalone && !worker->ponder_alternative) {
+        smp_stop_all();
     }
 }
 
-static void update_pv(struct search_worker *worker, uint32_t move)
+static bool node_limit_reached(struct search_worker *worker)
 {
-    struct position *pos;
+    uint64_t max_nodes = worker->state->max_nodes;
 
-    pos = &worker->pos;
-    worker->pv_table[pos->sply].moves[0] = move;
-    memcpy(&worker->pv_table[pos->sply].moves[1],
-           &worker->pv_table[pos->sply+1].moves[0],
-           worker->pv_table[pos->sply+1].size*sizeof(uint32_t));
-    worker->pv_table[pos->sply].size = worker->pv_table[pos->sply+1].size + 1;
+    if (max_nodes == 0ULL) {
+        return false;
+    }
+    if (worker->nodes >= max_nodes) {
+        return true;
+    }
+
+    /*
+     * When several workers share the search the limit applies to
+     * the total number of nodes. Summing the counters of all workers
+     * is too expensive to do for every node so it is only done at
+     * regular intervals.
+     */
+    return !worker->state->standalone &&
+           ((worker->nodes&(NODE_CHECK_INTERVAL-1)) == 0) &&
+           (smp_nodes() >= max_nodes);
 }
 
 static void checkup(struct search_worker *worker)
@@ -274,21 +355,29 @@ static void checkup(struct search_worker *worker)
     }
 
     /*
-     * For the master worker also check if the time
-     * is up or if a new command have been received.
+     * Workers searching an alternative to the ponder move give
+     * up as soon as the ponder move is played.
      */
-    if ((worker->id != 0) || !CHECKUP(worker->nodes)) {
-        return;
+    if (worker->ponder_alternative && !worker->state->pondering) {
+        longjmp(worker->env, EXCEPTION_STOP);
     }
 
-    /* Perform checkup */
-    if (!tc_check_time(worker)) {
-        smp_stop_all();
-        longjmp(worker->env, EXCEPTION_TIMEOUT);
+    /* Check if the node limit have been reached */
+    if (node_limit_reached(worker)) {
+        stop_search(worker);
+        longjmp(worker->env, EXCEPTION_STOP);
     }
-    if (engine_check_input(worker)) {
-        smp_stop_all();
-        longjmp(worker->env, EXCEPTION_COMMAND);
+
+    /*
+     * In nodestime mode the time is derived from the node count so
+     * the master checks it from within the search instead of relying
+     * on the monitor thread. This keeps the search reproducible.
+     */
+    if ((worker->id == 0) && !worker->state->standalone &&
+        ((worker->nodes&(NODE_CHECK_INTERVAL-1)) == 0) &&
+        tc_is_nodestime() && !tc_check_time(worker)) {
+        stop_search(worker);
+        longjmp(worker->env, EXCEPTION_STOP);
     }
 }
 
@@ -337,16 +426,27 @@ static int quiescence(struct search_worker *worker, int depth, int alpha,
     /* Check if the time is up or if we have received a new command */
     checkup(worker);
 
-    /* Reset the search tree for this ply */
-    worker->pv_table[pos->sply].size = 0;
+    /* Reset the search tree and the move stack for this ply */
+    worker->pv_length[pos->sply] = 0;
+    worker->move_stack_end[pos->sply] =
+                    (pos->sply > 0)?worker->move_stack_end[pos->sply-1]:0;
 
     /* Check if we should considered the game as a draw */
     if (board_is_repetition(pos) || (pos->fifty >= 100)) {
         return 0;
     }
+    if ((alpha < 0) && board_has_upcoming_repetition(pos)) {
+        alpha = 0;
+        if (alpha >= beta) {
+            return alpha;
+        }
+    }
 
-    /* Evaluate the position */
-    static_score = eval_evaluate(pos);
+    /*
+     * Evaluate the position. An approximate score is good enough
+     * if the position is far outside the window.
+     */
+    static_score = eval_evaluate_lazy(pos, alpha, beta);
 
     /* If we have reached the maximum depth then we stop */
     if (pos->sply >= MAX_PLY) {
@@ -375,6 +475,7 @@ static int quiescence(struct search_worker *worker, int depth, int alpha,
     if (tt_found) {
         score = adjust_mate_score(pos, tt_item.score);
         if (check_tt_cutoff(&tt_item, 0, alpha, beta, score)) {
+            STATS_INC(worker, tt_cutoffs);
             return score;
         }
     }
@@ -420,6 +521,7 @@ static int quiescence(struct search_worker *worker, int depth, int alpha,
             best_score = score;
             if (score > alpha) {
                 if (score >= beta) {
+                    STATS_INC(worker, qsearch_cutoffs);
                     break;
                 }
                 alpha = score;
@@ -441,6 +543,7 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
     int                 score;
     int                 tt_score;
     int                 tb_score;
+    int                 tb_type;
     int                 best_score;
     int                 static_score;
     int                 threshold;
@@ -468,6 +571,11 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
     int                 chist;
     int                 fhist;
     struct moveselector ms;
+    struct movelist     deferred;
+    int                 deferidx;
+    bool                use_abdada;
+    bool                marked;
+    uint64_t            key;
 
     /* Set node type */
     pv_node = (beta-alpha) > 1;
@@ -492,8 +600,10 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
         worker->seldepth = pos->sply;
     }
 
-    /* Reset the search tree for this ply */
-    worker->pv_table[pos->sply].size = 0;
+    /* Reset the search tree and the move stack for this ply */
+    worker->pv_length[pos->sply] = 0;
+    worker->move_stack_end[pos->sply] =
+                    (pos->sply > 0)?worker->move_stack_end[pos->sply-1]:0;
 
     /*
      * Check if the game should be considered a draw. A position is
@@ -506,6 +616,18 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
         return 0;
     }
 
+    /*
+     * If a previous position can be reached with a single move then
+     * at least a draw is guaranteed, which allows the window to be
+     * narrowed.
+     */
+    if ((alpha < 0) && board_has_upcoming_repetition(pos)) {
+        alpha = 0;
+        if (alpha >= beta) {
+            return alpha;
+        }
+    }
+
     /*
      * Check the main transposition table to see if the positon
      * have been searched before. If this a singular extension
@@ -520,6 +642,7 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
         tt_score = adjust_mate_score(pos, tt_item.score);
         if (!pv_node && (tt_move != exclude_move) &&
             check_tt_cutoff(&tt_item, depth, alpha, beta, tt_score)) {
+            STATS_INC(worker, tt_cutoffs);
             return tt_score;
         }
     }
@@ -528,6 +651,24 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
     if (worker->state->probe_wdl &&
         (BITCOUNT(pos->bb_all) <= (int)TB_LARGEST)) {
         if (probe_wdl_tables(worker, alpha, beta, &tb_score)) {
+            /*
+             * Store the result in the transposition table so that
+             * later visits to the position can be cut off without
+             * probing the tables again. Only draws are exact, a win
+             * is a lower bound and a loss is an upper bound since
+             * the position may still contain a mate.
+             */
+            if (tb_score > 0) {
+                tb_type = TT_BETA;
+            } else if (tb_score < 0) {
+                tb_type = TT_ALPHA;
+            } else {
+                tb_type = TT_EXACT;
+            }
+            hash_tt_store(pos, NOMOVE,
+                          MIN(depth+TABLEBASE_TT_DEPTH_BONUS, MAX_SEARCH_DEPTH),
+                          tb_score, tb_type,
+                          tt_found?tt_item.eval_score:eval_evaluate(pos));
             return tb_score;
         }
     }
@@ -582,12 +723,15 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
         !in_check &&
         (depth > NULLMOVE_DEPTH) &&
         board_has_non_pawn(pos, pos->stm)) {
+        STATS_INC(worker, nullmove_tries);
         reduction = NULLMOVE_BASE_REDUCTION + depth/NULLMOVE_DIVISOR;
         board_make_null_move(pos);
         score = -search(worker, depth-reduction-1, -beta, -beta+1, false,
                         NOMOVE);
         board_unmake_null_move(pos);
         if (score >= beta) {
+            STATS_INC(worker, nullmove_cutoffs);
+
             /*
              * Since the score is based on doing a null move a checkmate
              * score doesn't necessarilly indicate a forced mate. So
@@ -635,15 +779,22 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
         }
     }
 
-    /* Check if the move from the transposition table is singular */
+    /*
+     * Check if the move from the transposition table is singular. The
+     * move is not checked for legality here. Items are verified against
+     * the full key, except in TT_COMPACT builds where only 16 bits of the
+     * key are stored and the move can belong to another position. That
+     * is harmless since the move is only excluded from the verification
+     * search, never made, and the move selector checks that the move is
+     * pseudo legal before it is searched.
+     */
     is_singular = false;
     if (depth >= SE_DEPTH &&
         (exclude_move == NOMOVE) &&
         (tt_move != NOMOVE) &&
         (tt_item.type == TT_BETA) &&
         (tt_item.depth >= (depth-3)) &&
-        (abs(beta) < KNOWN_WIN) &&
-        board_is_move_pseudo_legal(pos, tt_move)) {
+        (abs(beta) < KNOWN_WIN)) {
         threshold = tt_score-2*depth;
 
         score = search(worker, depth/2, threshold-1, threshold, true, tt_move);
@@ -671,8 +822,13 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
     tt_flag = TT_ALPHA;
     movenumber = 0;
     found_move = false;
+    deferred.size = 0;
+    deferidx = 0;
+    key = pos->key;
+    use_abdada = !pv_node && (depth >= ABDADA_DEPTH) &&
+                                                    smp_use_abdada(worker);
     select_init_node(&ms, worker, false, in_check, tt_move);
-    while (select_get_move(&ms, worker, &move)) {
+    while (get_next_move(&ms, worker, &deferred, &deferidx, &move)) {
         /*
          * If this a singular extension search then skip the move
          * that is expected to be singular.
@@ -681,6 +837,18 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
             continue;
         }
 
+        /*
+         * ABDADA. Moves other than the first one that are currently
+         * being searched by another worker are deferred until all
+         * other moves have been searched. By then the result is
+         * often available in the transposition table.
+         */
+        if (use_abdada && (deferidx == 0) && found_move &&
+            smp_is_searched_elsewhere(worker, key, move)) {
+            deferred.moves[deferred.size++] = move;
+            continue;
+        }
+
         /* Various move properties */
         gives_check = board_move_gives_check(pos, move);
         tactical = ISTACTICAL(move) || in_check || gives_check;
@@ -778,6 +946,7 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
 
         /* Recursivly search the move */
         reduction = CLAMP(reduction, 0, new_depth-1);
+        marked = use_abdada && smp_start_move(worker, key, move);
         if (best_score == -INFINITE_SCORE) {
             /*
              * Perform a full search until a pv move is found. Usually
@@ -790,7 +959,11 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
                             true, NOMOVE);
 
             /* Re-search with full depth if the move improved alpha */
+            if (reduction > 0) {
+                STATS_INC(worker, lmr_searches);
+            }
             if ((score > alpha) && (reduction > 0)) {
+                STATS_INC(worker, lmr_researches);
                 score = -search(worker, new_depth-1, -alpha-1, -alpha, true,
                                 NOMOVE);
             }
@@ -806,6 +979,9 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
             }
         }
         board_unmake_move(pos);
+        if (marked) {
+            smp_finish_move(key, move);
+        }
 
         /* Check if we have found a new best move */
         if (score > best_score) {
@@ -824,6 +1000,10 @@ static int search(struct search_worker *worker, int depth, int alpha, int beta,
                  * search this position further.
                  */
                 if (score >= beta) {
+                    STATS_INC(worker, beta_cutoffs);
+                    if (movenumber == 1) {
+                        STATS_INC(worker, first_move_cutoffs);
+                    }
                     if (!ISTACTICAL(move) || !see_ge(pos, move, 0)) {
                         killer_add_move(worker, move);
                         counter_add_move(worker, move);
@@ -882,12 +1062,13 @@ static int search_root(struct search_worker *worker, int depth, int alpha,
     bool                tt_found;
     struct tt_item      tt_item;
     struct moveselector ms;
+    uint64_t            nodes;
 
     /* Check if the time is up or if we have received a new command */
     checkup(worker);
 
     /* Reset the search tree for this ply */
-    worker->pv_table[0].size = 0;
+    worker->pv_length[0] = 0;
 
     /* Check the transposition table and initialize some helper variables */
     tt_found = hash_tt_lookup(pos, &tt_item);
@@ -935,9 +1116,14 @@ static int search_root(struct search_worker *worker, int depth, int alpha,
             new_depth++;
         }
 
-        /* Recursivly search the move */
+        /*
+         * Recursivly search the move and keep track of the effort
+         * spent on it for the time management.
+         */
+        nodes = worker->nodes;
         score = -search(worker, new_depth-1, -beta, -alpha, true, NOMOVE);
         board_unmake_move(pos);
+        worker->root_nodes[FROM(move)][TO(move)] += worker->nodes - nodes;
 
         if ((worker->currmovenumber == 1) && (score <= alpha)) {
             worker->resolving_tt_fail = true;
@@ -980,8 +1166,7 @@ static int search_root(struct search_worker *worker, int depth, int alpha,
                  * window since it's only then that the score can be trusted.
                  */
                 worker->mpv_moves[worker->mpvidx] = move;
-                copy_pv(&worker->pv_table[0],
-                        &worker->mpv_lines[worker->mpvidx].pv);
+                copy_pv(worker, &worker->mpv_lines[worker->mpvidx].pv);
                 worker->mpv_lines[worker->mpvidx].score = score;
                 worker->mpv_lines[worker->mpvidx].depth = worker->depth;
                 worker->mpv_lines[worker->mpvidx].seldepth = worker->seldepth;
@@ -991,7 +1176,7 @@ static int search_root(struct search_worker *worker, int depth, int alpha,
                 if (worker->resolving_tt_fail) {
                     worker->resolving_tt_fail = false;
                     if (!tc_check_time(worker)) {
-                        smp_stop_all();
+                        stop_search(worker);
                         break;
                     }
                 }
@@ -1049,6 +1234,7 @@ static void search_aspiration_window(struct search_worker *worker, int depth,
          * increase the window and re-search.
          */
         if (score <= alpha) {
+            TIMETRACE_INSTANT(worker, "fail low", score);
             awindex++;
             alpha = score - aspiration_window[awindex];
             worker->resolving_root_fail = true;
@@ -1058,6 +1244,7 @@ static void search_aspiration_window(struct search_worker *worker, int depth,
             continue;
         }
         if (score >= beta) {
+            TIMETRACE_INSTANT(worker, "fail high", score);
             bwindex++;
             beta = score + aspiration_window[bwindex];
             if (worker->id == 0) {
@@ -1087,32 +1274,77 @@ void search_find_best_move(struct search_worker *worker)
     int score;
     int depth;
     int mpvidx;
+    int nextra;
 
     assert(valid_position(&worker->pos));
 
     /* Setup the first iteration */
-    depth = 1 + worker->id%2;
+    depth = smp_first_iteration(worker);
+    TIMETRACE_BEGIN(worker, "search");
 
     /* Main search loop */
     score = 0;
     while (true) {
 		/* Handle aborted searches */
         if (setjmp(worker->env) != 0) {
+            TIMETRACE_END(worker, "iteration");
             break;
         }
+        TIMETRACE_BEGIN(worker, "iteration");
 
-        /* Multipv loop */
-        for (mpvidx=0;mpvidx<worker->multipv;mpvidx++) {
+        /*
+         * Multipv loop. When several workers are used the lines are
+         * distributed over the workers, each line being centered around
+         * the score it had after the previous iteration.
+         */
+        for (mpvidx=smp_first_multipv_line(worker);
+             mpvidx<worker->multipv;
+             mpvidx=smp_next_multipv_line(worker, mpvidx)) {
             worker->mpvidx = mpvidx;
+            if (smp_parallel_multipv(worker) &&
+                (worker->mpv_moves[mpvidx] != NOMOVE)) {
+                score = worker->mpv_lines[mpvidx].score;
+            }
             search_aspiration_window(worker, depth, score);
 
+            if (smp_parallel_multipv(worker)) {
+                smp_share_multipv_line(worker);
+            }
             if ((worker->id == 0) && (worker->multipv > 1)) {
                 engine_send_multipv_info(worker);
             }
         }
+
+        /*
+         * Lines that were dropped as outdated, or removed because a
+         * deeper line contradicted them, are searched again before the
+         * iteration is completed so that all lines are available if the
+         * search ends after this iteration. Sharing a line can empty
+         * another slot so the lines are scanned again after each
+         * search, but at most multipv extra lines are searched.
+         */
+        if (smp_parallel_multipv(worker)) {
+            nextra = 0;
+            mpvidx = 0;
+            while ((mpvidx < worker->multipv) && (nextra < worker->multipv)) {
+                if (worker->mpv_moves[mpvidx] != NOMOVE) {
+                    mpvidx++;
+                    continue;
+                }
+                worker->mpvidx = mpvidx;
+                search_aspiration_window(worker, depth, score);
+                smp_share_multipv_line(worker);
+                if (worker->id == 0) {
+                    engine_send_multipv_info(worker);
+                }
+                nextra++;
+                mpvidx = 0;
+            }
+        }
         score = worker->mpv_lines[0].score;
 
         /* Report iteration as completed */
+        TIMETRACE_END(worker, "iteration");
         depth = smp_complete_iteration(worker);
 
         /*
@@ -1122,14 +1354,14 @@ void search_find_best_move(struct search_worker *worker)
          */
         if (worker->state->exit_on_mate && !worker->state->pondering) {
             if ((score > KNOWN_WIN) || (score < (-KNOWN_WIN))) {
-                smp_stop_all();
+                stop_search(worker);
                 break;
             }
         }
 
         /* Check if the worker has reached the maximum depth */
         if (depth > worker->state->sd) {
-            smp_stop_all();
+            stop_search(worker);
             break;
         }
 
@@ -1137,7 +1369,7 @@ void search_find_best_move(struct search_worker *worker)
          * Time management is handled by the master worker so  ordinary
          * workers can just continue with thye next iteration.
          */
-        if (worker->id != 0) {
+        if ((worker->id != 0) || worker->state->standalone) {
             continue;
         }
 
@@ -1147,20 +1379,5 @@ void search_find_best_move(struct search_worker *worker)
             break;
         }
     }
-
-    /*
-     * In some rare cases the search may reach the maximum depth. If this
-     * happens while the engine is pondering then wait until a ponderhit
-     * command is received so that the bestmove command is not sent too
-     * early.
-     */
-	while ((worker->id == 0) && worker->state->pondering) {
-		if (engine_wait_for_input(worker)) {
-			smp_stop_all();
-            break;
-		}
-		if (!worker->state->pondering) {
-			smp_stop_all();
-		}
-	}
+    TIMETRACE_END(worker, "search");
 }
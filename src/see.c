@@ -23,6 +23,7 @@
 #include "eval.h"
 #include "evalparams.h"
 #include "bitboard.h"
+#include "board.h"
 #include "validation.h"
 #include "fen.h"
 
@@ -35,19 +36,24 @@ int see_material[NPIECES] = {100,  100,      /* pawn */
 
 bool see_ge(struct position *pos, uint32_t move, int threshold)
 {
-    int      see_score;
-    int      old_score;
-    int      sq;
-    int      maximizer;
-    int      stm;
-    int      piece;
-    int      victim;
-    int      val;
-    uint64_t attackers;
-    uint64_t attacker;
-    uint64_t occ;
-    uint64_t bq;
-    uint64_t rq;
+    struct checkinfo  *ci;
+    struct attackinfo *ai;
+    int               see_score;
+    int               old_score;
+    int               opp;
+    int               sq;
+    int               maximizer;
+    int               stm;
+    int               piece;
+    int               victim;
+    int               val;
+    uint64_t          attackers;
+    uint64_t          attacker;
+    uint64_t          candidates;
+    uint64_t          occ;
+    uint64_t          bq;
+    uint64_t          rq;
+    uint64_t          sliders;
 
     assert(valid_position(pos));
     assert(valid_move(move));
@@ -84,6 +90,23 @@ bool see_ge(struct position *pos, uint32_t move, int threshold)
         }
     }
 
+    /*
+     * If the attack maps for the position are already known then the
+     * exchange can often be resolved without finding the attackers. The
+     * moving piece cannot be recaptured if the opponent does not attack
+     * the target square, unless the move uncovers an opponent slider.
+     */
+    if (!ISENPASSANT(move) && board_has_attackinfo(pos)) {
+        ai = board_attackinfo(pos);
+        opp = FLIP_COLOR(maximizer);
+        sliders = ai->attacked_by[BISHOP+opp]|ai->attacked_by[ROOK+opp]|
+                  ai->attacked_by[QUEEN+opp];
+        if (!ISBITSET(ai->attacked[opp], sq) &&
+            !ISBITSET(sliders, FROM(move))) {
+            return see_score >= threshold;
+        }
+    }
+
     /* Apply the move */
     occ = pos->bb_all&(~sq_mask[FROM(move)]);
     if (ISENPASSANT(move)) {
@@ -107,6 +130,7 @@ bool see_ge(struct position *pos, uint32_t move, int threshold)
     }
 
     /* Iterate until there are no more attackers */
+    ci = board_checkinfo(pos);
     bq = pos->bb_pieces[WHITE_BISHOP] | pos->bb_pieces[WHITE_QUEEN] |
          pos->bb_pieces[BLACK_BISHOP] | pos->bb_pieces[BLACK_QUEEN];
     rq = pos->bb_pieces[WHITE_ROOK] | pos->bb_pieces[WHITE_QUEEN] |
@@ -124,11 +148,19 @@ bool see_ge(struct position *pos, uint32_t move, int threshold)
             break;
         }
 
-        /* Find the next attacker to consider */
+        /*
+         * Find the next attacker to consider. Pieces that are pinned to
+         * their king can not take part as long as the pinning piece is
+         * still on the board.
+         */
+        candidates = attackers&pos->bb_sides[stm];
+        if ((ci->pinners[stm]&occ) != 0ULL) {
+            candidates &= ~ci->blockers[stm];
+        }
         attacker = 0ULL;
         for (piece=PAWN+stm;piece<NPIECES;piece+=2) {
-            if ((attackers&pos->bb_pieces[piece]) != 0ULL) {
-                attacker = ISOLATE(attackers&pos->bb_pieces[piece]);
+            if ((candidates&pos->bb_pieces[piece]) != 0ULL) {
+                attacker = ISOLATE(candidates&pos->bb_pieces[piece]);
                 break;
             }
         }
@@ -0,0 +1,276 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "selfplay.h"
+#include "sfen.h"
+#include "board.h"
+#include "config.h"
+#include "eval.h"
+#include "history.h"
+#include "movegen.h"
+#include "nnue.h"
+#include "search.h"
+#include "smp.h"
+#include "thread.h"
+#include "utils.h"
+
+/* Games longer than this (in plies) are adjudicated as draws */
+#define MAX_GAME_PLY 400
+
+/*
+ * Games are adjudicated as draws when the score has stayed within
+ * DRAW_SCORE of zero for DRAW_COUNT consecutive positions after
+ * MIN_DRAW_PLY plies.
+ */
+#define MIN_DRAW_PLY 80
+#define DRAW_SCORE 0
+#define DRAW_COUNT 8
+
+/* Default values for options */
+#define DEFAULT_DEPTH 8
+#define DEFAULT_RANDOM_PLIES 10
+#define DEFAULT_EVAL_LIMIT 3000
+
+/* Shared data for all self-play threads */
+struct selfplay_data {
+    struct selfplay_options *options;
+    struct sfen_writer      *writer;
+    mutex_t                 lock;
+    int                     games_started;
+    uint64_t                npositions;
+};
+
+/* Data for a single self-play thread */
+struct selfplay_thread {
+    thread_t             thread;
+    uint64_t             seed;
+    struct selfplay_data *data;
+    struct gamestate     *state;
+    struct search_worker *worker;
+    struct sfen_record   records[MAX_GAME_PLY+1];
+};
+
+static uint64_t next_random(uint64_t *seed)
+{
+    /* xorshift64* */
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed*0x2545F4914F6CDD1DULL;
+}
+
+static bool claim_game(struct selfplay_data *data)
+{
+    bool claimed;
+
+    mutex_lock(&data->lock);
+    claimed = data->games_started < data->options->ngames;
+    if (claimed) {
+        data->games_started++;
+    }
+    mutex_unlock(&data->lock);
+
+    return claimed;
+}
+
+/*
+ * Play a random opening. Returns false if the game ended before all
+ * random moves could be played.
+ */
+static bool play_random_moves(struct selfplay_thread *thread)
+{
+    struct position *pos = &thread->state->pos;
+    struct movelist legal;
+    int             k;
+
+    board_start_position(pos);
+    for (k=0;k<thread->data->options->random_plies;k++) {
+        gen_legal_moves(pos, &legal);
+        if (legal.size == 0) {
+            return false;
+        }
+        (void)board_make_move(pos,
+                    legal.moves[next_random(&thread->seed)%legal.size]);
+    }
+    gen_legal_moves(pos, &legal);
+
+    return legal.size > 0;
+}
+
+/*
+ * Play one game. Returns the number of recorded positions. The result
+ * is stored in the records.
+ */
+static int play_game(struct selfplay_thread *thread)
+{
+    struct selfplay_options *options = thread->data->options;
+    struct gamestate        *state = thread->state;
+    struct position         *pos = &state->pos;
+    struct movelist         legal;
+    struct sfen_record      *record;
+    int                     nrecords;
+    int                     draw_count;
+    int                     score;
+    int                     result;
+    int                     k;
+
+    while (!play_random_moves(thread)) {
+    }
+    history_clear_tables(thread->worker);
+
+    nrecords = 0;
+    draw_count = 0;
+    result = 0;
+    while (true) {
+        /* Check if the game is over */
+        gen_legal_moves(pos, &legal);
+        if (legal.size == 0) {
+            if (board_in_check(pos, pos->stm)) {
+                result = (pos->stm == WHITE)?-1:1;
+            }
+            break;
+        }
+        if (board_is_repetition(pos) || (pos->fifty >= 100) ||
+            eval_is_material_draw(pos) || (nrecords >= MAX_GAME_PLY)) {
+            break;
+        }
+
+        /* Search the position */
+        state->sd = options->depth;
+        state->max_nodes = options->nodes;
+        smp_search_standalone(thread->worker, state);
+        score = thread->worker->mpv_lines[0].score;
+
+        /* Adjudicate decided games */
+        if (abs(score) > options->eval_limit) {
+            result = ((score > 0) == (pos->stm == WHITE))?1:-1;
+            break;
+        }
+        sfen_make_record(pos, state->best_move, score,
+                         &thread->records[nrecords]);
+        nrecords++;
+
+        /* Adjudicate drawn games */
+        if (nrecords > MIN_DRAW_PLY) {
+            draw_count = (abs(score) <= DRAW_SCORE)?draw_count+1:0;
+            if (draw_count >= DRAW_COUNT) {
+                break;
+            }
+        }
+
+        (void)board_make_move(pos, state->best_move);
+    }
+
+    /* Store the result from the point of view of the side to move */
+    for (k=0;k<nrecords;k++) {
+        record = &thread->records[k];
+        record->result = (int8_t)(((record->ply%2) == 0)?result:-result);
+    }
+
+    return nrecords;
+}
+
+static thread_retval_t selfplay_thread_func(void *arg)
+{
+    struct selfplay_thread *thread = arg;
+    struct selfplay_data   *data = thread->data;
+    int                    nrecords;
+    int                    k;
+
+    /* The worker is created by the thread that uses it */
+    thread->worker = smp_create_standalone_worker();
+    thread->state = create_game_state();
+    thread->state->silent = true;
+    thread->state->standalone = true;
+    thread->state->multipv = 1;
+
+    while (claim_game(data)) {
+        nrecords = play_game(thread);
+
+        mutex_lock(&data->lock);
+        for (k=0;k<nrecords;k++) {
+            (void)sfen_writer_write(data->writer, &thread->records[k]);
+        }
+        data->npositions += nrecords;
+        mutex_unlock(&data->lock);
+    }
+
+    smp_destroy_standalone_worker(thread->worker);
+    if (thread->state->pos.nnue_pos != NULL) {
+        nnue_destroy_pos(thread->state->pos.nnue_pos);
+    }
+    free(thread->state);
+
+    return (thread_retval_t)0;
+}
+
+void selfplay_init_options(struct selfplay_options *options)
+{
+    assert(options != NULL);
+
+    options->ngames = 1;
+    options->nthreads = 1;
+    options->depth = DEFAULT_DEPTH;
+    options->nodes = 0ULL;
+    options->random_plies = DEFAULT_RANDOM_PLIES;
+    options->eval_limit = DEFAULT_EVAL_LIMIT;
+    options->compress = false;
+}
+
+uint64_t selfplay_run(FILE *fp, struct selfplay_options *options)
+{
+    struct selfplay_data   data;
+    struct selfplay_thread *threads;
+    uint64_t               seed;
+    int                    k;
+
+    assert(fp != NULL);
+    assert(options != NULL);
+    assert(options->nthreads > 0);
+
+    data.options = options;
+    data.writer = sfen_writer_create(fp, options->compress);
+    if (data.writer == NULL) {
+        return 0ULL;
+    }
+    data.games_started = 0;
+    data.npositions = 0ULL;
+    mutex_init(&data.lock);
+
+    threads = aligned_malloc(CACHE_LINE_SIZE,
+                             options->nthreads*sizeof(struct selfplay_thread));
+    seed = (uint64_t)time(NULL)*0x9E3779B97F4A7C15ULL;
+    for (k=0;k<options->nthreads;k++) {
+        threads[k].seed = (seed^(k + 1)*0xD1B54A32D192ED03ULL)|1ULL;
+        threads[k].data = &data;
+        thread_create(&threads[k].thread,
+                      (thread_func_t)selfplay_thread_func, &threads[k]);
+    }
+    for (k=0;k<options->nthreads;k++) {
+        thread_join(&threads[k].thread);
+    }
+    aligned_free(threads);
+    mutex_destroy(&data.lock);
+    (void)sfen_writer_destroy(data.writer);
+
+    return data.npositions;
+}
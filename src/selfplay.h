@@ -0,0 +1,64 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Options for generating training data by self-play */
+struct selfplay_options {
+    /* The number of games to play */
+    int ngames;
+    /* The number of threads to play games in */
+    int nthreads;
+    /* The depth to search each position to */
+    int depth;
+    /* The number of nodes to search for each position (0 for no limit) */
+    uint64_t nodes;
+    /* The number of random moves played at the start of each game */
+    int random_plies;
+    /* Games are adjudicated when the score exceeds this limit */
+    int eval_limit;
+    /* Flag indicating if the training records should be compressed */
+    bool compress;
+};
+
+/*
+ * Initialize options to default values.
+ *
+ * @param options The options to initialize.
+ */
+void selfplay_init_options(struct selfplay_options *options);
+
+/*
+ * Generate training data by letting the engine play games against itself.
+ * Several games are played concurrently, each in its own thread with its
+ * own search worker. Every searched position is written to the output
+ * file as a packed training record (see sfen.h) once the game is over
+ * and the result is known. The records of each game are written together
+ * so that they compress well.
+ *
+ * @param fp The file to write training records to.
+ * @param options The options to use.
+ * @return Returns the number of positions written.
+ */
+uint64_t selfplay_run(FILE *fp, struct selfplay_options *options);
+
+#endif
@@ -0,0 +1,754 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sfen.h"
+#include "bitboard.h"
+#include "board.h"
+#include "engine.h"
+#include "eval.h"
+#include "key.h"
+#include "nnue.h"
+#include "utils.h"
+#include "validation.h"
+
+/* Huffman codes for the different piece types (and empty squares) */
+static struct {
+    int code;
+    int nbits;
+} huffman_table[] = {
+    {0x1, 4},   /* Pawn */
+    {0x3, 4},   /* Knight */
+    {0x5, 4},   /* Bishop */
+    {0x7, 4},   /* Rook */
+    {0x9, 4},   /* Queen */
+    {0x0, 1}    /* Empty */
+};
+
+/* Flags for the different move types */
+#define SFEN_MOVE_PROMOTION  (1 << 14)
+#define SFEN_MOVE_EN_PASSANT (2 << 14)
+#define SFEN_MOVE_CASTLING   (3 << 14)
+
+/* Size of the chunks in a compressed stream (in bytes) */
+#define CHUNK_SIZE (1024*1024)
+
+/* Size of a chunk header (in bytes) */
+#define CHUNK_HEADER_SIZE 12
+
+/* Magic identifying a chunk */
+#define CHUNK_MAGIC "MVTD"
+
+/*
+ * The maximum number of positions following the first one in a run.
+ * Keeps the run length within a single byte and the number of moves
+ * played within the limits of the position history.
+ */
+#define MAX_RUN_LENGTH 255
+
+/* The maximum size of a single continuation (move and score) */
+#define MAX_CONTINUATION_SIZE 5
+
+/* Bit stream used when packing a position */
+struct bitstream {
+    uint8_t *data;
+    int     cursor;
+};
+
+/* Writer for training records */
+struct sfen_writer {
+    FILE               *fp;
+    bool               compress;
+    bool               ok;
+    /* The current chunk */
+    uint8_t            *chunk;
+    int                size;
+    uint32_t           nrecords;
+    /* Offset of the count byte of the current run (-1 for no run) */
+    int                run_offset;
+    int                run_length;
+    /* The previous record and the position it was made from */
+    struct sfen_record last;
+    struct position    *pos;
+};
+
+/* Reader for training records */
+struct sfen_reader {
+    FILE               *fp;
+    bool               compressed;
+    /* Bytes read when detecting the file format */
+    uint8_t            head[4];
+    int                nhead;
+    /* The current chunk */
+    uint8_t            *chunk;
+    int                size;
+    int                cursor;
+    /* The number of positions left in the current run */
+    int                run_length;
+    /* The previous record and the position it was made from */
+    struct sfen_record last;
+    struct position    *pos;
+};
+
+static void write_bits(struct bitstream *stream, int value, int nbits)
+{
+    int k;
+
+    for (k=0;k<nbits;k++) {
+        if ((value&(1 << k)) != 0) {
+            stream->data[stream->cursor/8] |= 1 << (stream->cursor&7);
+        }
+        stream->cursor++;
+    }
+}
+
+static int read_bits(struct bitstream *stream, int nbits)
+{
+    int value;
+    int k;
+
+    value = 0;
+    for (k=0;k<nbits;k++) {
+        if ((stream->cursor < SFEN_SIZE*8) &&
+            ((stream->data[stream->cursor/8]&(1 << (stream->cursor&7))) != 0)) {
+            value |= 1 << k;
+        }
+        stream->cursor++;
+    }
+
+    return value;
+}
+
+static void write_piece(struct bitstream *stream, int piece)
+{
+    int idx;
+
+    idx = (piece == NO_PIECE)?5:VALUE(piece)/2;
+    write_bits(stream, huffman_table[idx].code, huffman_table[idx].nbits);
+    if (piece != NO_PIECE) {
+        write_bits(stream, COLOR(piece), 1);
+    }
+}
+
+/* Returns -1 for invalid codes */
+static int read_piece(struct bitstream *stream)
+{
+    int code;
+    int idx;
+
+    if (read_bits(stream, 1) == 0) {
+        return NO_PIECE;
+    }
+    code = (read_bits(stream, 3) << 1)|1;
+    for (idx=0;idx<5;idx++) {
+        if (huffman_table[idx].code == code) {
+            return 2*idx + read_bits(stream, 1);
+        }
+    }
+
+    return -1;
+}
+
+static void write_u32(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)(value&0xFF);
+    data[1] = (uint8_t)((value >> 8)&0xFF);
+    data[2] = (uint8_t)((value >> 16)&0xFF);
+    data[3] = (uint8_t)((value >> 24)&0xFF);
+}
+
+static uint32_t read_u32(uint8_t *data)
+{
+    return (uint32_t)data[0]|((uint32_t)data[1] << 8)|
+                                ((uint32_t)data[2] << 16)|
+                                ((uint32_t)data[3] << 24);
+}
+
+/* Score differences are stored as zigzag encoded varints */
+static int write_varint(uint8_t *data, int value)
+{
+    uint32_t zigzag;
+    int      n;
+
+    zigzag = (value < 0)?(((uint32_t)(-value) << 1) - 1):
+                                                    ((uint32_t)value << 1);
+    n = 0;
+    while (zigzag >= 0x80) {
+        data[n++] = (uint8_t)((zigzag&0x7F)|0x80);
+        zigzag >>= 7;
+    }
+    data[n++] = (uint8_t)zigzag;
+
+    return n;
+}
+
+static bool read_varint(uint8_t *data, int size, int *cursor, int *value)
+{
+    uint32_t zigzag;
+    int      shift;
+
+    zigzag = 0;
+    shift = 0;
+    while (true) {
+        if ((*cursor >= size) || (shift > 28)) {
+            return false;
+        }
+        zigzag |= (uint32_t)(data[*cursor]&0x7F) << shift;
+        shift += 7;
+        if ((data[(*cursor)++]&0x80) == 0) {
+            break;
+        }
+    }
+    *value = ((zigzag&1) != 0)?-(int)(zigzag >> 1)-1:(int)(zigzag >> 1);
+
+    return true;
+}
+
+static struct position* create_position(void)
+{
+    struct position *pos;
+
+    pos = malloc(sizeof(struct position));
+    if (pos == NULL) {
+        return NULL;
+    }
+    memset(pos, 0, sizeof(struct position));
+    if (engine_using_nnue) {
+        pos->nnue_pos = nnue_create_pos();
+    }
+    board_reset(pos);
+
+    return pos;
+}
+
+static void destroy_position(struct position *pos)
+{
+    if (pos->nnue_pos != NULL) {
+        nnue_destroy_pos(pos->nnue_pos);
+    }
+    free(pos);
+}
+
+/*
+ * Play the move of the previous record and check that the resulting
+ * position matches the record.
+ */
+static bool is_next_position(struct position *pos, struct sfen_record *last,
+                             struct sfen_record *record)
+{
+    uint8_t  sfen[SFEN_SIZE];
+    uint32_t move;
+
+    if ((record->ply != last->ply+1) || (record->result != -last->result) ||
+        (record->padding != last->padding)) {
+        return false;
+    }
+    move = sfen_unpack_move(pos, last->move);
+    if ((move == NOMOVE) || !board_make_move(pos, move)) {
+        return false;
+    }
+    sfen_pack(pos, sfen);
+
+    return memcmp(sfen, record->sfen, SFEN_SIZE) == 0;
+}
+
+static bool write_chunk(struct sfen_writer *writer)
+{
+    uint8_t header[CHUNK_HEADER_SIZE];
+
+    if (writer->nrecords == 0) {
+        return true;
+    }
+
+    memcpy(header, CHUNK_MAGIC, 4);
+    write_u32(&header[4], writer->nrecords);
+    write_u32(&header[8], (uint32_t)writer->size);
+    if ((fwrite(header, CHUNK_HEADER_SIZE, 1, writer->fp) != 1) ||
+        (fwrite(writer->chunk, writer->size, 1, writer->fp) != 1)) {
+        writer->ok = false;
+    }
+    writer->size = 0;
+    writer->nrecords = 0;
+    writer->run_offset = -1;
+
+    return writer->ok;
+}
+
+static bool read_bytes(struct sfen_reader *reader, void *data, int size)
+{
+    int n;
+
+    n = MIN(size, reader->nhead);
+    memcpy(data, reader->head, n);
+    memmove(reader->head, &reader->head[n], reader->nhead-n);
+    reader->nhead -= n;
+
+    return (n == size) ||
+           (fread((uint8_t*)data+n, size-n, 1, reader->fp) == 1);
+}
+
+static bool read_chunk(struct sfen_reader *reader)
+{
+    uint8_t  header[CHUNK_HEADER_SIZE];
+    uint32_t size;
+
+    if (!read_bytes(reader, header, CHUNK_HEADER_SIZE) ||
+        (memcmp(header, CHUNK_MAGIC, 4) != 0)) {
+        return false;
+    }
+    size = read_u32(&header[8]);
+    if ((size == 0) || (size > CHUNK_SIZE) ||
+        !read_bytes(reader, reader->chunk, (int)size)) {
+        return false;
+    }
+    reader->size = (int)size;
+    reader->cursor = 0;
+
+    return true;
+}
+
+void sfen_pack(struct position *pos, uint8_t *sfen)
+{
+    struct bitstream stream;
+    int              rank;
+    int              file;
+    int              sq;
+
+    assert(valid_position(pos));
+    assert(sfen != NULL);
+
+    memset(sfen, 0, SFEN_SIZE);
+    stream.data = sfen;
+    stream.cursor = 0;
+
+    /* Side to move and king locations */
+    write_bits(&stream, pos->stm, 1);
+    write_bits(&stream, LSB(pos->bb_pieces[WHITE_KING]), 6);
+    write_bits(&stream, LSB(pos->bb_pieces[BLACK_KING]), 6);
+
+    /* All other pieces, from the 8th rank down */
+    for (rank=RANK_8;rank>=RANK_1;rank--) {
+        for (file=FILE_A;file<=FILE_H;file++) {
+            sq = SQUARE(file, rank);
+            if ((pos->pieces[sq] != NO_PIECE) &&
+                (VALUE(pos->pieces[sq]) == KING)) {
+                continue;
+            }
+            write_piece(&stream, pos->pieces[sq]);
+        }
+    }
+
+    /* Castling rights and en-passant square */
+    write_bits(&stream, (pos->castle&WHITE_KINGSIDE) != 0, 1);
+    write_bits(&stream, (pos->castle&WHITE_QUEENSIDE) != 0, 1);
+    write_bits(&stream, (pos->castle&BLACK_KINGSIDE) != 0, 1);
+    write_bits(&stream, (pos->castle&BLACK_QUEENSIDE) != 0, 1);
+    if (pos->ep_sq == NO_SQUARE) {
+        write_bits(&stream, 0, 1);
+    } else {
+        write_bits(&stream, 1, 1);
+        write_bits(&stream, pos->ep_sq, 6);
+    }
+
+    /*
+     * Move counters. The high bits of both counters are stored
+     * last for compatibility with readers that only know about
+     * the low bits.
+     */
+    write_bits(&stream, pos->fifty, 6);
+    write_bits(&stream, pos->fullmove, 8);
+    write_bits(&stream, pos->fullmove >> 8, 8);
+    write_bits(&stream, pos->fifty >> 6, 1);
+
+    assert(stream.cursor <= SFEN_SIZE*8);
+}
+
+bool sfen_unpack(uint8_t *sfen, struct position *pos)
+{
+    struct bitstream stream;
+    int              rank;
+    int              file;
+    int              sq;
+    int              kingsq[NSIDES];
+    int              piece;
+
+    assert(sfen != NULL);
+    assert(pos != NULL);
+
+    board_reset(pos);
+    stream.data = sfen;
+    stream.cursor = 0;
+
+    /* Side to move and king locations */
+    pos->stm = read_bits(&stream, 1);
+    kingsq[WHITE] = read_bits(&stream, 6);
+    kingsq[BLACK] = read_bits(&stream, 6);
+    if (kingsq[WHITE] == kingsq[BLACK]) {
+        return false;
+    }
+    pos->pieces[kingsq[WHITE]] = WHITE_KING;
+    pos->pieces[kingsq[BLACK]] = BLACK_KING;
+
+    /* All other pieces */
+    for (rank=RANK_8;rank>=RANK_1;rank--) {
+        for (file=FILE_A;file<=FILE_H;file++) {
+            sq = SQUARE(file, rank);
+            if ((sq == kingsq[WHITE]) || (sq == kingsq[BLACK])) {
+                continue;
+            }
+            piece = read_piece(&stream);
+            if (piece < 0) {
+                return false;
+            }
+            pos->pieces[sq] = piece;
+        }
+    }
+
+    /* Castling rights and en-passant square */
+    pos->castle = 0;
+    pos->castle |= read_bits(&stream, 1)?WHITE_KINGSIDE:0;
+    pos->castle |= read_bits(&stream, 1)?WHITE_QUEENSIDE:0;
+    pos->castle |= read_bits(&stream, 1)?BLACK_KINGSIDE:0;
+    pos->castle |= read_bits(&stream, 1)?BLACK_QUEENSIDE:0;
+    if (read_bits(&stream, 1) != 0) {
+        pos->ep_sq = read_bits(&stream, 6);
+        if (RANKNR(pos->ep_sq) != ((pos->stm == WHITE)?RANK_6:RANK_3)) {
+            return false;
+        }
+    }
+
+    /* Move counters */
+    pos->fifty = read_bits(&stream, 6);
+    pos->fullmove = read_bits(&stream, 8);
+    pos->fullmove |= read_bits(&stream, 8) << 8;
+    pos->fifty |= read_bits(&stream, 1) << 6;
+    if (stream.cursor > SFEN_SIZE*8) {
+        return false;
+    }
+
+    /* Update bitboards */
+    for (sq=0;sq<NSQUARES;sq++) {
+        if (pos->pieces[sq] != NO_PIECE) {
+            SETBIT(pos->bb_pieces[pos->pieces[sq]], sq);
+            SETBIT(pos->bb_sides[COLOR(pos->pieces[sq])], sq);
+            SETBIT(pos->bb_all, sq);
+        }
+    }
+    if (!valid_position(pos)) {
+        return false;
+    }
+
+    /* Generate keys and calculate piece/square table scores */
+    pos->key = key_generate(pos);
+    pos->pawnkey = key_generate_pawnkey(pos);
+    pos->materialkey = key_generate_materialkey(pos);
+    eval_generate_psq(pos, pos->psq);
+
+    pos->start_side = pos->stm;
+    memcpy(pos->start_pieces, pos->pieces, NSQUARES*sizeof(uint8_t));
+    if (engine_using_nnue) {
+        nnue_setup_pos(pos->nnue_pos, pos->pieces, pos->stm);
+    }
+
+    return true;
+}
+
+uint16_t sfen_pack_move(uint32_t move)
+{
+    int from;
+    int to;
+    int flags;
+
+    from = FROM(move);
+    to = TO(move);
+    flags = 0;
+
+    /* Castling moves are encoded as the king capturing its own rook */
+    if (ISKINGSIDECASTLE(move)) {
+        to = SQUARE(FILE_H, RANKNR(to));
+        flags = SFEN_MOVE_CASTLING;
+    } else if (ISQUEENSIDECASTLE(move)) {
+        to = SQUARE(FILE_A, RANKNR(to));
+        flags = SFEN_MOVE_CASTLING;
+    } else if (ISENPASSANT(move)) {
+        flags = SFEN_MOVE_EN_PASSANT;
+    } else if (ISPROMOTION(move)) {
+        flags = SFEN_MOVE_PROMOTION|(((VALUE(PROMOTION(move))/2)-1) << 12);
+    }
+
+    return (uint16_t)(flags|(from << 6)|to);
+}
+
+uint32_t sfen_unpack_move(struct position *pos, uint16_t move)
+{
+    uint32_t m;
+    int      from;
+    int      to;
+    int      flags;
+    int      promotion;
+
+    assert(valid_position(pos));
+
+    from = (move >> 6)&0x3F;
+    to = move&0x3F;
+    if (from == to) {
+        return NOMOVE;
+    }
+
+    flags = (pos->pieces[to] != NO_PIECE)?CAPTURE:NORMAL;
+    promotion = NO_PIECE;
+    switch (move&SFEN_MOVE_CASTLING) {
+    case SFEN_MOVE_CASTLING:
+        if (to > from) {
+            to = SQUARE(FILE_G, RANKNR(from));
+            flags = KINGSIDE_CASTLE;
+        } else {
+            to = SQUARE(FILE_C, RANKNR(from));
+            flags = QUEENSIDE_CASTLE;
+        }
+        break;
+    case SFEN_MOVE_EN_PASSANT:
+        flags = EN_PASSANT;
+        break;
+    case SFEN_MOVE_PROMOTION:
+        flags |= PROMOTION;
+        promotion = KNIGHT + 2*((move >> 12)&3) + pos->stm;
+        break;
+    default:
+        break;
+    }
+
+    m = MOVE(from, to, promotion, flags);
+    if (!board_is_move_pseudo_legal(pos, m) || !board_is_move_legal(pos, m)) {
+        return NOMOVE;
+    }
+
+    return m;
+}
+
+void sfen_make_record(struct position *pos, uint32_t move, int score,
+                      struct sfen_record *record)
+{
+    assert(valid_position(pos));
+    assert(record != NULL);
+
+    sfen_pack(pos, record->sfen);
+    record->score = (int16_t)(CLAMP(score, INT16_MIN, INT16_MAX));
+    record->move = sfen_pack_move(move);
+    record->ply = (uint16_t)(MAX(2*(pos->fullmove-1)+pos->stm, 0));
+    record->result = 0;
+    record->padding = 0;
+}
+
+struct sfen_writer* sfen_writer_create(FILE *fp, bool compress)
+{
+    struct sfen_writer *writer;
+
+    assert(fp != NULL);
+
+    writer = malloc(sizeof(struct sfen_writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    memset(writer, 0, sizeof(struct sfen_writer));
+    writer->fp = fp;
+    writer->compress = compress;
+    writer->ok = true;
+    writer->run_offset = -1;
+    if (compress) {
+        writer->chunk = malloc(CHUNK_SIZE);
+        writer->pos = create_position();
+        if ((writer->chunk == NULL) || (writer->pos == NULL)) {
+            (void)sfen_writer_destroy(writer);
+            return NULL;
+        }
+    }
+
+    return writer;
+}
+
+bool sfen_writer_write(struct sfen_writer *writer, struct sfen_record *record)
+{
+    uint16_t move;
+    int      score;
+
+    assert(writer != NULL);
+    assert(record != NULL);
+
+    if (!writer->compress) {
+        if (fwrite(record, sizeof(struct sfen_record), 1, writer->fp) != 1) {
+            writer->ok = false;
+        }
+        return writer->ok;
+    }
+
+    if ((writer->run_offset >= 0) &&
+        (writer->run_length < MAX_RUN_LENGTH) &&
+        (writer->size+MAX_CONTINUATION_SIZE <= CHUNK_SIZE) &&
+        is_next_position(writer->pos, &writer->last, record)) {
+        /* Continue the current run */
+        move = record->move;
+        score = record->score + writer->last.score;
+        writer->chunk[writer->size++] = (uint8_t)(move&0xFF);
+        writer->chunk[writer->size++] = (uint8_t)(move >> 8);
+        writer->size += write_varint(&writer->chunk[writer->size], score);
+        writer->run_length++;
+        writer->chunk[writer->run_offset] = (uint8_t)writer->run_length;
+    } else {
+        /* Start a new run */
+        if ((writer->size+(int)sizeof(struct sfen_record)+1 > CHUNK_SIZE) &&
+            !write_chunk(writer)) {
+            return false;
+        }
+        memcpy(&writer->chunk[writer->size], record,
+               sizeof(struct sfen_record));
+        writer->size += sizeof(struct sfen_record);
+        writer->run_offset = writer->size;
+        writer->run_length = 0;
+        writer->chunk[writer->size++] = 0;
+
+        /* Runs can only be continued from valid positions */
+        if (!sfen_unpack(record->sfen, writer->pos)) {
+            writer->run_offset = -1;
+        }
+    }
+    writer->nrecords++;
+    writer->last = *record;
+
+    return writer->ok;
+}
+
+bool sfen_writer_destroy(struct sfen_writer *writer)
+{
+    bool ok;
+
+    assert(writer != NULL);
+
+    if (writer->compress && (writer->chunk != NULL)) {
+        (void)write_chunk(writer);
+    }
+    ok = writer->ok;
+
+    free(writer->chunk);
+    if (writer->pos != NULL) {
+        destroy_position(writer->pos);
+    }
+    free(writer);
+
+    return ok;
+}
+
+struct sfen_reader* sfen_reader_create(FILE *fp)
+{
+    struct sfen_reader *reader;
+
+    assert(fp != NULL);
+
+    reader = malloc(sizeof(struct sfen_reader));
+    if (reader == NULL) {
+        return NULL;
+    }
+    memset(reader, 0, sizeof(struct sfen_reader));
+    reader->fp = fp;
+
+    /* Compressed files start with the magic of the first chunk */
+    reader->nhead = (int)fread(reader->head, 1, 4, fp);
+    reader->compressed = (reader->nhead == 4) &&
+                         (memcmp(reader->head, CHUNK_MAGIC, 4) == 0);
+    if (reader->compressed) {
+        reader->chunk = malloc(CHUNK_SIZE);
+        reader->pos = create_position();
+        if ((reader->chunk == NULL) || (reader->pos == NULL)) {
+            sfen_reader_destroy(reader);
+            return NULL;
+        }
+    }
+
+    return reader;
+}
+
+bool sfen_reader_read(struct sfen_reader *reader, struct sfen_record *record)
+{
+    uint16_t move;
+    uint32_t m;
+    int      score;
+
+    assert(reader != NULL);
+    assert(record != NULL);
+
+    if (!reader->compressed) {
+        return read_bytes(reader, record, sizeof(struct sfen_record));
+    }
+
+    if (reader->run_length > 0) {
+        /* Recreate the next position in the run */
+        if (reader->cursor+2 > reader->size) {
+            return false;
+        }
+        move = (uint16_t)(reader->chunk[reader->cursor]|
+                          (reader->chunk[reader->cursor+1] << 8));
+        reader->cursor += 2;
+        if (!read_varint(reader->chunk, reader->size, &reader->cursor,
+                         &score)) {
+            return false;
+        }
+        m = sfen_unpack_move(reader->pos, reader->last.move);
+        if ((m == NOMOVE) || !board_make_move(reader->pos, m)) {
+            return false;
+        }
+        *record = reader->last;
+        sfen_pack(reader->pos, record->sfen);
+        record->score = (int16_t)(score - reader->last.score);
+        record->move = move;
+        record->ply = reader->last.ply + 1;
+        record->result = -reader->last.result;
+        reader->run_length--;
+    } else {
+        /* Start a new run */
+        if ((reader->cursor >= reader->size) && !read_chunk(reader)) {
+            return false;
+        }
+        if (reader->cursor+(int)sizeof(struct sfen_record)+1 > reader->size) {
+            return false;
+        }
+        memcpy(record, &reader->chunk[reader->cursor],
+               sizeof(struct sfen_record));
+        reader->cursor += sizeof(struct sfen_record);
+        reader->run_length = reader->chunk[reader->cursor++];
+        if ((reader->run_length > 0) &&
+            !sfen_unpack(record->sfen, reader->pos)) {
+            return false;
+        }
+    }
+    reader->last = *record;
+
+    return true;
+}
+
+void sfen_reader_destroy(struct sfen_reader *reader)
+{
+    assert(reader != NULL);
+
+    free(reader->chunk);
+    if (reader->pos != NULL) {
+        destroy_position(reader->pos);
+    }
+    free(reader);
+}
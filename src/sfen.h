@@ -0,0 +1,163 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SFEN_H
+#define SFEN_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chess.h"
+
+/*
+ * Packed training positions in the binary format used by the NNUE
+ * trainers (the .bin format). A position is Huffman coded into 256
+ * bits and stored together with the search result in a 40 byte
+ * record. All fields are little-endian.
+ *
+ * Records can also be written to a compressed stream. The stream is a
+ * sequence of independent chunks, each starting with a 12 byte header
+ * (the magic "MVTD", the number of records and the size of the payload
+ * in bytes). The payload consists of runs of consecutive positions from
+ * the same game. A run is stored as one complete record followed by a
+ * count byte and, for each following position, the packed move and the
+ * score difference. Positions in a run are recreated by playing the
+ * moves so each continuation only costs three or four bytes.
+ */
+
+/* The size of a packed position (in bytes) */
+#define SFEN_SIZE 32
+
+/* A training position */
+struct sfen_record {
+    /* The Huffman coded position */
+    uint8_t sfen[SFEN_SIZE];
+    /* The search score from the point of view of the side to move */
+    int16_t score;
+    /* The best move */
+    uint16_t move;
+    /* The number of half moves played in the game */
+    uint16_t ply;
+    /*
+     * The game result from the point of view of the side to move
+     * (1 for a win, 0 for a draw and -1 for a loss).
+     */
+    int8_t result;
+    uint8_t padding;
+};
+
+/*
+ * Pack a position.
+ *
+ * @param pos The position.
+ * @param sfen Location to store the packed position at. It must have room
+ *             for at least SFEN_SIZE bytes.
+ */
+void sfen_pack(struct position *pos, uint8_t *sfen);
+
+/*
+ * Convert a move to the 16-bit representation used in training records.
+ *
+ * @param move The move.
+ * @return Returns the packed move.
+ */
+uint16_t sfen_pack_move(uint32_t move);
+
+/*
+ * Unpack a position.
+ *
+ * @param sfen The packed position.
+ * @param pos The position to set up.
+ * @return Returns false if the packed position is invalid.
+ */
+bool sfen_unpack(uint8_t *sfen, struct position *pos);
+
+/*
+ * Convert a move from the 16-bit representation used in training records.
+ *
+ * @param pos The position the move is played in.
+ * @param move The packed move.
+ * @return Returns the move or NOMOVE if it is not legal in the position.
+ */
+uint32_t sfen_unpack_move(struct position *pos, uint16_t move);
+
+/*
+ * Fill in a training record.
+ *
+ * @param pos The position.
+ * @param move The best move.
+ * @param score The search score from the point of view of the side to move.
+ * @param record The record to fill in. The result field is not set.
+ */
+void sfen_make_record(struct position *pos, uint32_t move, int score,
+                      struct sfen_record *record);
+
+/*
+ * Create a writer for training records.
+ *
+ * @param fp The file to write to.
+ * @param compress Flag indicating if the records should be compressed.
+ * @return Returns the writer or NULL on failure.
+ */
+struct sfen_writer* sfen_writer_create(FILE *fp, bool compress);
+
+/*
+ * Write a training record. Records that are to be compressed should be
+ * written in game order to get the best compression.
+ *
+ * @param writer The writer.
+ * @param record The record to write.
+ * @return Returns false if writing failed.
+ */
+bool sfen_writer_write(struct sfen_writer *writer, struct sfen_record *record);
+
+/*
+ * Flush any buffered records and destroy the writer. The file is
+ * not closed.
+ *
+ * @param writer The writer.
+ * @return Returns false if writing failed.
+ */
+bool sfen_writer_destroy(struct sfen_writer *writer);
+
+/*
+ * Create a reader for training records. Both plain and compressed
+ * files are handled.
+ *
+ * @param fp The file to read from.
+ * @return Returns the reader or NULL on failure.
+ */
+struct sfen_reader* sfen_reader_create(FILE *fp);
+
+/*
+ * Read the next training record.
+ *
+ * @param reader The reader.
+ * @param record Location to store the record at.
+ * @return Returns false at the end of the file or if the file is corrupt.
+ */
+bool sfen_reader_read(struct sfen_reader *reader, struct sfen_record *record);
+
+/*
+ * Destroy a reader. The file is not closed.
+ *
+ * @param reader The reader.
+ */
+void sfen_reader_destroy(struct sfen_reader *reader);
+
+#endif
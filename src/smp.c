@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdatomic.h>
+#include <inttypes.h>
 #include <stdlib.h>
 
 #include "smp.h"
@@ -29,27 +30,576 @@
 #include "engine.h"
 #include "validation.h"
 #include "tbprobe.h"
+#include "tbprefetch.h"
 #include "polybook.h"
 #include "bitboard.h"
 #include "board.h"
 #include "history.h"
 #include "nnue.h"
+#include "debug.h"
+#include "utils.h"
+#include "timetrace.h"
 
 /* Worker actions */
 #define ACTION_IDLE 0
 #define ACTION_EXIT 1
 #define ACTION_RUN 2
+#define ACTION_BATCH 3
 
-/* Lock for updating the state struct during search */
-static mutex_t state_lock;
+/* The highest depth completed by any worker during the current search */
+static atomic_int completed_depth = 0;
 
-/* Variables used to signal to workers to stop searching */
-static mutex_t stop_lock;
-static atomic_bool should_stop = false;
+/*
+ * The time (in milliseconds since the search started) when each
+ * depth was first completed by any worker.
+ */
+static time_t depth_times[MAX_SEARCH_DEPTH+1];
+
+/*
+ * Tables used to distribute helper workers over different depths.
+ * Helper number n skips every depth d for which
+ * ((d + skip_phase[i])/skip_size[i]) is odd, where i = (n - 1)%SKIP_TABLE_SIZE.
+ * The first helpers alternate between odd and even depths while
+ * later helpers skip progressively longer runs of depths, so the
+ * workers stay spread out regardless of the number of threads.
+ */
+#define SKIP_TABLE_SIZE 20
+static const int skip_size[SKIP_TABLE_SIZE] = {
+    1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4
+};
+static const int skip_phase[SKIP_TABLE_SIZE] = {
+    0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7
+};
+
+/*
+ * With more helpers than entries in the skip tables the cycling pattern
+ * sends too many helpers far ahead of the main worker. Instead each
+ * helper then picks the first depth that fewer than half of the workers
+ * are searching, which keeps about half of the workers at the frontier.
+ * The number of workers searching each depth is kept in atomic counters
+ * so that no lock is needed.
+ */
+#define SKIP_TABLE_MAX_WORKERS (SKIP_TABLE_SIZE+1)
+static atomic_int depth_workers[MAX_SEARCH_DEPTH+2];
+
+/*
+ * Flag used to signal to workers to stop searching. It is read at every
+ * node by all workers so it is kept on a cache line of its own.
+ */
+static struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_bool flag;
+    char padding[CACHE_LINE_SIZE-sizeof(atomic_bool)];
+} should_stop;
+
+/*
+ * Interval (in milliseconds) at which the monitor thread checks the
+ * clock and polls for commands while a search is running.
+ */
+#define MONITOR_INTERVAL 1
+
+/* Data for the monitor thread */
+static thread_t monitor_thread;
+static atomic_bool master_done = false;
 
 /* Data for worker threads */
 static int number_of_workers = 0;
-static struct search_worker *workers = NULL;
+static struct search_worker **workers = NULL;
+
+/* Data for batch searches where each worker searches its own position */
+static mutex_t batch_lock;
+static smp_batch_next_func_t batch_next = NULL;
+static smp_batch_done_func_t batch_done = NULL;
+static void *batch_data = NULL;
+static struct gamestate **batch_states = NULL;
+
+/* Flag indicating if workers should be bound to NUMA nodes */
+static bool numa_enabled = false;
+
+/* Flag indicating if workers should be pinned to individual processors */
+static bool pinning_enabled = false;
+
+/* The size of the pawn hash table of each worker (in MB) */
+static int pawn_hash_size = DEFAULT_PAWN_HASH_SIZE;
+
+/*
+ * The size of the pawn hash tables actually created (in MB), which is
+ * smaller than pawn_hash_size when needed to stay within the memory limit.
+ */
+static int worker_pawn_hash_size = DEFAULT_PAWN_HASH_SIZE;
+
+/*
+ * Table of moves currently being searched, used for ABDADA. Each entry
+ * holds a tag computed from the position key and the move, with the id
+ * of the searching worker in the low bits.
+ */
+#define SEARCHING_TABLE_SIZE 16384
+#define SEARCHING_ID_BITS 10
+#define SEARCHING_ID_MASK ((1ULL << SEARCHING_ID_BITS) - 1)
+static atomic_uint_least64_t searching_table[SEARCHING_TABLE_SIZE];
+static bool abdada_enabled = false;
+
+/*
+ * Root move results shared by all workers when the multipv lines are
+ * distributed over the workers. The lines are kept sorted by score and
+ * there is at most one line for each root move. Lines older than the
+ * previous iteration are dropped.
+ */
+#define MAX_SHARED_LINES (2*MAX_MULTIPV_LINES)
+static mutex_t multipv_lock;
+static int nshared_lines = 0;
+static uint32_t shared_moves[MAX_SHARED_LINES];
+static struct pvinfo shared_lines[MAX_SHARED_LINES];
+
+/*
+ * Copy of the shared lines from the last time there was a line for each
+ * multipv slot. Used for the final result since dropping outdated lines
+ * can leave slots empty when the search stops.
+ */
+static int ncomplete_lines = 0;
+static uint32_t complete_moves[MAX_MULTIPV_LINES];
+static struct pvinfo complete_lines[MAX_MULTIPV_LINES];
+
+/*
+ * The number of alternative opponent replies searched by helpers while
+ * pondering and the position before the ponder move, used for setting
+ * up the alternatives.
+ */
+static int wide_ponder_moves = 0;
+static struct position ponder_parent;
+
+/*
+ * Bind the calling thread to the processors configured for a worker.
+ * Only threads that run searches for a worker are bound, since threads
+ * inherit the affinity of the thread that creates them.
+ */
+static void bind_worker_thread(struct search_worker *worker)
+{
+    if (worker->cpu >= 0) {
+        thread_bind_to_cpu(worker->cpu);
+    } else if (worker->numa_node >= 0) {
+        thread_bind_to_node(worker->numa_node);
+    } else {
+        thread_bind_to_group(worker->id);
+    }
+}
+
+/*
+ * Memory is placed on the NUMA node of the thread that first touches
+ * it, so the thread should be bound before calling this function.
+ */
+static void setup_worker_memory(struct search_worker *worker)
+{
+    memset((char*)worker+SEARCH_WORKER_DATA_OFFSET, 0,
+           sizeof(struct search_worker)-SEARCH_WORKER_DATA_OFFSET);
+    history_clear_tables(worker);
+    hash_pawntt_create_table(worker, worker_pawn_hash_size);
+    hash_evalcache_create_table(worker, EVAL_CACHE_SIZE);
+}
+
+/*
+ * Get the largest pawn hash size (in MB), at most pawn_hash_size, that
+ * lets nthreads workers and a transposition table of the minimum size
+ * fit within the memory limit. The size is halved until it fits so that
+ * it stays a power of 2.
+ */
+static int fit_pawn_hash_size(int nthreads)
+{
+    uint64_t limit;
+    uint64_t reserved;
+    uint64_t per_worker;
+    uint64_t available;
+    int      size;
+
+    size = pawn_hash_size;
+    if (engine_memory_limit == 0) {
+        return size;
+    }
+
+    per_worker = sizeof(struct search_worker) +
+                                        EVAL_CACHE_SIZE*1024ULL*1024ULL;
+    if (engine_using_nnue) {
+        per_worker += nnue_pos_memory(NULL);
+    }
+    reserved = engine_fixed_memory() + nthreads*per_worker +
+                                        MIN_MAIN_HASH_SIZE*1024ULL*1024ULL;
+    limit = engine_memory_limit*1024ULL*1024ULL;
+    available = (limit > reserved)?limit-reserved:0ULL;
+    while ((size > MIN_PAWN_HASH_SIZE) &&
+           ((nthreads*size*1024ULL*1024ULL) > available)) {
+        size /= 2;
+    }
+
+    return MAX(size, MIN_PAWN_HASH_SIZE);
+}
+
+static void free_worker(struct search_worker *worker)
+{
+    hash_pawntt_destroy_table(worker);
+    hash_evalcache_destroy_table(worker);
+    if (worker->pos.nnue_pos != NULL) {
+        nnue_destroy_pos(worker->pos.nnue_pos);
+        worker->pos.nnue_pos = NULL;
+    }
+#ifdef TIMETRACE
+    timetrace_destroy_buffer(worker->timetrace);
+#endif
+    aligned_free(worker);
+}
+
+static void log_evalcache_stats(void)
+{
+    uint64_t lookups;
+    uint64_t hits;
+    int      k;
+
+    lookups = 0ULL;
+    hits = 0ULL;
+    for (k=0;k<number_of_workers;k++) {
+        lookups += workers[k]->evalcache_lookups;
+        hits += workers[k]->evalcache_hits;
+    }
+    if (lookups > 0ULL) {
+        LOG_INFO1("Evaluation cache: %"PRIu64" lookups, %"PRIu64" hits (%d%%)\n",
+                  lookups, hits, (int)((hits*100ULL)/lookups));
+    }
+}
+
+static void clear_searching_table(void)
+{
+    int k;
+
+    for (k=0;k<SEARCHING_TABLE_SIZE;k++) {
+        atomic_store_explicit(&searching_table[k], 0ULL, memory_order_relaxed);
+    }
+}
+
+static uint64_t searching_tag(uint64_t key, uint32_t move)
+{
+    return (key^(move*0x9E3779B97F4A7C15ULL))&(~SEARCHING_ID_MASK);
+}
+
+/*
+ * The low bits of a tag hold the worker id so the slot is selected
+ * using the bits above them.
+ */
+static int searching_index(uint64_t tag)
+{
+    return (int)((tag>>SEARCHING_ID_BITS)&(SEARCHING_TABLE_SIZE-1));
+}
+
+static bool is_excluded_move(struct search_worker *worker, uint32_t move)
+{
+    int k;
+
+    for (k=0;k<worker->mpvidx;k++) {
+        if (worker->mpv_moves[k] == move) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void fetch_shared_lines(struct search_worker *worker)
+{
+    int k;
+
+    for (k=0;k<worker->multipv;k++) {
+        if (k < nshared_lines) {
+            worker->mpv_moves[k] = shared_moves[k];
+            worker->mpv_lines[k] = shared_lines[k];
+        } else {
+            worker->mpv_moves[k] = NOMOVE;
+            worker->mpv_lines[k].score = -INFINITE_SCORE;
+            worker->mpv_lines[k].pv.size = 0;
+            worker->mpv_lines[k].depth = 0;
+            worker->mpv_lines[k].seldepth = 0;
+        }
+    }
+}
+
+static void save_complete_lines(struct search_worker *worker)
+{
+    int k;
+
+    if (nshared_lines < worker->multipv) {
+        return;
+    }
+    for (k=0;k<worker->multipv;k++) {
+        complete_moves[k] = shared_moves[k];
+        complete_lines[k] = shared_lines[k];
+    }
+    ncomplete_lines = worker->multipv;
+}
+
+static void fetch_complete_lines(struct search_worker *worker)
+{
+    int k;
+
+    if (ncomplete_lines < worker->multipv) {
+        fetch_shared_lines(worker);
+        return;
+    }
+    for (k=0;k<worker->multipv;k++) {
+        worker->mpv_moves[k] = complete_moves[k];
+        worker->mpv_lines[k] = complete_lines[k];
+    }
+}
+
+static void remove_shared_line(int idx)
+{
+    int k;
+
+    for (k=idx;k<nshared_lines-1;k++) {
+        shared_moves[k] = shared_moves[k+1];
+        shared_lines[k] = shared_lines[k+1];
+    }
+    nshared_lines--;
+}
+
+static struct search_worker* select_best_worker(void)
+{
+    int64_t              votes[MAX_WORKERS];
+    int64_t              weight;
+    int64_t              total;
+    int                  min_score;
+    int                  k;
+    int                  l;
+    struct search_worker *worker;
+    struct search_worker *best;
+    char                 movestr[MAX_MOVESTR_LENGTH];
+
+    /*
+     * Find the lowest score among the workers that found a move. Workers
+     * that searched an alternative to the ponder move are ignored.
+     */
+    min_score = INFINITE_SCORE;
+    for (k=0;k<number_of_workers;k++) {
+        worker = workers[k];
+        if (!worker->ponder_alternative &&
+            (worker->mpv_moves[0] != NOMOVE) &&
+            (worker->mpv_lines[0].score < min_score)) {
+            min_score = worker->mpv_lines[0].score;
+        }
+    }
+
+    /*
+     * Each worker votes for its best move with a weight based on
+     * both the depth it reached and how much better its score is
+     * than the worst score. This way a single worker that barely
+     * finished a deeper iteration can not override a clear consensus.
+     */
+    total = 0;
+    for (k=0;k<number_of_workers;k++) {
+        votes[k] = 0;
+    }
+    for (k=0;k<number_of_workers;k++) {
+        worker = workers[k];
+        if (worker->ponder_alternative || (worker->mpv_moves[0] == NOMOVE)) {
+            continue;
+        }
+        weight = (int64_t)(worker->mpv_lines[0].score - min_score + 14)*
+                                                    worker->mpv_lines[0].depth;
+        for (l=0;l<number_of_workers;l++) {
+            if (workers[l]->mpv_moves[0] == worker->mpv_moves[0]) {
+                votes[l] += weight;
+            }
+        }
+        total += weight;
+    }
+
+    /*
+     * Select the move with the most votes. Among the workers voting for
+     * that move the one that searched the deepest is used. A proven win
+     * always takes precedence since it can not be overturned by a deeper
+     * search.
+     */
+    best = workers[0];
+    for (k=1;k<number_of_workers;k++) {
+        worker = workers[k];
+        if (worker->ponder_alternative || (worker->mpv_moves[0] == NOMOVE)) {
+            continue;
+        }
+        if (best->mpv_lines[0].score > KNOWN_WIN) {
+            if (worker->mpv_lines[0].score > best->mpv_lines[0].score) {
+                best = worker;
+            }
+        } else if ((worker->mpv_lines[0].score > KNOWN_WIN) ||
+                   (votes[k] > votes[best->id]) ||
+                   ((votes[k] == votes[best->id]) &&
+                    (worker->mpv_lines[0].depth > best->mpv_lines[0].depth))) {
+            best = worker;
+        }
+    }
+
+    if ((best->mpv_moves[0] != NOMOVE) && (total > 0)) {
+        best->state->vote_share = (int)((votes[best->id]*100)/total);
+        move2str(best->mpv_moves[0], movestr);
+        LOG_INFO1("Selected %s from worker %d (depth %d, score %d, %d%% of votes)\n",
+                  movestr, best->id, best->mpv_lines[0].depth,
+                  best->mpv_lines[0].score, best->state->vote_share);
+    }
+
+    return best;
+}
+
+/*
+ * Check if a candidate reply found by find_ponder_alternatives should be
+ * ranked before another. Replies with an exact score, or a lower bound
+ * from the point of view of the opponent, are ranked first by score.
+ * Other replies only have an upper bound, meaning that they were refuted,
+ * and the bound says little about how good they are. Late moves are
+ * reduced, so these replies are ranked by depth instead, which follows
+ * the move order of the previous search, and by score for equal depths.
+ */
+static bool is_better_alternative(bool bounded1, int depth1, int score1,
+                                  bool bounded2, int depth2, int score2)
+{
+    if (bounded1 != bounded2) {
+        return !bounded1;
+    }
+    if (bounded1 && (depth1 != depth2)) {
+        return depth1 > depth2;
+    }
+    return score1 > score2;
+}
+
+/*
+ * Find the most likely opponent replies, other than the ponder move, in
+ * the position before the ponder move. Replies are ranked based on the
+ * items found in the transposition table, see is_better_alternative,
+ * and replies that have not been searched are skipped. Returns the
+ * number of replies found.
+ */
+static int find_ponder_alternatives(struct gamestate *state, uint32_t *moves,
+                                    int nmoves)
+{
+    struct position *pos = &ponder_parent;
+    struct movelist legal;
+    struct tt_item  item;
+    uint32_t        ponder_move;
+    void            *nnue_pos;
+    bool            bounded[MAX_WIDE_PONDER_MOVES];
+    int             depths[MAX_WIDE_PONDER_MOVES];
+    int             scores[MAX_WIDE_PONDER_MOVES];
+    bool            is_bounded;
+    int             score;
+    int             count;
+    int             k;
+    int             l;
+
+    if (state->pos.ply <= state->pos.start_ply) {
+        return 0;
+    }
+    ponder_move = state->pos.history[state->pos.ply-1].move;
+    if (ISNULLMOVE(ponder_move)) {
+        return 0;
+    }
+
+    /* Setup the position before the ponder move */
+    nnue_pos = pos->nnue_pos;
+    *pos = state->pos;
+    pos->nnue_pos = nnue_pos;
+    pos->worker = NULL;
+    pos->state = NULL;
+    if (engine_using_nnue) {
+        if (pos->nnue_pos == NULL) {
+            pos->nnue_pos = nnue_create_pos();
+        }
+        nnue_copy_pos(state->pos.nnue_pos, pos->nnue_pos);
+    }
+    board_unmake_move(pos);
+
+    /* Keep the most likely replies, sorted by rank */
+    count = 0;
+    gen_legal_moves(pos, &legal);
+    for (k=0;k<legal.size;k++) {
+        if (legal.moves[k] == ponder_move) {
+            continue;
+        }
+        (void)board_make_move(pos, legal.moves[k]);
+        if (!hash_tt_lookup(pos, &item)) {
+            board_unmake_move(pos);
+            continue;
+        }
+        board_unmake_move(pos);
+
+        /*
+         * The item is stored from the point of view of the side to
+         * move after the reply, so a fail high there is an upper
+         * bound for the opponent.
+         */
+        score = -item.score;
+        is_bounded = item.type == TT_BETA;
+        for (l=count;l>0;l--) {
+            if (!is_better_alternative(is_bounded, item.depth, score,
+                                       bounded[l-1], depths[l-1],
+                                       scores[l-1])) {
+                break;
+            }
+            if (l < nmoves) {
+                moves[l] = moves[l-1];
+                bounded[l] = bounded[l-1];
+                depths[l] = depths[l-1];
+                scores[l] = scores[l-1];
+            }
+        }
+        if (l < nmoves) {
+            moves[l] = legal.moves[k];
+            bounded[l] = is_bounded;
+            depths[l] = item.depth;
+            scores[l] = score;
+            if (count < nmoves) {
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Let a share of the helpers search the most likely alternatives to
+ * the ponder move. Must be called after the workers have been prepared.
+ */
+static void setup_wide_ponder(struct gamestate *state)
+{
+    struct search_worker *worker;
+    uint32_t             moves[MAX_WIDE_PONDER_MOVES];
+    int                  nmoves;
+    int                  k;
+    char                 movestr[MAX_MOVESTR_LENGTH];
+
+    /*
+     * Multipv and searchmoves only make sense for the actual
+     * position so wide pondering is not used for such searches.
+     */
+    if ((wide_ponder_moves == 0) || (number_of_workers < 2) ||
+        (state->multipv > 1) || (state->move_filter.size > 0)) {
+        return;
+    }
+
+    nmoves = find_ponder_alternatives(state, moves,
+                                      MIN(wide_ponder_moves,
+                                          number_of_workers/2));
+    for (k=0;k<nmoves;k++) {
+        worker = workers[number_of_workers-1-k];
+        (void)board_make_move(&ponder_parent, moves[k]);
+        board_copy_root(&worker->pos, &ponder_parent);
+        if (engine_using_nnue) {
+            nnue_copy_pos(ponder_parent.nnue_pos, worker->pos.nnue_pos);
+        }
+        board_unmake_move(&ponder_parent);
+
+        worker->pos.sply = 0;
+        worker->pos.state = state;
+        worker->pos.worker = worker;
+        worker->ponder_alternative = true;
+
+        move2str(moves[k], movestr);
+        LOG_INFO2("Worker %d ponders on the alternative reply %s\n",
+                  worker->id, movestr);
+    }
+}
 
 static bool probe_dtz_tables(struct gamestate *state, int *score)
 {
@@ -129,25 +679,13 @@ static bool probe_dtz_tables(struct gamestate *state, int *score)
     return true;
 }
 
-static thread_retval_t worker_thread_func(void *data)
-{
-    struct search_worker *worker = data;
-
-    search_find_best_move(worker);
-
-    return (thread_retval_t)0;
-}
-
 static void prepare_worker(struct search_worker *worker,
                            struct gamestate *state)
 {
     int  mpvidx;
-    void *tmp;
 
     /* Copy data from game state */
-    tmp = worker->pos.nnue_pos;
-    worker->pos = state->pos;
-    worker->pos.nnue_pos = tmp;
+    board_copy_root(&worker->pos, &state->pos);
     if (engine_using_nnue) {
         if (worker->pos.nnue_pos == NULL) {
             worker->pos.nnue_pos = nnue_create_pos();
@@ -165,6 +703,18 @@ static void prepare_worker(struct search_worker *worker,
     worker->currmovenumber = 0;
     worker->currmove = NOMOVE;
     worker->tbhits = 0ULL;
+    worker->evalcache_lookups = 0ULL;
+    worker->evalcache_hits = 0ULL;
+    worker->tt_lookups = 0ULL;
+    worker->tt_hits = 0ULL;
+    worker->tt_stores = 0ULL;
+    worker->tt_overwrites = 0ULL;
+#ifdef STATS
+    stats_clear(&worker->stats);
+    if (worker->pos.nnue_pos != NULL) {
+        nnue_clear_stats(worker->pos.nnue_pos);
+    }
+#endif
 
     /* Clear best move information */
     for (mpvidx=0;mpvidx<state->multipv;mpvidx++) {
@@ -175,75 +725,378 @@ static void prepare_worker(struct search_worker *worker,
         worker->mpv_lines[mpvidx].seldepth = 0;
     }
 
-    /* Clear multipv information */
-    worker->multipv = state->multipv;
+    /* Clear multipv information */
+    worker->multipv = state->multipv;
+
+    /* Clear time management information */
+    memset(worker->root_nodes, 0, sizeof(worker->root_nodes));
+    worker->prev_best_move = NOMOVE;
+    worker->best_move_changes = 0;
+
+    /* Initialize helper variables */
+    worker->resolving_root_fail = false;
+    worker->resolving_tt_fail = false;
+    worker->ponder_alternative = false;
+
+    /* Setup parent pointers */
+    worker->state = state;
+    worker->pos.state = state;
+    worker->pos.worker = worker;
+
+    /* Worker is initiallly idle */
+    worker->action = ACTION_IDLE;
+}
+
+void smp_search_standalone(struct search_worker *worker,
+                           struct gamestate *state)
+{
+    struct movelist legal;
+
+    /* Reset the state for a new search */
+    state->best_move = NOMOVE;
+    state->ponder_move = NOMOVE;
+    state->probe_wdl = false;
+    state->root_in_tb = false;
+    state->root_tb_score = 0;
+    state->pondering = false;
+    state->exit_on_mate = false;
+    state->pos.sply = 0;
+    state->completed_depth = 0;
+    state->multipv = 1;
+    state->move_filter.size = 0;
+
+    /* Make sure a legal move is always returned */
+    gen_legal_moves(&state->pos, &legal);
+    if (legal.size == 0) {
+        worker->mpv_lines[0].pv.size = 0;
+        worker->mpv_lines[0].depth = 0;
+        worker->mpv_lines[0].score = board_in_check(&state->pos,
+                                                    state->pos.stm)?
+                                                    -CHECKMATE:0;
+        return;
+    }
+    state->best_move = legal.moves[0];
+
+    prepare_worker(worker, state);
+    search_find_best_move(worker);
+
+    if (worker->mpv_moves[0] != NOMOVE) {
+        state->best_move = worker->mpv_moves[0];
+        state->ponder_move = (worker->mpv_lines[0].pv.size > 1)?
+                                    worker->mpv_lines[0].pv.moves[1]:NOMOVE;
+    }
+}
+
+static void run_batch(struct search_worker *worker)
+{
+    struct gamestate *state;
+    bool             found;
+
+    state = batch_states[worker->id];
+    while (true) {
+        mutex_lock(&batch_lock);
+        found = batch_next(state, batch_data);
+        mutex_unlock(&batch_lock);
+        if (!found) {
+            break;
+        }
+
+        smp_search_standalone(worker, state);
+
+        mutex_lock(&batch_lock);
+        batch_done(state, &worker->mpv_lines[0], batch_data);
+        mutex_unlock(&batch_lock);
+    }
+}
+
+/*
+ * Thread that initializes the memory of the master worker. The master
+ * searches in the thread that created the workers, which is not bound
+ * since all threads it starts later would inherit the binding. A short
+ * lived thread bound in the same way as a helper touches the memory
+ * instead, so that it is still placed on the node of the master.
+ */
+static thread_retval_t master_setup_thread_func(void *data)
+{
+    struct search_worker *worker = data;
+
+    bind_worker_thread(worker);
+    setup_worker_memory(worker);
+
+    return (thread_retval_t)0;
+}
+
+static thread_retval_t worker_thread_func(void *data)
+{
+    struct search_worker *worker = data;
+    uint64_t             nodes;
+
+    /* Let the master know when the worker is ready to be used */
+    bind_worker_thread(worker);
+    setup_worker_memory(worker);
+    event_set(&worker->done_event);
+
+    /*
+     * Helper threads are kept alive between searches. They park
+     * on the start event until the master requests a new search
+     * or asks them to exit.
+     */
+    while (true) {
+        event_wait(&worker->start_event);
+        if (worker->action == ACTION_EXIT) {
+            break;
+        }
+
+        if (worker->action == ACTION_BATCH) {
+            run_batch(worker);
+        } else {
+            search_find_best_move(worker);
+
+            /*
+             * A worker searching an alternative to the ponder move
+             * joins the search of the actual position when the ponder
+             * move is played. The node count is kept so that the total
+             * reported to the GUI never decreases.
+             */
+            if (worker->ponder_alternative && !smp_should_stop()) {
+                nodes = worker->nodes;
+                prepare_worker(worker, worker->state);
+                worker->nodes = nodes;
+                search_find_best_move(worker);
+            }
+        }
+
+        worker->action = ACTION_IDLE;
+        event_set(&worker->done_event);
+    }
+
+    return (thread_retval_t)0;
+}
 
-    /* Initialize helper variables */
-    worker->resolving_root_fail = false;
-    worker->resolving_tt_fail = false;
+/*
+ * The monitor thread owns time control and input handling during a
+ * search so that the master worker never has to interrupt its search.
+ * It wakes up as soon as a command is received.
+ * If the master finishes while pondering then the monitor continues to
+ * read input until a ponderhit or stop command is received. The monitor
+ * also sends any search information buffered by the master.
+ */
+static thread_retval_t monitor_thread_func(void *data)
+{
+    struct search_worker *worker = data;
 
-    /* Setup parent pointers */
-    worker->state = state;
-    worker->pos.state = state;
-    worker->pos.worker = worker;
+    while (!atomic_load(&master_done) || worker->state->pondering) {
+        (void)engine_wait_for_input(MONITOR_INTERVAL);
+        engine_flush_output();
+        if (smp_should_stop() && !worker->state->pondering) {
+            continue;
+        }
 
-    /* Worker is initiallly idle */
-    worker->action = ACTION_IDLE;
+        if (engine_check_input(worker) ||
+            (!tc_is_nodestime() && !tc_check_time(worker))) {
+            smp_stop_all();
+        }
+    }
+
+    return (thread_retval_t)0;
 }
 
 void smp_init(void)
 {
-    mutex_init(&state_lock);
-    mutex_init(&stop_lock);
+    mutex_init(&batch_lock);
+    mutex_init(&multipv_lock);
+    atomic_init(&should_stop.flag, false);
 }
 
 void smp_destroy(void)
 {
-    mutex_destroy(&state_lock);
-    mutex_destroy(&stop_lock);
+    mutex_destroy(&batch_lock);
+    mutex_destroy(&multipv_lock);
+    if (ponder_parent.nnue_pos != NULL) {
+        nnue_destroy_pos(ponder_parent.nnue_pos);
+        ponder_parent.nnue_pos = NULL;
+    }
 }
 
 void smp_create_workers(int nthreads)
 {
     int k;
+    int nnodes;
+    int ncpus;
+
+    nnodes = numa_enabled?thread_number_of_nodes():1;
+    ncpus = pinning_enabled?thread_number_of_cpus():1;
 
+    /*
+     * Each worker is allocated separately and only the thread data at
+     * the start of the worker is initialized here. The rest of the pages
+     * backing the worker are not touched until the owning thread
+     * initializes them.
+     */
     number_of_workers = nthreads;
-    workers = malloc(number_of_workers*sizeof(struct search_worker));
+    worker_pawn_hash_size = fit_pawn_hash_size(nthreads);
+    workers = malloc(number_of_workers*sizeof(struct search_worker*));
     for (k=0;k<number_of_workers;k++) {
-        memset(&workers[k], 0, sizeof(struct search_worker));
-        hash_pawntt_create_table(&workers[k], PAWN_HASH_SIZE);
-        workers[k].state = NULL;
-        workers[k].id = k;
+        workers[k] = aligned_malloc(CACHE_LINE_SIZE,
+                                    sizeof(struct search_worker));
+        assert(workers[k] != NULL);
+        workers[k]->id = k;
+        workers[k]->action = ACTION_IDLE;
+        workers[k]->numa_node = numa_enabled?k%nnodes:-1;
+        workers[k]->cpu = pinning_enabled?k%ncpus:-1;
+#ifdef TIMETRACE
+        workers[k]->timetrace = timetrace_create_buffer(k);
+#endif
+    }
+
+    /* The master runs in the calling thread */
+    thread_create(&workers[0]->thread,
+                  (thread_func_t)master_setup_thread_func, workers[0]);
+    thread_join(&workers[0]->thread);
+
+    /* Start the helper threads and wait for them to become ready */
+    for (k=1;k<number_of_workers;k++) {
+        event_init(&workers[k]->start_event);
+        event_init(&workers[k]->done_event);
+        thread_create(&workers[k]->thread, (thread_func_t)worker_thread_func,
+                      workers[k]);
+    }
+    for (k=1;k<number_of_workers;k++) {
+        event_wait(&workers[k]->done_event);
     }
+
+    LOG_INFO1("Created %d workers (NUMA %s, %d nodes)\n", number_of_workers,
+              numa_enabled?"enabled":"disabled", nnodes);
+
+    /* The transposition table gets what is left of the memory limit */
+    hash_tt_apply_memory_limit();
 }
 
 void smp_destroy_workers(void)
 {
     int k;
 
+    /* Tell all helper threads to exit and wait for them */
+    for (k=1;k<number_of_workers;k++) {
+        workers[k]->action = ACTION_EXIT;
+        event_set(&workers[k]->start_event);
+    }
+    for (k=1;k<number_of_workers;k++) {
+        thread_join(&workers[k]->thread);
+        event_destroy(&workers[k]->start_event);
+        event_destroy(&workers[k]->done_event);
+    }
+
     for (k=0;k<number_of_workers;k++) {
-        hash_pawntt_destroy_table(&workers[k]);
-        if (workers[k].pos.nnue_pos != NULL) {
-            nnue_destroy_pos(workers[k].pos.nnue_pos);
-            workers[k].pos.nnue_pos = NULL;
-        }
+        free_worker(workers[k]);
     }
     free(workers);
     workers = NULL;
     number_of_workers = 0;
 }
 
+struct search_worker* smp_create_standalone_worker(void)
+{
+    struct search_worker *worker;
+
+    worker = aligned_malloc(CACHE_LINE_SIZE, sizeof(struct search_worker));
+    if (worker == NULL) {
+        return NULL;
+    }
+    worker->id = 0;
+    worker->action = ACTION_IDLE;
+    worker->numa_node = -1;
+    worker->cpu = -1;
+#ifdef TIMETRACE
+    worker->timetrace = NULL;
+#endif
+    setup_worker_memory(worker);
+
+    return worker;
+}
+
+void smp_destroy_standalone_worker(struct search_worker *worker)
+{
+    assert(worker != NULL);
+
+    free_worker(worker);
+}
+
 int smp_number_of_workers(void)
 {
     return number_of_workers;
 }
 
+void smp_set_numa_mode(bool enabled)
+{
+    numa_enabled = enabled;
+}
+
+bool smp_numa_mode(void)
+{
+    return numa_enabled;
+}
+
+void smp_set_pawn_hash_size(int size)
+{
+    assert(size > 0);
+
+    pawn_hash_size = size;
+}
+
+int smp_pawn_hash_size(void)
+{
+    return pawn_hash_size;
+}
+
+void smp_set_pinning(bool enabled)
+{
+    pinning_enabled = enabled;
+}
+
+bool smp_pinning(void)
+{
+    return pinning_enabled;
+}
+
+void smp_set_abdada_mode(bool enabled)
+{
+    abdada_enabled = enabled;
+}
+
+bool smp_abdada_mode(void)
+{
+    return abdada_enabled;
+}
+
+void smp_set_wide_ponder_moves(int nmoves)
+{
+    assert((nmoves >= 0) && (nmoves <= MAX_WIDE_PONDER_MOVES));
+
+    wide_ponder_moves = nmoves;
+}
+
+int smp_wide_ponder_moves(void)
+{
+    return wide_ponder_moves;
+}
+
 void smp_newgame(void)
 {
     int k;
 
     for (k=0;k<number_of_workers;k++) {
-        history_clear_tables(&workers[k]);
+        history_clear_tables(workers[k]);
+        hash_evalcache_clear_table(workers[k]);
+    }
+}
+
+void smp_clear_eval_caches(void)
+{
+    int k;
+
+    for (k=0;k<number_of_workers;k++) {
+        hash_evalcache_clear_table(workers[k]);
     }
 }
 
@@ -251,9 +1104,11 @@ void smp_search(struct gamestate *state, bool pondering, bool use_book,
                 bool use_tablebases)
 {
     int                  k;
-    struct search_worker *worker;
     struct search_worker *best;
     struct movelist      legal;
+#ifdef STATS
+    struct search_stats  stats;
+#endif
 
     assert(valid_position(&state->pos));
     assert(number_of_workers > 0);
@@ -282,12 +1137,23 @@ void smp_search(struct gamestate *state, bool pondering, bool use_book,
 
     /* Prepare for search */
     hash_tt_age_table();
+    clear_searching_table();
     state->probe_wdl = use_tablebases;
     state->root_in_tb = false;
     state->root_tb_score = 0;
     state->pondering = pondering;
     state->pos.sply = 0;
     state->completed_depth = 0;
+    state->vote_share = -1;
+    atomic_store(&completed_depth, 0);
+    nshared_lines = 0;
+    ncomplete_lines = 0;
+    for (k=0;k<=(MAX_SEARCH_DEPTH+1);k++) {
+        atomic_store(&depth_workers[k], 0);
+    }
+    for (k=0;k<=MAX_SEARCH_DEPTH;k++) {
+        depth_times[k] = -1;
+    }
 
     /* Probe tablebases for the root position */
     if (use_tablebases &&
@@ -298,6 +1164,11 @@ void smp_search(struct gamestate *state, bool pondering, bool use_book,
         state->probe_wdl = !state->root_in_tb;
     }
 
+    /* Get tables that the search is likely to probe ready in advance */
+    if (use_tablebases) {
+        tbprefetch_position(&state->pos);
+    }
+
     /*
      * Initialize the best move to the first legal root
      * move to make sure a legal move is always returned.
@@ -332,47 +1203,62 @@ void smp_search(struct gamestate *state, bool pondering, bool use_book,
 
     /* Prepare workers for a new search */
     for (k=0;k<number_of_workers;k++) {
-        prepare_worker(&workers[k], state);
+        prepare_worker(workers[k], state);
+    }
+    if (pondering) {
+        setup_wide_ponder(state);
     }
 
-    /* Start helpers */
-    should_stop = false;
+    /* Wake up helpers */
+    atomic_store(&should_stop.flag, false);
     for (k=1;k<number_of_workers;k++) {
-        thread_create(&workers[k].thread, (thread_func_t)worker_thread_func,
-                      &workers[k]);
+        workers[k]->action = ACTION_RUN;
+        event_set(&workers[k]->start_event);
     }
 
     /* Send information to the GUI about which eval that is being used */
-    engine_send_eval_info(&workers[0]);
+    engine_send_eval_info(workers[0]);
 
-    /* Start the master worker thread */
-    search_find_best_move(&workers[0]);
+    /* Start the monitor thread and the master worker */
+    atomic_store(&master_done, false);
+    thread_create(&monitor_thread, (thread_func_t)monitor_thread_func,
+                  workers[0]);
+    search_find_best_move(workers[0]);
+    atomic_store(&master_done, true);
+    thread_join(&monitor_thread);
 
     /* Wait for all helpers to finish */
+    TIMETRACE_BEGIN(workers[0], "wait for helpers");
     for (k=1;k<number_of_workers;k++) {
-        thread_join(&workers[k].thread);
+        event_wait(&workers[k]->done_event);
     }
+    TIMETRACE_END(workers[0], "wait for helpers");
+#ifdef TIMETRACE
+    timetrace_flush();
+#endif
+
+    state->completed_depth = atomic_load(&completed_depth);
 
     /* Find the worker with the best move */
-    best = &workers[0];
+    best = workers[0];
     if (state->multipv == 1) {
-        for (k=1;k<number_of_workers;k++) {
-            worker = &workers[k];
-            if ((worker->mpv_lines[0].depth > best->mpv_lines[0].depth) ||
-                ((worker->mpv_lines[0].depth == best->mpv_lines[0].depth) &&
-                (worker->mpv_lines[0].score > best->mpv_lines[0].score))) {
-                best = worker;
-            }
-        }
+        best = select_best_worker();
+    } else if (smp_parallel_multipv(best)) {
+        mutex_lock(&multipv_lock);
+        fetch_complete_lines(best);
+        mutex_unlock(&multipv_lock);
     }
 
     /*
-     * If the best worker is not the first worker then send
-     * an extra pv line to the GUI.
+     * If the best worker is not the first worker, if the last update
+     * was held back, or if the move was selected by a vote, then send
+     * an extra pv line to the GUI. The line includes the vote result.
      */
-    if (best->id != 0) {
-        engine_send_pv_info(best, best->mpv_lines[0].score);
+    if ((best->id != 0) || engine_pv_info_pending() ||
+        (state->vote_share >= 0)) {
+        engine_send_final_pv_info(best);
     }
+    engine_flush_output();
 
     /* Copy the best move to the state struct */
     if (best->mpv_moves[0] != NOMOVE) {
@@ -381,10 +1267,71 @@ void smp_search(struct gamestate *state, bool pondering, bool use_book,
                                     best->mpv_lines[0].pv.moves[1]:NOMOVE;
     }
 
+    /* Log evaluation cache statistics */
+    log_evalcache_stats();
+#ifdef STATS
+    smp_collect_stats(&stats);
+    stats_log(&stats);
+#endif
+
     /* Reset move filter since it's not needed anymore */
     state->move_filter.size = 0;
 }
 
+void smp_search_batch(smp_batch_next_func_t next, smp_batch_done_func_t done,
+                      void *data)
+{
+    int k;
+
+    assert(next != NULL);
+    assert(done != NULL);
+    assert(number_of_workers > 0);
+    assert(workers != NULL);
+
+    /* Create a separate state for each worker */
+    batch_states = malloc(number_of_workers*sizeof(struct gamestate*));
+    for (k=0;k<number_of_workers;k++) {
+        batch_states[k] = create_game_state();
+        batch_states[k]->silent = true;
+        batch_states[k]->standalone = true;
+        batch_states[k]->sd = MAX_SEARCH_DEPTH;
+        batch_states[k]->multipv = 1;
+    }
+    batch_next = next;
+    batch_done = done;
+    batch_data = data;
+
+    /* Prepare for search */
+    hash_tt_age_table();
+    atomic_store(&should_stop.flag, false);
+
+    /* Let all workers process positions until there are no more left */
+    for (k=1;k<number_of_workers;k++) {
+        workers[k]->action = ACTION_BATCH;
+        event_set(&workers[k]->start_event);
+    }
+    run_batch(workers[0]);
+    for (k=1;k<number_of_workers;k++) {
+        event_wait(&workers[k]->done_event);
+    }
+#ifdef TIMETRACE
+    timetrace_flush();
+#endif
+
+    /* Clean up */
+    for (k=0;k<number_of_workers;k++) {
+        if (batch_states[k]->pos.nnue_pos != NULL) {
+            nnue_destroy_pos(batch_states[k]->pos.nnue_pos);
+        }
+        free(batch_states[k]);
+    }
+    free(batch_states);
+    batch_states = NULL;
+    batch_next = NULL;
+    batch_done = NULL;
+    batch_data = NULL;
+}
+
 uint64_t smp_nodes(void)
 {
     uint64_t nodes;
@@ -392,7 +1339,7 @@ uint64_t smp_nodes(void)
 
     nodes = 0ULL;
     for (k=0;k<number_of_workers;k++) {
-        nodes += workers[k].nodes;
+        nodes += workers[k]->nodes;
     }
     return nodes;
 }
@@ -404,58 +1351,398 @@ uint64_t smp_tbhits(void)
 
     tbhits = 0ULL;
     for (k=0;k<number_of_workers;k++) {
-        tbhits += workers[k].tbhits;
+        tbhits += workers[k]->tbhits;
     }
     return tbhits;
 }
 
+void smp_tt_stats(uint64_t *lookups, uint64_t *hits, uint64_t *stores,
+                  uint64_t *overwrites)
+{
+    int k;
+
+    assert(lookups != NULL);
+    assert(hits != NULL);
+    assert(stores != NULL);
+    assert(overwrites != NULL);
+
+    *lookups = 0ULL;
+    *hits = 0ULL;
+    *stores = 0ULL;
+    *overwrites = 0ULL;
+    for (k=0;k<number_of_workers;k++) {
+        *lookups += workers[k]->tt_lookups;
+        *hits += workers[k]->tt_hits;
+        *stores += workers[k]->tt_stores;
+        *overwrites += workers[k]->tt_overwrites;
+    }
+}
+
+void smp_memory_usage(uint64_t *worker_mem, uint64_t *pawntt,
+                      uint64_t *evalcache, uint64_t *nnue)
+{
+    int k;
+
+    assert(worker_mem != NULL);
+    assert(pawntt != NULL);
+    assert(evalcache != NULL);
+    assert(nnue != NULL);
+
+    *worker_mem = number_of_workers*sizeof(struct search_worker);
+    *pawntt = 0ULL;
+    *evalcache = 0ULL;
+    *nnue = 0ULL;
+    for (k=0;k<number_of_workers;k++) {
+        *pawntt += hash_pawntt_memory(workers[k]);
+        *evalcache += hash_evalcache_memory(workers[k]);
+        if (workers[k]->pos.nnue_pos != NULL) {
+            *nnue += nnue_pos_memory(workers[k]->pos.nnue_pos);
+        }
+    }
+    if (ponder_parent.nnue_pos != NULL) {
+        *nnue += nnue_pos_memory(ponder_parent.nnue_pos);
+    }
+}
+
+#ifdef STATS
+void smp_collect_stats(struct search_stats *stats)
+{
+    struct search_worker *worker;
+    uint64_t             evals;
+    uint64_t             updates;
+    uint64_t             refreshes;
+    int                  k;
+
+    assert(stats != NULL);
+
+    stats_clear(stats);
+    for (k=0;k<number_of_workers;k++) {
+        worker = workers[k];
+        stats_add(stats, &worker->stats);
+        stats->nodes += worker->nodes;
+        stats->qnodes += worker->qnodes;
+        stats->tt_lookups += worker->tt_lookups;
+        stats->tt_hits += worker->tt_hits;
+        stats->evalcache_lookups += worker->evalcache_lookups;
+        stats->evalcache_hits += worker->evalcache_hits;
+        if (worker->pos.nnue_pos != NULL) {
+            nnue_get_stats(worker->pos.nnue_pos, &evals, &updates,
+                           &refreshes);
+            stats->nnue_evals += evals;
+            stats->nnue_updates += updates;
+            stats->nnue_refreshes += refreshes;
+        }
+    }
+}
+#endif
+
+time_t smp_time_to_depth(int depth)
+{
+    if ((depth < 0) || (depth > MAX_SEARCH_DEPTH)) {
+        return -1;
+    }
+    return depth_times[depth];
+}
+
 void smp_stop_all(void)
 {
-    mutex_lock(&stop_lock);
-    should_stop = true;
-    mutex_unlock(&stop_lock);
+    atomic_store(&should_stop.flag, true);
 }
 
 bool smp_should_stop(void)
 {
-    return atomic_load_explicit(&should_stop, memory_order_relaxed);
+    return atomic_load_explicit(&should_stop.flag, memory_order_relaxed);
 }
 
-int smp_complete_iteration(struct search_worker *worker)
+static int depth_index(int depth)
+{
+    return CLAMP(depth, 0, MAX_SEARCH_DEPTH+1);
+}
+
+static int next_depth(struct search_worker *worker, int depth)
 {
-    int new_depth;
+    int idx;
     int count;
     int k;
 
-    mutex_lock(&state_lock);
+    /* The main worker searches every depth */
+    if ((worker->id == 0) || (number_of_workers == 1)) {
+        return depth;
+    }
+
+    /*
+     * With many workers helpers pick the first depth that fewer than
+     * half of the workers are searching.
+     */
+    if (number_of_workers > SKIP_TABLE_MAX_WORKERS) {
+        while (depth <= MAX_SEARCH_DEPTH) {
+            count = 0;
+            for (k=depth;k<=(MAX_SEARCH_DEPTH+1);k++) {
+                count += atomic_load_explicit(&depth_workers[k],
+                                              memory_order_relaxed);
+            }
+            if (((count+1)/2) < (number_of_workers/2)) {
+                break;
+            }
+            depth++;
+        }
+        return depth;
+    }
+
+    /* Otherwise helpers skip depths according to the skip tables */
+    idx = (worker->id - 1)%SKIP_TABLE_SIZE;
+    while (((depth + skip_phase[idx])/skip_size[idx])%2 != 0) {
+        depth++;
+    }
+
+    return depth;
+}
+
+int smp_first_iteration(struct search_worker *worker)
+{
+    int depth;
+
+    if (worker->state->standalone || worker->ponder_alternative) {
+        return 1;
+    }
+    depth = next_depth(worker, 1);
+    atomic_fetch_add_explicit(&depth_workers[depth_index(depth)], 1,
+                              memory_order_relaxed);
+    return depth;
+}
+
+int smp_complete_iteration(struct search_worker *worker)
+{
+    time_t now;
+    int    depth;
+    int    last;
+    int    k;
+
+    /* Standalone searches just continue with the next depth */
+    if (worker->state->standalone) {
+        if (worker->depth > worker->state->completed_depth) {
+            worker->state->completed_depth = worker->depth;
+        }
+        return worker->depth + 1;
+    }
+
+    /*
+     * Workers searching an alternative to the ponder move do not
+     * contribute to the depth of the actual search.
+     */
+    if (worker->ponder_alternative) {
+        return worker->depth + 1;
+    }
 
     /*
      * If this is the first time completing this depth then
-     * update the completed_depth counter.
+     * update the completed depth counter.
      */
-    if (worker->depth > worker->state->completed_depth) {
-        worker->state->completed_depth = worker->depth;
+    depth = atomic_load_explicit(&completed_depth, memory_order_relaxed);
+    while ((worker->depth > depth) &&
+           !atomic_compare_exchange_weak_explicit(&completed_depth, &depth,
+                                                  worker->depth,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
     }
+    /*
+     * Depths that no worker completed, because all workers skipped
+     * them, are reached at the same time as the deeper depth.
+     */
+    if (worker->depth > depth) {
+        now = tc_elapsed_time();
+        last = (worker->depth < MAX_SEARCH_DEPTH)?
+                                            worker->depth:MAX_SEARCH_DEPTH;
+        for (k=depth+1;k<=last;k++) {
+            depth_times[k] = now;
+        }
+    }
+    TIMETRACE_INSTANT(worker, "complete iteration", worker->depth);
 
-    /* Calculate the next depth for this worker to search */
-    new_depth = worker->depth;
-    while (true) {
-        new_depth++;
-        count = 0;
-        for (k=0;k<number_of_workers;k++) {
-            if (workers[k].depth >= new_depth) {
-                count++;
+    /*
+     * Continue from the highest completed depth since searching
+     * depths that have already been completed by another worker
+     * adds little information.
+     */
+    if (depth < worker->depth) {
+        depth = worker->depth;
+    }
+    depth++;
+
+    /*
+     * Never skip past the maximum depth, since completing the
+     * maximum depth ends the search.
+     */
+    if (depth <= worker->state->sd) {
+        depth = next_depth(worker, depth);
+        depth = (depth > worker->state->sd)?worker->state->sd:depth;
+    }
+
+    /* Move the worker to the new depth in the per-depth counters */
+    atomic_fetch_sub_explicit(&depth_workers[depth_index(worker->depth)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&depth_workers[depth_index(depth)], 1,
+                              memory_order_relaxed);
+    return depth;
+}
+
+bool smp_use_abdada(struct search_worker *worker)
+{
+    return abdada_enabled && (number_of_workers > 1) &&
+            !worker->state->standalone;
+}
+
+bool smp_is_searched_elsewhere(struct search_worker *worker, uint64_t key,
+                               uint32_t move)
+{
+    uint64_t tag;
+    uint64_t entry;
+
+    tag = searching_tag(key, move);
+    entry = atomic_load_explicit(&searching_table[searching_index(tag)],
+                                 memory_order_relaxed);
+
+    return ((entry&(~SEARCHING_ID_MASK)) == tag) &&
+           ((int)(entry&SEARCHING_ID_MASK) != worker->id);
+}
+
+bool smp_start_move(struct search_worker *worker, uint64_t key, uint32_t move)
+{
+    uint64_t tag;
+    uint64_t expected;
+
+    /*
+     * Only claim empty slots so that a move being searched
+     * by another worker is never hidden.
+     */
+    tag = searching_tag(key, move);
+    expected = 0ULL;
+    return atomic_compare_exchange_strong_explicit(
+                                &searching_table[searching_index(tag)],
+                                &expected, tag|(uint64_t)worker->id,
+                                memory_order_relaxed, memory_order_relaxed);
+}
+
+void smp_finish_move(uint64_t key, uint32_t move)
+{
+    uint64_t tag;
+
+    tag = searching_tag(key, move);
+    atomic_store_explicit(&searching_table[searching_index(tag)], 0ULL,
+                          memory_order_relaxed);
+}
+
+int smp_completed_depth(struct gamestate *state)
+{
+    if (state->standalone) {
+        return state->completed_depth;
+    }
+    return atomic_load_explicit(&completed_depth, memory_order_relaxed);
+}
+
+bool smp_parallel_multipv(struct search_worker *worker)
+{
+    return (worker->multipv > 1) && (number_of_workers > 1) &&
+            !worker->state->standalone;
+}
+
+int smp_first_multipv_line(struct search_worker *worker)
+{
+    if (!smp_parallel_multipv(worker)) {
+        return 0;
+    }
+    return (number_of_workers >= worker->multipv)?
+                                worker->id%worker->multipv:worker->id;
+}
+
+int smp_next_multipv_line(struct search_worker *worker, int line)
+{
+    if (!smp_parallel_multipv(worker)) {
+        return line + 1;
+    }
+    return (number_of_workers >= worker->multipv)?
+                                worker->multipv:line+number_of_workers;
+}
+
+void smp_share_multipv_line(struct search_worker *worker)
+{
+    struct pvinfo *line;
+    uint32_t      move;
+    bool          found;
+    int           k;
+
+    line = &worker->mpv_lines[worker->mpvidx];
+    move = worker->mpv_moves[worker->mpvidx];
+
+    mutex_lock(&multipv_lock);
+
+    /*
+     * Lines that were last updated before the previous iteration are
+     * outdated. They are dropped so that the moves are searched again
+     * instead of being reported with their old depth and score.
+     */
+    k = 0;
+    while (k < nshared_lines) {
+        if (shared_lines[k].depth < (worker->depth-1)) {
+            remove_shared_line(k);
+            continue;
+        }
+        k++;
+    }
+
+    if (move != NOMOVE) {
+        /*
+         * The line is the best line among all moves that were not
+         * excluded. Lines for other moves that were searched to at most
+         * the same depth but claim a higher score are therefore outdated
+         * and are removed.
+         */
+        found = false;
+        k = 0;
+        while (k < nshared_lines) {
+            if (shared_moves[k] == move) {
+                found = true;
+            } else if ((shared_lines[k].depth <= line->depth) &&
+                       (shared_lines[k].score > line->score) &&
+                       !is_excluded_move(worker, shared_moves[k])) {
+                remove_shared_line(k);
+                continue;
             }
-            if (((count+1)/2) >= (number_of_workers/2)) {
+            k++;
+        }
+
+        /* Replace any line for the same move unless it is deeper */
+        for (k=0;found&&(k<nshared_lines);k++) {
+            if (shared_moves[k] == move) {
+                if (shared_lines[k].depth <= line->depth) {
+                    remove_shared_line(k);
+                    found = false;
+                }
                 break;
             }
         }
-        if (k == number_of_workers || (number_of_workers == 1)) {
-            break;
+
+        /* Insert the line in score order */
+        if (!found) {
+            if (nshared_lines == MAX_SHARED_LINES) {
+                nshared_lines--;
+            }
+            for (k=nshared_lines;k>0;k--) {
+                if (shared_lines[k-1].score >= line->score) {
+                    break;
+                }
+                shared_moves[k] = shared_moves[k-1];
+                shared_lines[k] = shared_lines[k-1];
+            }
+            shared_moves[k] = move;
+            shared_lines[k] = *line;
+            nshared_lines++;
         }
     }
 
-    mutex_unlock(&state_lock);
+    /* Pick up the lines found by other workers */
+    save_complete_lines(worker);
+    fetch_shared_lines(worker);
 
-    return new_depth;
+    mutex_unlock(&multipv_lock);
 }
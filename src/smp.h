@@ -36,6 +36,24 @@ void smp_create_workers(int nthreads);
 /* Destroy all workers */
 void smp_destroy_workers(void);
 
+/*
+ * Create a worker that is not part of the worker pool. The worker
+ * owns all its search tables and is only used for standalone searches
+ * driven by the caller, so several such workers can search different
+ * games concurrently. The transposition table is shared with all
+ * other workers.
+ *
+ * @return Returns the new worker, or NULL if it could not be created.
+ */
+struct search_worker* smp_create_standalone_worker(void);
+
+/*
+ * Destroy a worker created by smp_create_standalone_worker.
+ *
+ * @param worker The worker to destroy.
+ */
+void smp_destroy_standalone_worker(struct search_worker *worker);
+
 /*
  * Get the number of workers being used.
  *
@@ -43,9 +61,96 @@ void smp_destroy_workers(void);
  */
 int smp_number_of_workers(void);
 
+/*
+ * Enable or disable binding of workers to NUMA nodes. Only takes
+ * effect the next time workers are created.
+ *
+ * @param enabled If workers should be bound to NUMA nodes.
+ */
+void smp_set_numa_mode(bool enabled);
+
+/*
+ * Check if workers are bound to NUMA nodes.
+ *
+ * @return Returns true if NUMA mode is enabled.
+ */
+bool smp_numa_mode(void);
+
+/*
+ * Set the size of the pawn hash table of each worker. Only takes
+ * effect the next time workers are created. If a memory limit is set
+ * the tables are made smaller when needed to stay within the limit.
+ *
+ * @param size The size of the table (in MB).
+ */
+void smp_set_pawn_hash_size(int size);
+
+/*
+ * Get the size of the pawn hash table of each worker.
+ *
+ * @return Returns the size of the table (in MB).
+ */
+int smp_pawn_hash_size(void);
+
+/*
+ * Enable or disable pinning of each worker to its own processor. Takes
+ * precedence over NUMA mode. Only takes effect the next time workers
+ * are created.
+ *
+ * @param enabled If workers should be pinned to processors.
+ */
+void smp_set_pinning(bool enabled);
+
+/*
+ * Check if workers are pinned to processors.
+ *
+ * @return Returns true if pinning is enabled.
+ */
+bool smp_pinning(void);
+
+/*
+ * Enable or disable ABDADA. When enabled workers defer moves at
+ * non-PV nodes that are currently being searched by another worker.
+ *
+ * @param enabled Set to true to enable ABDADA.
+ */
+void smp_set_abdada_mode(bool enabled);
+
+/*
+ * Check if ABDADA is enabled.
+ *
+ * @return Returns true if ABDADA is enabled.
+ */
+bool smp_abdada_mode(void);
+
+/*
+ * Set the number of alternative opponent replies to search while
+ * pondering. Up to half of the workers search the most likely replies,
+ * other than the ponder move, according to the transposition table.
+ * This way the table is already populated if the opponent plays one of
+ * them. When the ponder move is played these workers join the normal
+ * search instead.
+ *
+ * @param nmoves The number of replies, zero disables wide pondering.
+ */
+void smp_set_wide_ponder_moves(int nmoves);
+
+/*
+ * Get the number of alternative opponent replies searched while pondering.
+ *
+ * @return Returns the number of replies.
+ */
+int smp_wide_ponder_moves(void);
+
 /* Indicate the start of a new game */
 void smp_newgame(void);
 
+/*
+ * Clear the evaluation caches of all workers. Should be called
+ * whenever the evaluation function changes.
+ */
+void smp_clear_eval_caches(void);
+
 /*
  * Start a new search.
  *
@@ -57,6 +162,56 @@ void smp_newgame(void);
 void smp_search(struct gamestate *state, bool pondering, bool use_book,
                 bool use_tablebases);
 
+/*
+ * Function used by smp_search_batch to get the next position to search.
+ * The function should setup the position and the search limits in the
+ * state.
+ *
+ * @param state The state to setup.
+ * @param data User data passed to smp_search_batch.
+ * @return Returns false if there are no more positions to search.
+ */
+typedef bool (*smp_batch_next_func_t)(struct gamestate *state, void *data);
+
+/*
+ * Function called by smp_search_batch when the search of a position
+ * has finished.
+ *
+ * @param state The searched state. The best move is available in the
+ *              best_move field.
+ * @param line The principal variation found by the search.
+ * @param data User data passed to smp_search_batch.
+ */
+typedef void (*smp_batch_done_func_t)(struct gamestate *state,
+                                      struct pvinfo *line, void *data);
+
+/*
+ * Search the position in a standalone state using a single worker
+ * in the calling thread. The search is independent of all other
+ * workers and is only limited by the depth and node limits in the
+ * state. The best move is stored in the best_move field of the state
+ * and the principal variation is available in mpv_lines[0] of the
+ * worker.
+ *
+ * @param worker The worker to search with.
+ * @param state The state to search. The standalone field must be set.
+ */
+void smp_search_standalone(struct search_worker *worker,
+                           struct gamestate *state);
+
+/*
+ * Search a number of positions concurrently. Each worker searches its own
+ * position independently of the other workers and then moves on to the
+ * next position until there are no more positions. The callbacks are
+ * serialized so they don't have to be thread safe.
+ *
+ * @param next Function used to get the next position to search.
+ * @param done Function called for each finished search.
+ * @param data User data passed to the callbacks.
+ */
+void smp_search_batch(smp_batch_next_func_t next, smp_batch_done_func_t done,
+                      void *data);
+
 /*
  * The number of nodes searched.
  *
@@ -71,6 +226,48 @@ uint64_t smp_nodes(void);
  */
 uint64_t smp_tbhits(void);
 
+/*
+ * Transposition table statistics for the latest search.
+ *
+ * @param lookups Location to store the total number of lookups at.
+ * @param hits Location to store the total number of hits at.
+ * @param stores Location to store the total number of stored items at.
+ * @param overwrites Location to store the number of stores that replaced
+ *                   an item for another position at.
+ */
+void smp_tt_stats(uint64_t *lookups, uint64_t *hits, uint64_t *stores,
+                  uint64_t *overwrites);
+
+/*
+ * Memory used by the search workers.
+ *
+ * @param worker_mem Location to store the size of the worker structures
+ *                   (search stacks, history tables etc.) at.
+ * @param pawntt Location to store the size of the pawn hash tables at.
+ * @param evalcache Location to store the size of the evaluation caches at.
+ * @param nnue Location to store the size of the NNUE positions at.
+ */
+void smp_memory_usage(uint64_t *worker_mem, uint64_t *pawntt,
+                      uint64_t *evalcache, uint64_t *nnue);
+
+#ifdef STATS
+/*
+ * Detailed search statistics for the latest search.
+ *
+ * @param stats Location to store the statistics at.
+ */
+void smp_collect_stats(struct search_stats *stats);
+#endif
+
+/*
+ * The time it took to complete a specific depth during the latest search.
+ *
+ * @param depth The depth.
+ * @return Returns the time in milliseconds, or -1 if the depth
+ *         was not completed.
+ */
+time_t smp_time_to_depth(int depth);
+
 /*
  * Stop all workers.
  */
@@ -83,6 +280,15 @@ void smp_stop_all(void);
  */
 bool smp_should_stop(void);
 
+/*
+ * Called by workers before starting the first search iteration.
+ *
+ * @param worker The worker.
+ * @return Returns the depth the worker should search to for the
+ *         first iteration.
+ */
+int smp_first_iteration(struct search_worker *worker);
+
 /*
  * Called by workers when they have finished a search iteration.
  *
@@ -92,4 +298,91 @@ bool smp_should_stop(void);
  */
 int smp_complete_iteration(struct search_worker *worker);
 
+/*
+ * Check if a worker should use ABDADA for the current search.
+ *
+ * @param worker The worker.
+ * @return Returns true if ABDADA should be used.
+ */
+bool smp_use_abdada(struct search_worker *worker);
+
+/*
+ * Check if a move is currently being searched by another worker.
+ *
+ * @param worker The worker.
+ * @param key The key of the position.
+ * @param move The move.
+ * @return Returns true if another worker is searching the move.
+ */
+bool smp_is_searched_elsewhere(struct search_worker *worker, uint64_t key,
+                               uint32_t move);
+
+/*
+ * Mark a move as being searched by a worker.
+ *
+ * @param worker The worker.
+ * @param key The key of the position.
+ * @param move The move.
+ * @return Returns true if the move was marked, in which case
+ *         smp_finish_move must be called when the search of the
+ *         move is done.
+ */
+bool smp_start_move(struct search_worker *worker, uint64_t key, uint32_t move);
+
+/*
+ * Remove the mark set by smp_start_move.
+ *
+ * @param key The key of the position.
+ * @param move The move.
+ */
+void smp_finish_move(uint64_t key, uint32_t move);
+
+/*
+ * Check if the multipv lines are distributed over the workers. This is
+ * the case when several lines are searched using more than one worker.
+ * Each worker then only searches some of the lines and the results are
+ * shared between the workers.
+ *
+ * @param worker The worker.
+ * @return Returns true if the lines are distributed.
+ */
+bool smp_parallel_multipv(struct search_worker *worker);
+
+/*
+ * Get the first multipv line to search in an iteration.
+ *
+ * @param worker The worker.
+ * @return Returns the index of the line.
+ */
+int smp_first_multipv_line(struct search_worker *worker);
+
+/*
+ * Get the next multipv line to search in an iteration.
+ *
+ * @param worker The worker.
+ * @param line The index of the line that was just searched.
+ * @return Returns the index of the next line, or the number of lines
+ *         if there are no more lines to search in this iteration.
+ */
+int smp_next_multipv_line(struct search_worker *worker, int line);
+
+/*
+ * Share the line that was just searched by a worker with the other
+ * workers. Afterwards the multipv lines of the worker are updated with
+ * the best lines found by all workers so far. The moves of these lines
+ * are excluded when the worker searches the following lines.
+ *
+ * @param worker The worker.
+ */
+void smp_share_multipv_line(struct search_worker *worker);
+
+/*
+ * Get the highest depth completed by any worker during the
+ * current search.
+ *
+ * @param state The game state.
+ * @return Returns the highest completed depth.
+ */
+int smp_completed_depth(struct gamestate *state);
+
 #endif
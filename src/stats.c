@@ -0,0 +1,221 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <string.h>
+#include <inttypes.h>
+#if defined(WINDOWS)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "stats.h"
+#include "debug.h"
+
+/* The maximum number of lines in the text format */
+#define MAX_LINES 9
+
+/* The maximum length of a line in the text format */
+#define MAX_LINE_LENGTH 256
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return (total > 0ULL)?(part*100.0)/total:0.0;
+}
+
+static double rate(uint64_t part, uint64_t total)
+{
+    return (total > 0ULL)?((double)part)/total:0.0;
+}
+
+/*
+ * Format statistics as a number of text lines. Returns the
+ * number of lines.
+ */
+static int format_lines(struct search_stats *stats,
+                        char lines[MAX_LINES][MAX_LINE_LENGTH])
+{
+    uint64_t *moves = stats->moves;
+    int      n = 0;
+
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Nodes: %"PRIu64", qsearch %.1f%%\n", stats->nodes,
+             percent(stats->qnodes, stats->nodes));
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Cutoffs: %"PRIu64", first move %.1f%%, qsearch %"PRIu64"\n",
+             stats->beta_cutoffs,
+             percent(stats->first_move_cutoffs, stats->beta_cutoffs),
+             stats->qsearch_cutoffs);
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Transposition table: %"PRIu64" lookups, hits %.1f%%, "
+             "cutoffs %"PRIu64", collisions %"PRIu64"\n", stats->tt_lookups,
+             percent(stats->tt_hits, stats->tt_lookups), stats->tt_cutoffs,
+             stats->tt_collisions);
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Null move: %"PRIu64" tries, cutoffs %.1f%%\n",
+             stats->nullmove_tries,
+             percent(stats->nullmove_cutoffs, stats->nullmove_tries));
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "LMR: %"PRIu64" reduced searches, re-searches %.1f%%\n",
+             stats->lmr_searches,
+             percent(stats->lmr_researches, stats->lmr_searches));
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Moves: tt %"PRIu64", good tactical %"PRIu64", "
+             "killer %"PRIu64", counter %"PRIu64", quiet %"PRIu64", "
+             "bad tactical %"PRIu64"\n", moves[STATS_MOVE_TT],
+             moves[STATS_MOVE_GOOD_TACTICAL], moves[STATS_MOVE_KILLER],
+             moves[STATS_MOVE_COUNTER], moves[STATS_MOVE_QUIET],
+             moves[STATS_MOVE_BAD_TACTICAL]);
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "NNUE: %"PRIu64" evaluations, %"PRIu64" incremental updates, "
+             "%"PRIu64" refreshes (incremental %.1f%%)\n", stats->nnue_evals,
+             stats->nnue_updates, stats->nnue_refreshes,
+             percent(stats->nnue_updates,
+                     stats->nnue_updates+stats->nnue_refreshes));
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Evaluation cache: %"PRIu64" lookups, hits %.1f%%\n",
+             stats->evalcache_lookups,
+             percent(stats->evalcache_hits, stats->evalcache_lookups));
+    snprintf(lines[n++], MAX_LINE_LENGTH,
+             "Tablebases: %"PRIu64" probes, cache hits %.1f%%, "
+             "%.2f us per table probe\n", stats->tb_probes,
+             percent(stats->tb_cache_hits, stats->tb_probes),
+             rate(stats->tb_probe_time,
+                  stats->tb_probes-stats->tb_cache_hits)/1000.0);
+
+    return n;
+}
+
+uint64_t stats_time(void)
+{
+#ifdef WINDOWS
+    LARGE_INTEGER count;
+    LARGE_INTEGER freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (count.QuadPart/freq.QuadPart)*1000000000ULL +
+           ((count.QuadPart%freq.QuadPart)*1000000000ULL)/freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void stats_clear(struct search_stats *stats)
+{
+    assert(stats != NULL);
+
+    memset(stats, 0, sizeof(struct search_stats));
+}
+
+void stats_add(struct search_stats *total, struct search_stats *stats)
+{
+    uint64_t *dst = (uint64_t*)total;
+    uint64_t *src = (uint64_t*)stats;
+    int      k;
+
+    assert(total != NULL);
+    assert(stats != NULL);
+
+    /* All fields are 64-bit counters */
+    for (k=0;k<(int)(sizeof(struct search_stats)/sizeof(uint64_t));k++) {
+        dst[k] += src[k];
+    }
+}
+
+void stats_print(FILE *fp, struct search_stats *stats)
+{
+    char lines[MAX_LINES][MAX_LINE_LENGTH];
+    int  nlines;
+    int  k;
+
+    assert(fp != NULL);
+    assert(stats != NULL);
+
+    nlines = format_lines(stats, lines);
+    for (k=0;k<nlines;k++) {
+        fputs(lines[k], fp);
+    }
+}
+
+void stats_print_json(FILE *fp, struct search_stats *stats, int indent)
+{
+    uint64_t *moves;
+
+    assert(fp != NULL);
+    assert(stats != NULL);
+
+    moves = stats->moves;
+    fprintf(fp, "{\n");
+    fprintf(fp, "%*s\"qsearchshare\": %.4f,\n", indent+2, "",
+            rate(stats->qnodes, stats->nodes));
+    fprintf(fp, "%*s\"cutoffs\": %"PRIu64",\n", indent+2, "",
+            stats->beta_cutoffs);
+    fprintf(fp, "%*s\"firstmovecutoffrate\": %.4f,\n", indent+2, "",
+            rate(stats->first_move_cutoffs, stats->beta_cutoffs));
+    fprintf(fp, "%*s\"qsearchcutoffs\": %"PRIu64",\n", indent+2, "",
+            stats->qsearch_cutoffs);
+    fprintf(fp, "%*s\"tthitrate\": %.4f,\n", indent+2, "",
+            rate(stats->tt_hits, stats->tt_lookups));
+    fprintf(fp, "%*s\"ttcutoffs\": %"PRIu64",\n", indent+2, "",
+            stats->tt_cutoffs);
+    fprintf(fp, "%*s\"ttcollisions\": %"PRIu64",\n", indent+2, "",
+            stats->tt_collisions);
+    fprintf(fp, "%*s\"nullmovecutoffrate\": %.4f,\n", indent+2, "",
+            rate(stats->nullmove_cutoffs, stats->nullmove_tries));
+    fprintf(fp, "%*s\"lmrresearchrate\": %.4f,\n", indent+2, "",
+            rate(stats->lmr_researches, stats->lmr_searches));
+    fprintf(fp, "%*s\"moves\": {\"tt\": %"PRIu64", \"goodtactical\": %"PRIu64
+            ", \"killer\": %"PRIu64", \"counter\": %"PRIu64", \"quiet\": %"
+            PRIu64", \"badtactical\": %"PRIu64"},\n", indent+2, "",
+            moves[STATS_MOVE_TT], moves[STATS_MOVE_GOOD_TACTICAL],
+            moves[STATS_MOVE_KILLER], moves[STATS_MOVE_COUNTER],
+            moves[STATS_MOVE_QUIET], moves[STATS_MOVE_BAD_TACTICAL]);
+    fprintf(fp, "%*s\"nnueevals\": %"PRIu64",\n", indent+2, "",
+            stats->nnue_evals);
+    fprintf(fp, "%*s\"nnueincrementalrate\": %.4f,\n", indent+2, "",
+            rate(stats->nnue_updates,
+                 stats->nnue_updates+stats->nnue_refreshes));
+    fprintf(fp, "%*s\"evalcachehitrate\": %.4f,\n", indent+2, "",
+            rate(stats->evalcache_hits, stats->evalcache_lookups));
+    fprintf(fp, "%*s\"tbprobes\": %"PRIu64",\n", indent+2, "",
+            stats->tb_probes);
+    fprintf(fp, "%*s\"tbcachehitrate\": %.4f,\n", indent+2, "",
+            rate(stats->tb_cache_hits, stats->tb_probes));
+    fprintf(fp, "%*s\"tbprobetimeus\": %.3f\n", indent+2, "",
+            rate(stats->tb_probe_time,
+                 stats->tb_probes-stats->tb_cache_hits)/1000.0);
+    fprintf(fp, "%*s}", indent, "");
+}
+
+void stats_log(struct search_stats *stats)
+{
+    char lines[MAX_LINES][MAX_LINE_LENGTH];
+    int  nlines;
+    int  k;
+
+    assert(stats != NULL);
+
+    nlines = format_lines(stats, lines);
+    for (k=0;k<nlines;k++) {
+        LOG_INFO1("%s", lines[k]);
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#ifndef STATS
+
+#define STATS_INC(worker, counter)
+#define STATS_ADD(worker, counter, value) ((void)(value))
+#define STATS_TIME() 0ULL
+
+#else
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* The different sources of moves returned by the move selector */
+enum {
+    STATS_MOVE_TT,
+    STATS_MOVE_GOOD_TACTICAL,
+    STATS_MOVE_KILLER,
+    STATS_MOVE_COUNTER,
+    STATS_MOVE_QUIET,
+    STATS_MOVE_BAD_TACTICAL,
+    STATS_NMOVE_SOURCES
+};
+
+/* Search statistics */
+struct search_stats {
+    /* Counters that are updated by the search */
+    uint64_t beta_cutoffs;
+    uint64_t first_move_cutoffs;
+    uint64_t qsearch_cutoffs;
+    uint64_t tt_cutoffs;
+    uint64_t tt_collisions;
+    uint64_t nullmove_tries;
+    uint64_t nullmove_cutoffs;
+    uint64_t lmr_searches;
+    uint64_t lmr_researches;
+    uint64_t moves[STATS_NMOVE_SOURCES];
+    uint64_t tb_probes;
+    uint64_t tb_cache_hits;
+    uint64_t tb_probe_time;     /* Time spent probing tables (ns) */
+
+    /* Counters collected from other parts of the engine */
+    uint64_t nodes;
+    uint64_t qnodes;
+    uint64_t tt_lookups;
+    uint64_t tt_hits;
+    uint64_t evalcache_lookups;
+    uint64_t evalcache_hits;
+    uint64_t nnue_evals;
+    uint64_t nnue_updates;
+    uint64_t nnue_refreshes;
+};
+
+#define STATS_INC(worker, counter) ((worker)->stats.counter++)
+#define STATS_ADD(worker, counter, value) ((worker)->stats.counter += (value))
+#define STATS_TIME() stats_time()
+
+/*
+ * Get a timestamp for measuring the time spent in parts of the engine.
+ *
+ * @return Returns the current time in nanoseconds.
+ */
+uint64_t stats_time(void);
+
+/*
+ * Clear statistics.
+ *
+ * @param stats The statistics to clear.
+ */
+void stats_clear(struct search_stats *stats);
+
+/*
+ * Add statistics to a total.
+ *
+ * @param total The total to add to.
+ * @param stats The statistics to add.
+ */
+void stats_add(struct search_stats *total, struct search_stats *stats);
+
+/*
+ * Print statistics in text format.
+ *
+ * @param fp The file to print to.
+ * @param stats The statistics to print.
+ */
+void stats_print(FILE *fp, struct search_stats *stats);
+
+/*
+ * Print statistics as a JSON object.
+ *
+ * @param fp The file to print to.
+ * @param stats The statistics to print.
+ * @param indent The indentation of the closing brace.
+ */
+void stats_print_json(FILE *fp, struct search_stats *stats, int indent);
+
+/*
+ * Write statistics to the log file.
+ *
+ * @param stats The statistics to log.
+ */
+void stats_log(struct search_stats *stats);
+
+#endif
+
+#endif
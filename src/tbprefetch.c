@@ -0,0 +1,310 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "tbprefetch.h"
+#include "bitboard.h"
+#include "thread.h"
+#include "debug.h"
+#include "tbprobe.h"
+
+/*
+ * Tables are prefetched once the number of pieces in the root position
+ * is at most this many pieces above the largest available tables.
+ */
+#define PREFETCH_DISTANCE 2
+
+/* The maximum number of tables to prefetch for a single position */
+#define MAX_TABLES 1024
+
+/* The number of bits used for each piece in a material signature */
+#define SIGNATURE_BITS 4
+#define SIGNATURE_MASK 0xFULL
+
+/* Number of pieces of each type, kings are not included */
+#define NSIGPIECES (NPIECES-2)
+
+/* The different requests that can be handled by the prefetch thread */
+enum {
+    REQUEST_NONE,
+    REQUEST_POSITION,
+    REQUEST_WARMUP,
+    REQUEST_EXIT
+};
+
+static bool initialized = false;
+static thread_t prefetch_thread;
+static event_t start_event;
+
+/* The pending request, protected by request_lock */
+static mutex_t request_lock;
+static int pending_request = REQUEST_NONE;
+static uint64_t request_signature;
+static int request_npieces;
+
+/* Held by the prefetch thread while a request is being handled */
+static mutex_t busy_lock;
+static atomic_bool cancel = false;
+
+/*
+ * Encode the material of a position as a signature with the number of
+ * pieces of each type (excluding kings) in SIGNATURE_BITS bits each.
+ */
+static uint64_t material_signature(struct position *pos)
+{
+    uint64_t sig;
+    int      piece;
+
+    sig = 0ULL;
+    for (piece=0;piece<NSIGPIECES;piece++) {
+        sig |= ((uint64_t)BITCOUNT(pos->bb_pieces[piece]))<<
+                                                    (piece*SIGNATURE_BITS);
+    }
+    return sig;
+}
+
+static int signature_count(uint64_t sig, int piece)
+{
+    return (int)((sig>>(piece*SIGNATURE_BITS))&SIGNATURE_MASK);
+}
+
+static int signature_npieces(uint64_t sig)
+{
+    int piece;
+    int n;
+
+    n = 2;
+    for (piece=0;piece<NSIGPIECES;piece++) {
+        n += signature_count(sig, piece);
+    }
+    return n;
+}
+
+/* Prefetch the table for a signature. Returns true if the table exists. */
+static bool prefetch_table(uint64_t sig)
+{
+    static const char piece_chars[] = "PNBRQ";
+    char name[32];
+    int  idx;
+    int  color;
+    int  type;
+    int  k;
+
+    /* Table names list the pieces of each side as K, Q, R, B, N, P */
+    idx = 0;
+    for (color=WHITE;color<=BLACK;color++) {
+        name[idx++] = 'K';
+        for (type=QUEEN;type>=PAWN;type-=2) {
+            for (k=0;k<signature_count(sig, type+color);k++) {
+                name[idx++] = piece_chars[type/2];
+            }
+        }
+        if (color == WHITE) {
+            name[idx++] = 'v';
+        }
+    }
+    name[idx] = '\0';
+
+    return tb_prefetch_wdl(name);
+}
+
+/*
+ * Prefetch the tables for all material configurations that can be reached
+ * from a signature by captures. The configurations are visited in order of
+ * the number of captures needed, so the tables that are likely to be
+ * probed first are also prefetched first.
+ */
+static void prefetch_captures(uint64_t root)
+{
+    uint64_t queue[MAX_TABLES];
+    uint64_t sig;
+    int      head;
+    int      tail;
+    int      piece;
+    int      nfound;
+    int      k;
+
+    head = 0;
+    tail = 0;
+    nfound = 0;
+    queue[tail++] = root;
+    while ((head < tail) && !atomic_load(&cancel)) {
+        sig = queue[head++];
+        if ((signature_npieces(sig) <= (int)TB_LARGEST) &&
+            prefetch_table(sig)) {
+            nfound++;
+        }
+
+        /* Add all configurations where one more piece has been captured */
+        for (piece=0;piece<NSIGPIECES;piece++) {
+            if (signature_count(sig, piece) == 0) {
+                continue;
+            }
+            sig -= 1ULL<<(piece*SIGNATURE_BITS);
+            for (k=0;k<tail;k++) {
+                if (queue[k] == sig) {
+                    break;
+                }
+            }
+            if ((k == tail) && (tail < MAX_TABLES)) {
+                queue[tail++] = sig;
+            }
+            sig += 1ULL<<(piece*SIGNATURE_BITS);
+        }
+    }
+
+    LOG_INFO2("Prefetched %d tablebase files\n", nfound);
+}
+
+/*
+ * Prefetch the tables for all material configurations with pieces of
+ * the types [piece, NSIGPIECES) added to a signature.
+ */
+static int prefetch_all(uint64_t sig, int piece, int nleft)
+{
+    int nfound;
+    int k;
+
+    if (atomic_load(&cancel)) {
+        return 0;
+    }
+    if (piece == NSIGPIECES) {
+        return (sig != 0ULL) && prefetch_table(sig);
+    }
+
+    nfound = 0;
+    for (k=0;k<=nleft;k++) {
+        nfound += prefetch_all(sig+((uint64_t)k<<(piece*SIGNATURE_BITS)),
+                               piece+1, nleft-k);
+    }
+    return nfound;
+}
+
+static thread_retval_t prefetch_thread_func(void *data)
+{
+    uint64_t sig;
+    int      request;
+    int      npieces;
+    int      nfound;
+
+    (void)data;
+
+    while (true) {
+        event_wait(&start_event);
+
+        mutex_lock(&busy_lock);
+        mutex_lock(&request_lock);
+        request = pending_request;
+        sig = request_signature;
+        npieces = request_npieces;
+        pending_request = REQUEST_NONE;
+        mutex_unlock(&request_lock);
+
+        if (request == REQUEST_EXIT) {
+            mutex_unlock(&busy_lock);
+            break;
+        } else if (request == REQUEST_POSITION) {
+            prefetch_captures(sig);
+        } else if (request == REQUEST_WARMUP) {
+            nfound = prefetch_all(0ULL, 0, npieces-2);
+            LOG_INFO1("Warmed up %d tablebase files\n", nfound);
+        }
+        mutex_unlock(&busy_lock);
+    }
+
+    return (thread_retval_t)0;
+}
+
+static void post_request(int request, uint64_t sig, int npieces)
+{
+    mutex_lock(&request_lock);
+    pending_request = request;
+    request_signature = sig;
+    request_npieces = npieces;
+    mutex_unlock(&request_lock);
+    event_set(&start_event);
+}
+
+void tbprefetch_init(void)
+{
+    if (initialized) {
+        return;
+    }
+
+    mutex_init(&request_lock);
+    mutex_init(&busy_lock);
+    event_init(&start_event);
+    atomic_store(&cancel, false);
+    pending_request = REQUEST_NONE;
+    thread_create(&prefetch_thread, prefetch_thread_func, NULL);
+    initialized = true;
+}
+
+void tbprefetch_destroy(void)
+{
+    if (!initialized) {
+        return;
+    }
+
+    atomic_store(&cancel, true);
+    post_request(REQUEST_EXIT, 0ULL, 0);
+    thread_join(&prefetch_thread);
+    event_destroy(&start_event);
+    mutex_destroy(&busy_lock);
+    mutex_destroy(&request_lock);
+    initialized = false;
+}
+
+void tbprefetch_position(struct position *pos)
+{
+    assert(pos != NULL);
+
+    if (!initialized || (TB_LARGEST == 0) ||
+        (BITCOUNT(pos->bb_all) > ((int)TB_LARGEST+PREFETCH_DISTANCE))) {
+        return;
+    }
+
+    post_request(REQUEST_POSITION, material_signature(pos), 0);
+}
+
+void tbprefetch_warmup(int npieces)
+{
+    if (!initialized || (TB_LARGEST == 0) || (npieces < 3)) {
+        return;
+    }
+
+    post_request(REQUEST_WARMUP, 0ULL, MIN(npieces, (int)TB_LARGEST));
+}
+
+void tbprefetch_cancel(void)
+{
+    if (!initialized) {
+        return;
+    }
+
+    /* Wait for the current request to be aborted and drop pending ones */
+    atomic_store(&cancel, true);
+    mutex_lock(&busy_lock);
+    mutex_lock(&request_lock);
+    pending_request = REQUEST_NONE;
+    mutex_unlock(&request_lock);
+    atomic_store(&cancel, false);
+    mutex_unlock(&busy_lock);
+}
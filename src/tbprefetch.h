@@ -0,0 +1,60 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TBPREFETCH_H
+#define TBPREFETCH_H
+
+#include "chess.h"
+
+/*
+ * Prefetching of tablebase files. Fathom maps tablebase files the first
+ * time they are probed, which can stall the search on disk I/O when the
+ * game transitions into an endgame. A background thread maps the WDL
+ * tables that the search is likely to probe soon and asks the operating
+ * system to read them into memory ahead of time.
+ */
+
+/* Start the prefetch thread */
+void tbprefetch_init(void);
+
+/* Stop the prefetch thread */
+void tbprefetch_destroy(void);
+
+/*
+ * Prefetch the WDL tables that can be reached by captures from a
+ * position. Nothing is done unless the position is close to being
+ * covered by the tablebases. The request is handled in the background.
+ *
+ * @param pos The position.
+ */
+void tbprefetch_position(struct position *pos);
+
+/*
+ * Prefetch all available WDL tables with a limited number of pieces.
+ * The request is handled in the background.
+ *
+ * @param npieces The maximum number of pieces, including kings.
+ */
+void tbprefetch_warmup(int npieces);
+
+/*
+ * Cancel any ongoing prefetch and wait for the prefetch thread to become
+ * idle. Must be called before the tablebases are re-initialized.
+ */
+void tbprefetch_cancel(void);
+
+#endif
@@ -17,7 +17,10 @@
  */
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 
 #include "test.h"
 #include "config.h"
@@ -33,6 +36,8 @@
 #include "engine.h"
 #include "timectl.h"
 #include "smp.h"
+#include "thread.h"
+#include "nnue.h"
 
 /* Depth to search the benchmark positions to */
 #define BENCH_DEPTH 15
@@ -73,114 +78,543 @@ static char *positions[] = {
     "2K5/r6k/7p/4N3/5P2/8/8/8 b - - 0 1"
 };
 
-static void perft(struct position *pos, int depth, uint32_t *nleafs)
+/* Entry in the perft hash table */
+struct perft_entry {
+    /* The position key xor:ed with the data */
+    uint64_t key;
+    /* The number of leafs in the upper bits and the depth in the lower bits */
+    uint64_t data;
+};
+
+/*
+ * Hash table used to avoid counting the leafs of transpositions more than
+ * once. The table is shared by all perft threads without locking. Instead
+ * the key is stored xor:ed with the data so that entries that are torn by
+ * concurrent writes are detected and ignored.
+ */
+struct perft_hash {
+    struct perft_entry *table;
+    uint64_t           mask;
+};
+
+/* Shared state for a parallel perft run */
+struct perft_task {
+    struct position   *pos;
+    struct perft_hash *hash;
+    struct movelist   *list;
+    uint64_t          *nleafs;
+    int               depth;
+    atomic_int        next_move;
+};
+
+static bool perft_hash_probe(struct perft_hash *hash, uint64_t key, int depth,
+                             uint64_t *nleafs)
+{
+    struct perft_entry *entry;
+    uint64_t           data;
+
+    entry = &hash->table[key&hash->mask];
+    data = entry->data;
+    if (((entry->key^data) != key) || ((int)(data&0xFF) != depth)) {
+        return false;
+    }
+    *nleafs = data >> 8;
+    return true;
+}
+
+static void perft_hash_store(struct perft_hash *hash, uint64_t key, int depth,
+                             uint64_t nleafs)
+{
+    struct perft_entry *entry;
+    uint64_t           data;
+
+    entry = &hash->table[key&hash->mask];
+    data = (nleafs << 8)|(uint64_t)depth;
+    entry->key = key^data;
+    entry->data = data;
+}
+
+static uint64_t perft(struct position *pos, int depth, struct perft_hash *hash)
 {
     struct movelist list;
+    uint64_t        nleafs;
     int             k;
 
     /* Check if its time to stop */
     if (depth == 0) {
-        (*nleafs)++;
-        return;
+        return 1;
+    }
+
+    /*
+     * Check if the subtree has already been counted. Subtrees of
+     * depth 1 are never stored so there is no need to probe them.
+     */
+    if ((depth > 1) && (hash != NULL) &&
+        perft_hash_probe(hash, pos->key, depth, &nleafs)) {
+        return nleafs;
+    }
+
+    /*
+     * At the last ply the leafs can be counted directly
+     * without making the moves.
+     */
+    gen_legal_moves(pos, &list);
+    if (depth == 1) {
+        return list.size;
     }
 
     /* Search all moves */
-    gen_moves(pos, &list);
+    nleafs = 0ULL;
     for (k=0;k<list.size;k++) {
-        if (!board_make_move(pos, list.moves[k])) {
-            continue;
-        }
-        perft(pos, depth-1, nleafs);
+        (void)board_make_move(pos, list.moves[k]);
+        nleafs += perft(pos, depth-1, hash);
         board_unmake_move(pos);
     }
+
+    if (hash != NULL) {
+        perft_hash_store(hash, pos->key, depth, nleafs);
+    }
+
+    return nleafs;
 }
 
-void test_run_perft(struct position *pos, int depth)
+/*
+ * Thread function for a parallel perft run. Each thread works on its
+ * own copy of the position and picks root moves from the shared list
+ * until all of them have been counted.
+ */
+static thread_retval_t perft_thread_func(void *data)
 {
-    uint32_t nleafs;
-    char     fenstr[FEN_MAX_LENGTH];
+    struct perft_task *task = data;
+    struct position   *pos;
+    int               k;
+
+    pos = malloc(sizeof(struct position));
+    *pos = *task->pos;
+    if (engine_using_nnue) {
+        pos->nnue_pos = nnue_create_pos();
+        nnue_copy_pos(task->pos->nnue_pos, pos->nnue_pos);
+    }
+
+    while ((k=atomic_fetch_add(&task->next_move, 1)) < task->list->size) {
+        (void)board_make_move(pos, task->list->moves[k]);
+        task->nleafs[k] = perft(pos, task->depth-1, task->hash);
+        board_unmake_move(pos);
+    }
+
+    if (engine_using_nnue) {
+        nnue_destroy_pos(pos->nnue_pos);
+    }
+    free(pos);
+
+    return (thread_retval_t)0;
+}
+
+/*
+ * Count the number of leafs below each legal root move. The root moves
+ * are split between the same number of threads as is used for searching.
+ */
+static uint64_t perft_root(struct position *pos, int depth, int hash_size,
+                           struct movelist *list, uint64_t *nleafs)
+{
+    struct perft_task task;
+    struct perft_hash hash;
+    thread_t          threads[MAX_WORKERS];
+    uint64_t          nentries;
+    uint64_t          ntotal;
+    int               nthreads;
+    int               k;
+
+    gen_legal_moves(pos, list);
+
+    /* Allocate the hash table, rounded down to a power of two entries */
+    hash.table = NULL;
+    if (hash_size > 0) {
+        nentries = ((uint64_t)hash_size*1024*1024)/sizeof(struct perft_entry);
+        while ((nentries&(nentries-1)) != 0) {
+            nentries &= nentries - 1;
+        }
+        hash.table = calloc(nentries, sizeof(struct perft_entry));
+        hash.mask = nentries - 1;
+    }
+
+    task.pos = pos;
+    task.hash = (hash.table != NULL)?&hash:NULL;
+    task.list = list;
+    task.nleafs = nleafs;
+    task.depth = depth;
+    atomic_init(&task.next_move, 0);
+
+    nthreads = MIN(smp_number_of_workers(), list->size);
+    for (k=0;k<nthreads;k++) {
+        thread_create(&threads[k], (thread_func_t)perft_thread_func,
+                      &task);
+    }
+    for (k=0;k<nthreads;k++) {
+        thread_join(&threads[k]);
+    }
+    free(hash.table);
+
+    ntotal = 0ULL;
+    for (k=0;k<list->size;k++) {
+        ntotal += nleafs[k];
+    }
+    return ntotal;
+}
+
+void test_run_perft(struct position *pos, int depth, int hash_size)
+{
+    struct movelist list;
+    uint64_t        nleafs[MAX_MOVES];
+    uint64_t        ntotal;
+    time_t          start;
 
     assert(valid_position(pos));
     assert(depth > 0);
 
-    fen_build_string(pos, fenstr);
-
-    nleafs = 0;
-    perft(pos, depth, &nleafs);
-    printf("Nodes: %u\n", nleafs);
+    start = get_current_time();
+    ntotal = perft_root(pos, depth, hash_size, &list, nleafs);
+    printf("Nodes: %"PRIu64"\n", ntotal);
+    printf("Time: %.2fs\n", (get_current_time() - start)/1000.0);
 }
 
-void test_run_divide(struct position *pos, int depth)
+void test_run_divide(struct position *pos, int depth, int hash_size)
 {
     struct movelist list;
-    uint32_t        nleafs;
-    uint32_t        ntotal;
+    uint64_t        nleafs[MAX_MOVES];
+    uint64_t        ntotal;
     int             k;
     char            movestr[MAX_MOVESTR_LENGTH];
-    char            fenstr[FEN_MAX_LENGTH];
 
     assert(valid_position(pos));
     assert(depth > 0);
 
-    fen_build_string(pos, fenstr);
-
-    ntotal = 0;
-    gen_moves(pos, &list);
+    ntotal = perft_root(pos, depth, hash_size, &list, nleafs);
     for (k=0;k<list.size;k++) {
-        if (!board_make_move(pos, list.moves[k])) {
-            continue;
-        }
-        nleafs = 0;
-        perft(pos, depth-1, &nleafs);
-        ntotal += nleafs;
         move2str(list.moves[k], movestr);
-        printf("%s %u\n", movestr, nleafs);
-        board_unmake_move(pos);
+        printf("%s %"PRIu64"\n", movestr, nleafs[k]);
     }
 
     printf("Moves: %d\n", list.size);
-    printf("Leafs: %u\n", ntotal);
+    printf("Leafs: %"PRIu64"\n", ntotal);
+}
+
+/*
+ * Read benchmark positions from a file with one FEN string per line.
+ * Empty lines are ignored.
+ */
+static char** read_bench_positions(char *file, int *npos)
+{
+    FILE *fp;
+    char line[FEN_MAX_LENGTH];
+    char **fens;
+    char **tmp;
+    int  size;
+
+    *npos = 0;
+    fp = fopen(file, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    size = 0;
+    fens = NULL;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (*npos == size) {
+            size = (size == 0)?32:size*2;
+            tmp = realloc(fens, size*sizeof(char*));
+            if (tmp == NULL) {
+                break;
+            }
+            fens = tmp;
+        }
+        fens[*npos] = strdup(line);
+        (*npos)++;
+    }
+    fclose(fp);
+
+    return fens;
 }
 
-void test_run_benchmark(void)
+char** test_bench_positions(int *npos)
+{
+    assert(npos != NULL);
+
+    *npos = sizeof(positions)/sizeof(char*);
+    return positions;
+}
+
+void test_init_bench_options(struct bench_options *options)
+{
+    assert(options != NULL);
+
+    options->threads = 1;
+    options->hash_size = DEFAULT_MAIN_HASH_SIZE;
+    options->depth = BENCH_DEPTH;
+    options->nodes = 0ULL;
+    options->movetime = 0;
+    options->fen_file = NULL;
+    options->json = false;
+    options->scaling = 0;
+    options->pin = false;
+}
+
+/* Accumulated result of a benchmark run */
+struct bench_result {
+    uint64_t nodes;
+    uint64_t tt_lookups;
+    uint64_t tt_hits;
+    time_t   time;
+#ifdef STATS
+    struct search_stats stats;
+#endif
+};
+
+/*
+ * Search all benchmark positions with the current set of workers. If
+ * verbose is set then statistics are printed for each position.
+ */
+static void run_bench_positions(struct gamestate *state,
+                                struct bench_options *options, char **fens,
+                                int npos, bool verbose,
+                                struct bench_result *result)
 {
-    struct gamestate *state;
     int              k;
-    int              npos;
+    int              l;
+    int              depth;
+    int              nprinted;
     uint64_t         nodes;
+    uint64_t         lookups;
+    uint64_t         hits;
+    uint64_t         stores;
+    uint64_t         overwrites;
     time_t           start;
-    time_t           total;
+    time_t           elapsed;
+#ifdef STATS
+    struct search_stats stats;
+#endif
 
-    hash_tt_destroy_table();
-    hash_tt_create_table(DEFAULT_MAIN_HASH_SIZE);
-    smp_destroy_workers();
-    smp_create_workers(1);
+    /* Start from an empty transposition table to get repeatable results */
+    hash_tt_clear_table();
 
-    state = create_game_state();
-    nodes = 0ULL;
-    total = 0;
-    npos = sizeof(positions)/sizeof(char*);
+    memset(result, 0, sizeof(struct bench_result));
+    nprinted = 0;
     for (k=0;k<npos;k++) {
-        board_setup_from_fen(&state->pos, positions[k]);
-        tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
+        if (!board_setup_from_fen(&state->pos, fens[k])) {
+            fprintf(stderr, "Invalid position: %s\n", fens[k]);
+            continue;
+        }
+        if (options->movetime > 0) {
+            tc_configure_time_control(options->movetime, 0, 0,
+                                      TC_FIXED_TIME|TC_TIME_LIMIT);
+        } else {
+            tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
+        }
         smp_newgame();
-        state->sd = BENCH_DEPTH;
+        state->sd = options->depth;
+        state->max_nodes = options->nodes;
         state->silent = true;
         state->move_filter.size = 0;
         state->exit_on_mate = true;
 
         start = get_current_time();
+        tc_start_clock();
         smp_search(state, false, false, false);
-        total += (get_current_time() - start);
-        nodes += smp_nodes();
+        tc_stop_clock();
+        elapsed = get_current_time() - start;
+        nodes = smp_nodes();
+        smp_tt_stats(&lookups, &hits, &stores, &overwrites);
+        depth = state->completed_depth;
+        result->time += elapsed;
+        result->nodes += nodes;
+        result->tt_lookups += lookups;
+        result->tt_hits += hits;
+#ifdef STATS
+        smp_collect_stats(&stats);
+        stats_add(&result->stats, &stats);
+#endif
 
-        printf("#");
+        if (!verbose) {
+            continue;
+        }
+        if (options->json) {
+            printf("%s    {\"fen\": \"%s\", \"nodes\": %"PRIu64", "
+                   "\"time\": %d, \"nps\": %"PRIu64", "
+                   "\"tthitrate\": %.4f, \"depth\": %d, "
+                   "\"timetodepth\": [", (nprinted > 0)?",\n":"",
+                   fens[k], nodes, (int)elapsed,
+                   (uint64_t)(nodes*1000)/(MAX(elapsed, 1)),
+                   (lookups > 0)?((double)hits)/lookups:0.0, depth);
+            for (l=1;l<=depth;l++) {
+                printf("%s%d", (l > 1)?", ":"", (int)smp_time_to_depth(l));
+            }
+            printf("]}");
+        } else {
+            printf("%2d: nodes %"PRIu64", time %.2fs, %.2fkN/s, "
+                   "tt hits %.1f%%, depth %d in %.2fs\n", k+1, nodes,
+                   elapsed/1000.0, ((double)nodes)/(MAX(elapsed, 1)),
+                   (lookups > 0)?(hits*100.0)/lookups:0.0, depth,
+                   smp_time_to_depth(depth)/1000.0);
+        }
+        nprinted++;
+    }
+    if (verbose && options->json && (nprinted > 0)) {
+        printf("\n");
     }
-    printf("\n");
+}
 
-    printf("Total time: %.2fs\n", total/1000.0);
-    printf("Total number of nodes: %"PRIu64"\n", nodes);
-    printf("Speed: %.2fkN/s\n", ((double)nodes)/(total/1000.0)/1000);
+static void print_json_header(struct bench_options *options)
+{
+    printf("{\n");
+    printf("  \"version\": \"%s %s (%s)\",\n", APP_NAME, APP_VERSION,
+           APP_ARCH);
+    printf("  \"threads\": %d,\n", options->threads);
+    printf("  \"hash\": %d,\n", options->hash_size);
+    printf("  \"depth\": %d,\n", options->depth);
+    printf("  \"nodes\": %"PRIu64",\n", options->nodes);
+    printf("  \"movetime\": %d,\n", options->movetime);
+    printf("  \"pin\": %s,\n", options->pin?"true":"false");
+}
+
+/*
+ * Run the benchmark positions with an increasing number of threads
+ * (1, 2, 4, ..., options->scaling) and report how the search scales
+ * compared to a single thread.
+ */
+static void run_scaling(struct gamestate *state,
+                        struct bench_options *options, char **fens, int npos)
+{
+    struct bench_result base;
+    struct bench_result result;
+    int                 nthreads;
+    uint64_t            nps;
+    uint64_t            base_nps;
+
+    if (options->json) {
+        print_json_header(options);
+        printf("  \"scaling\": [\n");
+    } else {
+        printf("Threads       Time          Nodes        kN/s  "
+               "NPS scaling  Speedup  Overhead\n");
+    }
+
+    base_nps = 1;
+    memset(&base, 0, sizeof(struct bench_result));
+    nthreads = 1;
+    while (true) {
+        smp_destroy_workers();
+        smp_create_workers(nthreads);
+        run_bench_positions(state, options, fens, npos, false, &result);
+        nps = (uint64_t)(result.nodes*1000)/(MAX(result.time, 1));
+        if (nthreads == 1) {
+            base = result;
+            base_nps = MAX(nps, 1);
+        }
+
+        if (options->json) {
+            printf("    {\"threads\": %d, \"time\": %d, "
+                   "\"nodes\": %"PRIu64", \"nps\": %"PRIu64", "
+                   "\"npsscaling\": %.3f, \"speedup\": %.3f, "
+                   "\"overhead\": %.3f}%s\n", nthreads, (int)result.time,
+                   result.nodes, nps, ((double)nps)/base_nps,
+                   ((double)base.time)/(MAX(result.time, 1)),
+                   ((double)result.nodes)/(MAX(base.nodes, 1)),
+                   (nthreads < options->scaling)?",":"");
+        } else {
+            printf("%7d  %8.2fs  %13"PRIu64"  %10.2f  %11.2f  %7.2f  %8.2f\n",
+                   nthreads, result.time/1000.0, result.nodes,
+                   ((double)result.nodes)/(MAX(result.time, 1)),
+                   ((double)nps)/base_nps,
+                   ((double)base.time)/(MAX(result.time, 1)),
+                   ((double)result.nodes)/(MAX(base.nodes, 1)));
+        }
+
+        if (nthreads == options->scaling) {
+            break;
+        }
+        nthreads = MIN(nthreads*2, options->scaling);
+    }
+
+    if (options->json) {
+        printf("  ]\n");
+        printf("}\n");
+    }
+}
+
+void test_run_benchmark(struct bench_options *options)
+{
+    struct gamestate    *state;
+    struct bench_result result;
+    char                **fens;
+    int                 npos;
+    int                 k;
+
+    assert(options != NULL);
+
+    /* Get the positions to search */
+    if (options->fen_file != NULL) {
+        fens = read_bench_positions(options->fen_file, &npos);
+        if (npos == 0) {
+            fprintf(stderr, "No positions found in %s\n", options->fen_file);
+            free(fens);
+            return;
+        }
+    } else {
+        fens = positions;
+        npos = sizeof(positions)/sizeof(char*);
+    }
+
+    smp_set_pinning(options->pin);
+    hash_tt_destroy_table();
+    hash_tt_create_table(options->hash_size);
+    state = create_game_state();
+
+    if (options->scaling > 0) {
+        run_scaling(state, options, fens, npos);
+    } else {
+        smp_destroy_workers();
+        smp_create_workers(options->threads);
+        if (options->json) {
+            print_json_header(options);
+            printf("  \"positions\": [\n");
+        }
+
+        run_bench_positions(state, options, fens, npos, true, &result);
+
+        if (options->json) {
+            printf("  ],\n");
+            printf("  \"totaltime\": %d,\n", (int)result.time);
+            printf("  \"totalnodes\": %"PRIu64",\n", result.nodes);
+            printf("  \"nps\": %"PRIu64",\n",
+                   (uint64_t)(result.nodes*1000)/(MAX(result.time, 1)));
+            printf("  \"tthitrate\": %.4f", (result.tt_lookups > 0)?
+                            ((double)result.tt_hits)/result.tt_lookups:0.0);
+#ifdef STATS
+            printf(",\n  \"stats\": ");
+            stats_print_json(stdout, &result.stats, 2);
+#endif
+            printf("\n}\n");
+        } else {
+            printf("Total time: %.2fs\n", result.time/1000.0);
+            printf("Total number of nodes: %"PRIu64"\n", result.nodes);
+            printf("Speed: %.2fkN/s\n",
+                   ((double)result.nodes)/(MAX(result.time, 1)));
+#ifdef STATS
+            printf("\n");
+            stats_print(stdout, &result.stats);
+#endif
+        }
+    }
 
     destroy_game_state(state);
+    if (fens != positions) {
+        for (k=0;k<npos;k++) {
+            free(fens[k]);
+        }
+        free(fens);
+    }
 }
@@ -22,15 +22,18 @@
 
 /*
  * Run perft on a specific position. Perft results can be compared with the
- * engine ROCE.
+ * engine ROCE. The root moves are split between the same number of threads
+ * as is used for searching.
  *
  * Perft info: http://www.rocechess.ch/perft.html
  * ROCE: http://www.rocechess.ch/rocee.html
  *
  * @param pos The position to run perft for.
  * @param depth The depth to run perft to.
+ * @param hash_size The size (in MB) of the hash table used to detect
+ *                  transpositions, or 0 to not use a hash table.
  */
-void test_run_perft(struct position *pos, int depth);
+void test_run_perft(struct position *pos, int depth, int hash_size);
 
 /*
  * Run divide on a specific position. Divide is a variant of perft that counts
@@ -43,10 +46,57 @@ void test_run_perft(struct position *pos, int depth);
  *
  * @param pos The position to run divide for.
  * @param depth The depth to run divide to.
+ * @param hash_size The size (in MB) of the hash table used to detect
+ *                  transpositions, or 0 to not use a hash table.
  */
-void test_run_divide(struct position *pos, int depth);
+void test_run_divide(struct position *pos, int depth, int hash_size);
 
-/* Run a benchmark to check evaluate the performance of the engine */
-void test_run_benchmark(void);
+/*
+ * Get the built-in benchmark positions.
+ *
+ * @param npos Location to store the number of positions at.
+ * @return Returns an array of FEN strings.
+ */
+char** test_bench_positions(int *npos);
+
+/* Options for the benchmark */
+struct bench_options {
+    /* The number of threads to search with */
+    int threads;
+    /* The size of the main transposition table (in MB) */
+    int hash_size;
+    /* The depth to search each position to */
+    int depth;
+    /* The maximum number of nodes to search per position, or 0 for no limit */
+    uint64_t nodes;
+    /* The time to search each position for (in ms), or 0 for no limit */
+    int movetime;
+    /* File with one FEN string per line, or NULL for the built-in positions */
+    char *fen_file;
+    /* Flag indicating if the result should be reported as JSON */
+    bool json;
+    /*
+     * If larger than 0 then the positions are searched with 1, 2, 4, ...
+     * threads up to this number and the scaling is reported.
+     */
+    int scaling;
+    /* Flag indicating if worker threads should be pinned to cores */
+    bool pin;
+};
+
+/*
+ * Initialize benchmark options to the default values.
+ *
+ * @param options The options to initialize.
+ */
+void test_init_bench_options(struct bench_options *options);
+
+/*
+ * Run a benchmark to evaluate the performance of the engine. Statistics
+ * are reported for each position as well as for the whole run.
+ *
+ * @param options The benchmark options.
+ */
+void test_run_benchmark(struct bench_options *options);
 
 #endif
@@ -15,9 +15,137 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+#ifdef WINDOWS
+/* Processor groups require Windows 7 or later */
+#if !defined(_WIN32_WINNT) || (_WIN32_WINNT < 0x0601)
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601
+#endif
+#endif
+#include <string.h>
+#include <time.h>
+
 #include "thread.h"
 
+/* The maximum number of NUMA nodes that are considered */
+#define MAX_NUMA_NODES 64
+
 #ifdef WINDOWS
+/* The maximum number of processor groups that are considered */
+#define MAX_PROCESSOR_GROUPS 64
+
+/*
+ * The processors of each group that the process is allowed to run on,
+ * for instance when started with "start /affinity". Read once, before
+ * any thread has been bound, since binding a thread to another group
+ * changes the groups of the process.
+ */
+static KAFFINITY allowed_cpus[MAX_PROCESSOR_GROUPS];
+static INIT_ONCE allowed_cpus_once = INIT_ONCE_STATIC_INIT;
+
+static KAFFINITY full_group_mask(WORD group)
+{
+    DWORD count;
+
+    count = GetActiveProcessorCount(group);
+    return (count >= (DWORD)(sizeof(KAFFINITY)*8))?
+                                ~((KAFFINITY)0):(((KAFFINITY)1) << count) - 1;
+}
+
+static BOOL CALLBACK read_allowed_cpus(PINIT_ONCE once, PVOID param,
+                                       PVOID *context)
+{
+    WORD      ngroups;
+    WORD      group;
+    USHORT    process_groups[1];
+    USHORT    nprocess_groups;
+    DWORD_PTR process_mask;
+    DWORD_PTR system_mask;
+    KAFFINITY full;
+    bool      restricted;
+
+    (void)once;
+    (void)param;
+    (void)context;
+
+    /*
+     * A process that has the full mask of its group is not restricted
+     * and may use all groups. Otherwise it is confined to the allowed
+     * processors of its own group.
+     */
+    restricted = false;
+    process_groups[0] = 0;
+    process_mask = 0;
+    nprocess_groups = 1;
+    if (GetProcessGroupAffinity(GetCurrentProcess(), &nprocess_groups,
+                                process_groups) &&
+        (nprocess_groups == 1) &&
+        GetProcessAffinityMask(GetCurrentProcess(), &process_mask,
+                               &system_mask)) {
+        full = full_group_mask(process_groups[0]);
+        restricted = ((KAFFINITY)process_mask&full) != full;
+    }
+
+    ngroups = GetActiveProcessorGroupCount();
+    for (group=0;(group<ngroups)&&(group<MAX_PROCESSOR_GROUPS);group++) {
+        full = full_group_mask(group);
+        if (!restricted) {
+            allowed_cpus[group] = full;
+        } else if (group == process_groups[0]) {
+            allowed_cpus[group] = (KAFFINITY)process_mask&full;
+        } else {
+            allowed_cpus[group] = 0;
+        }
+    }
+    return TRUE;
+}
+
+static KAFFINITY get_allowed_cpus(WORD group)
+{
+    (void)InitOnceExecuteOnce(&allowed_cpus_once, read_allowed_cpus, NULL,
+                              NULL);
+    return group < MAX_PROCESSOR_GROUPS?allowed_cpus[group]:0;
+}
+
+/*
+ * Windows splits systems with more than 64 logical processors into
+ * processor groups and a new thread only runs on the processors of
+ * one group. Processors are numbered consecutively over all groups
+ * here, counting only the ones the process is allowed to run on, so
+ * that threads can be spread over all of them.
+ */
+static bool find_processor_group(int cpu, GROUP_AFFINITY *affinity)
+{
+    WORD      ngroups;
+    WORD      group;
+    KAFFINITY mask;
+    int       bit;
+
+    ngroups = GetActiveProcessorGroupCount();
+    for (group=0;group<ngroups;group++) {
+        mask = get_allowed_cpus(group);
+        for (bit=0;bit<(int)(sizeof(KAFFINITY)*8);bit++) {
+            if ((mask&(((KAFFINITY)1) << bit)) == 0) {
+                continue;
+            }
+            if (cpu == 0) {
+                memset(affinity, 0, sizeof(GROUP_AFFINITY));
+                affinity->Group = group;
+                affinity->Mask = ((KAFFINITY)1) << bit;
+                return true;
+            }
+            cpu--;
+        }
+    }
+    return false;
+}
+
 void thread_create(thread_t *thread, thread_func_t func, void *data)
 {
     *thread = CreateThread(NULL, 0, func, data, 0, NULL);
@@ -29,6 +157,74 @@ void thread_join(thread_t *thread)
 	CloseHandle(*thread);
 }
 
+int thread_number_of_nodes(void)
+{
+    ULONG highest;
+
+    if (!GetNumaHighestNodeNumber(&highest)) {
+        return 1;
+    }
+    return (highest+1) > MAX_NUMA_NODES?MAX_NUMA_NODES:(int)(highest+1);
+}
+
+void thread_bind_to_node(int node)
+{
+    GROUP_AFFINITY affinity;
+
+    memset(&affinity, 0, sizeof(GROUP_AFFINITY));
+    if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity)) {
+        return;
+    }
+
+    /* Stay within the processors the process is allowed to use */
+    affinity.Mask &= get_allowed_cpus(affinity.Group);
+    if (affinity.Mask == 0) {
+        return;
+    }
+    (void)SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+}
+
+int thread_number_of_cpus(void)
+{
+    WORD      ngroups;
+    WORD      group;
+    KAFFINITY mask;
+    int       count;
+
+    count = 0;
+    ngroups = GetActiveProcessorGroupCount();
+    for (group=0;group<ngroups;group++) {
+        for (mask=get_allowed_cpus(group);mask!=0;mask&=(mask-1)) {
+            count++;
+        }
+    }
+    return count > 0?count:1;
+}
+
+void thread_bind_to_cpu(int cpu)
+{
+    GROUP_AFFINITY affinity;
+
+    if (!find_processor_group(cpu, &affinity)) {
+        return;
+    }
+    (void)SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+}
+
+void thread_bind_to_group(int index)
+{
+    GROUP_AFFINITY affinity;
+
+    if (GetActiveProcessorGroupCount() <= 1) {
+        return;
+    }
+    if (!find_processor_group(index%thread_number_of_cpus(), &affinity)) {
+        return;
+    }
+    affinity.Mask = get_allowed_cpus(affinity.Group);
+    (void)SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+}
+
 void mutex_init(mutex_t *mutex)
 {
     InitializeCriticalSection(mutex);
@@ -74,6 +270,11 @@ void event_wait(event_t *event)
 {
     WaitForSingleObject(*event, INFINITE);
 }
+
+bool event_wait_timeout(event_t *event, int timeout)
+{
+    return WaitForSingleObject(*event, (DWORD)timeout) == WAIT_OBJECT_0;
+}
 #else
 void thread_create(thread_t *thread, thread_func_t func, void *data)
 {
@@ -85,6 +286,157 @@ void thread_join(thread_t *thread)
     (void)pthread_join(*thread, NULL);
 }
 
+#ifdef __linux__
+/*
+ * The processors the process is allowed to run on, for instance when
+ * started through taskset or in a cpuset. Read once, before any thread
+ * has been bound, so that bound threads don't narrow it down.
+ */
+static cpu_set_t allowed_cpus;
+static pthread_once_t allowed_cpus_once = PTHREAD_ONCE_INIT;
+
+static void read_allowed_cpus(void)
+{
+    int cpu;
+
+    if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0) {
+        CPU_ZERO(&allowed_cpus);
+        for (cpu=0;(cpu<sysconf(_SC_NPROCESSORS_ONLN))&&(cpu<CPU_SETSIZE);
+             cpu++) {
+            CPU_SET(cpu, &allowed_cpus);
+        }
+    }
+}
+
+static cpu_set_t* get_allowed_cpus(void)
+{
+    (void)pthread_once(&allowed_cpus_once, read_allowed_cpus);
+    return &allowed_cpus;
+}
+
+int thread_number_of_nodes(void)
+{
+    char path[64];
+    int  nnodes;
+
+    /* Nodes are numbered consecutively in sysfs */
+    nnodes = 0;
+    while (nnodes < MAX_NUMA_NODES) {
+        sprintf(path, "/sys/devices/system/node/node%d", nnodes);
+        if (access(path, F_OK) != 0) {
+            break;
+        }
+        nnodes++;
+    }
+    return nnodes > 0?nnodes:1;
+}
+
+void thread_bind_to_node(int node)
+{
+    char      path[64];
+    FILE      *fp;
+    cpu_set_t set;
+    int       first;
+    int       last;
+    int       cpu;
+    int       c;
+
+    /*
+     * The processors belonging to a node are listed in
+     * sysfs as a list of ranges, e.g. "0-7,16-23".
+     */
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;
+    }
+    CPU_ZERO(&set);
+    while (fscanf(fp, "%d", &first) == 1) {
+        last = first;
+        c = fgetc(fp);
+        if (c == '-') {
+            if (fscanf(fp, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(fp);
+        }
+        for (cpu=first;(cpu<=last)&&(cpu<CPU_SETSIZE);cpu++) {
+            CPU_SET(cpu, &set);
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(fp);
+
+    /* Stay within the processors the process is allowed to use */
+    CPU_AND(&set, &set, get_allowed_cpus());
+    if (CPU_COUNT(&set) > 0) {
+        (void)sched_setaffinity(0, sizeof(set), &set);
+    }
+}
+
+int thread_number_of_cpus(void)
+{
+    int ncpus;
+
+    ncpus = CPU_COUNT(get_allowed_cpus());
+    return ncpus > 0?ncpus:1;
+}
+
+void thread_bind_to_cpu(int cpu)
+{
+    cpu_set_t *allowed;
+    cpu_set_t set;
+    int       k;
+
+    /* Processors are numbered among the ones the process may use */
+    allowed = get_allowed_cpus();
+    for (k=0;k<CPU_SETSIZE;k++) {
+        if (!CPU_ISSET(k, allowed)) {
+            continue;
+        }
+        if (cpu == 0) {
+            CPU_ZERO(&set);
+            CPU_SET(k, &set);
+            (void)sched_setaffinity(0, sizeof(set), &set);
+            return;
+        }
+        cpu--;
+    }
+}
+
+void thread_bind_to_group(int index)
+{
+    (void)index;
+}
+#else
+int thread_number_of_nodes(void)
+{
+    return 1;
+}
+
+void thread_bind_to_node(int node)
+{
+    (void)node;
+}
+
+int thread_number_of_cpus(void)
+{
+    return 1;
+}
+
+void thread_bind_to_cpu(int cpu)
+{
+    (void)cpu;
+}
+
+void thread_bind_to_group(int index)
+{
+    (void)index;
+}
+#endif
+
 void mutex_init(mutex_t *mutex)
 {
     (void)pthread_mutex_init(mutex, NULL);
@@ -143,4 +495,30 @@ void event_wait(event_t *event)
     event->is_set = false;
     pthread_mutex_unlock(&event->mutex);
 }
+
+bool event_wait_timeout(event_t *event, int timeout)
+{
+    struct timespec ts;
+    bool            is_set;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout/1000;
+    ts.tv_nsec += (long)(timeout%1000)*1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    while (!event->is_set) {
+        if (pthread_cond_timedwait(&event->cond, &event->mutex, &ts) != 0) {
+            break;
+        }
+    }
+    is_set = event->is_set;
+    event->is_set = false;
+    pthread_mutex_unlock(&event->mutex);
+
+    return is_set;
+}
 #endif
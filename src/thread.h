@@ -60,6 +60,50 @@ void thread_create(thread_t *thread, thread_func_t func, void *data);
  */
 void thread_join(thread_t *thread);
 
+/*
+ * Get the number of NUMA nodes available on the system.
+ *
+ * @return Returns the number of NUMA nodes. Systems without NUMA
+ *         support are reported as having a single node.
+ */
+int thread_number_of_nodes(void);
+
+/*
+ * Bind the calling thread to the processors of a NUMA node.
+ *
+ * @param node The node to bind to.
+ */
+void thread_bind_to_node(int node);
+
+/*
+ * Get the number of processors the process is allowed to run on.
+ *
+ * @return Returns the number of processors.
+ */
+int thread_number_of_cpus(void);
+
+/*
+ * Bind the calling thread to a single processor. Processors are numbered
+ * consecutively among the ones the process is allowed to run on, so a
+ * process started with a restricted affinity stays within it. On Windows
+ * processors are numbered consecutively over all processor groups.
+ *
+ * @param cpu The index of the processor to bind to, between 0 and
+ *            thread_number_of_cpus()-1.
+ */
+void thread_bind_to_cpu(int cpu);
+
+/*
+ * Let the calling thread run on any processor of the processor group
+ * that a thread index maps to. Threads with consecutive indices are
+ * spread over the groups in proportion to their size. Only Windows has
+ * processor groups, on other systems threads can already run on all
+ * processors so nothing is done.
+ *
+ * @param index The index of the thread.
+ */
+void thread_bind_to_group(int index);
+
 /*
  * Initialize a mutex.
  *
@@ -123,4 +167,13 @@ void event_reset(event_t *event);
  */
 void event_wait(event_t *event);
 
+/*
+ * Wait for an event for at most a certain amount of time.
+ *
+ * @param event The event to wait for.
+ * @param timeout The maximum time to wait (in milliseconds).
+ * @return Returns true if the event was set, false if the wait timed out.
+ */
+bool event_wait_timeout(event_t *event, int timeout);
+
 #endif
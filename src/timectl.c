@@ -19,8 +19,11 @@
 #include <stdio.h>
 
 #include "timectl.h"
+#include "config.h"
+#include "smp.h"
 #include "utils.h"
 #include "debug.h"
+#include "timetrace.h"
 
 /*
  * When using sudden death or fischer time controls this constant is used. An
@@ -29,8 +32,13 @@
  */
 #define MOVES_TO_TIME_CONTROL 30
 
-/* Safety margin to avoid loosing on time (in ms) */
-#define SAFETY_MARGIN 50
+/*
+ * Limits (in percent of the soft time limit) for how much the time
+ * management may shorten or extend a search depending on the effort
+ * spent on the best move.
+ */
+#define MIN_EFFORT_FACTOR 50
+#define MAX_EFFORT_FACTOR 120
 
 /* Flags indicating special time control modes */
 static int tc_flags = 0;
@@ -59,11 +67,114 @@ static time_t search_start = 0;
 
 static time_t medium_time_limit = 0;
 
+/*
+ * The soft time limit adjusted by the effort spent on the best
+ * move and by how stable the best move is.
+ */
+static time_t effort_time_limit = 0;
+
 /* Keeps track if the clock is running or not */
 static bool clock_is_running = false;
 
+/* The number of nodes per millisecond in nodestime mode */
+static int tc_nodes_per_ms = 0;
+
+/* The configured move overhead (in milliseconds) */
+static int move_overhead = DEFAULT_MOVE_OVERHEAD;
+
+/* Flag indicating if the move overhead should be estimated */
+static bool adaptive_overhead = false;
+
+/* The estimated move overhead (in milliseconds) */
+static int estimated_overhead = 0;
+
+/*
+ * The time (in milliseconds) the engine expects to have left on the
+ * clock when the next search starts, or -1 if not known.
+ */
+static int expected_time_left = -1;
+
+/*
+ * The time when the time for the current search was allocated, which
+ * is when the clock of the engine started running. Zero if no time has
+ * been allocated.
+ */
+static time_t allocation_start = 0;
+
+/* Check if the clock is used as in a normal game */
+static bool is_game_clock(void)
+{
+    return ((tc_flags&(TC_INFINITE_TIME|TC_FIXED_TIME|TC_TIME_LIMIT)) ==
+                                                        TC_TIME_LIMIT) &&
+            !tc_is_nodestime();
+}
+
+/* Get the overhead (in milliseconds) to account for on each move */
+static int current_overhead(void)
+{
+    if (adaptive_overhead) {
+        return MAX(move_overhead, estimated_overhead);
+    }
+    return move_overhead;
+}
+
+/*
+ * Get the current time. In nodestime mode the time is derived from
+ * the number of nodes searched since the search was started.
+ */
+static time_t current_time(void)
+{
+    if (tc_is_nodestime()) {
+        return search_start + (time_t)(smp_nodes()/tc_nodes_per_ms);
+    }
+    return get_current_time();
+}
+
+void tc_set_nodestime(int nodes_per_ms)
+{
+    tc_nodes_per_ms = nodes_per_ms;
+}
+
+int tc_get_nodestime(void)
+{
+    return tc_nodes_per_ms;
+}
+
+bool tc_is_nodestime(void)
+{
+    return (tc_nodes_per_ms > 0) && ((tc_flags&TC_TIME_LIMIT) != 0);
+}
+
+void tc_set_move_overhead(int overhead)
+{
+    move_overhead = CLAMP(overhead, 0, MAX_MOVE_OVERHEAD);
+}
+
+int tc_get_move_overhead(void)
+{
+    return move_overhead;
+}
+
+void tc_set_adaptive_overhead(bool enabled)
+{
+    adaptive_overhead = enabled;
+    estimated_overhead = 0;
+}
+
+bool tc_adaptive_overhead(void)
+{
+    return adaptive_overhead;
+}
+
+void tc_new_game(void)
+{
+    expected_time_left = -1;
+}
+
 void tc_configure_time_control(int time, int inc, int movestogo, int flags)
 {
+    int lag;
+
     tc_time_left = time;
     tc_increment = inc;
     tc_movestogo = movestogo > 0?movestogo:MOVES_TO_TIME_CONTROL;
@@ -71,6 +182,28 @@ void tc_configure_time_control(int time, int inc, int movestogo, int flags)
     soft_time_limit = 0;
     hard_time_limit = 0;
     medium_time_limit = 0;
+    effort_time_limit = 0;
+
+    /*
+     * Compare the clock with the time that should have been left after
+     * the previous move. The difference is time that was lost outside
+     * of the engine. Samples where time has been added to the clock,
+     * for instance at a new time control, are ignored.
+     */
+    if (adaptive_overhead && (expected_time_left >= 0) && is_game_clock()) {
+        lag = expected_time_left - time;
+        if ((lag >= 0) && (lag <= MAX_MOVE_OVERHEAD)) {
+            if (lag > estimated_overhead) {
+                estimated_overhead = (estimated_overhead + lag + 1)/2;
+            } else {
+                estimated_overhead = (3*estimated_overhead + lag)/4;
+            }
+            LOG_INFO2("Move overhead: measured %d ms, estimated %d ms\n",
+                      lag, estimated_overhead);
+        }
+    }
+    expected_time_left = -1;
+    allocation_start = 0;
 }
 
 int tc_get_flags(void)
@@ -86,6 +219,11 @@ void tc_start_clock(void)
 
 void tc_stop_clock(void)
 {
+    /* Remember how much time should be left when the next search starts */
+    if ((allocation_start > 0) && is_game_clock()) {
+        expected_time_left = tc_time_left + tc_increment -
+                                (int)(get_current_time() - allocation_start);
+    }
     clock_is_running = false;
 }
 
@@ -97,32 +235,41 @@ bool tc_is_clock_running(void)
 void tc_allocate_time(void)
 {
     time_t allocated = 0;
+    time_t available;
+    int    overhead;
+
+    allocation_start = get_current_time();
+    overhead = current_overhead();
 
     /* Handle special cases first */
     if (tc_flags&TC_INFINITE_TIME) {
         soft_time_limit = 0;
         medium_time_limit = 0;
         hard_time_limit = 0;
+        effort_time_limit = 0;
         return;
     } else if (tc_flags&TC_FIXED_TIME) {
-        allocated = MAX(tc_time_left-SAFETY_MARGIN, 0);
+        allocated = MAX(tc_time_left-overhead, 0);
         soft_time_limit = search_start + allocated;
         medium_time_limit = soft_time_limit;
         hard_time_limit = soft_time_limit;
+        effort_time_limit = soft_time_limit;
         return;
     }
 
     /*
-     * Calculate how much time to allocate. For regular time
-     * controls (number of moves in fixed time) make sure to
-     * leave a little margin in order to be able to use extra
+     * Calculate how much time to allocate. The move overhead is lost
+     * on every move so it is reserved for all moves to the time control.
+     * For regular time controls (number of moves in fixed time) make
+     * sure to leave a little margin in order to be able to use extra
      * time time in case of danger.
      * */
-    allocated = tc_time_left/tc_movestogo + tc_increment;
+    available = MAX(tc_time_left-overhead*tc_movestogo, 0);
+    allocated = available/tc_movestogo + tc_increment;
     if (tc_flags&TC_REGULAR) {
         allocated = allocated*0.75;
     }
-    allocated = MIN(allocated, tc_time_left-SAFETY_MARGIN);
+    allocated = MIN(allocated, tc_time_left-overhead);
 
     /*
      * Setup time limits. The soft time limit is time the engine is
@@ -130,13 +277,14 @@ void tc_allocate_time(void)
      * is allowed to spend in case of panic.
      */
     soft_time_limit = search_start + allocated;
+    effort_time_limit = soft_time_limit;
 
     allocated = MIN(2*allocated, tc_time_left*0.8);
-    allocated = MIN(allocated, tc_time_left-SAFETY_MARGIN);
+    allocated = MIN(allocated, tc_time_left-overhead);
     medium_time_limit = search_start + allocated;
 
     allocated = MIN(5*allocated, tc_time_left*0.8);
-    allocated = MIN(allocated, tc_time_left-SAFETY_MARGIN);
+    allocated = MIN(allocated, tc_time_left-overhead);
     hard_time_limit = search_start + allocated;
 }
 
@@ -172,18 +320,67 @@ bool tc_check_time(struct search_worker *worker)
      * limit in the hope that the iteration can be finished.
      */
     if ((worker->resolving_root_fail || worker->resolving_tt_fail) &&
-        (worker->depth > worker->state->completed_depth)) {
-        return get_current_time() < hard_time_limit;
+        (worker->depth > smp_completed_depth(worker->state))) {
+        return current_time() < hard_time_limit;
     } else if ((worker->currmovenumber == 1) &&
-               (worker->depth > worker->state->completed_depth)) {
-        return get_current_time() < medium_time_limit;
+               (worker->depth > smp_completed_depth(worker->state))) {
+        return current_time() < medium_time_limit;
     } else {
-        return get_current_time() < soft_time_limit;
+        return current_time() < effort_time_limit;
+    }
+}
+
+/*
+ * Adjust the soft time limit after an iteration. If the best move is
+ * stable and most of the nodes are spent on it then it is unlikely that
+ * more time changes the outcome so the search is stopped early. If the
+ * effort is spread over several moves, or if the best move has recently
+ * changed, then the search is extended.
+ */
+static void adjust_time_limit(struct search_worker *worker)
+{
+    uint32_t best_move;
+    uint64_t best_nodes;
+    int      effort;
+    int      factor;
+    time_t   allocated;
+
+    /* Keep track of how often the best move changes */
+    best_move = worker->mpv_moves[0];
+    worker->best_move_changes /= 2;
+    if ((worker->prev_best_move != NOMOVE) &&
+        (best_move != worker->prev_best_move)) {
+        worker->best_move_changes += 100;
+    }
+    worker->prev_best_move = best_move;
+
+    if ((tc_flags&TC_FIXED_TIME) || (best_move == NOMOVE) ||
+        (worker->nodes == 0ULL)) {
+        return;
     }
+
+    /* Find the share of the nodes (in percent) spent on the best move */
+    best_nodes = worker->root_nodes[FROM(best_move)][TO(best_move)];
+    effort = (int)((best_nodes*100ULL)/worker->nodes);
+
+    factor = CLAMP(150-effort, MIN_EFFORT_FACTOR, MAX_EFFORT_FACTOR);
+    factor = (factor*(100+worker->best_move_changes))/100;
+    allocated = ((soft_time_limit-search_start)*factor)/100;
+    effort_time_limit = MIN(search_start+allocated, medium_time_limit);
 }
 
 bool tc_new_iteration(struct search_worker *worker)
 {
-    return worker->state->pondering || ((tc_flags&TC_TIME_LIMIT) == 0) ||
-           worker->depth <= 1 || (get_current_time() < soft_time_limit);
+    bool new_iteration;
+
+    if ((tc_flags&TC_TIME_LIMIT) != 0) {
+        adjust_time_limit(worker);
+    }
+    new_iteration = worker->state->pondering ||
+                    ((tc_flags&TC_TIME_LIMIT) == 0) ||
+                    worker->depth <= 1 ||
+                    (current_time() < effort_time_limit);
+    TIMETRACE_INSTANT(worker, new_iteration?"new iteration":"stop iteration",
+                      (int)tc_elapsed_time());
+    return new_iteration;
 }
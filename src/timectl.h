@@ -29,6 +29,71 @@
 #define TC_DEPTH_LIMIT   0x00000008
 #define TC_REGULAR       0x00000010
 
+/*
+ * Set the speed used in nodestime mode. In this mode the clock is
+ * converted into a node budget by assuming that the engine searches
+ * a fixed number of nodes per millisecond. This makes time limited
+ * searches independent of the hardware.
+ *
+ * @param nodes_per_ms The number of nodes per millisecond, or zero
+ *                     to use the real clock.
+ */
+void tc_set_nodestime(int nodes_per_ms);
+
+/*
+ * Get the speed used in nodestime mode.
+ *
+ * @return Returns the number of nodes per millisecond, or zero if
+ *         the nodestime mode is disabled.
+ */
+int tc_get_nodestime(void);
+
+/*
+ * Check if the current search is limited by the nodestime mode
+ * instead of by the real clock.
+ *
+ * @return Returns true if the nodestime mode is in use.
+ */
+bool tc_is_nodestime(void);
+
+/*
+ * Set the move overhead. The overhead is the time lost on each move
+ * outside of the engine, for instance due to network latency.
+ *
+ * @param overhead The overhead in milliseconds.
+ */
+void tc_set_move_overhead(int overhead);
+
+/*
+ * Get the configured move overhead.
+ *
+ * @return Returns the overhead in milliseconds.
+ */
+int tc_get_move_overhead(void);
+
+/*
+ * Enable or disable estimation of the move overhead. When enabled the
+ * clock reported at the start of each search is compared with the time
+ * that should have been left after the previous move. The difference
+ * is used as the move overhead if it is larger than the configured
+ * overhead.
+ *
+ * @param enabled True if the overhead should be estimated.
+ */
+void tc_set_adaptive_overhead(bool enabled);
+
+/*
+ * Check if the move overhead is estimated.
+ *
+ * @return Returns true if the overhead is estimated.
+ */
+bool tc_adaptive_overhead(void);
+
+/*
+ * Tell the time control that a new game is started.
+ */
+void tc_new_game(void);
+
 /*
  * Configure the time control to use for the next search.
  *
@@ -0,0 +1,262 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#if defined(WINDOWS)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "timetrace.h"
+#include "chess.h"
+#include "thread.h"
+
+/* The number of events in each buffer, must be a power of two */
+#define BUFFER_SIZE 16384
+
+/* Trace event */
+struct event {
+    const char *name;
+    uint64_t   timestamp;
+    int        value;
+    char       phase;
+};
+
+/*
+ * Ring buffer of events recorded by a single thread. When the buffer
+ * is full the oldest events are overwritten.
+ */
+struct timetrace_buffer {
+    int                     tid;
+    bool                    named;
+    uint64_t                head;
+    uint64_t                tail;
+    struct event            events[BUFFER_SIZE];
+    struct timetrace_buffer *next;
+};
+
+/* The trace file */
+static FILE *tracefp = NULL;
+
+/* Time when the trace was opened (in microseconds) */
+static uint64_t start_time = 0ULL;
+
+/* All active buffers */
+static struct timetrace_buffer *buffers = NULL;
+static mutex_t buffers_lock;
+
+/* Buffer for events recorded outside of a worker */
+static struct timetrace_buffer *engine_buffer = NULL;
+
+/* Indicates if an event have been written to the trace file */
+static bool first_event = true;
+
+static uint64_t current_time_us(void)
+{
+#ifdef WINDOWS
+    LARGE_INTEGER count;
+    LARGE_INTEGER freq;
+
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (count.QuadPart/freq.QuadPart)*1000000ULL +
+           ((count.QuadPart%freq.QuadPart)*1000000ULL)/freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000ULL + ts.tv_nsec/1000ULL;
+#endif
+}
+
+static void write_separator(void)
+{
+    fprintf(tracefp, "%s\n", first_event?"":",");
+    first_event = false;
+}
+
+static void flush_buffer(struct timetrace_buffer *buffer)
+{
+    struct event *event;
+    uint64_t     dropped;
+
+    if (!buffer->named) {
+        write_separator();
+        if (buffer->tid == 0) {
+            fprintf(tracefp, "{\"name\": \"thread_name\", \"ph\": \"M\", "
+                    "\"pid\": 1, \"tid\": 0, \"args\": {\"name\": "
+                    "\"engine\"}}");
+        } else {
+            fprintf(tracefp, "{\"name\": \"thread_name\", \"ph\": \"M\", "
+                    "\"pid\": 1, \"tid\": %d, \"args\": {\"name\": "
+                    "\"worker %d\"}}", buffer->tid, buffer->tid-1);
+        }
+        buffer->named = true;
+    }
+
+    /* Skip events that have been overwritten */
+    if ((buffer->head-buffer->tail) > BUFFER_SIZE) {
+        dropped = buffer->head - buffer->tail - BUFFER_SIZE;
+        buffer->tail += dropped;
+        write_separator();
+        fprintf(tracefp, "{\"name\": \"dropped events\", \"ph\": \"i\", "
+                "\"s\": \"t\", \"ts\": %"PRIu64", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"value\": %"PRIu64"}}",
+                buffer->events[buffer->tail&(BUFFER_SIZE-1)].timestamp,
+                buffer->tid, dropped);
+    }
+
+    while (buffer->tail < buffer->head) {
+        event = &buffer->events[buffer->tail&(BUFFER_SIZE-1)];
+        write_separator();
+        fprintf(tracefp, "{\"name\": \"%s\", \"ph\": \"%c\", ", event->name,
+                event->phase);
+        if (event->phase == 'i') {
+            fprintf(tracefp, "\"s\": \"t\", ");
+        }
+        fprintf(tracefp, "\"ts\": %"PRIu64", \"pid\": 1, \"tid\": %d",
+                event->timestamp, buffer->tid);
+        if (event->phase != 'E') {
+            fprintf(tracefp, ", \"args\": {\"value\": %d}", event->value);
+        }
+        fprintf(tracefp, "}");
+        buffer->tail++;
+    }
+}
+
+bool timetrace_open(char *file)
+{
+    assert(file != NULL);
+
+    tracefp = fopen(file, "w");
+    if (tracefp == NULL) {
+        return false;
+    }
+
+    /*
+     * The closing bracket of the event array is optional in the
+     * Chrome trace format so a trace from an engine that was
+     * terminated abruptly can still be read.
+     */
+    fprintf(tracefp, "[");
+    first_event = true;
+    start_time = current_time_us();
+    mutex_init(&buffers_lock);
+    engine_buffer = timetrace_create_buffer(-1);
+
+    return true;
+}
+
+void timetrace_close(void)
+{
+    if (tracefp == NULL) {
+        return;
+    }
+
+    timetrace_flush();
+    timetrace_destroy_buffer(engine_buffer);
+    engine_buffer = NULL;
+    fprintf(tracefp, "\n]\n");
+    fclose(tracefp);
+    tracefp = NULL;
+    mutex_destroy(&buffers_lock);
+}
+
+struct timetrace_buffer* timetrace_create_buffer(int id)
+{
+    struct timetrace_buffer *buffer;
+
+    if (tracefp == NULL) {
+        return NULL;
+    }
+
+    buffer = malloc(sizeof(struct timetrace_buffer));
+    if (buffer == NULL) {
+        return NULL;
+    }
+    buffer->tid = id + 1;
+    buffer->named = false;
+    buffer->head = 0ULL;
+    buffer->tail = 0ULL;
+
+    mutex_lock(&buffers_lock);
+    buffer->next = buffers;
+    buffers = buffer;
+    mutex_unlock(&buffers_lock);
+
+    return buffer;
+}
+
+void timetrace_destroy_buffer(struct timetrace_buffer *buffer)
+{
+    struct timetrace_buffer **iter;
+
+    if ((buffer == NULL) || (tracefp == NULL)) {
+        return;
+    }
+
+    mutex_lock(&buffers_lock);
+    flush_buffer(buffer);
+    for (iter=&buffers;*iter!=NULL;iter=&(*iter)->next) {
+        if (*iter == buffer) {
+            *iter = buffer->next;
+            break;
+        }
+    }
+    mutex_unlock(&buffers_lock);
+
+    free(buffer);
+}
+
+void timetrace_event(struct search_worker *worker, const char *name,
+                     char phase, int value)
+{
+    struct timetrace_buffer *buffer;
+    struct event            *event;
+
+    buffer = (worker != NULL)?worker->timetrace:engine_buffer;
+    if (buffer == NULL) {
+        return;
+    }
+
+    event = &buffer->events[buffer->head&(BUFFER_SIZE-1)];
+    event->name = name;
+    event->timestamp = current_time_us() - start_time;
+    event->value = value;
+    event->phase = phase;
+    buffer->head++;
+}
+
+void timetrace_flush(void)
+{
+    struct timetrace_buffer *buffer;
+
+    if (tracefp == NULL) {
+        return;
+    }
+
+    mutex_lock(&buffers_lock);
+    for (buffer=buffers;buffer!=NULL;buffer=buffer->next) {
+        flush_buffer(buffer);
+    }
+    fflush(tracefp);
+    mutex_unlock(&buffers_lock);
+}
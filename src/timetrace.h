@@ -0,0 +1,95 @@
+/*
+ * Marvin - an UCI/XBoard compatible chess engine
+ * Copyright (C) 2015 Martin Danielsson
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TIMETRACE_H
+#define TIMETRACE_H
+
+/*
+ * Timing trace of the search. Events are recorded in a ring buffer owned
+ * by each worker and written to a file in the Chrome trace event format
+ * (readable by chrome://tracing and Perfetto) when the search finishes.
+ * Events recorded outside of a worker (worker is NULL) go to a separate
+ * buffer owned by the engine thread.
+ */
+
+#ifndef TIMETRACE
+
+#define TIMETRACE_BEGIN(worker, name)
+#define TIMETRACE_END(worker, name)
+#define TIMETRACE_INSTANT(worker, name, value)
+
+#else
+
+#include <stdbool.h>
+
+struct search_worker;
+struct timetrace_buffer;
+
+#define TIMETRACE_BEGIN(worker, name) \
+                        timetrace_event((worker), (name), 'B', 0)
+#define TIMETRACE_END(worker, name) \
+                        timetrace_event((worker), (name), 'E', 0)
+#define TIMETRACE_INSTANT(worker, name, value) \
+                        timetrace_event((worker), (name), 'i', (value))
+
+/*
+ * Open the trace file.
+ *
+ * @param file The name of the file.
+ * @return Returns true if the file was opened.
+ */
+bool timetrace_open(char *file);
+
+/* Flush all buffers and close the trace file */
+void timetrace_close(void);
+
+/*
+ * Create an event buffer for a worker.
+ *
+ * @param id The id of the worker.
+ * @return Returns the new buffer.
+ */
+struct timetrace_buffer* timetrace_create_buffer(int id);
+
+/*
+ * Destroy an event buffer. Pending events are written to the
+ * trace file first.
+ *
+ * @param buffer The buffer to destroy.
+ */
+void timetrace_destroy_buffer(struct timetrace_buffer *buffer);
+
+/*
+ * Record an event.
+ *
+ * @param worker The worker, or NULL for the engine thread.
+ * @param name The name of the event. Must be a string literal.
+ * @param phase The Chrome trace event phase ('B', 'E' or 'i').
+ * @param value Value attached to the event.
+ */
+void timetrace_event(struct search_worker *worker, const char *name,
+                     char phase, int value);
+
+/*
+ * Write all pending events to the trace file. Must only be called when
+ * no worker is recording events.
+ */
+void timetrace_flush(void);
+
+#endif
+
+#endif
@@ -17,10 +17,80 @@
  */
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "trace.h"
 #include "eval.h"
+#include "bitboard.h"
+
+static void trace_add(struct eval_trace *trace, int idx, int phase, int side,
+                      int multiplier, int divisor)
+{
+    if ((trace->used[idx/64]&(1ULL << (idx%64))) == 0ULL) {
+        trace->used[idx/64] |= (1ULL << (idx%64));
+        trace->nparams++;
+    }
+    trace->params[idx].mul[phase][side] += multiplier;
+    trace->params[idx].div[phase][side] += divisor;
+}
+
+struct eval_trace* trace_create(void)
+{
+    struct eval_trace *trace;
+
+    trace = calloc(1, sizeof(struct eval_trace));
+    assert(trace != NULL);
+
+    return trace;
+}
+
+void trace_clear(struct eval_trace *trace)
+{
+    int k;
+    int iter;
+
+    assert(trace != NULL);
+
+    iter = 0;
+    while ((k=trace_next_param(trace, &iter)) != -1) {
+        memset(&trace->params[k], 0, sizeof(struct trace_param));
+    }
+    memset(trace->used, 0, sizeof(trace->used));
+    trace->nparams = 0;
+    trace->phase_factor = 0;
+    memset(trace->base, 0, sizeof(trace->base));
+}
+
+int trace_next_param(struct eval_trace *trace, int *iter)
+{
+    uint64_t bits;
+    int      word;
+
+    assert(trace != NULL);
+    assert(iter != NULL);
+
+    /*
+     * The iterator is the index of the parameter following the
+     * previously returned one.
+     */
+    word = *iter/64;
+    if (word >= TRACE_USED_WORDS) {
+        return -1;
+    }
+    bits = trace->used[word]&(~0ULL << (*iter%64));
+    while (bits == 0ULL) {
+        word++;
+        if (word >= TRACE_USED_WORDS) {
+            *iter = word*64;
+            return -1;
+        }
+        bits = trace->used[word];
+    }
+    *iter = word*64 + LSB(bits) + 1;
+
+    return *iter - 1;
+}
 
 void trace_const(struct eval_trace *trace, int side, int const_val)
 {
@@ -43,12 +113,10 @@ void trace_param(struct eval_trace *trace, int side, int tp1, int tp2,
 
     if (tp1 != -1) {
         idx = tuning_param_index(tp1) + offset;
-        trace->params[idx].mul[MIDDLEGAME][side] += multiplier;
-        trace->params[idx].div[MIDDLEGAME][side] += divisor;
+        trace_add(trace, idx, MIDDLEGAME, side, multiplier, divisor);
     }
     if (tp2 != -1) {
         idx = tuning_param_index(tp2) + offset;
-        trace->params[idx].mul[ENDGAME][side] += multiplier;
-        trace->params[idx].div[ENDGAME][side] += divisor;
+        trace_add(trace, idx, ENDGAME, side, multiplier, divisor);
     }
 }
@@ -42,10 +42,20 @@ struct trace_param {
     int div[NPHASES][NSIDES];
 };
 
-/* Evaluation trace */
+/* The number of words in the bitmap of used trace parameters */
+#define TRACE_USED_WORDS ((NUM_TUNING_PARAMS+63)/64)
+
+/*
+ * Evaluation trace. Only the parameters that are set in the used
+ * bitmap are in use, all other entries in params are zero. This
+ * allows a trace to be cleared, and its used parameters to be found
+ * in order, without looking at every tuning parameter.
+ */
 struct eval_trace {
     int                 phase_factor;
     int                 base[NPHASES][NSIDES];
+    int                 nparams;
+    uint64_t            used[TRACE_USED_WORDS];
     struct trace_param  params[NUM_TUNING_PARAMS];
 };
 
@@ -72,6 +82,31 @@ struct eval_trace {
 #define TRACE_OM_E(te, o, m) \
         trace_param(eval->trace, side, -1, (TP_ ## te), (o), (m), 0)
 
+/*
+ * Create an empty evaluation trace.
+ *
+ * @return Returns the new trace.
+ */
+struct eval_trace* trace_create(void);
+
+/*
+ * Clear an evaluation trace. Only the parameters that are in
+ * use are cleared.
+ *
+ * @param trace The evaluation trace.
+ */
+void trace_clear(struct eval_trace *trace);
+
+/*
+ * Get the next used parameter of an evaluation trace.
+ *
+ * @param trace The evaluation trace.
+ * @param iter The iterator. Must be set to zero before the first call.
+ * @return Returns the index of the next used parameter, or -1 if there
+ *         are no more used parameters.
+ */
+int trace_next_param(struct eval_trace *trace, int *iter);
+
 /*
  * Add a constant value to the trace.
  *
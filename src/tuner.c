@@ -19,11 +19,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #ifndef WINDOWS
 #include <signal.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+#ifdef USE_AVX2
+#include <immintrin.h>
 #endif
 
 #include "chess.h"
@@ -54,7 +61,7 @@
 /* Constants used when calculating K */
 #define K_MIN 0.00
 #define K_MAX 2.0
-#define K_STEP 0.001
+#define K_TOLERANCE 0.0001
 
 /* Constants for Adam */
 #define BETA1 0.9
@@ -72,34 +79,71 @@ enum optimization_algorithm {
     OPT_ADAM
 };
 
-/* Equation term */
-struct term {
-    int    param_id;
-    double fact;
-    double scale;
+/* The number of training positions in each chunk of work */
+#define CHUNK_SIZE 1024
+
+/* Binary training set files */
+#define TRAINING_FILE_MAGIC "MRVNTSET"
+#define TRAINING_FILE_VERSION 1
+
+/*
+ * Header of a binary training set file. The header is followed by the
+ * arrays of an equation set covering all training positions, in the
+ * order base[size], results[size], first[size+1], coeffs[nterms] and
+ * param_ids[nterms]. All values are stored in native byte order. Since
+ * the equations depend on the evaluation function the file has to be
+ * regenerated when the evaluation changes.
+ */
+struct training_file_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nparams;
+    uint64_t size;
+    uint64_t nterms;
 };
 
+/* The initial number of terms to allocate space for per equation */
+#define INITIAL_TERMS_PER_EQUATION 32
+
 /*
- * Equation describing the evaluation function
- * for a specific position.
+ * Equations describing the evaluation function for a range of training
+ * positions. Each equation is a base score plus a sum of terms, where
+ * each term is a tuning parameter multiplied by a coefficient. The terms
+ * of all equations are packed into contiguous arrays so that they can be
+ * streamed through when evaluating. The terms of equation k are found at
+ * the indices [first[k], first[k+1]).
  */
-struct eval_equation {
-    double      base;
-    int         nterms;
-    struct term *terms;
+struct equation_set {
+    int      size;
+    double   *base;
+    double   *results;
+    uint64_t *first;
+    int      *param_ids;
+    double   *coeffs;
+    uint64_t nterms;
+    uint64_t capacity;
 };
 
 /* Training position */
 struct trainingpos {
-    char                 *epd;
-    double               result;
-    struct eval_equation equation;
+    char   *epd;
+    double result;
 };
 
-/* Training set */
+/*
+ * Training set. A training set read from a binary file has no positions,
+ * instead the equations for all positions are mapped into memory and
+ * described by the stored equation set.
+ */
 struct trainingset {
-    struct trainingpos *positions;
-    int                size;
+    struct trainingpos  *positions;
+    int                 size;
+    struct equation_set *equations;
+    double              *errors;
+    int                 nequationsets;
+    struct equation_set stored;
+    void                *mapping;
+    uint64_t            mapsize;
 };
 
 /* Tuning set */
@@ -109,51 +153,73 @@ struct tuningset {
     int                 nactive;
 };
 
+/*
+ * Inverted index from each active parameter to the training positions
+ * whose equations reference it. The entries for parameter id are found
+ * at the indices [first[id], first[id+1]). It is used to update the
+ * error incrementally when a single parameter is changed.
+ */
+struct param_index {
+    uint64_t first[NUM_TUNING_PARAMS+1];
+    int      *positions;
+    double   *coeffs;
+};
+
+/* Tasks that can be run by the worker threads */
+enum worker_task {
+    TASK_TRACE,
+    TASK_ERROR,
+    TASK_GRADIENTS,
+    TASK_BATCH_GRADIENTS,
+    TASK_EXIT
+};
+
 /* Worker thread */
 struct tuning_worker {
-    thread_t           thread;
-    struct trainingset *trainingset;
-    struct tuningset   *tuningset;
-    int                first_pos;
-    int                last_pos;
-    double             val;
-    double             gradients[NUM_TUNING_PARAMS];
+    thread_t            thread;
+    event_t             start_event;
+    event_t             done_event;
+    struct trainingset  *trainingset;
+    struct tuningset    *tuningset;
+    struct gamestate    *state;
+    struct eval_trace   *trace;
+    double              gradients[NUM_TUNING_PARAMS];
 };
 
-/* Workers used for calculating errors */
-struct tuning_worker *workers = NULL;
+/*
+ * Workers used for tracing and for calculating errors and gradients. The
+ * workers are kept alive for the whole tuning session. The training set
+ * is divided into chunks of CHUNK_SIZE positions and each worker claims
+ * the next unprocessed chunk until all chunks are done, so workers that
+ * get cheap positions are not left idle. The calling thread acts as the
+ * first worker. If position_scores is set then the score of each
+ * position is saved there when the error is calculated.
+ */
+static struct tuning_worker *workers = NULL;
 static int nworkerthreads = 0;
+static enum worker_task current_task;
+static atomic_int next_chunk;
+static double param_values[NUM_TUNING_PARAMS];
 static double scaling_constant = K;
+static double *position_scores = NULL;
+
+/*
+ * Data for minibatch gradients. The positions are visited in the order
+ * given by batch_order, which is shuffled for each epoch, and the current
+ * batch consists of the batch_size positions starting at batch_start.
+ */
+static int *batch_order = NULL;
+static int batch_start;
+static int batch_size;
 static volatile bool stop_optimization = false;
 static bool regularize = true;
 
-static void init_workers(struct trainingset *trainingset,
-                         struct tuningset *tuningset)
-{
-    int iter;
-    int pos_per_thread;
-    int nextpos;
-
-    pos_per_thread = trainingset->size/nworkerthreads;
-    nextpos = 0;
-    for (iter=0;iter<nworkerthreads;iter++) {
-        workers[iter].trainingset = trainingset;
-        workers[iter].tuningset = tuningset;
-        workers[iter].first_pos = nextpos;
-        workers[iter].last_pos = workers[iter].first_pos + pos_per_thread - 1;
-        nextpos = workers[iter].last_pos + 1;
-    }
-}
-
-static void setup_term(struct term *term, struct trace_param *param,
-                       int param_id, int phase_factor)
+static double term_coefficient(struct trace_param *param, int phase_factor)
 {
     double temp;
     double fact[NPHASES];
     int    phase;
 
-    term->param_id = param_id;
-
     for (phase=0;phase<NPHASES;phase++) {
         temp = param->mul[phase][WHITE];
         if (param->div[phase][WHITE] > 0) {
@@ -170,143 +236,167 @@ static void setup_term(struct term *term, struct trace_param *param,
 
     if ((fact[MIDDLEGAME] != 0) && (fact[ENDGAME] != 0)) {
         assert(fact[MIDDLEGAME] == fact[ENDGAME]);
-        term->fact = fact[MIDDLEGAME];
-        term->scale = 1;
+        return fact[MIDDLEGAME];
     } else if (fact[MIDDLEGAME] != 0) {
-        term->fact = fact[MIDDLEGAME];
-        term->scale = (256.0-phase_factor)/256.0;
-    } else {
-        term->fact = fact[ENDGAME];
-        term->scale = phase_factor/256.0;
+        return fact[MIDDLEGAME]*((256.0-phase_factor)/256.0);
     }
+    return fact[ENDGAME]*(phase_factor/256.0);
 }
 
-static void setup_eval_equation(struct eval_trace *trace,
-                                struct eval_equation *equation)
+static void init_equation_set(struct equation_set *set, int size)
 {
-    int k;
-    int idx;
-    int count;
+    set->size = 0;
+    set->base = malloc(sizeof(double)*size);
+    set->results = malloc(sizeof(double)*size);
+    set->first = malloc(sizeof(uint64_t)*(size+1));
+    set->first[0] = 0ULL;
+    set->nterms = 0ULL;
+    set->capacity = (uint64_t)(MAX(size, 1))*INITIAL_TERMS_PER_EQUATION;
+    set->param_ids = malloc(sizeof(int)*set->capacity);
+    set->coeffs = malloc(sizeof(double)*set->capacity);
+}
 
-    /* Count the number of non-zero parameters */
-    count = 0;
-    for (k=0;k<NUM_TUNING_PARAMS;k++) {
-        if ((trace->params[k].mul[MIDDLEGAME][WHITE] != 0) ||
-            (trace->params[k].mul[MIDDLEGAME][BLACK] != 0) ||
-            (trace->params[k].mul[ENDGAME][WHITE] != 0) ||
-            (trace->params[k].mul[ENDGAME][BLACK] != 0)) {
-            count++;
-        }
-    }
+static void free_equation_set(struct equation_set *set)
+{
+    free(set->base);
+    free(set->results);
+    free(set->first);
+    free(set->param_ids);
+    free(set->coeffs);
+}
 
-    /* Allocate terms */
-    equation->terms = malloc(sizeof(struct term)*count);
-    equation->nterms = count;
+/*
+ * Add the equation for a traced position to the end of an equation set.
+ * The set must have been initialized with room for the equation.
+ */
+static void add_eval_equation(struct equation_set *set,
+                              struct eval_trace *trace, double result)
+{
+    struct trace_param *param;
+    int                iter;
+    int                id;
+
+    /* Make sure there is room for all parameters */
+    if ((set->nterms+trace->nparams) > set->capacity) {
+        set->capacity = MAX(set->capacity*2, set->nterms+trace->nparams);
+        set->param_ids = realloc(set->param_ids, sizeof(int)*set->capacity);
+        set->coeffs = realloc(set->coeffs, sizeof(double)*set->capacity);
+        assert((set->param_ids != NULL) && (set->coeffs != NULL));
+    }
 
     /* Setup base score */
     assert(trace->base[MIDDLEGAME][WHITE] == trace->base[ENDGAME][WHITE]);
     assert(trace->base[MIDDLEGAME][BLACK] == trace->base[ENDGAME][BLACK]);
-    equation->base = trace->base[ENDGAME][WHITE] - trace->base[ENDGAME][BLACK];
-
-    /* Setup terms */
-    idx = 0;
-    for (k=0;k<NUM_TUNING_PARAMS;k++) {
-        if ((trace->params[k].mul[MIDDLEGAME][WHITE] == 0) &&
-            (trace->params[k].mul[MIDDLEGAME][BLACK] == 0) &&
-            (trace->params[k].mul[ENDGAME][WHITE] == 0) &&
-            (trace->params[k].mul[ENDGAME][BLACK] == 0)) {
+    set->base[set->size] = trace->base[ENDGAME][WHITE] -
+                                                trace->base[ENDGAME][BLACK];
+    set->results[set->size] = result;
+
+    /* Add a term for each parameter that is used */
+    iter = 0;
+    while ((id=trace_next_param(trace, &iter)) != -1) {
+        param = &trace->params[id];
+        if ((param->mul[MIDDLEGAME][WHITE] == 0) &&
+            (param->mul[MIDDLEGAME][BLACK] == 0) &&
+            (param->mul[ENDGAME][WHITE] == 0) &&
+            (param->mul[ENDGAME][BLACK] == 0)) {
             continue;
         }
 
-        setup_term(&equation->terms[idx], &trace->params[k], k,
-                   trace->phase_factor);
-        idx++;
+        set->param_ids[set->nterms] = id;
+        set->coeffs[set->nterms] = term_coefficient(param,
+                                                    trace->phase_factor);
+        set->nterms++;
     }
-}
 
-static double evaluate_term(struct term *term, struct tuningset *tuningset)
-{
-    return tuningset->params[term->param_id].current*term->fact*term->scale;
+    set->size++;
+    set->first[set->size] = set->nterms;
 }
 
-static double evaluate_equation(struct eval_equation *equation,
-                                struct tuningset *tuningset)
+/*
+ * Evaluate equation k in a set given the current values of all
+ * parameters. Partial sums are kept in independent lanes so that
+ * the terms can be processed in parallel.
+ */
+static double evaluate_equation(struct equation_set *set, int k,
+                                double *values)
 {
-    double score;
-    int    k;
+    int      *ids = set->param_ids;
+    double   *coeffs = set->coeffs;
+    uint64_t end = set->first[k+1];
+    uint64_t i = set->first[k];
+    double   lanes[4];
+    double   score;
+#ifdef USE_AVX2
+    __m256d  sum;
+    __m128i  idx;
+
+    sum = _mm256_setzero_pd();
+    for (;(i+4)<=end;i+=4) {
+        idx = _mm_loadu_si128((__m128i*)&ids[i]);
+        sum = _mm256_add_pd(sum,
+                            _mm256_mul_pd(_mm256_i32gather_pd(values, idx, 8),
+                                          _mm256_loadu_pd(&coeffs[i])));
+    }
+    _mm256_storeu_pd(lanes, sum);
+#else
+    lanes[0] = 0.0;
+    lanes[1] = 0.0;
+    lanes[2] = 0.0;
+    lanes[3] = 0.0;
+    for (;(i+4)<=end;i+=4) {
+        lanes[0] += values[ids[i]]*coeffs[i];
+        lanes[1] += values[ids[i+1]]*coeffs[i+1];
+        lanes[2] += values[ids[i+2]]*coeffs[i+2];
+        lanes[3] += values[ids[i+3]]*coeffs[i+3];
+    }
+#endif
 
-    score = equation->base;
-    for (k=0;k<equation->nterms;k++) {
-        score += evaluate_term(&equation->terms[k], tuningset);
+    score = set->base[k] + (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (;i<end;i++) {
+        score += values[ids[i]]*coeffs[i];
     }
 
     return score;
 }
 
-void print_equation(struct eval_equation *equation)
+static void load_values(struct tuningset *tuningset, double *values)
 {
-    struct term *term;
-    int         k;
+    int k;
 
-    printf("base: %f\n", equation->base);
-    for (k=0;k<equation->nterms;k++) {
-        term = &equation->terms[k];
-        printf("param %d: %f, %f\n", term->param_id, term->fact, term->scale);
+    for (k=0;k<NUM_TUNING_PARAMS;k++) {
+        values[k] = tuningset->params[k].current;
     }
 }
 
-static thread_retval_t trace_positions_func(void *data)
+void print_equation(struct equation_set *set, int k)
 {
-    struct tuning_worker *worker;
-    struct gamestate     *state;
-    struct trainingset   *trainingset;
-    int                  iter;
-    struct eval_trace    *trace;
-    struct pv            *pv;
-
-    worker = (struct tuning_worker*)data;
-    state = create_game_state();
-    pv = malloc(sizeof(struct movelist));
-    memset(pv, 0, sizeof(struct movelist));
-    trainingset = worker->trainingset;
-
-    /* Iterate over all training positions assigned to this worker */
-    for (iter=worker->first_pos;iter<=worker->last_pos;iter++) {
-        /* Setup position */
-        board_reset(&state->pos);
-        (void)fen_setup_board(&state->pos, trainingset->positions[iter].epd);
+    uint64_t i;
 
-        /*
-         * Trace the evaluation function for this position
-         * and create a corresponding equation
-         */
-        trace = malloc(sizeof(struct eval_trace));
-        eval_generate_trace(&state->pos, trace);
-        setup_eval_equation(trace, &trainingset->positions[iter].equation);
-        free(trace);
+    printf("base: %f\n", set->base[k]);
+    for (i=set->first[k];i<set->first[k+1];i++) {
+        printf("param %d: %f\n", set->param_ids[i], set->coeffs[i]);
     }
-
-    /* Clean up */
-    free(pv);
-    destroy_game_state(state);
-
-    return (thread_retval_t)0;
 }
 
-static void trace_positions(void)
+static void free_equations(struct trainingset *trainingset)
 {
-    int iter;
+    int k;
 
-    /* Start all worker threads */
-    for (iter=0;iter<nworkerthreads;iter++) {
-        thread_create(&workers[iter].thread, trace_positions_func,
-                      &workers[iter]);
+    if (trainingset->equations == NULL) {
+        return;
     }
 
-    /* Wait for all workers to finish */
-    for (iter=0;iter<nworkerthreads;iter++) {
-        thread_join(&workers[iter].thread);
+    /* Equation sets referring to a mapped file do not own their arrays */
+    if (trainingset->mapping == NULL) {
+        for (k=0;k<trainingset->nequationsets;k++) {
+            free_equation_set(&trainingset->equations[k]);
+        }
     }
+    free(trainingset->equations);
+    free(trainingset->errors);
+    trainingset->equations = NULL;
+    trainingset->errors = NULL;
+    trainingset->nequationsets = 0;
 }
 
 static double texel_sigmoid(double score)
@@ -330,118 +420,302 @@ static double texel_squared_error(double score, double result)
     return error*error;
 }
 
-static thread_retval_t calc_texel_squared_error_func(void *data)
+#ifndef WINDOWS
+static void signal_handler(int signum)
 {
-    struct tuning_worker *worker;
-    struct gamestate     *state;
-    struct trainingset   *trainingset;
-    int                  iter;
-    double               score;
-
-    /* Initialize worker */
-    worker = (struct tuning_worker*)data;
-    state = create_game_state();
-    trainingset = worker->trainingset;
+    if (signum == SIGINT) {
+        stop_optimization = true;
+    }
+}
+#endif
+
+/*
+ * Trace the evaluation function for all training positions in a chunk
+ * and create corresponding equations.
+ */
+static void trace_chunk(struct tuning_worker *worker, int chunk)
+{
+    struct trainingset  *trainingset = worker->trainingset;
+    struct equation_set *set = &trainingset->equations[chunk];
+    struct gamestate    *state = worker->state;
+    int                 first;
+    int                 last;
+    int                 iter;
+
+    first = chunk*CHUNK_SIZE;
+    last = MIN(first+CHUNK_SIZE, trainingset->size);
+    init_equation_set(set, last-first);
+    for (iter=first;iter<last;iter++) {
+        board_reset(&state->pos);
+        (void)fen_setup_board(&state->pos, trainingset->positions[iter].epd);
+        eval_generate_trace(&state->pos, worker->trace);
+        add_eval_equation(set, worker->trace,
+                          trainingset->positions[iter].result);
+    }
+}
+
+static void calc_chunk_error(struct tuning_worker *worker, int chunk)
+{
+    struct equation_set *set = &worker->trainingset->equations[chunk];
+    double              error;
+    double              score;
+    int                 k;
+
+    error = 0.0;
+    for (k=0;k<set->size;k++) {
+        score = evaluate_equation(set, k, param_values);
+        error += texel_squared_error(score, set->results[k]);
+        if (position_scores != NULL) {
+            position_scores[chunk*CHUNK_SIZE+k] = score;
+        }
+    }
+    worker->trainingset->errors[chunk] = error;
+}
+
+static void calc_chunk_gradients(struct tuning_worker *worker, int chunk)
+{
+    struct equation_set *set = &worker->trainingset->equations[chunk];
+    double              *gradients = worker->gradients;
+    double              score;
+    double              error;
+    uint64_t            i;
+    int                 k;
 
-    /* Iterate over all training positions assigned to this worker */
-    worker->val = 0.0;
-    for (iter=worker->first_pos;iter<=worker->last_pos;iter++) {
-        /* Evaluate the equation */
-        score = evaluate_equation(&trainingset->positions[iter].equation,
-                                  worker->tuningset);
+    for (k=0;k<set->size;k++) {
+        score = evaluate_equation(set, k, param_values);
+        error = texel_error(score, set->results[k]);
 
-        /* Calculate error */
-        worker->val += texel_squared_error(score,
-                                           trainingset->positions[iter].result);
+        for (i=set->first[k];i<set->first[k+1];i++) {
+            gradients[set->param_ids[i]] += error*set->coeffs[i];
+        }
     }
+}
 
-    /* Clean up */
-    destroy_game_state(state);
+/*
+ * Calculate gradients for part of the current minibatch. Chunks of
+ * the batch are CHUNK_SIZE positions in the shuffled order.
+ */
+static void calc_batch_chunk_gradients(struct tuning_worker *worker,
+                                       int chunk)
+{
+    struct equation_set *set;
+    double              *gradients = worker->gradients;
+    double              score;
+    double              error;
+    uint64_t            i;
+    int                 first;
+    int                 last;
+    int                 iter;
+    int                 pos;
+    int                 k;
+
+    first = batch_start + chunk*CHUNK_SIZE;
+    last = MIN(first+CHUNK_SIZE, batch_start+batch_size);
+    for (iter=first;iter<last;iter++) {
+        pos = batch_order[iter];
+        set = &worker->trainingset->equations[pos/CHUNK_SIZE];
+        k = pos%CHUNK_SIZE;
+        score = evaluate_equation(set, k, param_values);
+        error = texel_error(score, set->results[k]);
+
+        for (i=set->first[k];i<set->first[k+1];i++) {
+            gradients[set->param_ids[i]] += error*set->coeffs[i];
+        }
+    }
+}
+
+/* Process chunks of the current task until there are no chunks left */
+static void run_task(struct tuning_worker *worker)
+{
+    int nchunks = worker->trainingset->nequationsets;
+    int chunk;
+    int k;
+
+    if (current_task == TASK_BATCH_GRADIENTS) {
+        nchunks = (batch_size+CHUNK_SIZE-1)/CHUNK_SIZE;
+    }
+    if ((current_task == TASK_GRADIENTS) ||
+        (current_task == TASK_BATCH_GRADIENTS)) {
+        for (k=0;k<NUM_TUNING_PARAMS;k++) {
+            worker->gradients[k] = 0.0;
+        }
+    }
+
+    chunk = atomic_fetch_add(&next_chunk, 1);
+    while (chunk < nchunks) {
+        switch (current_task) {
+        case TASK_TRACE:
+            trace_chunk(worker, chunk);
+            break;
+        case TASK_ERROR:
+            calc_chunk_error(worker, chunk);
+            break;
+        case TASK_GRADIENTS:
+            calc_chunk_gradients(worker, chunk);
+            break;
+        case TASK_BATCH_GRADIENTS:
+            calc_batch_chunk_gradients(worker, chunk);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        chunk = atomic_fetch_add(&next_chunk, 1);
+    }
+}
+
+static thread_retval_t worker_thread_func(void *data)
+{
+    struct tuning_worker *worker = data;
+
+    /* Park on the start event until there is a task to run */
+    while (true) {
+        event_wait(&worker->start_event);
+        if (current_task == TASK_EXIT) {
+            break;
+        }
+        run_task(worker);
+        event_set(&worker->done_event);
+    }
 
     return (thread_retval_t)0;
 }
 
-static double calc_texel_squared_error(struct trainingset *trainingset)
+/* Run a task on all workers and wait for it to finish */
+static void run_workers(enum worker_task task)
 {
-    int     iter;
-    double  error;
+    int iter;
+
+    current_task = task;
+    atomic_store(&next_chunk, 0);
+    for (iter=1;iter<nworkerthreads;iter++) {
+        event_set(&workers[iter].start_event);
+    }
+    run_task(&workers[0]);
+    for (iter=1;iter<nworkerthreads;iter++) {
+        event_wait(&workers[iter].done_event);
+    }
+}
 
-    /* Start all worker threads */
+static void start_workers(int nthreads, struct trainingset *trainingset,
+                          struct tuningset *tuningset)
+{
+    int iter;
+
+    nworkerthreads = nthreads;
+    workers = malloc(sizeof(struct tuning_worker)*nworkerthreads);
     for (iter=0;iter<nworkerthreads;iter++) {
-        thread_create(&workers[iter].thread, calc_texel_squared_error_func,
+        workers[iter].trainingset = trainingset;
+        workers[iter].tuningset = tuningset;
+        workers[iter].state = create_game_state();
+        workers[iter].trace = trace_create();
+    }
+
+    /* The first worker runs in the calling thread */
+    for (iter=1;iter<nworkerthreads;iter++) {
+        event_init(&workers[iter].start_event);
+        event_init(&workers[iter].done_event);
+        thread_create(&workers[iter].thread, worker_thread_func,
                       &workers[iter]);
     }
+}
 
-    /* Wait for all workers to finish */
-    for (iter=0;iter<nworkerthreads;iter++) {
+static void stop_workers(void)
+{
+    int iter;
+
+    /* Tell all worker threads to exit and wait for them */
+    current_task = TASK_EXIT;
+    for (iter=1;iter<nworkerthreads;iter++) {
+        event_set(&workers[iter].start_event);
+    }
+    for (iter=1;iter<nworkerthreads;iter++) {
         thread_join(&workers[iter].thread);
+        event_destroy(&workers[iter].start_event);
+        event_destroy(&workers[iter].done_event);
     }
 
-    /* Summarize the result of all workers and calculate the error */
-    error = 0.0;
     for (iter=0;iter<nworkerthreads;iter++) {
-        error += workers[iter].val;
+        free(workers[iter].trace);
+        destroy_game_state(workers[iter].state);
     }
-
-    return error/(double)trainingset->size;
+    free(workers);
+    workers = NULL;
+    nworkerthreads = 0;
 }
 
-#ifndef WINDOWS
-static void signal_handler(int signum)
+static void trace_positions(void)
 {
-    if (signum == SIGINT) {
-        stop_optimization = true;
+    struct trainingset  *trainingset = workers[0].trainingset;
+    struct equation_set *set;
+    int                 nchunks;
+    int                 chunk;
+    int                 first;
+
+    /* Each chunk of positions gets its own set of equations */
+    nchunks = (trainingset->size+CHUNK_SIZE-1)/CHUNK_SIZE;
+    free_equations(trainingset);
+    trainingset->equations = malloc(sizeof(struct equation_set)*nchunks);
+    trainingset->errors = malloc(sizeof(double)*nchunks);
+    trainingset->nequationsets = nchunks;
+
+    /*
+     * For a binary training set the equations are already available so
+     * each chunk is just a view of part of the stored set. The term
+     * offsets are absolute so the term arrays are shared.
+     */
+    if (trainingset->mapping != NULL) {
+        for (chunk=0;chunk<nchunks;chunk++) {
+            set = &trainingset->equations[chunk];
+            first = chunk*CHUNK_SIZE;
+            set->size = MIN(CHUNK_SIZE, trainingset->size-first);
+            set->base = trainingset->stored.base + first;
+            set->results = trainingset->stored.results + first;
+            set->first = trainingset->stored.first + first;
+            set->param_ids = trainingset->stored.param_ids;
+            set->coeffs = trainingset->stored.coeffs;
+            set->nterms = set->first[set->size] - set->first[0];
+            set->capacity = trainingset->stored.capacity;
+        }
+        return;
     }
+
+    run_workers(TASK_TRACE);
 }
-#endif
 
-static thread_retval_t calc_texel_gradients_func(void *data)
+static double calc_texel_squared_error(struct trainingset *trainingset)
 {
-    struct tuning_worker *worker;
-    struct trainingset   *trainingset;
-    struct eval_equation *equation;
-    struct term          *term;
-    double               score;
-    double               error;
-    int                  iter;
-    int                  k;
-
-    /* Initialize worker */
-    worker = (struct tuning_worker*)data;
-    trainingset = worker->trainingset;
-    for (k=0;k<NUM_TUNING_PARAMS;k++) {
-        worker->gradients[k] = 0.0;
-    }
+    int     chunk;
+    double  error;
 
-    for (iter=worker->first_pos;iter<=worker->last_pos;iter++) {
-        equation = &trainingset->positions[iter].equation;
-        score = evaluate_equation(equation, worker->tuningset);
-        error = texel_error(score, trainingset->positions[iter].result);
+    load_values(workers[0].tuningset, param_values);
+    run_workers(TASK_ERROR);
 
-        for (k=0;k<equation->nterms;k++) {
-            term = &equation->terms[k];
-            worker->gradients[term->param_id] += (error*term->fact*term->scale);
-        }
+    /*
+     * Summarize the errors of all chunks. The order is fixed so the
+     * result does not depend on which worker processed which chunk.
+     */
+    error = 0.0;
+    for (chunk=0;chunk<trainingset->nequationsets;chunk++) {
+        error += trainingset->errors[chunk];
     }
 
-    return (thread_retval_t)0;
+    return error/(double)trainingset->size;
 }
 
-static void calc_texel_gradients(double *gradients)
+/*
+ * Calculate the gradients over all training positions or, if a minibatch
+ * is given, over the positions of the batch.
+ */
+static void calc_texel_gradients(double *gradients, bool minibatch)
 {
+    int npositions;
     int iter;
     int k;
 
-    /* Start all worker threads */
-    for (iter=0;iter<nworkerthreads;iter++) {
-        thread_create(&workers[iter].thread, calc_texel_gradients_func,
-                      &workers[iter]);
-    }
-
-    /* Wait for all workers to finish */
-    for (iter=0;iter<nworkerthreads;iter++) {
-        thread_join(&workers[iter].thread);
-    }
+    load_values(workers[0].tuningset, param_values);
+    run_workers(minibatch?TASK_BATCH_GRADIENTS:TASK_GRADIENTS);
+    npositions = minibatch?batch_size:workers[0].trainingset->size;
 
     /* Summarize the result of all workers and calculate the error */
     for (k=0;k<NUM_TUNING_PARAMS;k++) {
@@ -449,26 +723,137 @@ static void calc_texel_gradients(double *gradients)
         for (iter=0;iter<nworkerthreads;iter++) {
             gradients[k] += (workers[iter].gradients[k]);
         }
-        gradients[k] *= (-2.0/workers[0].trainingset->size);
+        gradients[k] *= (-2.0/npositions);
         if (regularize) {
             gradients[k] += (2*LAMBDA*workers[0].tuningset->params[k].current);
         }
     }
 }
 
-static void adam(struct tuningset *tuningset, struct trainingset *trainingset,
-                 int max_iterations, double step_size)
+/* Shuffle the order in which positions are visited by minibatches */
+static void shuffle_batch_order(int npositions)
+{
+    int k;
+    int l;
+    int temp;
+
+    for (k=npositions-1;k>0;k--) {
+        l = (int)((((uint64_t)rand()<<31)^(uint64_t)rand())%(k+1));
+        temp = batch_order[k];
+        batch_order[k] = batch_order[l];
+        batch_order[l] = temp;
+    }
+}
+
+/* Write the current parameter values to a checkpoint file */
+static void write_checkpoint(struct tuningset *tuningset, int iteration)
+{
+    char name[64];
+    FILE *fp;
+
+    snprintf(name, sizeof(name), TUNING_ITERATION_RESULT_FILE, iteration);
+    fp = fopen(name, "w");
+    if (fp != NULL) {
+        tuning_param_write_parameters(fp, tuningset->params, true, false);
+        fclose(fp);
+    }
+}
+
+/* Update the active parameters using the gradients from step t */
+static void adam_update(struct tuningset *tuningset, double *gradients,
+                        double *m, double *v, int t, double step_size)
 {
     struct tuning_param *param;
-    double              m[NUM_TUNING_PARAMS] = {0.0};
-    double              v[NUM_TUNING_PARAMS] = {0.0};
-    double              gradients[NUM_TUNING_PARAMS];
     double              m_hat;
     double              v_hat;
     int                 k;
-    int                 niterations;
-    double              error;
-    double              prev_error;
+
+    for (k=0;k<NUM_TUNING_PARAMS;k++) {
+        param = &tuningset->params[k];
+        if (!param->active) {
+            continue;
+        }
+
+        m[k] = BETA1*m[k] + (1 - BETA1)*gradients[k];
+        v[k] = BETA2*v[k] + (1 - BETA2)*gradients[k]*gradients[k];
+        m_hat = m[k]/(1 - pow(BETA1, t));
+        v_hat = v[k]/(1 - pow(BETA2, t));
+        param->current -= ((step_size/(sqrt(v_hat) + EPSILON))*m_hat);
+        param->current = CLAMP(param->current, param->min, param->max);
+    }
+    tuning_param_assign_current(tuningset->params);
+}
+
+/*
+ * Minibatch Adam. The positions are shuffled at the start of each epoch
+ * and the parameters are updated after each batch of batchsize positions.
+ * The error over all positions is calculated, and a checkpoint written,
+ * after each epoch.
+ */
+static void adam_minibatch(struct tuningset *tuningset,
+                           struct trainingset *trainingset, int max_epochs,
+                           double step_size, int batchsize, double error)
+{
+    double m[NUM_TUNING_PARAMS] = {0.0};
+    double v[NUM_TUNING_PARAMS] = {0.0};
+    double gradients[NUM_TUNING_PARAMS];
+    double prev_error;
+    int    nepochs;
+    int    t;
+    int    k;
+
+    printf("Using minibatches of %d positions\n\n", batchsize);
+
+    batch_order = malloc(sizeof(int)*trainingset->size);
+    for (k=0;k<trainingset->size;k++) {
+        batch_order[k] = k;
+    }
+
+    prev_error = error;
+    t = 0;
+    for (nepochs=1;nepochs<=max_epochs;nepochs++) {
+        /* Visit all positions once in a new order */
+        shuffle_batch_order(trainingset->size);
+        for (batch_start=0;
+             (batch_start<trainingset->size) && !stop_optimization;
+             batch_start+=batchsize) {
+            batch_size = MIN(batchsize, trainingset->size-batch_start);
+            calc_texel_gradients(gradients, true);
+            t++;
+            adam_update(tuningset, gradients, m, v, t, step_size);
+        }
+        if (stop_optimization) {
+            break;
+        }
+
+        /* Report the progress and save the parameters */
+        error = calc_texel_squared_error(trainingset);
+        printf("Epoch: %d, Error: %f\n", nepochs, error);
+        write_checkpoint(tuningset, nepochs);
+        if (error >= prev_error) {
+            break;
+        }
+        prev_error = error;
+    }
+
+    free(batch_order);
+    batch_order = NULL;
+
+    error = calc_texel_squared_error(trainingset);
+    printf("\n");
+    printf("Total number of epochs: %d\n", MIN(nepochs, max_epochs));
+    printf("Final error: %f\n", error);
+}
+
+static void adam(struct tuningset *tuningset, struct trainingset *trainingset,
+                 int max_iterations, double step_size, int batchsize)
+{
+    double m[NUM_TUNING_PARAMS] = {0.0};
+    double v[NUM_TUNING_PARAMS] = {0.0};
+    double gradients[NUM_TUNING_PARAMS];
+    int    niterations;
+    double error;
+    double prev_error;
 
 #ifndef WINDOWS
     struct sigaction sa = {0};
@@ -489,6 +874,12 @@ static void adam(struct tuningset *tuningset, struct trainingset *trainingset,
     }
     printf("\n");
 
+    if ((batchsize > 0) && (batchsize < trainingset->size)) {
+        adam_minibatch(tuningset, trainingset, max_iterations, step_size,
+                       batchsize, error);
+        return;
+    }
+
     for (niterations=1;niterations<=max_iterations;niterations++) {
         /* Check if the user has interrupted the optimization */
         if (stop_optimization) {
@@ -496,23 +887,10 @@ static void adam(struct tuningset *tuningset, struct trainingset *trainingset,
         }
 
         /* Calculate the gradient for each parameter */
-        calc_texel_gradients(gradients);
+        calc_texel_gradients(gradients, false);
 
         /* Update the parameters that are being tuned */
-        for (k=0;k<NUM_TUNING_PARAMS;k++) {
-            param = &tuningset->params[k];
-            if (!param->active) {
-                continue;
-            }
-
-            m[k] = BETA1*m[k] + (1 - BETA1)*gradients[k];
-            v[k] = BETA2*v[k] + (1 - BETA2)*gradients[k]*gradients[k];
-            m_hat = m[k]/(1 - pow(BETA1, niterations));
-            v_hat = v[k]/(1 - pow(BETA2, niterations));
-            param->current -= ((step_size/(sqrt(v_hat) + EPSILON))*m_hat);
-            param->current = CLAMP(param->current, param->min, param->max);
-        }
-        tuning_param_assign_current(tuningset->params);
+        adam_update(tuningset, gradients, m, v, niterations, step_size);
 
         /* Display regular progress */
         if ((niterations%REPORT_INTERVAL) == 0) {
@@ -532,10 +910,94 @@ static void adam(struct tuningset *tuningset, struct trainingset *trainingset,
     printf("Final error: %f\n", error);
 }
 
+static void build_param_index(struct tuningset *tuningset,
+                              struct trainingset *trainingset,
+                              struct param_index *index)
+{
+    struct equation_set *set;
+    uint64_t            next[NUM_TUNING_PARAMS];
+    uint64_t            i;
+    int                 chunk;
+    int                 id;
+    int                 k;
+
+    /* Count the number of references to each active parameter */
+    memset(index->first, 0, sizeof(index->first));
+    for (chunk=0;chunk<trainingset->nequationsets;chunk++) {
+        set = &trainingset->equations[chunk];
+        for (i=set->first[0];i<set->first[set->size];i++) {
+            if (tuningset->params[set->param_ids[i]].active) {
+                index->first[set->param_ids[i]+1]++;
+            }
+        }
+    }
+    for (id=0;id<NUM_TUNING_PARAMS;id++) {
+        index->first[id+1] += index->first[id];
+        next[id] = index->first[id];
+    }
+
+    /* Fill in the positions and coefficients */
+    index->positions = malloc(sizeof(int)*index->first[NUM_TUNING_PARAMS]);
+    index->coeffs = malloc(sizeof(double)*index->first[NUM_TUNING_PARAMS]);
+    for (chunk=0;chunk<trainingset->nequationsets;chunk++) {
+        set = &trainingset->equations[chunk];
+        for (k=0;k<set->size;k++) {
+            for (i=set->first[k];i<set->first[k+1];i++) {
+                id = set->param_ids[i];
+                if (!tuningset->params[id].active) {
+                    continue;
+                }
+                index->positions[next[id]] = chunk*CHUNK_SIZE + k;
+                index->coeffs[next[id]] = set->coeffs[i];
+                next[id]++;
+            }
+        }
+    }
+}
+
+static void free_param_index(struct param_index *index)
+{
+    free(index->positions);
+    free(index->coeffs);
+}
+
+/*
+ * Change the value of a parameter by delta and update the scores of
+ * the positions referencing it. Returns the change of the error.
+ */
+static double change_param(struct tuningset *tuningset,
+                           struct trainingset *trainingset,
+                           struct param_index *index, int id, int delta)
+{
+    double   change;
+    double   result;
+    uint64_t i;
+    int      pos;
+
+    tuningset->params[id].current += delta;
+
+    change = 0.0;
+    for (i=index->first[id];i<index->first[id+1];i++) {
+        pos = index->positions[i];
+        result = trainingset->equations[pos/CHUNK_SIZE].results[pos%CHUNK_SIZE];
+        change -= texel_squared_error(position_scores[pos], result);
+        position_scores[pos] += delta*index->coeffs[i];
+        change += texel_squared_error(position_scores[pos], result);
+    }
+
+    return change/(double)trainingset->size;
+}
+
+/*
+ * Local search where only the positions that reference the parameter
+ * being changed are evaluated after each step. The error is recalculated
+ * from scratch after each iteration to avoid accumulating rounding errors.
+ */
 static void local_search(struct tuningset *tuningset,
                          struct trainingset *trainingset)
 {
     struct  tuning_param *param;
+    struct  param_index  index;
     double  best_e;
     double  e;
     bool    improved;
@@ -549,7 +1011,9 @@ static void local_search(struct tuningset *tuningset,
     /* Generate a quiet trainingset and calculate the initial error */
     trace_positions();
     tuning_param_assign_current(tuningset->params);
+    position_scores = malloc(sizeof(double)*trainingset->size);
     best_e = calc_texel_squared_error(trainingset);
+    build_param_index(tuningset, trainingset, &index);
     printf("Initial error: %f\n", best_e);
 
     /* Loop until no more improvements are found */
@@ -578,9 +1042,8 @@ static void local_search(struct tuningset *tuningset,
             undo = false;
             improved_local = false;
             while ((param->current+delta) <= param->max) {
-                param->current += delta;
-                tuning_param_assign_current(tuningset->params);
-                e = calc_texel_squared_error(trainingset);
+                e = best_e + change_param(tuningset, trainingset, &index, pi,
+                                          delta);
                 if (e < best_e) {
                     best_e = e;
                     improved = true;
@@ -591,8 +1054,7 @@ static void local_search(struct tuningset *tuningset,
                 }
             }
             if (undo) {
-                param->current -= delta;
-                tuning_param_assign_current(tuningset->params);
+                (void)change_param(tuningset, trainingset, &index, pi, -delta);
             }
 
             /* If no improvement was found try decreasing the value instead */
@@ -600,9 +1062,8 @@ static void local_search(struct tuningset *tuningset,
                 undo = false;
                 improved_local = false;
                 while ((param->current-delta) >= param->min) {
-                    param->current -= delta;
-                    tuning_param_assign_current(tuningset->params);
-                    e = calc_texel_squared_error(trainingset);
+                    e = best_e + change_param(tuningset, trainingset, &index,
+                                              pi, -delta);
                     if (e < best_e) {
                         best_e = e;
                         improved = true;
@@ -612,8 +1073,8 @@ static void local_search(struct tuningset *tuningset,
                     }
                 }
                 if (undo) {
-                    param->current += delta;
-                    tuning_param_assign_current(tuningset->params);
+                    (void)change_param(tuningset, trainingset, &index, pi,
+                                       delta);
                 }
             }
 
@@ -626,25 +1087,39 @@ static void local_search(struct tuningset *tuningset,
 
         /* Output the result after the current iteration */
         niterations++;
+        best_e = calc_texel_squared_error(trainingset);
         printf("\rIteration %d complete, error %f\n", niterations, best_e);
     }
 
     printf("Final error: %f\n", best_e);
+
+    free_param_index(&index);
+    free(position_scores);
+    position_scores = NULL;
 }
 
 static void free_trainingset(struct trainingset *trainingset)
 {
     int k;
 
-    if ((trainingset == NULL) || (trainingset->positions == NULL)) {
+    if (trainingset == NULL) {
         return;
     }
 
-    for (k=0;k<trainingset->size;k++) {
-        free(trainingset->positions[k].epd);
-        free(trainingset->positions[k].equation.terms);
+    if (trainingset->positions != NULL) {
+        for (k=0;k<trainingset->size;k++) {
+            free(trainingset->positions[k].epd);
+        }
+        free(trainingset->positions);
+    }
+    free_equations(trainingset);
+    if (trainingset->mapping != NULL) {
+#ifndef WINDOWS
+        munmap(trainingset->mapping, trainingset->mapsize);
+#else
+        free(trainingset->mapping);
+#endif
     }
-    free(trainingset->positions);
     free(trainingset);
 }
 
@@ -667,6 +1142,11 @@ static struct trainingset* read_trainingset(struct gamestate *state, char *file)
     ntot = (int)sb.st_size/APPROX_EPD_LENGTH;
     trainingset->positions = malloc(ntot*sizeof(struct trainingpos));
     trainingset->size = 0;
+    trainingset->equations = NULL;
+    trainingset->errors = NULL;
+    trainingset->nequationsets = 0;
+    trainingset->mapping = NULL;
+    trainingset->mapsize = 0ULL;
 
     /* Open the training set */
     fp = fopen(file, "r");
@@ -721,6 +1201,221 @@ static struct trainingset* read_trainingset(struct gamestate *state, char *file)
     return trainingset;
 }
 
+static bool is_binary_trainingset(char *file)
+{
+    FILE *fp;
+    char magic[8];
+    bool ret;
+
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    ret = (fread(magic, sizeof(magic), 1, fp) == 1) &&
+          !memcmp(magic, TRAINING_FILE_MAGIC, sizeof(magic));
+    fclose(fp);
+
+    return ret;
+}
+
+/*
+ * Map a binary training set file into memory. Without mmap the file is
+ * read into newly allocated memory instead.
+ */
+static void* map_training_file(char *file, uint64_t *size)
+{
+    struct stat sb;
+    void        *mapping;
+#ifndef WINDOWS
+    int         fd;
+
+    fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &sb) != 0) ||
+        (sb.st_size < (off_t)sizeof(struct training_file_header))) {
+        close(fd);
+        return NULL;
+    }
+    mapping = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(mapping, sb.st_size, MADV_SEQUENTIAL);
+#else
+    FILE        *fp;
+    bool        ok;
+
+    if ((stat(file, &sb) != 0) ||
+        (sb.st_size < (off_t)sizeof(struct training_file_header))) {
+        return NULL;
+    }
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    mapping = malloc(sb.st_size);
+    ok = (mapping != NULL) && (fread(mapping, sb.st_size, 1, fp) == 1);
+    fclose(fp);
+    if (!ok) {
+        free(mapping);
+        return NULL;
+    }
+#endif
+
+    *size = sb.st_size;
+    return mapping;
+}
+
+static struct trainingset* map_trainingset(char *file)
+{
+    struct training_file_header *header;
+    struct trainingset          *trainingset;
+    struct equation_set         *set;
+    char                        *data;
+    uint64_t                    size;
+
+    /* Allocate an empty training set */
+    trainingset = malloc(sizeof(struct trainingset));
+    trainingset->positions = NULL;
+    trainingset->size = 0;
+    trainingset->equations = NULL;
+    trainingset->errors = NULL;
+    trainingset->nequationsets = 0;
+    trainingset->mapping = map_training_file(file, &size);
+    trainingset->mapsize = size;
+    if (trainingset->mapping == NULL) {
+        free(trainingset);
+        return NULL;
+    }
+
+    /* Validate the header and the size of the file */
+    header = trainingset->mapping;
+    if (memcmp(header->magic, TRAINING_FILE_MAGIC, sizeof(header->magic)) ||
+        (header->version != TRAINING_FILE_VERSION) ||
+        (header->nparams != NUM_TUNING_PARAMS) ||
+        (header->size == 0ULL) || (header->size > INT_MAX) ||
+        (size != (sizeof(struct training_file_header) +
+                  header->size*(2*sizeof(double)+sizeof(uint64_t)) +
+                  sizeof(uint64_t) +
+                  header->nterms*(sizeof(double)+sizeof(int))))) {
+        free_trainingset(trainingset);
+        return NULL;
+    }
+
+    /* Setup an equation set referring to the arrays in the file */
+    data = (char*)(header + 1);
+    set = &trainingset->stored;
+    set->size = (int)header->size;
+    set->nterms = header->nterms;
+    set->capacity = header->nterms;
+    set->base = (double*)data;
+    data += header->size*sizeof(double);
+    set->results = (double*)data;
+    data += header->size*sizeof(double);
+    set->first = (uint64_t*)data;
+    data += (header->size+1)*sizeof(uint64_t);
+    set->coeffs = (double*)data;
+    data += header->nterms*sizeof(double);
+    set->param_ids = (int*)data;
+    if ((set->first[0] != 0ULL) || (set->first[set->size] != set->nterms)) {
+        free_trainingset(trainingset);
+        return NULL;
+    }
+    trainingset->size = set->size;
+
+    return trainingset;
+}
+
+/*
+ * Read a training set in either the EPD or the binary format.
+ */
+static struct trainingset* load_trainingset(struct gamestate *state,
+                                            char *file)
+{
+    if (is_binary_trainingset(file)) {
+        return map_trainingset(file);
+    }
+    return read_trainingset(state, file);
+}
+
+/*
+ * Write the equations of a traced training set to a binary file. The
+ * equation sets of all workers are joined into a single set.
+ */
+static bool write_trainingset(struct trainingset *trainingset, char *file)
+{
+    struct training_file_header header;
+    struct equation_set         *set;
+    FILE                        *fp;
+    uint64_t                    *first;
+    uint64_t                    offset;
+    bool                        ok;
+    int                         iter;
+    int                         k;
+
+    fp = fopen(file, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    memset(&header, 0, sizeof(struct training_file_header));
+    memcpy(header.magic, TRAINING_FILE_MAGIC, sizeof(header.magic));
+    header.version = TRAINING_FILE_VERSION;
+    header.nparams = NUM_TUNING_PARAMS;
+    header.size = trainingset->size;
+    for (iter=0;iter<trainingset->nequationsets;iter++) {
+        header.nterms += trainingset->equations[iter].nterms;
+    }
+    ok = fwrite(&header, sizeof(struct training_file_header), 1, fp) == 1;
+
+    for (iter=0;(iter<trainingset->nequationsets)&&ok;iter++) {
+        set = &trainingset->equations[iter];
+        ok = fwrite(set->base, sizeof(double), set->size, fp) ==
+                                                        (size_t)set->size;
+    }
+    for (iter=0;(iter<trainingset->nequationsets)&&ok;iter++) {
+        set = &trainingset->equations[iter];
+        ok = fwrite(set->results, sizeof(double), set->size, fp) ==
+                                                        (size_t)set->size;
+    }
+
+    /* Term offsets are relative to the start of the joined set */
+    offset = 0ULL;
+    for (iter=0;(iter<trainingset->nequationsets)&&ok;iter++) {
+        set = &trainingset->equations[iter];
+        first = malloc(sizeof(uint64_t)*(MAX(set->size, 1)));
+        for (k=0;k<set->size;k++) {
+            first[k] = set->first[k] + offset;
+        }
+        ok = fwrite(first, sizeof(uint64_t), set->size, fp) ==
+                                                        (size_t)set->size;
+        offset += set->nterms;
+        free(first);
+    }
+    ok = ok && (fwrite(&offset, sizeof(uint64_t), 1, fp) == 1);
+
+    for (iter=0;(iter<trainingset->nequationsets)&&ok;iter++) {
+        set = &trainingset->equations[iter];
+        ok = fwrite(set->coeffs, sizeof(double), set->nterms, fp) ==
+                                                                set->nterms;
+    }
+    for (iter=0;(iter<trainingset->nequationsets)&&ok;iter++) {
+        set = &trainingset->equations[iter];
+        ok = fwrite(set->param_ids, sizeof(int), set->nterms, fp) ==
+                                                                set->nterms;
+    }
+
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        remove(file);
+    }
+
+    return ok;
+}
+
 static void free_tuningset(struct tuningset *tuningset)
 {
     if ((tuningset == NULL) || (tuningset->params == NULL)) {
@@ -826,15 +1521,27 @@ static struct tuningset* read_tuningset(char *file)
     return tuningset;
 }
 
+/* Calculate the error for a specific scaling constant */
+static double calc_k_error(struct trainingset *trainingset, double k)
+{
+    scaling_constant = k;
+    return calc_texel_squared_error(trainingset);
+}
+
 void find_k(char *file, int nthreads)
 {
     struct gamestate    *state;
     struct trainingset  *trainingset;
     struct tuningset    *tuningset;
-    double              k;
+    double              a;
+    double              b;
+    double              c;
+    double              d;
+    double              ec;
+    double              ed;
     double              best_k;
-    double              e;
     double              lowest_e;
+    double              ratio;
     int                 niterations;
 
     assert(file != NULL);
@@ -845,7 +1552,7 @@ void find_k(char *file, int nthreads)
     state = create_game_state();
 
     /* Read training set */
-    trainingset = read_trainingset(state, file);
+    trainingset = load_trainingset(state, file);
     if (trainingset == NULL) {
         printf("Error: failed to read training set\n");
         return;
@@ -860,27 +1567,36 @@ void find_k(char *file, int nthreads)
     printf("Found %d training positions\n", trainingset->size);
 
     /* Setup worker threads */
-    nworkerthreads = nthreads;
-    workers = malloc(sizeof(struct tuning_worker)*nworkerthreads);
-    init_workers(trainingset, tuningset);
+    start_workers(nthreads, trainingset, tuningset);
     trace_positions();
 
-    /* Make sure all training positions are covered */
-    workers[nworkerthreads-1].last_pos = trainingset->size - 1;
-
-    /* Find the K that gives the lowest error */
-    best_k = 0.0;
-    lowest_e = 10.0;
-    niterations = 0;
-    for (k=K_MIN;k<K_MAX;k+=K_STEP) {
-        /* Calculate error */
-        scaling_constant = k;
-        e = calc_texel_squared_error(trainingset);
-
-        /* Check if the error has decreased */
-        if (e < lowest_e) {
-            best_k = k;
-            lowest_e = e;
+    /*
+     * Find the K that gives the lowest error using a golden-section
+     * search. The error is unimodal in K so the interval containing the
+     * minimum can be narrowed down by a constant factor for each new
+     * error calculation.
+     */
+    ratio = (sqrt(5.0)-1.0)/2.0;
+    a = K_MIN;
+    b = K_MAX;
+    c = b - ratio*(b-a);
+    d = a + ratio*(b-a);
+    ec = calc_k_error(trainingset, c);
+    ed = calc_k_error(trainingset, d);
+    niterations = 2;
+    while ((b-a) > K_TOLERANCE) {
+        if (ec < ed) {
+            b = d;
+            d = c;
+            ed = ec;
+            c = b - ratio*(b-a);
+            ec = calc_k_error(trainingset, c);
+        } else {
+            a = c;
+            c = d;
+            ec = ed;
+            d = a + ratio*(b-a);
+            ed = calc_k_error(trainingset, d);
         }
 
         /* Display progress information */
@@ -890,13 +1606,15 @@ void find_k(char *file, int nthreads)
             printf("\n");
         }
     }
+    best_k = (ec < ed)?c:d;
+    lowest_e = MIN(ec, ed);
 
     /* Print result */
     printf("\nK=%.3f, e=%.5f (%.2f%%)\n",
            best_k, lowest_e, sqrt(lowest_e)*100.0);
 
     /* Clean up */
-    free(workers);
+    stop_workers();
     free_trainingset(trainingset);
     free_tuningset(tuningset);
     destroy_game_state(state);
@@ -904,7 +1622,7 @@ void find_k(char *file, int nthreads)
 
 static void tune_parameters(char *training_file, char *parameter_file,
                             int nthreads, enum optimization_algorithm optalgo,
-                            int niterations)
+                            int niterations, int batchsize)
 {
     struct tuningset    *tuningset;
     struct trainingset  *trainingset;
@@ -938,7 +1656,7 @@ static void tune_parameters(char *training_file, char *parameter_file,
     printf("Found %d parameter(s) to tune\n", tuningset->nactive);
 
     /* Read training set */
-    trainingset = read_trainingset(state, training_file);
+    trainingset = load_trainingset(state, training_file);
     if (trainingset == NULL) {
         printf("Error: failed to read training set\n");
         return;
@@ -947,12 +1665,7 @@ static void tune_parameters(char *training_file, char *parameter_file,
     printf("Found %d training positions\n", trainingset->size);
 
     /* Setup worker threads */
-    nworkerthreads = nthreads;
-    workers = malloc(sizeof(struct tuning_worker)*nthreads);
-    init_workers(trainingset, tuningset);
-
-    /* Make sure all training positions are covered */
-    workers[nthreads-1].last_pos = trainingset->size - 1;
+    start_workers(nthreads, trainingset, tuningset);
 
     /* Optimize the tuning set */
     switch (optalgo) {
@@ -960,7 +1673,7 @@ static void tune_parameters(char *training_file, char *parameter_file,
         local_search(tuningset, trainingset);
         break;
     case OPT_ADAM:
-        adam(tuningset, trainingset, niterations, STEP_SIZE);
+        adam(tuningset, trainingset, niterations, STEP_SIZE, batchsize);
         break;
     default:
         assert(false);
@@ -987,7 +1700,7 @@ static void tune_parameters(char *training_file, char *parameter_file,
     printf("\nTime: %02d:%02d:%02d\n", hh, mm, ss);
 
     /* Clean up */
-    free(workers);
+    stop_workers();
     free_tuningset(tuningset);
     free_trainingset(trainingset);
     destroy_game_state(state);
@@ -1013,13 +1726,15 @@ static void print_parameters(char *output_file, bool zero)
 
 static void verify_trace(char *training_file)
 {
-    struct trainingset *trainingset;
-    struct tuningset   *tuningset;
-    struct gamestate   *state;
-    int                k;
-    int                score;
-    int                score2;
-    struct eval_trace  *trace;
+    struct trainingset  *trainingset;
+    struct tuningset    *tuningset;
+    struct gamestate    *state;
+    int                 k;
+    int                 score;
+    int                 score2;
+    struct eval_trace   *trace;
+    struct equation_set equations;
+    double              values[NUM_TUNING_PARAMS];
 
     assert(training_file != NULL);
 
@@ -1034,13 +1749,23 @@ static void verify_trace(char *training_file)
     tuning_param_assign_current(tuningset->params);
 
     /* Read training set */
-    trainingset = read_trainingset(state, training_file);
+    trainingset = load_trainingset(state, training_file);
     if (trainingset == NULL) {
         printf("Error: failed to read training set\n");
         return;
     }
+    if (trainingset->positions == NULL) {
+        printf("Error: verification requires a training set in EPD format\n");
+        free_trainingset(trainingset);
+        free_tuningset(tuningset);
+        destroy_game_state(state);
+        return;
+    }
 
     /* Iterate over all positions */
+    load_values(tuningset, values);
+    init_equation_set(&equations, trainingset->size);
+    trace = trace_create();
     for (k=0;k<trainingset->size;k++) {
         /* Setup position */
         board_reset(&state->pos);
@@ -1050,16 +1775,12 @@ static void verify_trace(char *training_file)
         score = eval_evaluate(&state->pos);
 
         /* Generate a trace for this function */
-        trace = malloc(sizeof(struct eval_trace));
         eval_generate_trace(&state->pos, trace);
 
         /* Setup an equation and evaluate it */
-        setup_eval_equation(trace, &trainingset->positions[k].equation);
-        score2 = evaluate_equation(&trainingset->positions[k].equation,
-                                   tuningset);
+        add_eval_equation(&equations, trace, trainingset->positions[k].result);
+        score2 = evaluate_equation(&equations, k, values);
         score2 = (state->pos.stm == WHITE)?score2:-score2;
-        free(trace);
-        trace = NULL;
 
         /*
          * Check that the scores match. Since the standard evaluation
@@ -1070,12 +1791,14 @@ static void verify_trace(char *training_file)
         if (abs(score-score2) > 1) {
             printf("Wrong score (%d): %d (%d)\n", k, score2, score);
             printf("%s", trainingset->positions[k].epd);
-            print_equation(&trainingset->positions[k].equation);
+            print_equation(&equations, k);
             printf("\n");
         }
     }
 
     /* Clean up */
+    free(trace);
+    free_equation_set(&equations);
     free_trainingset(trainingset);
     free_tuningset(tuningset);
     destroy_game_state(state);
@@ -1094,7 +1817,7 @@ static void print_error(char *training_file, int nthreads)
     state = create_game_state();
 
     /* Read training set */
-    trainingset = read_trainingset(state, training_file);
+    trainingset = load_trainingset(state, training_file);
     if (trainingset == NULL) {
         printf("Error: failed to read training set\n");
         return;
@@ -1107,12 +1830,7 @@ static void print_error(char *training_file, int nthreads)
     tuningset->nactive = NUM_TUNING_PARAMS;
 
     /* Setup worker threads */
-    nworkerthreads = nthreads;
-    workers = malloc(sizeof(struct tuning_worker)*nthreads);
-    init_workers(trainingset, tuningset);
-
-    /* Make sure all training positions are covered */
-    workers[nthreads-1].last_pos = trainingset->size - 1;
+    start_workers(nthreads, trainingset, tuningset);
 
     /* Calculate error */
     trace_positions();
@@ -1121,12 +1839,51 @@ static void print_error(char *training_file, int nthreads)
     printf("Error: %f\n", error);
 
     /* Clean up */
-    free(workers);
+    stop_workers();
     free_tuningset(tuningset);
     free_trainingset(trainingset);
     destroy_game_state(state);
 }
 
+static void convert_trainingset(char *training_file, char *output_file,
+                                int nthreads)
+{
+    struct trainingset  *trainingset;
+    struct gamestate    *state;
+
+    assert(training_file != NULL);
+    assert(output_file != NULL);
+
+    printf("Converting %s to %s\n", training_file, output_file);
+
+    /* Create game state */
+    state = create_game_state();
+
+    /* Read training set */
+    trainingset = read_trainingset(state, training_file);
+    if (trainingset == NULL) {
+        printf("Error: failed to read training set\n");
+        destroy_game_state(state);
+        return;
+    }
+
+    printf("Found %d training positions\n", trainingset->size);
+
+    /* Trace all positions using the worker threads */
+    start_workers(nthreads, trainingset, NULL);
+    trace_positions();
+
+    /* Write the equations to the output file */
+    if (!write_trainingset(trainingset, output_file)) {
+        printf("Error: failed to write %s\n", output_file);
+    }
+
+    /* Clean up */
+    stop_workers();
+    free_trainingset(trainingset);
+    destroy_game_state(state);
+}
+
 static void print_usage(void)
 {
     printf("Usage: tuner [options]\n");
@@ -1135,9 +1892,13 @@ static void print_usage(void)
     printf("\t-v <training file>\n\tVerify evaluation tracing\n\n");
     printf("\t-t <training file> <parameter file>\n\tTune parameters\n\n");
     printf("\t-e <training file>\n\tCalculate error\n\n");
+    printf("\t-c <training file> <output file>\n");
+    printf("\tConvert a training set to the binary format\n\n");
     printf("\t-p <output file>\n\tPrint all tunable parameters\n\n");
     printf("\t-n <nthreads>\n\tThe number of threads to use\n\n");
     printf("\t-i <niterations>\n\tThe number of iterations to run\n\n");
+    printf("\t-b <batchsize>\n");
+    printf("\tUse minibatches with Adam, -i is then the number of epochs\n\n");
     printf("\t-o [local|adam]\n\tOptimization algorithm to use for tuning\n\n");
     printf("\t-z\n\tPrint tuning parameters with all values set to zero\n\n");
     printf("\t-h\n\tDisplay this message\n\n");
@@ -1155,6 +1916,7 @@ int main(int argc, char *argv[])
     int                         command;
     bool                        zero_params;
     int                         niterations;
+    int                         batchsize;
 
     /* Turn off buffering for I/O */
     setbuf(stdout, NULL);
@@ -1165,7 +1927,7 @@ int main(int argc, char *argv[])
 
     /* Initialize components */
     chess_data_init();
-    bb_init();
+    eval_init_psq();
 
     /* Initialize options */
     training_file = NULL;
@@ -1175,6 +1937,7 @@ int main(int argc, char *argv[])
     optalgo = OPT_ADAM;
     zero_params = false;
     niterations = DEFAULT_ITERATIONS;
+    batchsize = 0;
 
     /* Parse command line arguments */
     iter = 1;
@@ -1234,6 +1997,19 @@ int main(int argc, char *argv[])
                 print_usage();
                 exit(1);
             }
+        } else if (!strcmp(argv[iter], "-b")) {
+            iter++;
+            if (iter == argc) {
+                printf("Invalid argument\n");
+                print_usage();
+                exit(1);
+            }
+            nconv = sscanf(argv[iter], "%u", &batchsize);
+            if (nconv != 1) {
+                printf("Invalid argument\n");
+                print_usage();
+                exit(1);
+            }
         } else if (!strcmp(argv[iter], "-p")) {
             command = 2;
             iter++;
@@ -1252,6 +2028,22 @@ int main(int argc, char *argv[])
                 exit(1);
             }
             training_file = argv[iter];
+        } else if (!strcmp(argv[iter], "-c")) {
+            command = 5;
+            iter++;
+            if (iter == argc) {
+                printf("Invalid argument\n");
+                print_usage();
+                exit(1);
+            }
+            training_file = argv[iter];
+            iter++;
+            if (iter == argc) {
+                printf("Invalid argument\n");
+                print_usage();
+                exit(1);
+            }
+            output_file = argv[iter];
         } else if (!strcmp(argv[iter], "-z")) {
             zero_params = true;
         } else if (!strcmp(argv[iter], "-o")) {
@@ -1294,7 +2086,7 @@ int main(int argc, char *argv[])
         break;
     case 1:
         tune_parameters(training_file, parameter_file, nthreads, optalgo,
-                        niterations);
+                        niterations, batchsize);
         break;
     case 2:
         print_parameters(output_file, zero_params);
@@ -1305,6 +2097,9 @@ int main(int argc, char *argv[])
     case 4:
         print_error(training_file, nthreads);
         break;
+    case 5:
+        convert_trainingset(training_file, output_file, nthreads);
+        break;
     default:
         print_usage();
         exit(1);
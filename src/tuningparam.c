@@ -22,6 +22,7 @@
 
 #include "tuningparam.h"
 #include "evalparams.h"
+#include "eval.h"
 #include "chess.h"
 
 /* Define a tuning parameter and the connection evaluation parameter */
@@ -234,6 +235,9 @@ void tuning_param_assign_current(struct tuning_param *params)
     ASSIGN_MULTIPLE(THREAT_BY_ROOK_EG)
     ASSIGN_MULTIPLE(THREAT_BY_QUEEN_MG)
     ASSIGN_MULTIPLE(THREAT_BY_QUEEN_EG)
+
+    /* Update tables derived from the parameters */
+    eval_init_psq();
 }
 
 struct tuning_param* tuning_param_create_list(void)
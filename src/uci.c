@@ -62,6 +62,7 @@ static void uci_cmd_go(char *cmd, struct gamestate *state)
     bool     infinite_time = false;
     bool     fixed_time = false;
     int      depth = 0;
+    uint64_t nodes = 0ULL;
     bool     in_movelist = false;
     char     *temp;
     bool     ponder = false;
@@ -75,6 +76,7 @@ static void uci_cmd_go(char *cmd, struct gamestate *state)
     state->move_filter.size = 0;
     state->exit_on_mate = true;
     state->sd = MAX_SEARCH_DEPTH;
+    state->max_nodes = 0ULL;
 
     /*
      * Extract parameters. If an invalid parameter is
@@ -153,6 +155,15 @@ static void uci_cmd_go(char *cmd, struct gamestate *state)
             iter = strchr(iter, ' ');
             in_movelist = false;
             flags |= TC_DEPTH_LIMIT;
+        } else if (!strncmp(iter, "nodes", 5)) {
+            if (sscanf(iter, "nodes %"SCNu64, &nodes) != 1) {
+                return;
+            }
+            state->max_nodes = nodes;
+            iter = strchr(iter, ' ');
+            iter = skip_whitespace(iter);
+            iter = strchr(iter, ' ');
+            in_movelist = false;
         } else if (!strncmp(iter, "infinite", 8)) {
             infinite_time = true;
             iter = strchr(iter, ' ');
@@ -202,6 +213,9 @@ static void uci_cmd_go(char *cmd, struct gamestate *state)
     tc_configure_time_control(movetime, moveinc, movestogo, flags);
 
     /* Search the position for a move */
+    engine_wait_for_loading(state, LOAD_TABLEBASES|LOAD_NETWORK|
+                            ((own_book_mode && !skip_book)?LOAD_BOOK:0));
+    tablebase_mode = TB_LARGEST > 0;
     smp_search(state, ponder && ponder_mode, own_book_mode && !skip_book,
                tablebase_mode);
 
@@ -317,8 +331,61 @@ static void uci_cmd_setoption(char *cmd, struct gamestate *state)
                 } else if (value < MIN_MAIN_HASH_SIZE) {
                     value = MIN_MAIN_HASH_SIZE;
                 }
-                hash_tt_create_table(value);
+                hash_tt_resize_table(value);
+            }
+        } else if (!strncmp(iter, "PawnHash", 8)) {
+            iter += 8;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                value = CLAMP(value, MIN_PAWN_HASH_SIZE, MAX_PAWN_HASH_SIZE);
+                if (value != smp_pawn_hash_size()) {
+                    smp_set_pawn_hash_size(value);
+                    value = smp_number_of_workers();
+                    smp_destroy_workers();
+                    smp_create_workers(value);
+                }
+            }
+        } else if (!strncmp(iter, "MemoryLimit", 11)) {
+            iter += 11;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                value = CLAMP(value, 0, MAX_MEMORY_LIMIT);
+                if (value != engine_memory_limit) {
+                    engine_memory_limit = value;
+
+                    /*
+                     * Recreate the workers so that their tables, and
+                     * then the transposition table, are sized to fit.
+                     */
+                    engine_wait_for_loading(state, LOAD_NETWORK|LOAD_BOOK);
+                    value = smp_number_of_workers();
+                    smp_destroy_workers();
+                    smp_create_workers(value);
+
+                    value = engine_check_memory_limit(state);
+                    if (value > 0) {
+                        engine_write_info("info string Memory limit of %d MB "
+                                          "cannot be met, using %d MB",
+                                          engine_memory_limit, value);
+                        engine_flush_output();
+                    }
+                }
+            }
+        } else if (!strncmp(iter, "LargePages", 10)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5) && hash_tt_large_pages()) {
+                hash_tt_set_large_pages(false);
+            } else if (!strncmp(iter, "true", 4) && !hash_tt_large_pages()) {
+                hash_tt_set_large_pages(true);
+            } else {
+                iter = strstr(iter, "name");
+                continue;
             }
+            hash_tt_create_table(hash_tt_size());
+            engine_write_command("info string Transposition table using %s",
+                                 hash_tt_page_type());
         } else if (!strncmp(iter, "OwnBook", 7)) {
             iter = strstr(iter, "value");
             iter += strlen("value");
@@ -337,14 +404,17 @@ static void uci_cmd_setoption(char *cmd, struct gamestate *state)
             } else if (!strncmp(iter, "true", 4)) {
                 ponder_mode = true;
             }
-        } else if (!strncmp(iter, "SyzygyPath", 10) && !tablebase_mode) {
+        } else if (!strncmp(iter, "SyzygyPath", 10)) {
             iter = strstr(iter, "value");
             iter += strlen("value");
             iter = skip_whitespace(iter);
 
-            strncpy(engine_syzygy_path, iter, MAX_PATH_LENGTH);
-            tb_init(engine_syzygy_path);
-            tablebase_mode = TB_LARGEST > 0;
+            /* Tablebases that are already loaded are kept */
+            engine_wait_for_loading(state, LOAD_TABLEBASES);
+            if (TB_LARGEST == 0) {
+                strncpy(engine_syzygy_path, iter, MAX_PATH_LENGTH);
+                engine_load_tablebases(engine_syzygy_path, 0);
+            }
         } else if (!strncmp(iter, "Threads", 7)) {
             iter += 7;
             iter = skip_whitespace(iter);
@@ -357,6 +427,69 @@ static void uci_cmd_setoption(char *cmd, struct gamestate *state)
                 smp_destroy_workers();
                 smp_create_workers(value);
             }
+        } else if (!strncmp(iter, "NUMA", 4)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5) && smp_numa_mode()) {
+                smp_set_numa_mode(false);
+            } else if (!strncmp(iter, "true", 4) && !smp_numa_mode()) {
+                smp_set_numa_mode(true);
+            } else {
+                iter = strstr(iter, "name");
+                continue;
+            }
+
+            /*
+             * Recreate the workers and the transposition table so
+             * that memory is placed according to the new mode.
+             */
+            value = smp_number_of_workers();
+            smp_destroy_workers();
+            smp_create_workers(value);
+            hash_tt_create_table(hash_tt_size());
+        } else if (!strncmp(iter, "ThreadAffinity", 14)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5) && smp_pinning()) {
+                smp_set_pinning(false);
+            } else if (!strncmp(iter, "true", 4) && !smp_pinning()) {
+                smp_set_pinning(true);
+            } else {
+                iter = strstr(iter, "name");
+                continue;
+            }
+
+            /* Recreate the workers so that the threads are rebound */
+            value = smp_number_of_workers();
+            smp_destroy_workers();
+            smp_create_workers(value);
+        } else if (!strncmp(iter, "ABDADA", 6)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5)) {
+                smp_set_abdada_mode(false);
+            } else if (!strncmp(iter, "true", 4)) {
+                smp_set_abdada_mode(true);
+            }
+        } else if (!strncmp(iter, "UCI_AnalyseMode", 15)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5)) {
+                hash_tt_set_policy(TT_POLICY_GAME);
+            } else if (!strncmp(iter, "true", 4)) {
+                hash_tt_set_policy(TT_POLICY_ANALYSIS);
+            }
+        } else if (!strncmp(iter, "WidePonder", 10)) {
+            iter += 10;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                smp_set_wide_ponder_moves(CLAMP(value, 0,
+                                                MAX_WIDE_PONDER_MOVES));
+            }
         } else if (!strncmp(iter, "LogLevel", 8)) {
             iter += 8;
             iter = skip_whitespace(iter);
@@ -379,19 +512,39 @@ static void uci_cmd_setoption(char *cmd, struct gamestate *state)
                 }
                 state->multipv = value;
             }
+        } else if (!strncmp(iter, "NodesTime", 9)) {
+            iter += 9;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                tc_set_nodestime(CLAMP(value, 0, MAX_NODES_TIME));
+            }
+        } else if (!strncmp(iter, "MoveOverhead", 12)) {
+            iter += 12;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                tc_set_move_overhead(value);
+            }
+        } else if (!strncmp(iter, "InfoInterval", 12)) {
+            iter += 12;
+            iter = skip_whitespace(iter);
+            if (sscanf(iter, "value %d", &value) == 1) {
+                engine_info_interval = CLAMP(value, 0, MAX_INFO_INTERVAL);
+            }
+        } else if (!strncmp(iter, "AdaptiveOverhead", 16)) {
+            iter = strstr(iter, "value");
+            iter += strlen("value");
+            iter = skip_whitespace(iter);
+            if (!strncmp(iter, "false", 5)) {
+                tc_set_adaptive_overhead(false);
+            } else if (!strncmp(iter, "true", 4)) {
+                tc_set_adaptive_overhead(true);
+            }
         } else if (!strncmp(iter, "EvalFile", 8)) {
             iter = strstr(iter, "value");
             iter += strlen("value");
             iter = skip_whitespace(iter);
             strncpy(engine_eval_file, iter, MAX_PATH_LENGTH);
-            engine_using_nnue = nnue_init(engine_eval_file);
-            if (engine_using_nnue) {
-                if (state->pos.nnue_pos == NULL) {
-                    state->pos.nnue_pos = nnue_create_pos();
-                }
-                nnue_setup_pos(state->pos.nnue_pos, state->pos.start_pieces,
-                               state->pos.start_side);
-            }
+            engine_load_network(engine_eval_file);
         }
         iter = strstr(iter, "name");
     }
@@ -401,8 +554,6 @@ static void uci_cmd_uci(struct gamestate *state)
 {
     engine_protocol = PROTOCOL_UCI;
 
-    tablebase_mode = TB_LARGEST > 0;
-
     state->silent = false;
 
     engine_write_command("id name %s %s", APP_NAME, APP_VERSION);
@@ -410,14 +561,35 @@ static void uci_cmd_uci(struct gamestate *state)
     engine_write_command("option name Hash type spin default %d min %d max %d",
                          engine_default_hash_size, MIN_MAIN_HASH_SIZE,
 						 hash_tt_max_size());
+    engine_write_command(
+                    "option name PawnHash type spin default %d min %d max %d",
+                    smp_pawn_hash_size(), MIN_PAWN_HASH_SIZE,
+                    MAX_PAWN_HASH_SIZE);
+    engine_write_command(
+                    "option name MemoryLimit type spin default %d min 0 max %d",
+                    engine_memory_limit, MAX_MEMORY_LIMIT);
+    engine_write_command("option name LargePages type check default %s",
+                         hash_tt_large_pages()?"true":"false");
     engine_write_command("option name OwnBook type check default true");
     engine_write_command("option name Ponder type check default false");
+    engine_write_command("option name UCI_AnalyseMode type check default %s",
+                         (hash_tt_policy() == TT_POLICY_ANALYSIS)?
+                                                            "true":"false");
     engine_write_command("option name SyzygyPath type string default %s",
                          engine_syzygy_path[0] != '\0'?
                                                 engine_syzygy_path:"<empty>");
     engine_write_command(
                         "option name Threads type spin default %d min 1 max %d",
                         engine_default_num_threads, MAX_WORKERS);
+    engine_write_command("option name NUMA type check default %s",
+                         smp_numa_mode()?"true":"false");
+    engine_write_command("option name ThreadAffinity type check default %s",
+                         smp_pinning()?"true":"false");
+    engine_write_command("option name ABDADA type check default %s",
+                         smp_abdada_mode()?"true":"false");
+    engine_write_command(
+                "option name WidePonder type spin default %d min 0 max %d",
+                smp_wide_ponder_moves(), MAX_WIDE_PONDER_MOVES);
     engine_write_command(
                         "option name MultiPV type spin default 1 min 1 max %d",
                         MAX_MULTIPV_LINES);
@@ -427,13 +599,25 @@ static void uci_cmd_uci(struct gamestate *state)
     engine_write_command("option name EvalFile type string default %s",
                          engine_eval_file[0] != '\0'?
                                                 engine_eval_file:"<empty>");
+    engine_write_command(
+                "option name NodesTime type spin default %d min 0 max %d",
+                tc_get_nodestime(), MAX_NODES_TIME);
+    engine_write_command(
+                "option name MoveOverhead type spin default %d min 0 max %d",
+                tc_get_move_overhead(), MAX_MOVE_OVERHEAD);
+    engine_write_command("option name AdaptiveOverhead type check default %s",
+                         tc_adaptive_overhead()?"true":"false");
+    engine_write_command(
+                "option name InfoInterval type spin default %d min 0 max %d",
+                engine_info_interval, MAX_INFO_INTERVAL);
     engine_write_command("uciok");
 }
 
 static void uci_cmd_ucinewgame(void)
 {
-    hash_tt_clear_table();
+    hash_tt_clear_table_async();
     smp_newgame();
+    tc_new_game();
 }
 
 bool uci_handle_command(struct gamestate *state, char *cmd, bool *stop)
@@ -499,6 +683,10 @@ bool uci_check_input(struct search_worker *worker)
     } else if (!strncmp(cmd, "stop", 4)) {
         worker->state->pondering = false;
         stop = true;
+    } else if (!strncmp(cmd, "quit", 4)) {
+        engine_set_pending_command(cmd);
+        worker->state->pondering = false;
+        stop = true;
     }
 
     return stop;
@@ -537,8 +725,17 @@ void uci_send_pv_info(struct search_worker *worker, int score)
         strcat(buffer, movestr);
     }
 
+    /*
+     * Report how the workers voted for the move. The string
+     * field must come last since it extends to the end of the line.
+     */
+    if (worker->state->vote_share >= 0) {
+        sprintf(buffer+strlen(buffer), " string %d percent of votes",
+                worker->state->vote_share);
+    }
+
     /* Write command */
-    engine_write_command(buffer);
+    engine_write_info(buffer);
 }
 
 void uci_send_bound_info(struct search_worker *worker, int score, bool lower)
@@ -569,7 +766,7 @@ void uci_send_bound_info(struct search_worker *worker, int score, bool lower)
             score, lower?"lowerbound":"upperbound");
 
     /* Write command */
-    engine_write_command(buffer);
+    engine_write_info(buffer);
 }
 
 void uci_send_move_info(struct search_worker *worker)
@@ -586,8 +783,8 @@ void uci_send_move_info(struct search_worker *worker)
 
     /* Send command */
     move2str(worker->currmove, movestr);
-    engine_write_command("info depth %d currmove %s currmovenumber %d",
-                         worker->depth, movestr, worker->currmovenumber);
+    engine_write_info("info depth %d currmove %s currmovenumber %d",
+                      worker->depth, movestr, worker->currmovenumber);
 }
 
 void uci_send_multipv_info(struct search_worker *worker)
@@ -630,8 +827,14 @@ void uci_send_multipv_info(struct search_worker *worker)
         }
     }
 
-    /* Write one info command for each pv line */
+    /*
+     * Write one info command for each pv line. Lines that have not
+     * been found yet are skipped.
+     */
     for (k=0;k<worker->multipv;k++) {
+        if (sorted_mpv_lines[k].pv.size == 0) {
+            continue;
+        }
         sprintf(buffer, "info multipv %d depth %d seldepth %d nodes %"PRIu64" "
                 "time %d nps %d tbhits %"PRIu64" hashfull %d score cp %d pv",
                 k+1, sorted_mpv_lines[k].depth, sorted_mpv_lines[k].seldepth,
@@ -642,16 +845,16 @@ void uci_send_multipv_info(struct search_worker *worker)
             strcat(buffer, movestr);
         }
 
-        engine_write_command(buffer);
+        engine_write_info(buffer);
     }
 }
 
 void uci_send_eval_info(void)
 {
     if (!engine_using_nnue) {
-        engine_write_command("info string Using classic evaluation");
+        engine_write_info("info string Using classic evaluation");
     } else {
-        engine_write_command("info string Using NNUE evaluation with %s",
-                             engine_eval_file);
+        engine_write_info("info string Using NNUE evaluation with %s (%s)",
+                          engine_eval_file, nnue_kernel_name());
     }
 }
@@ -26,6 +26,7 @@
 #else
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 #endif
@@ -33,22 +34,61 @@
 #include "utils.h"
 #include "thread.h"
 
+#define SIZE_2MB (2ULL*1024ULL*1024ULL)
+#define SIZE_1GB (1024ULL*1024ULL*1024ULL)
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static void* map_huge_pages(uint64_t size, uint64_t page_size, int flags)
+{
+    void *ptr;
+
+    if ((size < page_size) || ((size%page_size) != 0)) {
+        return NULL;
+    }
+    ptr = mmap(NULL, size, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|flags, -1, 0);
+    return (ptr == MAP_FAILED)?NULL:ptr;
+}
+#endif
+
 struct memset_task {
     thread_t thread;
     void *start;
     size_t size;
     uint8_t value;
+    int node;
 };
 
 static thread_retval_t memset_func(void *data)
 {
     struct memset_task *task = data;
 
+    /*
+     * Memory pages are placed on the node of the thread that first
+     * touches them so bind the thread before writing anything.
+     */
+    if (task->node >= 0) {
+        thread_bind_to_node(task->node);
+    }
     memset(task->start, task->value, task->size);
     return (thread_retval_t)0;
 }
 
-#if USE_POPCNT && __GNUC__
+#if USE_POPCNT && __GNUC__ && !CPU_DISPATCH
+/*
+ * The builtin is compiled to the popcnt instruction on x86-64 and to
+ * the cnt instruction on ARMv8.
+ */
 int pop_count (uint64_t v)
 {
     return __builtin_popcountll(v);
@@ -62,7 +102,7 @@ const uint64_t k1 = 0x5555555555555555ULL;
 const uint64_t k2 = 0x3333333333333333ULL;
 const uint64_t k4 = 0x0f0f0f0f0f0f0f0fULL;
 const uint64_t kf = 0x0101010101010101ULL;
-int pop_count (uint64_t v)
+static int pop_count_sw(uint64_t v)
 {
     v =  v - ((v >> 1) & k1);
     v = (v & k2) + ((v >> 2) & k2);
@@ -70,6 +110,39 @@ int pop_count (uint64_t v)
     v = (v * kf) >> 56;
     return (int) v;
 }
+
+#if CPU_DISPATCH && __GNUC__
+/*
+ * When building with runtime CPU dispatch the popcnt instruction is
+ * only used if the CPU supports it. The first call selects the
+ * implementation to use for all subsequent calls.
+ */
+__attribute__((target("popcnt"))) static int pop_count_hw(uint64_t v)
+{
+    return __builtin_popcountll(v);
+}
+
+static int pop_count_select(uint64_t v);
+static int (*pop_count_impl)(uint64_t v) = pop_count_select;
+
+static int pop_count_select(uint64_t v)
+{
+    __builtin_cpu_init();
+    pop_count_impl = __builtin_cpu_supports("popcnt")?
+                                                pop_count_hw:pop_count_sw;
+    return pop_count_impl(v);
+}
+
+int pop_count (uint64_t v)
+{
+    return pop_count_impl(v);
+}
+#else
+int pop_count (uint64_t v)
+{
+    return pop_count_sw(v);
+}
+#endif
 #endif
 
 #ifdef __GNUC__
@@ -181,40 +254,6 @@ int get_current_pid(void)
 #endif
 }
 
-bool poll_input(void)
-{
-#ifdef WINDOWS
-    HANDLE handle;
-    DWORD  temp;
-
-    handle = GetStdHandle(STD_INPUT_HANDLE);
-    if (handle == INVALID_HANDLE_VALUE)
-        return FALSE;
-    if (GetConsoleMode(handle, &temp)) {
-        SetConsoleMode(handle, ENABLE_ECHO_INPUT|ENABLE_LINE_INPUT|
-                       ENABLE_PROCESSED_INPUT);
-        FlushConsoleInputBuffer(handle);
-        if (!GetNumberOfConsoleInputEvents(handle, &temp))
-            return FALSE;
-        return (bool)(temp > 1);
-    } else {
-        if (!PeekNamedPipe(handle, NULL, 0, NULL, &temp, NULL)) {
-            return FALSE;
-        }
-        return (bool)(temp != 0);
-    }
-#else
-    fd_set         set;
-    struct timeval tv;
-
-    FD_ZERO(&set);
-    FD_SET(STDIN_FILENO, &set);
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-    return (select(STDIN_FILENO+1, &set, NULL, NULL, &tv) > 0);
-#endif
-}
-
 void sleep_ms(int ms)
 {
 #ifdef WINDOWS
@@ -327,7 +366,87 @@ void aligned_free(void *ptr)
 #endif
 }
 
-void parallel_memset(void *memory, uint8_t value, size_t size, int nthreads)
+void* large_pages_malloc(uint64_t size, int *type)
+{
+    void *ptr;
+
+    assert(type != NULL);
+
+#if defined(WINDOWS)
+    SIZE_T min_size;
+
+    /*
+     * Large pages requires the SeLockMemoryPrivilege privilege. If the
+     * user doesn't have it the allocation fails and normal pages are
+     * used instead.
+     */
+    min_size = GetLargePageMinimum();
+    if ((min_size > 0) && (size >= min_size) && ((size%min_size) == 0)) {
+        ptr = VirtualAlloc(NULL, size, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES,
+                           PAGE_READWRITE);
+        if (ptr != NULL) {
+            *type = LARGE_PAGES_2MB;
+            return ptr;
+        }
+    }
+#elif defined(__linux__)
+#if defined(MAP_HUGETLB)
+    /* Try explicit huge pages from hugetlbfs first */
+    ptr = map_huge_pages(size, SIZE_1GB, MAP_HUGE_1GB);
+    if (ptr != NULL) {
+        *type = LARGE_PAGES_1GB;
+        return ptr;
+    }
+    ptr = map_huge_pages(size, SIZE_2MB, MAP_HUGE_2MB);
+    if (ptr != NULL) {
+        *type = LARGE_PAGES_2MB;
+        return ptr;
+    }
+#endif
+#if defined(MADV_HUGEPAGE)
+    /* Fall back to asking for transparent huge pages */
+    if (size >= SIZE_2MB) {
+        ptr = aligned_malloc(SIZE_2MB, size);
+        if (ptr == NULL) {
+            return NULL;
+        }
+        *type = (madvise(ptr, size, MADV_HUGEPAGE) == 0)?
+                                    LARGE_PAGES_TRANSPARENT:LARGE_PAGES_NONE;
+        return ptr;
+    }
+#endif
+#endif
+
+    *type = LARGE_PAGES_NONE;
+    return aligned_malloc(CACHE_LINE_SIZE, size);
+}
+
+void large_pages_free(void *ptr, uint64_t size, int type)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    switch (type) {
+    case LARGE_PAGES_1GB:
+    case LARGE_PAGES_2MB:
+#if defined(WINDOWS)
+        (void)size;
+        VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+        munmap(ptr, size);
+#endif
+        break;
+    case LARGE_PAGES_TRANSPARENT:
+    case LARGE_PAGES_NONE:
+    default:
+        aligned_free(ptr);
+        break;
+    }
+}
+
+void parallel_memset(void *memory, uint8_t value, size_t size, int nthreads,
+                     int nnodes)
 {
     int k;
     size_t size_per_thread;
@@ -342,6 +461,7 @@ void parallel_memset(void *memory, uint8_t value, size_t size, int nthreads)
         task_list[k].start = memory + size_per_thread*k;
         task_list[k].size = size_per_thread;
         task_list[k].value = value;
+        task_list[k].node = (nnodes > 0)?k%nnodes:-1;
         thread_create(&task_list[k].thread, memset_func, &task_list[k]);
     }
 
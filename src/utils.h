@@ -22,14 +22,13 @@
 #include <stdbool.h>
 #include <time.h>
 
+#include "config.h"
+
 /* Utility macros */
 #define MIN(a, b)       ((a) < (b))?(a):(b)
 #define MAX(a, b)       ((a) > (b))?(a):(b)
 #define CLAMP(x, a, b)  MAX((a), MIN((x), (b)))
 
-/* The cache line size */
-#define CACHE_LINE_SIZE 64
-
 /* Macro for prefetching the data at an address in to the cache */
 #ifdef __GNUC__
 #define PREFETCH_ADDRESS(a) __builtin_prefetch((a))
@@ -85,13 +84,6 @@ time_t get_current_time(void);
  */
 int get_current_pid(void);
 
-/*
- * Function to check for input in a portable way.
- *
- * @return Returns true if there is a command waiting.
- */
-bool poll_input(void);
-
 /*
  * Sleep for a specified number of milliseconds.
  *
@@ -147,6 +139,34 @@ void* aligned_malloc(int alignment, uint64_t size);
  */
 void aligned_free(void *ptr);
 
+/* Types of pages used to back a large allocation */
+enum {
+    LARGE_PAGES_NONE,
+    LARGE_PAGES_TRANSPARENT,
+    LARGE_PAGES_2MB,
+    LARGE_PAGES_1GB
+};
+
+/*
+ * Allocate memory backed by large pages if possible. Explicit huge
+ * pages are tried first, then transparent huge pages and finally
+ * normal cache line aligned memory.
+ *
+ * @param size The amount of memory to allocate.
+ * @param type Location to store the type of pages obtained.
+ * @return Returns a pointer to the allocated memory.
+ */
+void* large_pages_malloc(uint64_t size, int *type);
+
+/*
+ * Free memory allocated with large_pages_malloc.
+ *
+ * @param ptr Pointer to the memory to free.
+ * @param size The size that was allocated.
+ * @param type The type of pages returned by large_pages_malloc.
+ */
+void large_pages_free(void *ptr, uint64_t size, int type);
+
 /*
  * Parallel version of memset.
  *
@@ -154,8 +174,11 @@ void aligned_free(void *ptr);
  * @param value The value to write
  * @param size The number of bytes to write.
  * @param nthreads The number of threads to use.
+ * @param nnodes The number of NUMA nodes to spread the threads over, or 0
+ *               if the threads should not be bound to any node.
  */
-void parallel_memset(void *memory, uint8_t value, size_t size, int nthreads);
+void parallel_memset(void *memory, uint8_t value, size_t size, int nthreads,
+                     int nnodes);
 
 /*
  * Check this is a 64-bit build.
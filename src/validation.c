@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <stdlib.h>
+#include <string.h>
 
 #include "validation.h"
 #include "bitboard.h"
@@ -177,6 +178,14 @@ bool valid_move(uint32_t move)
     return true;
 }
 
+bool validate_psq(struct position *pos)
+{
+    int psq[NPHASES][NSIDES];
+
+    eval_generate_psq(pos, psq);
+    return memcmp(psq, pos->psq, sizeof(psq)) == 0;
+}
+
 bool validate_nnue(struct position *pos)
 {
     void *nnue_pos;
@@ -193,7 +202,7 @@ bool validate_nnue(struct position *pos)
     nnue_pos = nnue_create_pos();
     nnue_setup_pos(nnue_pos, pos->start_pieces, pos->start_side);
 
-    for (k=0;k<pos->ply;k++) {
+    for (k=pos->start_ply;k<pos->ply;k++) {
         if (!ISNULLMOVE(pos->history[k].move)) {
             nnue_make_move(nnue_pos,
                             FROM(pos->history[k].move),
@@ -62,6 +62,15 @@ bool valid_piece(int piece);
  */
 bool valid_move(uint32_t move);
 
+/*
+ * Validate the incrementally updated material and
+ * piece/square table scores of a position.
+ *
+ * @param pos The board structure.
+ * @return Returns true if the scores are correct.
+ */
+bool validate_psq(struct position *pos);
+
 /*
  * Validate NNUE position and evaluation.
  *
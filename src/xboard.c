@@ -183,6 +183,12 @@ static enum game_result is_game_over(struct position *pos)
     return RESULT_UNDETERMINED;
 }
 
+static void wait_for_loading(struct gamestate *state)
+{
+    engine_wait_for_loading(state, LOAD_ALL);
+    tablebase_mode = TB_LARGEST > 0;
+}
+
 static void make_engine_move(struct gamestate *state)
 {
     uint32_t         best_move;
@@ -225,6 +231,7 @@ static void make_engine_move(struct gamestate *state)
                                   moves_to_time_control, flags);
 
         /* Search the position for a move */
+        wait_for_loading(state);
         smp_search(state, ponder_mode && ponder, true, tablebase_mode);
         best_move = state->best_move;
         ponder_move = state->ponder_move;
@@ -279,10 +286,15 @@ static void make_engine_move(struct gamestate *state)
 static void xboard_cmd_analyze(struct gamestate *state)
 {
     char *cmd;
+    int  policy;
 
     analyze_mode = true;
     tc_start_clock();
 
+    /* Keep deep results around for as long as the analysis goes on */
+    policy = hash_tt_policy();
+    hash_tt_set_policy(TT_POLICY_ANALYSIS);
+
     while (true) {
         /* Set default search parameters */
         state->sd = MAX_SEARCH_DEPTH;
@@ -292,6 +304,7 @@ static void xboard_cmd_analyze(struct gamestate *state)
         tc_configure_time_control(0, 0, 0, TC_INFINITE_TIME);
 
         /* Search until told otherwise */
+        wait_for_loading(state);
         smp_search(state, false, false, tablebase_mode);
 
         /* Exit analyze mode if there is no pending command */
@@ -314,6 +327,7 @@ static void xboard_cmd_analyze(struct gamestate *state)
         }
     }
 
+    hash_tt_set_policy(policy);
     tc_stop_clock();
     analyze_mode = false;
 }
@@ -381,7 +395,8 @@ static void xboard_cmd_egtpath(char *cmd)
 {
     char *iter;
 
-    if (tablebase_mode) {
+    /* Tablebases that are already loaded are kept */
+    if (TB_LARGEST > 0) {
         return;
     }
 
@@ -394,8 +409,7 @@ static void xboard_cmd_egtpath(char *cmd)
     iter = skip_whitespace(iter);
 
     strncpy(engine_syzygy_path, iter, MAX_PATH_LENGTH);
-    tb_init(engine_syzygy_path);
-    tablebase_mode = TB_LARGEST > 0;
+    engine_load_tablebases(engine_syzygy_path, 0);
 }
 
 static void xboard_cmd_force(void)
@@ -442,6 +456,7 @@ static void xboard_cmd_hint(struct gamestate *state)
             state->exit_on_mate = true;
             state->sd = 6;
             state->silent = true;
+            wait_for_loading(state);
             smp_search(state, false, true, tablebase_mode);
             move = state->best_move;
             state->silent = false;
@@ -535,7 +550,7 @@ static void xboard_cmd_memory(char *cmd)
         } else if (size < MIN_MAIN_HASH_SIZE) {
             size = MIN_MAIN_HASH_SIZE;
         }
-        hash_tt_create_table(size);
+        hash_tt_resize_table(size);
     } else {
         engine_write_command("Error (malformed command): %s", cmd);
     }
@@ -544,8 +559,9 @@ static void xboard_cmd_memory(char *cmd)
 static void xboard_cmd_new(struct gamestate *state)
 {
     board_start_position(&state->pos);
-    hash_tt_clear_table();
+    hash_tt_clear_table_async();
     smp_newgame();
+    tc_new_game();
 
     search_depth_limit = MAX_SEARCH_DEPTH;
     engine_side = BLACK;
@@ -729,7 +745,6 @@ static void xboard_cmd_xboard(struct gamestate *state)
     engine_protocol = PROTOCOL_XBOARD;
 
     ponder_mode = false;
-    tablebase_mode = TB_LARGEST > 0;
     analyze_mode = false;
     force_mode = false;
     post_mode = false;
@@ -937,11 +952,11 @@ void xboard_send_pv_info(struct search_worker *worker,  int score)
 	msec = tc_elapsed_time();
 	sprintf(buffer, "%3d %6d %7d %9"PRIu64"", worker->mpv_lines[0].depth,
             score, msec/10, smp_nodes());
-    pv = &worker->pv_table[0];
+    pv = &worker->mpv_lines[0].pv;
 	for (k=0;k<pv->size;k++) {
 		strcat(buffer, " ");
         move2str(pv->moves[k], movestr);
 		strcat(buffer, movestr);
 	}
-	engine_write_command(buffer);
+	engine_write_info(buffer);
 }